@@ -0,0 +1,89 @@
+/**
+ * arena.c
+ * Benchmarks loading a big workspace's worth of notes with and without an
+ * arena allocator.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "note.h"
+#include "notelist.h"
+
+/* Default number of notes to create. */
+#define BENCH_NOTES 100000
+
+/**
+ * Creates and destroys a whole workspace's worth of notes.
+ *
+ * @param mode  Name of the mode being benchmarked.
+ * @param arena Should the notes be allocated from an arena?
+ * @param paths Paths of the notes.
+ * @param count Number of notes.
+ */
+static void bench(const char *mode, bool arena, char **paths, size_t count) {
+	notelist_t *list;
+	note_t *note;
+	double start;
+	double end;
+	size_t i;
+
+	bench_allocs = 0;
+	bench_frees = 0;
+	start = bench_now();
+
+	/* Load and free the notes. */
+	list = notelist_new();
+	if (arena)
+		notelist_use_arena(list);
+	for (i = 0; i < count; i++) {
+		note = note_from_fname_arena(paths[i], notelist_arena(list));
+		notelist_push(list, note);
+	}
+	notelist_free(list);
+
+	end = bench_now();
+	printf("{\"bench\":\"arena\",\"mode\":\"%s\",\"notes\":%lu,"
+		   "\"seconds\":%.6f,\"notes_per_sec\":%.0f,\"allocs\":%lu,"
+		   "\"frees\":%lu}\n", mode, (unsigned long)count, end - start,
+		   (double)count / (end - start), bench_allocs, bench_frees);
+}
+
+/**
+ * Program's main entry point.
+ *
+ * @param argc Number of command line arguments provided.
+ * @param argv Command line arguments. (Optional number of notes)
+ *
+ * @return Return code.
+ */
+int main(int argc, char **argv) {
+	char **paths;
+	size_t count;
+	size_t i;
+
+	/* Generate the note paths. */
+	count = (argc > 1) ? (size_t)strtoul(argv[1], NULL, 10) : BENCH_NOTES;
+	paths = (char **)malloc(count * sizeof(char *));
+	for (i = 0; i < count; i++) {
+		paths[i] = (char *)malloc(64 * sizeof(char));
+		sprintf(paths[i], "workspace/%04lu-%02lu-%02lu_Note number %lu.md",
+				1990 + (unsigned long)(i % 40), 1 + (unsigned long)(i % 12),
+				1 + (unsigned long)(i % 28), (unsigned long)i);
+	}
+
+	/* Run the benchmarks. */
+	bench("heap", false, paths, count);
+	bench("arena", true, paths, count);
+
+	/* Clean up. */
+	for (i = 0; i < count; i++)
+		free(paths[i]);
+	free(paths);
+
+	return 0;
+}
@@ -0,0 +1,194 @@
+/**
+ * bench.c
+ * Common utilities shared by the benchmarks.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "bench.h"
+
+#include <string.h>
+#include <time.h>
+
+/* Allocation counters. Bumped atomically since the loader threads allocate
+ * too, but only reset and read while no benchmark is running. */
+unsigned long bench_allocs = 0;
+unsigned long bench_frees = 0;
+
+#ifdef BENCH_WRAP_ALLOC
+/* The real allocator functions provided by the linker. */
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t nmemb, size_t size);
+void* __real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void* __wrap_malloc(size_t size) {
+	__sync_fetch_and_add(&bench_allocs, 1);
+	return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t nmemb, size_t size) {
+	__sync_fetch_and_add(&bench_allocs, 1);
+	return __real_calloc(nmemb, size);
+}
+
+void* __wrap_realloc(void *ptr, size_t size) {
+	__sync_fetch_and_add(&bench_allocs, 1);
+	return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr) {
+	if (ptr != NULL)
+		__sync_fetch_and_add(&bench_frees, 1);
+	__real_free(ptr);
+}
+#endif /* BENCH_WRAP_ALLOC */
+
+/**
+ * Gets the current time of a monotonic clock.
+ *
+ * @return Time in seconds.
+ */
+double bench_now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
+
+/**
+ * qsort comparison function for samples.
+ *
+ * @param a Pointer to a sample.
+ * @param b Pointer to another sample.
+ *
+ * @return Negative if a is smaller than b, positive if bigger, 0 if equal.
+ */
+static int bench_sample_cmp(const void *a, const void *b) {
+	double x;
+	double y;
+
+	x = *(const double *)a;
+	y = *(const double *)b;
+	return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+/**
+ * Gets a percentile out of sorted samples using the nearest rank.
+ *
+ * @param samples Sorted samples.
+ * @param count   Number of samples.
+ * @param pct     Percentile to get. (0-100)
+ *
+ * @return Sample at the percentile.
+ */
+static double bench_percentile(const double *samples, size_t count,
+							   double pct) {
+	size_t rank;
+
+	rank = (size_t)((pct / 100.0) * (double)count + 0.999999);
+	if (rank < 1)
+		rank = 1;
+	if (rank > count)
+		rank = count;
+
+	return samples[rank - 1];
+}
+
+/**
+ * Summarizes a set of timing samples.
+ * @warning The samples will be sorted in place.
+ *
+ * @param samples Timing samples in seconds.
+ * @param count   Number of samples.
+ * @param stats   Will hold the summary.
+ */
+void bench_stats(double *samples, size_t count, bench_stats_t *stats) {
+	double total;
+	size_t i;
+
+	memset(stats, 0, sizeof(bench_stats_t));
+	if (count == 0)
+		return;
+
+	qsort(samples, count, sizeof(double), bench_sample_cmp);
+	total = 0;
+	for (i = 0; i < count; i++)
+		total += samples[i];
+
+	stats->count = count;
+	stats->min = samples[0];
+	stats->p50 = bench_percentile(samples, count, 50);
+	stats->p90 = bench_percentile(samples, count, 90);
+	stats->p99 = bench_percentile(samples, count, 99);
+	stats->max = samples[count - 1];
+	stats->mean = total / (double)count;
+}
+
+/**
+ * Prints a summary of timing samples as JSON object members, without the
+ * surrounding braces.
+ *
+ * @param out   Stream to print to.
+ * @param stats Summary of the samples.
+ */
+void bench_stats_print(FILE *out, const bench_stats_t *stats) {
+	fprintf(out, "\"runs\":%lu,\"min\":%.6f,\"p50\":%.6f,\"p90\":%.6f,"
+			"\"p99\":%.6f,\"max\":%.6f,\"mean\":%.6f",
+			(unsigned long)stats->count, stats->min, stats->p50, stats->p90,
+			stats->p99, stats->max, stats->mean);
+}
+
+/**
+ * Gets a numeric setting from the environment.
+ *
+ * @param name Name of the environment variable.
+ * @param def  Default value if the variable isn't set.
+ *
+ * @return Value of the setting.
+ */
+unsigned long bench_env_ulong(const char *name, unsigned long def) {
+	const char *val;
+
+	val = getenv(name);
+	if ((val == NULL) || (*val == '\0'))
+		return def;
+
+	return strtoul(val, NULL, 10);
+}
+
+/**
+ * Gets a floating point setting from the environment.
+ *
+ * @param name Name of the environment variable.
+ * @param def  Default value if the variable isn't set.
+ *
+ * @return Value of the setting.
+ */
+double bench_env_double(const char *name, double def) {
+	const char *val;
+
+	val = getenv(name);
+	if ((val == NULL) || (*val == '\0'))
+		return def;
+
+	return strtod(val, NULL);
+}
+
+/**
+ * Gets a string setting from the environment.
+ *
+ * @param name Name of the environment variable.
+ * @param def  Default value if the variable isn't set.
+ *
+ * @return Value of the setting.
+ */
+const char* bench_env_str(const char *name, const char *def) {
+	const char *val;
+
+	val = getenv(name);
+	if ((val == NULL) || (*val == '\0'))
+		return def;
+
+	return val;
+}
@@ -0,0 +1,51 @@
+/**
+ * bench.h
+ * Common utilities shared by the benchmarks.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Summary of a set of timing samples.
+ */
+typedef struct {
+	size_t count;
+	double min;
+	double p50;
+	double p90;
+	double p99;
+	double max;
+	double mean;
+} bench_stats_t;
+
+/* Allocation counters. (Only updated if the allocator is wrapped, and only
+ * safe to reset or read between runs) */
+extern unsigned long bench_allocs;
+extern unsigned long bench_frees;
+
+/* Timing. */
+double bench_now(void);
+void bench_stats(double *samples, size_t count, bench_stats_t *stats);
+void bench_stats_print(FILE *out, const bench_stats_t *stats);
+
+/* Configuration. */
+unsigned long bench_env_ulong(const char *name, unsigned long def);
+double bench_env_double(const char *name, double def);
+const char* bench_env_str(const char *name, const char *def);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BENCH_H */
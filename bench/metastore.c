@@ -0,0 +1,216 @@
+/**
+ * metastore.c
+ * Benchmarks building, sorting and filtering the metadata of a huge workspace
+ * as note objects and as a columnar metadata store.
+ *
+ * The benchmark is configured through the environment:
+ *     BENCH_NOTES  Number of notes. (Default: 1000000)
+ *     BENCH_FILTER Filter expression. (Default: date:2000..2019 format:md)
+ *     BENCH_RUNS   Times each benchmark is run. (Default: 3)
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "dateutils.h"
+#include "filter.h"
+#include "metastore.h"
+#include "note.h"
+#include "notelist.h"
+
+/* Longest note file name generated. */
+#define BENCH_NAME_MAX 64
+
+/* Formats of the generated notes. */
+static const char *bench_formats[] = { "md", "md", "md", "txt", "txt", "log" };
+
+/**
+ * Times spent in each phase of a run.
+ */
+typedef struct {
+	double build;
+	double sort;
+	double filter;
+	size_t kept;
+} bench_times_t;
+
+/**
+ * Runs through the phases with note objects.
+ *
+ * @param names  File names of the notes.
+ * @param count  Number of notes.
+ * @param filter Filter used to pick notes.
+ * @param times  Will hold the time taken by each phase.
+ */
+static void bench_notes(char **names, size_t count, const filter_t *filter,
+						bench_times_t *times) {
+	notelist_t *list;
+	const note_t *note;
+	double start;
+	size_t i;
+
+	/* Build. */
+	start = bench_now();
+	list = notelist_new();
+	notelist_use_arena(list);
+	for (i = 0; i < count; i++)
+		notelist_push(list, note_from_fname_arena(names[i],
+												  notelist_arena(list)));
+	times->build = bench_now() - start;
+
+	/* Sort. */
+	start = bench_now();
+	notelist_sort(list);
+	times->sort = bench_now() - start;
+
+	/* Filter. */
+	start = bench_now();
+	times->kept = 0;
+	for (i = 0; i < notelist_len(list); i++) {
+		note = notelist_get(list, i);
+		if (filter_match_fields(filter, date_to_days(note_get_date(note)),
+								note_get_title(note),
+								strlen(note_get_title(note)),
+								note_get_format(note))) {
+			times->kept++;
+		}
+	}
+	times->filter = bench_now() - start;
+
+	notelist_free(list);
+}
+
+/**
+ * Runs through the phases with a metadata store.
+ *
+ * @param names  File names of the notes.
+ * @param count  Number of notes.
+ * @param filter Filter used to pick notes.
+ * @param times  Will hold the time taken by each phase.
+ */
+static void bench_store(char **names, size_t count, const filter_t *filter,
+						bench_times_t *times) {
+	metastore_t *ms;
+	uint16_t dir;
+	double start;
+	size_t i;
+
+	/* Build. */
+	start = bench_now();
+	ms = metastore_new();
+	metastore_add_dir(ms, "workspace", &dir);
+	for (i = 0; i < count; i++)
+		metastore_push(ms, dir, names[i], 0, 0, 0);
+	times->build = bench_now() - start;
+
+	/* Sort. */
+	start = bench_now();
+	metastore_sort(ms);
+	times->sort = bench_now() - start;
+
+	/* Filter. */
+	start = bench_now();
+	metastore_filter(ms, filter);
+	times->kept = metastore_len(ms);
+	times->filter = bench_now() - start;
+
+	metastore_free(ms);
+}
+
+/**
+ * Runs one of the benchmarks a couple of times and prints the best times.
+ *
+ * @param mode   Name of the mode being benchmarked.
+ * @param store  Should the metadata store be used?
+ * @param names  File names of the notes.
+ * @param count  Number of notes.
+ * @param filter Filter used to pick notes.
+ * @param runs   Number of runs.
+ */
+static void bench(const char *mode, bool store, char **names, size_t count,
+				  const filter_t *filter, unsigned long runs) {
+	bench_times_t best;
+	bench_times_t times;
+	unsigned long i;
+
+	for (i = 0; i < runs; i++) {
+		bench_allocs = 0;
+		if (store) {
+			bench_store(names, count, filter, &times);
+		} else {
+			bench_notes(names, count, filter, &times);
+		}
+		if ((i == 0) || (times.build < best.build))
+			best.build = times.build;
+		if ((i == 0) || (times.sort < best.sort))
+			best.sort = times.sort;
+		if ((i == 0) || (times.filter < best.filter))
+			best.filter = times.filter;
+		best.kept = times.kept;
+	}
+
+	printf("{\"bench\":\"metastore\",\"mode\":\"%s\",\"notes\":%lu,"
+		   "\"build_seconds\":%.6f,\"sort_seconds\":%.6f,"
+		   "\"filter_seconds\":%.6f,\"kept\":%lu,\"allocs\":%lu}\n", mode,
+		   (unsigned long)count, best.build, best.sort, best.filter,
+		   (unsigned long)best.kept, bench_allocs);
+}
+
+/**
+ * Program's main entry point.
+ *
+ * @param argc Number of command line arguments provided.
+ * @param argv Command line arguments.
+ *
+ * @return Return code.
+ */
+int main(int argc, char **argv) {
+	filter_t *filter;
+	char **names;
+	char date[NOTE_DATESTR_LEN];
+	unsigned long seed;
+	unsigned long runs;
+	size_t count;
+	size_t i;
+
+	/* Get the configuration. */
+	count = bench_env_ulong("BENCH_NOTES", 1000000);
+	runs = bench_env_ulong("BENCH_RUNS", 3);
+	filter = filter_new(bench_env_str("BENCH_FILTER",
+									  "date:2000..2019 format:md"), false);
+	if (filter == NULL) {
+		fprintf(stderr, "Invalid filter expression.\n");
+		return 1;
+	}
+
+	/* Generate the note names in no particular order. */
+	seed = 1;
+	names = (char **)malloc(count * sizeof(char *));
+	for (i = 0; i < count; i++) {
+		seed = (seed * 1103515245UL) + 12345UL;
+		date_format(date_days_from_civil(1990 + (int32_t)((seed >> 16) % 40),
+										 1 + (unsigned int)((seed >> 8) % 12),
+										 1 + (unsigned int)(seed % 28)), date);
+		names[i] = (char *)malloc(BENCH_NAME_MAX * sizeof(char));
+		sprintf(names[i], "%s_Note number %lu.%s", date, (unsigned long)i,
+				bench_formats[i % (sizeof(bench_formats) / sizeof(char *))]);
+	}
+
+	/* Run the benchmarks. */
+	if (runs == 0)
+		runs = 1;
+	bench("notes", false, names, count, filter, runs);
+	bench("store", true, names, count, filter, runs);
+
+	/* Clean up. */
+	for (i = 0; i < count; i++)
+		free(names[i]);
+	free(names);
+	filter_free(filter);
+
+	return 0;
+}
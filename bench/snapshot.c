@@ -0,0 +1,292 @@
+/**
+ * snapshot.c
+ * Benchmarks readers on several threads going through the notes while they're
+ * being replaced, with snapshots and with a plain mutex.
+ *
+ * The benchmark is configured through the environment:
+ *     BENCH_NOTES   Number of notes. (Default: 20000)
+ *     BENCH_THREADS Maximum number of reader threads, up to
+ *                   SNAPSHOT_MAX_READERS. (Default: CPUs or 4)
+ *     BENCH_SECONDS Time each run lasts. (Default: 1.0)
+ *     BENCH_READS   Notes looked at by every read. (Default: 16)
+ *     BENCH_BATCH   Notes replaced by every update. (Default: 16)
+ *     BENCH_PERIOD  Microseconds between updates. (Default: 1000)
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "note.h"
+#include "snapshot.h"
+
+/* Longest note path generated. */
+#define BENCH_PATH_MAX 64
+
+/**
+ * State shared by the threads of a run.
+ */
+typedef struct {
+	bool snapshots;
+	volatile int stop;
+
+	snapshot_store_t *store;
+	pthread_mutex_t lock;
+	note_t **notes;
+	size_t len;
+
+	unsigned long reads;
+	unsigned long batch;
+	unsigned long period;
+	unsigned long updates;
+} bench_run_t;
+
+/**
+ * Reader thread.
+ */
+typedef struct {
+	bench_run_t *run;
+	snapshot_reader_t *slot;
+	pthread_t thread;
+	unsigned long seed;
+	unsigned long ops;
+	uint64_t sink;
+} bench_reader_t;
+
+/**
+ * Cheap pseudo-random number generator that's private to each thread.
+ *
+ * @param seed State of the generator.
+ *
+ * @return Next pseudo-random number.
+ */
+static unsigned long bench_rand(unsigned long *seed) {
+	*seed = (*seed * 1103515245UL) + 12345UL;
+	return (*seed >> 16) & 0x7FFFFFFFUL;
+}
+
+/**
+ * Creates a synthetic note.
+ *
+ * @param id Number of the note.
+ *
+ * @return Note object.
+ */
+static note_t* bench_note(unsigned long id) {
+	char path[BENCH_PATH_MAX];
+
+	sprintf(path, "workspace/%04lu-%02lu-%02lu_Note number %lu.md",
+			1990 + (id % 40), 1 + (id % 12), 1 + (id % 28), id);
+	return note_from_fname(path);
+}
+
+/**
+ * Looks at a couple of notes, the way a query would.
+ *
+ * @param notes Notes in the collection.
+ * @param len   Number of notes.
+ * @param rd    Reader doing the work.
+ */
+static void bench_look(note_t **notes, size_t len, bench_reader_t *rd) {
+	const note_t *note;
+	unsigned long i;
+
+	for (i = 0; i < rd->run->reads; i++) {
+		note = notes[bench_rand(&rd->seed) % len];
+		rd->sink += (uint64_t)note_get_date(note) +
+			(unsigned char)note_get_title(note)[0];
+	}
+}
+
+/**
+ * Reads the notes over and over until the run is over.
+ *
+ * @param arg Reader object.
+ *
+ * @return Nothing.
+ */
+static void* bench_reader(void *arg) {
+	bench_reader_t *rd;
+	bench_run_t *run;
+	snapshot_t *snap;
+
+	rd = (bench_reader_t *)arg;
+	run = rd->run;
+	while (!__atomic_load_n(&run->stop, __ATOMIC_RELAXED)) {
+		if (run->snapshots) {
+			snap = snapshot_acquire(rd->slot);
+			bench_look(snap->notes, snap->len, rd);
+			snapshot_release(rd->slot);
+		} else {
+			pthread_mutex_lock(&run->lock);
+			bench_look(run->notes, run->len, rd);
+			pthread_mutex_unlock(&run->lock);
+		}
+		rd->ops++;
+	}
+
+	return NULL;
+}
+
+/**
+ * Keeps replacing notes until the run is over.
+ *
+ * @param arg Run object.
+ *
+ * @return Nothing.
+ */
+static void* bench_updater(void *arg) {
+	bench_run_t *run;
+	note_t **added;
+	unsigned long seed;
+	unsigned long id;
+	unsigned long i;
+	size_t index;
+	note_t *note;
+
+	run = (bench_run_t *)arg;
+	added = (note_t **)malloc(run->batch * sizeof(note_t *));
+	seed = 42;
+	id = run->len;
+	while (!__atomic_load_n(&run->stop, __ATOMIC_RELAXED)) {
+		if (run->snapshots) {
+			/* Build the new version off to the side. */
+			for (i = 0; i < run->batch; i++) {
+				index = bench_rand(&seed) % run->len;
+				snapshot_retire(run->store, run->notes[index]);
+				run->notes[index] = bench_note(id++);
+				added[i] = run->notes[index];
+			}
+			snapshot_update(run->store, added, run->batch);
+		} else {
+			pthread_mutex_lock(&run->lock);
+			for (i = 0; i < run->batch; i++) {
+				index = bench_rand(&seed) % run->len;
+				note = run->notes[index];
+				run->notes[index] = bench_note(id++);
+				note_free(note);
+			}
+			pthread_mutex_unlock(&run->lock);
+		}
+		run->updates++;
+
+		if (run->period > 0)
+			usleep(run->period);
+	}
+	free(added);
+
+	return NULL;
+}
+
+/**
+ * Runs the readers against an updater for a while.
+ *
+ * @param snapshots Should the readers use snapshots instead of a mutex?
+ * @param len       Number of notes.
+ * @param threads   Number of reader threads.
+ * @param seconds   How long the run lasts.
+ */
+static void bench(bool snapshots, size_t len, unsigned long threads,
+				  double seconds) {
+	bench_reader_t *readers;
+	bench_run_t run;
+	pthread_t updater;
+	unsigned long ops;
+	double start;
+	double end;
+	size_t i;
+
+	/* Set up the notes. */
+	memset(&run, 0, sizeof(run));
+	run.snapshots = snapshots;
+	run.reads = bench_env_ulong("BENCH_READS", 16);
+	run.batch = bench_env_ulong("BENCH_BATCH", 16);
+	run.period = bench_env_ulong("BENCH_PERIOD", 1000);
+	run.len = len;
+	run.notes = (note_t **)malloc(len * sizeof(note_t *));
+	for (i = 0; i < len; i++)
+		run.notes[i] = bench_note(i);
+	pthread_mutex_init(&run.lock, NULL);
+	if (snapshots) {
+		run.store = snapshot_store_new();
+		snapshot_publish(run.store, run.notes, run.len);
+	}
+
+	/* Let everything loose for a while. */
+	readers = (bench_reader_t *)calloc(threads, sizeof(bench_reader_t));
+	start = bench_now();
+	for (i = 0; i < threads; i++) {
+		readers[i].run = &run;
+		readers[i].seed = i + 1;
+		if (snapshots)
+			readers[i].slot = snapshot_reader_new(run.store);
+		pthread_create(&readers[i].thread, NULL, bench_reader, &readers[i]);
+	}
+	pthread_create(&updater, NULL, bench_updater, &run);
+	usleep((useconds_t)(seconds * 1000000.0));
+	__atomic_store_n(&run.stop, 1, __ATOMIC_RELAXED);
+	pthread_join(updater, NULL);
+	ops = 0;
+	for (i = 0; i < threads; i++) {
+		pthread_join(readers[i].thread, NULL);
+		ops += readers[i].ops;
+	}
+	end = bench_now();
+
+	printf("{\"bench\":\"snapshot\",\"mode\":\"%s\",\"notes\":%lu,"
+		   "\"threads\":%lu,\"seconds\":%.6f,\"reads\":%lu,"
+		   "\"reads_per_sec\":%.0f,\"updates\":%lu}\n",
+		   (snapshots) ? "snapshot" : "mutex", (unsigned long)len, threads,
+		   end - start, ops, (double)ops / (end - start), run.updates);
+
+	/* Clean up. */
+	for (i = 0; i < threads; i++)
+		snapshot_reader_free(readers[i].slot);
+	free(readers);
+	snapshot_store_free(run.store);
+	for (i = 0; i < len; i++)
+		note_free(run.notes[i]);
+	free(run.notes);
+	pthread_mutex_destroy(&run.lock);
+}
+
+/**
+ * Program's main entry point.
+ *
+ * @param argc Number of command line arguments provided.
+ * @param argv Command line arguments.
+ *
+ * @return Return code.
+ */
+int main(int argc, char **argv) {
+	unsigned long threads;
+	unsigned long max;
+	double seconds;
+	size_t len;
+	long cpus;
+
+	/* Get the configuration. */
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	len = bench_env_ulong("BENCH_NOTES", 20000);
+	max = bench_env_ulong("BENCH_THREADS",
+						  (cpus > 4) ? (unsigned long)cpus : 4);
+	seconds = bench_env_double("BENCH_SECONDS", 1.0);
+	if (len == 0)
+		len = 1;
+	if (max > SNAPSHOT_MAX_READERS)
+		max = SNAPSHOT_MAX_READERS;
+
+	/* Run the benchmarks with more and more readers. */
+	for (threads = 1; threads <= max; threads *= 2) {
+		bench(false, len, threads, seconds);
+		bench(true, len, threads, seconds);
+	}
+
+	return 0;
+}
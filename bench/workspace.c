@@ -0,0 +1,569 @@
+/**
+ * workspace.c
+ * Generates a synthetic workspace and benchmarks scanning it, parsing the note
+ * file names, loading their contents and the whole loading process.
+ *
+ * The workspace is configured through the environment:
+ *     BENCH_NOTES   Number of notes. (Default: 20000)
+ *     BENCH_SIZE    Median size of a note in bytes. (Default: 2048)
+ *     BENCH_SPREAD  Spread of the log-normal size distribution. (Default: 1.0)
+ *     BENCH_FORMATS Weighted mix of formats. (Default: md:6,txt:3,log:1)
+ *     BENCH_DEPTH   Levels of nested folders. (Default: 0)
+ *     BENCH_FANOUT  Folders inside each folder. (Default: 4)
+ *     BENCH_RUNS    Times each benchmark is run. (Default: 5)
+ *     BENCH_SEED    Seed of the generator. (Default: 1)
+ *     BENCH_DIR     Generate the workspace here and keep it afterwards.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "dateutils.h"
+#include "fsutils.h"
+#include "loader.h"
+#include "note.h"
+#include "notelist.h"
+#include "strutils.h"
+
+/* Limits of the generator. */
+#define BENCH_MAX_FORMATS 16
+#define BENCH_MAX_DIRS    100000
+#define BENCH_MAX_SIZE    (4 * 1024 * 1024)
+
+/**
+ * Note format and how often it shows up.
+ */
+typedef struct {
+	char ext[16];
+	unsigned long weight;
+} bench_format_t;
+
+/**
+ * Synthetic workspace.
+ */
+typedef struct {
+	char *root;
+	bool keep;
+
+	char **dirs;
+	size_t ndirs;
+	size_t depth;
+
+	char **notes;
+	size_t nnotes;
+	uint64_t bytes;
+
+	bench_format_t formats[BENCH_MAX_FORMATS];
+	size_t nformats;
+	unsigned long total_weight;
+
+	uint64_t rng;
+} bench_ws_t;
+
+/* Words used to fill up the notes. */
+static const char *words[] = {
+	"note", "idea", "todo", "meeting", "project", "draft", "review", "fix",
+	"build", "release", "hacker", "kernel", "socket", "buffer", "thread",
+	"memory", "cache", "index", "search", "parser", "workspace", "folder"
+};
+
+/**
+ * Gets the next number from the generator's xorshift64* generator.
+ *
+ * @param ws Workspace generator.
+ *
+ * @return Pseudo-random number.
+ */
+static uint64_t bench_rand(bench_ws_t *ws) {
+	ws->rng ^= ws->rng >> 12;
+	ws->rng ^= ws->rng << 25;
+	ws->rng ^= ws->rng >> 27;
+
+	return ws->rng * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * Gets a uniformly distributed number between 0 (exclusive) and 1.
+ *
+ * @param ws Workspace generator.
+ *
+ * @return Pseudo-random number.
+ */
+static double bench_uniform(bench_ws_t *ws) {
+	return ((double)(bench_rand(ws) >> 11) + 1.0) / 9007199254740993.0;
+}
+
+/**
+ * Parses the weighted format mix in the "ext:weight,ext:weight" format.
+ *
+ * @param ws  Workspace generator.
+ * @param mix Format mix string.
+ *
+ * @return FALSE if the mix is invalid.
+ */
+static bool bench_parse_formats(bench_ws_t *ws, const char *mix) {
+	const char *cur;
+	size_t len;
+
+	ws->nformats = 0;
+	ws->total_weight = 0;
+	for (cur = mix; *cur != '\0'; ) {
+		bench_format_t *fmt;
+
+		if (ws->nformats == BENCH_MAX_FORMATS)
+			return false;
+		fmt = &ws->formats[ws->nformats];
+
+		/* Extension. */
+		len = strcspn(cur, ":,");
+		if ((len == 0) || (len >= sizeof(fmt->ext)))
+			return false;
+		memcpy(fmt->ext, cur, len);
+		fmt->ext[len] = '\0';
+		cur += len;
+
+		/* Weight. */
+		fmt->weight = 1;
+		if (*cur == ':')
+			fmt->weight = strtoul(cur + 1, (char **)&cur, 10);
+		if (*cur == ',')
+			cur++;
+
+		ws->total_weight += fmt->weight;
+		ws->nformats++;
+	}
+
+	return ws->total_weight > 0;
+}
+
+/**
+ * Picks a format according to the weighted mix.
+ *
+ * @param ws Workspace generator.
+ *
+ * @return Extension of the format.
+ */
+static const char* bench_pick_format(bench_ws_t *ws) {
+	unsigned long n;
+	size_t i;
+
+	n = (unsigned long)(bench_rand(ws) % ws->total_weight);
+	for (i = 0; i < ws->nformats; i++) {
+		if (n < ws->formats[i].weight)
+			return ws->formats[i].ext;
+		n -= ws->formats[i].weight;
+	}
+
+	return ws->formats[0].ext;
+}
+
+/**
+ * Writes out a note with a size taken from a log-normal distribution.
+ *
+ * @param ws     Workspace generator.
+ * @param path   Path to the note.
+ * @param title  Title of the note.
+ * @param median Median size of a note.
+ * @param spread Spread of the distribution.
+ *
+ * @return FALSE if we couldn't write the note.
+ */
+static bool bench_write_note(bench_ws_t *ws, const char *path,
+							 const char *title, double median, double spread) {
+	FILE *fh;
+	double gauss;
+	size_t size;
+	size_t written;
+	size_t col;
+	const char *word;
+
+	/* Pick a size using the Box-Muller transform. */
+	gauss = sqrt(-2.0 * log(bench_uniform(ws))) *
+		cos(6.283185307179586 * bench_uniform(ws));
+	size = (size_t)(median * exp(spread * gauss));
+	if (size > BENCH_MAX_SIZE)
+		size = BENCH_MAX_SIZE;
+
+	fh = fopen(path, "wb");
+	if (fh == NULL)
+		return false;
+
+	/* Fill it up with lines of words. */
+	written = (size_t)fprintf(fh, "# %s\n\n", title);
+	col = 0;
+	while (written < size) {
+		word = words[bench_rand(ws) % (sizeof(words) / sizeof(words[0]))];
+		fputs(word, fh);
+		written += strlen(word);
+		col += strlen(word);
+
+		fputc((col > 60) ? '\n' : ' ', fh);
+		written++;
+		if (col > 60)
+			col = 0;
+	}
+
+	ws->bytes += written;
+	return fclose(fh) == 0;
+}
+
+/**
+ * Generates a synthetic workspace following the configuration in the
+ * environment.
+ *
+ * @param ws Workspace generator to be populated.
+ *
+ * @return FALSE if an error occurred. Check errno.
+ */
+static bool bench_generate(bench_ws_t *ws) {
+	char title[64];
+	char name[128];
+	size_t fanout;
+	size_t level_start;
+	size_t level_end;
+	size_t i;
+	size_t j;
+	double median;
+	double spread;
+	int32_t days;
+	int32_t first;
+
+	memset(ws, 0, sizeof(bench_ws_t));
+	if (!bench_parse_formats(ws, bench_env_str("BENCH_FORMATS",
+											   "md:6,txt:3,log:1"))) {
+		errno = EINVAL;
+		return false;
+	}
+	ws->nnotes = bench_env_ulong("BENCH_NOTES", 20000);
+	ws->depth = bench_env_ulong("BENCH_DEPTH", 0);
+	fanout = bench_env_ulong("BENCH_FANOUT", 4);
+	median = bench_env_double("BENCH_SIZE", 2048);
+	spread = bench_env_double("BENCH_SPREAD", 1.0);
+	ws->rng = bench_env_ulong("BENCH_SEED", 1) * 0x9E3779B97F4A7C15ULL + 1;
+
+	/* Create the workspace itself. */
+	if (getenv("BENCH_DIR") != NULL) {
+		ws->keep = true;
+		string_copy(&ws->root, getenv("BENCH_DIR"));
+		if ((mkdir(ws->root, 0755) != 0) && (errno != EEXIST))
+			return false;
+	} else {
+		string_copy(&ws->root, "/tmp/notein-bench-XXXXXX");
+		if (mkdtemp(ws->root) == NULL)
+			return false;
+	}
+
+	/* Create the nested folders level by level. */
+	ws->dirs = (char **)malloc(BENCH_MAX_DIRS * sizeof(char *));
+	if (ws->dirs == NULL)
+		return false;
+	ws->dirs[0] = NULL;
+	string_copy(&ws->dirs[0], ws->root);
+	ws->ndirs = 1;
+	level_start = 0;
+	level_end = 1;
+	for (i = 0; (i < ws->depth) && (fanout > 0); i++) {
+		for (j = level_start; j < level_end; j++) {
+			size_t k;
+
+			for (k = 0; (k < fanout) && (ws->ndirs < BENCH_MAX_DIRS); k++) {
+				ws->dirs[ws->ndirs] = NULL;
+				string_copy(&ws->dirs[ws->ndirs], ws->dirs[j]);
+				sprintf(name, "folder %lu", (unsigned long)k);
+				fs_pathcat(&ws->dirs[ws->ndirs], name);
+				if ((mkdir(ws->dirs[ws->ndirs], 0755) != 0) &&
+						(errno != EEXIST)) {
+					return false;
+				}
+				ws->ndirs++;
+			}
+		}
+		level_start = level_end;
+		level_end = ws->ndirs;
+	}
+
+	/* Write out the notes spread over the last 40 years. */
+	first = date_days_from_civil(1990, 1, 1);
+	ws->notes = (char **)calloc(ws->nnotes, sizeof(char *));
+	if (ws->notes == NULL)
+		return false;
+	for (i = 0; i < ws->nnotes; i++) {
+		days = first + (int32_t)(bench_rand(ws) % (40 * 365));
+		date_format(days, name);
+		sprintf(title, "Note number %lu", (unsigned long)i);
+		sprintf(name + DATE_STR_LEN, "_%s.%s", title, bench_pick_format(ws));
+
+		ws->notes[i] = NULL;
+		string_copy(&ws->notes[i], ws->dirs[bench_rand(ws) % ws->ndirs]);
+		fs_pathcat(&ws->notes[i], name);
+		if (!bench_write_note(ws, ws->notes[i], title, median, spread))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Removes the synthetic workspace, unless we were asked to keep it, and frees
+ * up the generator's resources.
+ *
+ * @param ws Workspace generator.
+ */
+static void bench_cleanup(bench_ws_t *ws) {
+	size_t i;
+
+	/* Notes. */
+	for (i = 0; (ws->notes != NULL) && (i < ws->nnotes); i++) {
+		if (ws->notes[i] == NULL)
+			break;
+		if (!ws->keep)
+			unlink(ws->notes[i]);
+		free(ws->notes[i]);
+	}
+
+	/* Folders, deepest first. */
+	for (i = ws->ndirs; i > 0; i--) {
+		if (!ws->keep)
+			rmdir(ws->dirs[i - 1]);
+		free(ws->dirs[i - 1]);
+	}
+
+	if (ws->notes)
+		free(ws->notes);
+	if (ws->dirs)
+		free(ws->dirs);
+	if (ws->root)
+		free(ws->root);
+}
+
+/**
+ * Scans every folder of the workspace using fs_readdir.
+ *
+ * @param ws Workspace.
+ *
+ * @return Number of entries found.
+ */
+static uint64_t bench_scan_readdir(bench_ws_t *ws) {
+	DIRHANDLE dh;
+	char *fname;
+	uint64_t count;
+	size_t i;
+
+	count = 0;
+	for (i = 0; i < ws->ndirs; i++) {
+		dh = fs_opendir(ws->dirs[i]);
+		if (dh == NULL)
+			continue;
+
+		while ((fname = fs_readdir(dh, ws->dirs[i])) != NULL) {
+			free(fname);
+			count++;
+		}
+		fs_closedir(dh);
+	}
+
+	return count;
+}
+
+/**
+ * Scans every folder of the workspace using the batched directory scanner.
+ *
+ * @param ws Workspace.
+ *
+ * @return Number of entries found.
+ */
+static uint64_t bench_scan_dirscan(bench_ws_t *ws) {
+	fs_dirscan_t scan;
+	const fs_dirent_t *entries;
+	uint64_t count;
+	size_t n;
+	size_t i;
+
+	count = 0;
+	for (i = 0; i < ws->ndirs; i++) {
+		if (!fs_dirscan_open(&scan, ws->dirs[i], FS_SCAN_FILES))
+			continue;
+
+		while ((n = fs_dirscan_next(&scan, &entries)) > 0)
+			count += n;
+		fs_dirscan_close(&scan);
+	}
+
+	return count;
+}
+
+/**
+ * Parses the metadata of every note out of its file name.
+ *
+ * @param ws Workspace.
+ *
+ * @return Number of notes parsed.
+ */
+static uint64_t bench_parse(bench_ws_t *ws) {
+	note_t *note;
+	uint64_t count;
+	size_t i;
+
+	count = 0;
+	for (i = 0; i < ws->nnotes; i++) {
+		note = note_from_fname(ws->notes[i]);
+		if (note == NULL)
+			continue;
+
+		note_free(note);
+		count++;
+	}
+
+	return count;
+}
+
+/**
+ * Loads the contents of every note.
+ *
+ * @param ws Workspace.
+ *
+ * @return Number of bytes loaded.
+ */
+static uint64_t bench_slurp(bench_ws_t *ws) {
+	note_t *note;
+	char *contents;
+	uint64_t bytes;
+	size_t i;
+
+	bytes = 0;
+	for (i = 0; i < ws->nnotes; i++) {
+		note = note_from_fname(ws->notes[i]);
+		if (note == NULL)
+			continue;
+
+		contents = note_fh_slurp(note);
+		if (contents != NULL) {
+			bytes += strlen(contents);
+			free(contents);
+		}
+		note_free(note);
+	}
+
+	return bytes;
+}
+
+/**
+ * Loads the whole workspace, contents included, the same way the application
+ * does.
+ *
+ * @param ws Workspace.
+ *
+ * @return Number of notes loaded.
+ */
+static uint64_t bench_load(bench_ws_t *ws) {
+	loader_opts_t opts;
+	notelist_t *list;
+	uint64_t count;
+
+	loader_opts_init(&opts);
+	opts.depth = ws->depth;
+
+	list = notelist_new();
+	notelist_use_arena(list);
+	loader_load(ws->root, &opts, list);
+	count = notelist_len(list);
+	notelist_free(list);
+
+	return count;
+}
+
+/**
+ * Runs a benchmark a number of times and prints out its results.
+ *
+ * @param ws    Workspace.
+ * @param op    Name of the operation being benchmarked.
+ * @param func  Benchmark function.
+ * @param bytes Does the function return bytes instead of items?
+ * @param runs  Number of times to run the benchmark.
+ */
+static void bench_run(bench_ws_t *ws, const char *op,
+					  uint64_t (*func)(bench_ws_t *), bool bytes, size_t runs) {
+	bench_stats_t stats;
+	double *samples;
+	double start;
+	uint64_t amount;
+	unsigned long allocs;
+	size_t i;
+
+	samples = (double *)malloc(runs * sizeof(double));
+	amount = 0;
+	bench_allocs = 0;
+	for (i = 0; i < runs; i++) {
+		start = bench_now();
+		amount = func(ws);
+		samples[i] = bench_now() - start;
+	}
+	allocs = bench_allocs;
+	bench_stats(samples, runs, &stats);
+
+	/* Report the results with the throughput of the median run. */
+	printf("{\"bench\":\"workspace\",\"op\":\"%s\",\"notes\":%lu,"
+		   "\"dirs\":%lu,", op, (unsigned long)ws->nnotes,
+		   (unsigned long)ws->ndirs);
+	bench_stats_print(stdout, &stats);
+	if (bytes) {
+		printf(",\"bytes\":%.0f,\"mb_per_sec\":%.2f", (double)amount,
+			   ((double)amount / 1048576.0) / stats.p50);
+	} else {
+		printf(",\"items\":%.0f,\"items_per_sec\":%.0f", (double)amount,
+			   (double)amount / stats.p50);
+	}
+	printf(",\"allocs_per_run\":%lu}\n", allocs / (unsigned long)runs);
+
+	free(samples);
+}
+
+/**
+ * Program's main entry point.
+ *
+ * @param argc Number of command line arguments provided.
+ * @param argv Command line arguments.
+ *
+ * @return Return code.
+ */
+int main(int argc, char **argv) {
+	bench_ws_t ws;
+	double start;
+	size_t runs;
+
+	/* Generate the workspace. */
+	start = bench_now();
+	if (!bench_generate(&ws)) {
+		fprintf(stderr, "Couldn't generate the workspace: %s\n",
+				strerror(errno));
+		bench_cleanup(&ws);
+		return 1;
+	}
+	printf("{\"bench\":\"workspace\",\"op\":\"generate\",\"notes\":%lu,"
+		   "\"dirs\":%lu,\"bytes\":%.0f,\"seconds\":%.6f}\n",
+		   (unsigned long)ws.nnotes, (unsigned long)ws.ndirs,
+		   (double)ws.bytes, bench_now() - start);
+	fflush(stdout);
+
+	/* Run the benchmarks. */
+	runs = bench_env_ulong("BENCH_RUNS", 5);
+	if (runs == 0)
+		runs = 1;
+	bench_run(&ws, "scan_readdir", bench_scan_readdir, false, runs);
+	bench_run(&ws, "scan_dirscan", bench_scan_dirscan, false, runs);
+	bench_run(&ws, "parse", bench_parse, false, runs);
+	bench_run(&ws, "slurp", bench_slurp, true, runs);
+	bench_run(&ws, "load", bench_load, false, runs);
+
+	bench_cleanup(&ws);
+	return 0;
+}
@@ -0,0 +1,170 @@
+/**
+ * arena.c
+ * Bump allocator for objects that share the same lifetime.
+ *
+ * Allocations are carved out of big blocks and are never free'd individually.
+ * Instead everything is released at once when the arena itself is free'd,
+ * which turns thousands of malloc and free calls into a handful.
+ *
+ * @warning Arenas aren't thread safe. Use one per thread and merge them.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "arena.h"
+
+/* Size of the block header rounded up to the alignment. */
+#define ARENA_HEADER_SIZE \
+	((sizeof(arena_block_t) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+/**
+ * Allocates a brand new empty arena.
+ * @warning The object allocated by this function must be free'd after use.
+ *
+ * @param block_size Size of the blocks to allocate or 0 for the default.
+ *
+ * @return Brand new arena or NULL in case of an error.
+ *
+ * @see arena_free
+ */
+arena_t* arena_new(size_t block_size) {
+	arena_t *arena;
+
+	/* Allocate enough memory for our object. */
+	arena = (arena_t *)malloc(sizeof(arena_t));
+	if (arena == NULL)
+		return NULL;
+
+	/* Populate the arena with some defaults. */
+	arena->head = NULL;
+	arena->block_size = (block_size == 0) ? ARENA_BLOCK_SIZE : block_size;
+	arena->nblocks = 0;
+	arena->allocated = 0;
+
+	return arena;
+}
+
+/**
+ * Frees up an arena and everything that was allocated from it.
+ *
+ * @param arena Arena to be free'd.
+ */
+void arena_free(arena_t *arena) {
+	arena_block_t *block;
+	arena_block_t *next;
+
+	/* Do we even have anything to do? */
+	if (arena == NULL)
+		return;
+
+	/* Free the blocks and the object itself. */
+	for (block = arena->head; block != NULL; block = next) {
+		next = block->next;
+		free(block);
+	}
+	free(arena);
+}
+
+/**
+ * Allocates memory from an arena. The memory is aligned to ARENA_ALIGN and
+ * lives until the arena is free'd.
+ *
+ * @param arena Arena to allocate from.
+ * @param size  Number of bytes to allocate.
+ *
+ * @return Pointer to the allocated memory or NULL in case of an error.
+ */
+void* arena_alloc(arena_t *arena, size_t size) {
+	arena_block_t *block;
+	size_t bsize;
+	char *ptr;
+
+	/* Keep every allocation aligned. */
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	if (size == 0)
+		size = ARENA_ALIGN;
+
+	/* Bump the pointer in the current block if there's room. */
+	block = arena->head;
+	if ((block != NULL) && ((block->size - block->used) >= size)) {
+		ptr = (char *)block + ARENA_HEADER_SIZE + block->used;
+		block->used += size;
+		arena->allocated += size;
+
+		return ptr;
+	}
+
+	/* Allocate a new block. Big allocations get a block of their own. */
+	bsize = (size > (arena->block_size / 4)) ? size : arena->block_size;
+	block = (arena_block_t *)malloc(ARENA_HEADER_SIZE + bsize);
+	if (block == NULL)
+		return NULL;
+	block->size = bsize;
+	block->used = size;
+	arena->nblocks++;
+	arena->allocated += size;
+
+	/* Dedicated blocks go behind the current one so it can keep being used. */
+	if ((bsize == size) && (arena->head != NULL)) {
+		block->next = arena->head->next;
+		arena->head->next = block;
+	} else {
+		block->next = arena->head;
+		arena->head = block;
+	}
+
+	return (char *)block + ARENA_HEADER_SIZE;
+}
+
+/**
+ * Moves every block from one arena to another, leaving the source arena empty.
+ * Useful to gather the arenas used by multiple threads.
+ *
+ * @param arena Arena that will take ownership of the blocks.
+ * @param other Arena to take the blocks from.
+ */
+void arena_merge(arena_t *arena, arena_t *other) {
+	arena_block_t *tail;
+
+	/* Do we even have anything to do? */
+	if (other->head == NULL)
+		return;
+
+	/* Append our blocks after the other ones so our current block stays. */
+	for (tail = other->head; tail->next != NULL; tail = tail->next);
+	if (arena->head != NULL) {
+		tail->next = arena->head->next;
+		arena->head->next = other->head;
+	} else {
+		arena->head = other->head;
+	}
+	arena->nblocks += other->nblocks;
+	arena->allocated += other->allocated;
+
+	/* Leave the other arena empty. */
+	other->head = NULL;
+	other->nblocks = 0;
+	other->allocated = 0;
+}
+
+/**
+ * Gets the number of blocks allocated by the arena.
+ *
+ * @param arena Arena object.
+ *
+ * @return Number of blocks (each one a single malloc call).
+ */
+size_t arena_nblocks(const arena_t *arena) {
+	return arena->nblocks;
+}
+
+/**
+ * Gets the number of bytes handed out by the arena.
+ *
+ * @param arena Arena object.
+ *
+ * @return Number of bytes allocated from the arena.
+ */
+size_t arena_allocated(const arena_t *arena) {
+	return arena->allocated;
+}
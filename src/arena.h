@@ -0,0 +1,61 @@
+/**
+ * arena.h
+ * Bump allocator for objects that share the same lifetime.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Default size of the blocks allocated by an arena. */
+#ifndef ARENA_BLOCK_SIZE
+	#define ARENA_BLOCK_SIZE (256 * 1024)
+#endif /* ARENA_BLOCK_SIZE */
+
+/* Alignment of every allocation. */
+#define ARENA_ALIGN 16
+
+/**
+ * Block of memory owned by an arena.
+ */
+typedef struct arena_block_s {
+	struct arena_block_s *next;
+	size_t size;
+	size_t used;
+} arena_block_t;
+
+/**
+ * Arena object.
+ */
+typedef struct {
+	arena_block_t *head;
+	size_t block_size;
+	size_t nblocks;
+	size_t allocated;
+} arena_t;
+
+/* Construction and destruction. */
+arena_t* arena_new(size_t block_size);
+void arena_free(arena_t *arena);
+
+/* Allocation. */
+void* arena_alloc(arena_t *arena, size_t size);
+void arena_merge(arena_t *arena, arena_t *other);
+
+/* Statistics. */
+size_t arena_nblocks(const arena_t *arena);
+size_t arena_allocated(const arena_t *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ARENA_H */
@@ -0,0 +1,227 @@
+/**
+ * dateutils.c
+ * Fast and allocation-free conversions between dates and day numbers.
+ *
+ * Dates are represented as the number of days since 1970-01-01 and converted
+ * from and to civil dates using the closed-form algorithms described by Howard
+ * Hinnant in "chrono-Compatible Low-Level Date Algorithms". Conversions to
+ * local time use a timezone offset that is only computed once, so that we
+ * don't have to go through the C library's timezone machinery for every note.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "dateutils.h"
+
+#include <pthread.h>
+
+/* Number of seconds in a day. */
+#define DATE_DAY_SECS 86400L
+
+/* Cached timezone offset. */
+static pthread_once_t date_tz_once = PTHREAD_ONCE_INIT;
+static long date_tz_secs;
+
+/**
+ * Converts a civil date into the number of days since 1970-01-01.
+ *
+ * @param year  Full year.
+ * @param month Month of the year. (1-12)
+ * @param day   Day of the month. (1-31)
+ *
+ * @return Number of days since 1970-01-01. Negative for dates before it.
+ */
+int32_t date_days_from_civil(int32_t year, unsigned int month,
+							 unsigned int day) {
+	int32_t era;
+	uint32_t yoe;
+	uint32_t doy;
+	uint32_t doe;
+
+	/* Years start in March so that the leap day is at the end. */
+	year -= (month <= 2) ? 1 : 0;
+	era = ((year >= 0) ? year : (year - 399)) / 400;
+	yoe = (uint32_t)(year - (era * 400));
+	doy = ((153 * ((month > 2) ? (month - 3) : (month + 9))) + 2) / 5 + day - 1;
+	doe = (yoe * 365) + (yoe / 4) - (yoe / 100) + doy;
+
+	return (era * 146097) + (int32_t)doe - 719468;
+}
+
+/**
+ * Converts a number of days since 1970-01-01 into a civil date.
+ *
+ * @param days  Number of days since 1970-01-01.
+ * @param year  Will hold the full year.
+ * @param month Will hold the month of the year. (1-12)
+ * @param day   Will hold the day of the month. (1-31)
+ */
+void date_civil_from_days(int32_t days, int32_t *year, unsigned int *month,
+						  unsigned int *day) {
+	int32_t era;
+	uint32_t doe;
+	uint32_t yoe;
+	uint32_t doy;
+	uint32_t mp;
+
+	days += 719468;
+	era = ((days >= 0) ? days : (days - 146096)) / 146097;
+	doe = (uint32_t)(days - (era * 146097));
+	yoe = (doe - (doe / 1460) + (doe / 36524) - (doe / 146096)) / 365;
+	doy = doe - ((365 * yoe) + (yoe / 4) - (yoe / 100));
+	mp = ((5 * doy) + 2) / 153;
+
+	*day = doy - (((153 * mp) + 2) / 5) + 1;
+	*month = (mp < 10) ? (mp + 3) : (mp - 9);
+	*year = (int32_t)yoe + (era * 400) + ((*month <= 2) ? 1 : 0);
+}
+
+/**
+ * Gets the number of days in a month.
+ *
+ * @param year  Full year.
+ * @param month Month of the year. (1-12)
+ *
+ * @return Number of days in the month or 0 if the month is invalid.
+ */
+unsigned int date_month_days(int32_t year, unsigned int month) {
+	static const unsigned char days[12] = {
+		31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
+	};
+
+	if ((month < 1) || (month > 12))
+		return 0;
+	if ((month == 2) && ((year % 4) == 0) &&
+			(((year % 100) != 0) || ((year % 400) == 0))) {
+		return 29;
+	}
+
+	return days[month - 1];
+}
+
+/**
+ * Computes the local timezone offset. Called only once.
+ */
+static void date_tz_init(void) {
+	struct tm tm;
+	time_t now;
+	long local;
+
+	/* Compare the local broken down time with the actual time. */
+	now = time(NULL);
+	localtime_r(&now, &tm);
+	local = (long)date_days_from_civil(tm.tm_year + 1900, tm.tm_mon + 1,
+									   tm.tm_mday) * DATE_DAY_SECS;
+	local += (tm.tm_hour * 3600L) + (tm.tm_min * 60L) + tm.tm_sec;
+
+	date_tz_secs = local - (long)now;
+}
+
+/**
+ * Gets the offset of the local timezone from UTC. It's computed once, the
+ * first time it's needed, so changes in daylight saving time while running
+ * aren't taken into account.
+ *
+ * @return Number of seconds to add to UTC to get the local time.
+ */
+long date_tz_offset(void) {
+	pthread_once(&date_tz_once, date_tz_init);
+	return date_tz_secs;
+}
+
+/**
+ * Converts a day number into a timestamp at local midnight.
+ *
+ * @param days Number of days since 1970-01-01.
+ *
+ * @return Timestamp at midnight of that day in the local timezone.
+ */
+time_t date_from_days(int32_t days) {
+	return (time_t)(((long)days * DATE_DAY_SECS) - date_tz_offset());
+}
+
+/**
+ * Converts a timestamp into the day number it falls on in the local timezone.
+ *
+ * @param date Timestamp.
+ *
+ * @return Number of days since 1970-01-01.
+ */
+int32_t date_to_days(time_t date) {
+	long secs;
+
+	secs = (long)date + date_tz_offset();
+	if (secs < 0)
+		return (int32_t)(((secs + 1) / DATE_DAY_SECS) - 1);
+
+	return (int32_t)(secs / DATE_DAY_SECS);
+}
+
+/**
+ * Strictly parses a YYYY-MM-DD date at the start of a string.
+ *
+ * @param str  String starting with a date. Anything after it is ignored.
+ * @param days Will hold the number of days since 1970-01-01.
+ *
+ * @return TRUE if a valid date was parsed.
+ *         FALSE if the string doesn't start with one.
+ */
+bool date_parse(const char *str, int32_t *days) {
+	int32_t year;
+	unsigned int month;
+	unsigned int day;
+	unsigned int i;
+
+	/* Check the layout in order, so we never look past the end of a string
+	 * that's shorter than a date. */
+	for (i = 0; i < DATE_STR_LEN; i++) {
+		if ((i == 4) || (i == 7)) {
+			if (str[i] != '-')
+				return false;
+		} else if ((str[i] < '0') || (str[i] > '9')) {
+			return false;
+		}
+	}
+
+	/* Convert the fields. */
+	year = ((str[0] - '0') * 1000) + ((str[1] - '0') * 100) +
+		((str[2] - '0') * 10) + (str[3] - '0');
+	month = ((str[5] - '0') * 10) + (str[6] - '0');
+	day = ((str[8] - '0') * 10) + (str[9] - '0');
+
+	/* Validate them. */
+	if ((day < 1) || (day > date_month_days(year, month)))
+		return false;
+
+	*days = date_days_from_civil(year, month, day);
+	return true;
+}
+
+/**
+ * Formats a day number as a YYYY-MM-DD string.
+ *
+ * @param days Number of days since 1970-01-01.
+ * @param str  Buffer of at least DATE_STR_LEN + 1 bytes that will hold the
+ *             NULL terminated date string.
+ */
+void date_format(int32_t days, char *str) {
+	int32_t year;
+	unsigned int month;
+	unsigned int day;
+
+	date_civil_from_days(days, &year, &month, &day);
+	if ((year < 0) || (year > 9999))
+		year = 0;
+
+	str[0] = (char)('0' + ((year / 1000) % 10));
+	str[1] = (char)('0' + ((year / 100) % 10));
+	str[2] = (char)('0' + ((year / 10) % 10));
+	str[3] = (char)('0' + (year % 10));
+	str[4] = '-';
+	str[5] = (char)('0' + (month / 10));
+	str[6] = (char)('0' + (month % 10));
+	str[7] = '-';
+	str[8] = (char)('0' + (day / 10));
+	str[9] = (char)('0' + (day % 10));
+	str[10] = '\0';
+}
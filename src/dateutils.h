@@ -0,0 +1,42 @@
+/**
+ * dateutils.h
+ * Fast and allocation-free conversions between dates and day numbers.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _DATEUTILS_H
+#define _DATEUTILS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Length of a YYYY-MM-DD date string without the NULL terminator. */
+#define DATE_STR_LEN 10
+
+/* Civil date conversions. */
+int32_t date_days_from_civil(int32_t year, unsigned int month,
+							 unsigned int day);
+void date_civil_from_days(int32_t days, int32_t *year, unsigned int *month,
+						  unsigned int *day);
+unsigned int date_month_days(int32_t year, unsigned int month);
+
+/* Local time conversions. */
+long date_tz_offset(void);
+time_t date_from_days(int32_t days);
+int32_t date_to_days(time_t date);
+
+/* Parsing and formatting. */
+bool date_parse(const char *str, int32_t *days);
+void date_format(int32_t days, char *str);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _DATEUTILS_H */
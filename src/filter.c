@@ -0,0 +1,723 @@
+/**
+ * filter.c
+ * Compiled predicates that pick notes straight from their file names.
+ *
+ * Filters are written as a list of space separated conditions, all of which
+ * must hold for a note to be picked:
+ *
+ *   date:2023                 Notes from 2023. Months (2023-04) and days
+ *   date:2023-01..2023-06-15  (2023-04-01) work too, as do ranges between
+ *   date:..2022-12-31         them, which may be left open on either side.
+ *   format:md,txt             Notes in any of these formats.
+ *   title:"meeting *"         Titles matching a glob. (*, ? and [...])
+ *   title:/^(Re|Fwd): /       Titles matching an extended regular expression.
+ *   size:>=1k size:10..2m     Size bounds in bytes, with optional k, m or g.
+ *
+ * Everything except the size is checked against the file name alone, so notes
+ * that don't match cost nothing but a few comparisons while the directory is
+ * being scanned, long before anything gets allocated or opened. Size bounds
+ * need a stat, which is only done once the name has already matched.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "filter.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#include "dateutils.h"
+#include "note.h"
+#include "stats.h"
+#include "strutils.h"
+
+/* Size of the buffer used to hand titles over to the regular expression. */
+#ifdef NAME_MAX
+	#define FILTER_TITLE_MAX (NAME_MAX + 1)
+#else
+	#define FILTER_TITLE_MAX 256
+#endif /* NAME_MAX */
+
+/* Characters that separate conditions. */
+#define FILTER_IS_SPACE(c) \
+	(((c) == ' ') || ((c) == '\t') || ((c) == '\n') || ((c) == '\r'))
+
+/* Folds a character for comparison according to the filter's case. */
+#define FILTER_FOLD(icase, c) \
+	((icase) ? tolower_ascii((unsigned char)(c)) : (unsigned char)(c))
+
+/**
+ * Lowercases an ASCII character.
+ *
+ * @param c Character to be lowercased.
+ *
+ * @return Lowercase version of the character.
+ */
+static unsigned char tolower_ascii(unsigned char c) {
+	return ((c >= 'A') && (c <= 'Z')) ? (unsigned char)(c + 'a' - 'A') : c;
+}
+
+/**
+ * Matches a single character against a single element of a glob pattern.
+ *
+ * @param p     Element of the pattern. (Not '*' nor the end of it)
+ * @param c     Character to be matched.
+ * @param icase Ignore ASCII case?
+ * @param match Will be TRUE if the character matched.
+ *
+ * @return Pointer to the next element of the pattern.
+ */
+static const char* filter_glob_one(const char *p, unsigned char c, bool icase,
+								   bool *match) {
+	const char *q;
+	unsigned char lo;
+	unsigned char hi;
+	bool negate;
+	bool found;
+
+	/* Any character. */
+	if (*p == '?') {
+		*match = true;
+		return p + 1;
+	}
+
+	/* Character classes. Unterminated ones are taken literally. */
+	if (*p == '[') {
+		q = p + 1;
+		negate = (*q == '!') || (*q == '^');
+		if (negate)
+			q++;
+
+		found = false;
+		c = FILTER_FOLD(icase, c);
+		do {
+			if (*q == '\0')
+				break;
+
+			lo = FILTER_FOLD(icase, *q);
+			hi = lo;
+			if ((q[1] == '-') && (q[2] != '\0') && (q[2] != ']')) {
+				hi = FILTER_FOLD(icase, q[2]);
+				q += 2;
+			}
+			if ((c >= lo) && (c <= hi))
+				found = true;
+			q++;
+		} while (*q != ']');
+
+		if (*q == ']') {
+			*match = found != negate;
+			return q + 1;
+		}
+	}
+
+	/* Escaped or literal character. */
+	if ((*p == '\\') && (p[1] != '\0'))
+		p++;
+	*match = FILTER_FOLD(icase, *p) == FILTER_FOLD(icase, c);
+
+	return p + 1;
+}
+
+/**
+ * Matches a string against a glob pattern, backtracking to the last star
+ * whenever something doesn't match.
+ *
+ * @param p     NULL terminated glob pattern.
+ * @param s     String to be matched. (Doesn't need to be NULL terminated)
+ * @param end   End of the string.
+ * @param icase Ignore ASCII case?
+ *
+ * @return TRUE if the whole string matches the pattern.
+ */
+static bool filter_glob(const char *p, const char *s, const char *end,
+						bool icase) {
+	const char *star_p;
+	const char *star_s;
+	const char *next;
+	bool match;
+
+	star_p = NULL;
+	star_s = NULL;
+	while (s < end) {
+		/* Remember where the last star was, in case we need to go back. */
+		if (*p == '*') {
+			while (*p == '*')
+				p++;
+			if (*p == '\0')
+				return true;
+
+			star_p = p;
+			star_s = s;
+			continue;
+		}
+
+		if (*p != '\0') {
+			next = filter_glob_one(p, (unsigned char)*s, icase, &match);
+			if (match) {
+				p = next;
+				s++;
+				continue;
+			}
+		}
+
+		/* Let the last star eat one more character and try again. */
+		if (star_p == NULL)
+			return false;
+		p = star_p;
+		s = ++star_s;
+	}
+
+	while (*p == '*')
+		p++;
+
+	return *p == '\0';
+}
+
+/**
+ * Parses a date that might only have a year, or a year and a month.
+ *
+ * @param str  Date string. (YYYY, YYYY-MM or YYYY-MM-DD)
+ * @param len  Length of the string.
+ * @param last Take the last day of the period instead of the first one?
+ * @param days Will hold the number of days since 1970-01-01.
+ *
+ * @return TRUE if the date was valid.
+ */
+static bool filter_date(const char *str, size_t len, bool last,
+						int32_t *days) {
+	char buf[DATE_STR_LEN + 1];
+	unsigned int month;
+	int32_t year;
+
+	/* Full dates can be parsed as they are. */
+	if (len == DATE_STR_LEN) {
+		memcpy(buf, str, len);
+		buf[len] = '\0';
+		return date_parse(buf, days);
+	}
+	if ((len != 4) && (len != 7))
+		return false;
+
+	/* Fill in the blanks to get the first day of the period. */
+	memcpy(buf, "0000-01-01", DATE_STR_LEN + 1);
+	memcpy(buf, str, len);
+	if (!date_parse(buf, days))
+		return false;
+	if (!last)
+		return true;
+
+	/* Go to the last day of the period. */
+	year = ((buf[0] - '0') * 1000) + ((buf[1] - '0') * 100) +
+		((buf[2] - '0') * 10) + (buf[3] - '0');
+	month = (len == 4) ? 12 : (unsigned int)(((buf[5] - '0') * 10) +
+											(buf[6] - '0'));
+	*days = date_days_from_civil(year, month, date_month_days(year, month));
+
+	return true;
+}
+
+/**
+ * Parses a size in bytes with an optional k, m or g multiplier.
+ *
+ * @param str  Size string.
+ * @param len  Length of the string.
+ * @param size Will hold the size in bytes.
+ *
+ * @return TRUE if the size was valid.
+ */
+static bool filter_size(const char *str, size_t len, uint64_t *size) {
+	const char *end;
+	unsigned int shift;
+	uint64_t n;
+
+	/* Get the unit out of the way. */
+	end = str + len;
+	shift = 0;
+	if (len > 0) {
+		switch (tolower_ascii((unsigned char)end[-1])) {
+			case 'k':
+				shift = 10;
+				break;
+			case 'm':
+				shift = 20;
+				break;
+			case 'g':
+				shift = 30;
+				break;
+		}
+		if (shift > 0)
+			end--;
+	}
+	if (str == end)
+		return false;
+
+	/* Convert the number. */
+	n = 0;
+	for (; str < end; str++) {
+		if ((*str < '0') || (*str > '9') || (n > (UINT64_MAX / 10)))
+			return false;
+		n = (n * 10) + (uint64_t)(*str - '0');
+	}
+	if (n > (UINT64_MAX >> shift))
+		return false;
+
+	*size = n << shift;
+	return true;
+}
+
+/**
+ * Finds the .. separating the two sides of a range.
+ *
+ * @param str Condition value.
+ * @param len Length of the value.
+ *
+ * @return Pointer to the separator or NULL if the value isn't a range.
+ */
+static const char* filter_range_sep(const char *str, size_t len) {
+	size_t i;
+
+	for (i = 0; (i + 1) < len; i++) {
+		if ((str[i] == '.') && (str[i + 1] == '.'))
+			return str + i;
+	}
+
+	return NULL;
+}
+
+/**
+ * Compiles a date condition, narrowing down the range of the filter.
+ *
+ * @param filter Filter object.
+ * @param value  Condition value.
+ *
+ * @return TRUE if the condition was valid.
+ */
+static bool filter_compile_date(filter_t *filter, const char *value) {
+	const char *sep;
+	size_t len;
+	int32_t from;
+	int32_t to;
+
+	len = strlen(value);
+	sep = filter_range_sep(value, len);
+	if (sep == NULL) {
+		/* A single period. */
+		if (!filter_date(value, len, false, &from) ||
+				!filter_date(value, len, true, &to)) {
+			return false;
+		}
+	} else {
+		/* A range that may be open on either side, but not both. */
+		if (sep == (value + len - 2)) {
+			if (sep == value)
+				return false;
+			to = INT32_MAX;
+		} else if (!filter_date(sep + 2, len - (sep - value) - 2, true, &to)) {
+			return false;
+		}
+		if (sep == value) {
+			from = INT32_MIN;
+		} else if (!filter_date(value, (size_t)(sep - value), false, &from)) {
+			return false;
+		}
+	}
+
+	if (from > filter->from)
+		filter->from = from;
+	if (to < filter->to)
+		filter->to = to;
+
+	return true;
+}
+
+/**
+ * Compiles a size condition, narrowing down the size bounds of the filter.
+ *
+ * @param filter Filter object.
+ * @param value  Condition value.
+ *
+ * @return TRUE if the condition was valid.
+ */
+static bool filter_compile_size(filter_t *filter, const char *value) {
+	const char *sep;
+	uint64_t min;
+	uint64_t max;
+	uint64_t n;
+	size_t len;
+
+	len = strlen(value);
+	min = 0;
+	max = UINT64_MAX;
+	if ((value[0] == '<') || (value[0] == '>')) {
+		/* Comparisons. */
+		n = (value[1] == '=') ? 2 : 1;
+		if (!filter_size(value + n, len - (size_t)n, &max))
+			return false;
+		if (value[0] == '>') {
+			min = max;
+			max = UINT64_MAX;
+			if ((n == 1) && (min++ == UINT64_MAX))
+				return false;
+		} else if ((n == 1) && (max-- == 0)) {
+			return false;
+		}
+	} else if ((sep = filter_range_sep(value, len)) != NULL) {
+		/* Ranges. */
+		if ((sep != value) &&
+				!filter_size(value, (size_t)(sep - value), &min)) {
+			return false;
+		}
+		if ((sep != (value + len - 2)) &&
+				!filter_size(sep + 2, len - (sep - value) - 2, &max)) {
+			return false;
+		}
+	} else {
+		/* Exact sizes. */
+		if (!filter_size(value, len, &min))
+			return false;
+		max = min;
+	}
+
+	if (min > filter->min_size)
+		filter->min_size = min;
+	if (max < filter->max_size)
+		filter->max_size = max;
+
+	return true;
+}
+
+/**
+ * Compiles a format condition, adding its formats to the ones accepted.
+ *
+ * @param filter Filter object.
+ * @param value  Comma separated list of formats.
+ *
+ * @return TRUE if the condition was valid.
+ */
+static bool filter_compile_format(filter_t *filter, const char *value) {
+	const char *end;
+	char **formats;
+
+	while (*value != '\0') {
+		for (end = value; (*end != '\0') && (*end != ','); end++);
+		if (end > value) {
+			formats = (char **)realloc(filter->formats,
+				(filter->nformats + 1) * sizeof(char *));
+			if (formats == NULL)
+				return false;
+			filter->formats = formats;
+			filter->formats[filter->nformats] = NULL;
+			string_copy_untilp(&filter->formats[filter->nformats++], value,
+							   end);
+		}
+
+		value = (*end == ',') ? end + 1 : end;
+	}
+
+	return true;
+}
+
+/**
+ * Compiles a title condition, which is either a glob or an extended regular
+ * expression between slashes.
+ *
+ * @param filter Filter object.
+ * @param value  Condition value.
+ *
+ * @return TRUE if the condition was valid.
+ */
+static bool filter_compile_title(filter_t *filter, const char *value) {
+	char *re;
+	size_t len;
+	int ret;
+
+	len = strlen(value);
+	if ((len >= 2) && (value[0] == '/') && (value[len - 1] == '/')) {
+		if (filter->has_regex)
+			return false;
+
+		re = NULL;
+		string_copy_untilp(&re, value + 1, value + len - 1);
+		ret = regcomp(&filter->regex, re, REG_EXTENDED | REG_NOSUB |
+					  ((filter->icase) ? REG_ICASE : 0));
+		free(re);
+		if (ret != 0)
+			return false;
+
+		filter->has_regex = true;
+		return true;
+	}
+
+	if (filter->glob != NULL)
+		return false;
+	string_copy(&filter->glob, value);
+
+	return true;
+}
+
+/**
+ * Gets the next condition out of a filter expression.
+ *
+ * @param cur   Current position in the expression. Will be moved past the
+ *              condition.
+ * @param key   Will hold a pointer to the condition's key.
+ * @param klen  Will hold the length of the key.
+ * @param value Will hold the condition's value, without any quotes.
+ *              (Allocated by this function)
+ *
+ * @return 1 if a condition was found, 0 at the end of the expression or -1 if
+ *         it's malformed.
+ */
+static int filter_next(const char **cur, const char **key, size_t *klen,
+					   char **value) {
+	const char *p;
+	const char *start;
+
+	/* Find the key. */
+	for (p = *cur; FILTER_IS_SPACE(*p); p++);
+	if (*p == '\0')
+		return 0;
+	*key = p;
+	for (; (*p != ':') && (*p != '\0') && !FILTER_IS_SPACE(*p); p++);
+	if (*p != ':')
+		return -1;
+	*klen = (size_t)(p - *key);
+	p++;
+
+	/* Get the value, which may be quoted to hold spaces. */
+	if (*p == '"') {
+		start = ++p;
+		for (; (*p != '"') && (*p != '\0'); p++);
+		if (*p != '"')
+			return -1;
+		string_copy_untilp(value, start, p);
+		p++;
+	} else if (*p == '/') {
+		/* Regular expressions may hold spaces too, up to the closing slash,
+		 * and keep their slashes. */
+		start = p++;
+		for (; (*p != '/') && (*p != '\0'); p++) {
+			if ((*p == '\\') && (p[1] != '\0'))
+				p++;
+		}
+		if ((*p != '/') || ((p[1] != '\0') && !FILTER_IS_SPACE(p[1])))
+			return -1;
+		p++;
+		string_copy_untilp(value, start, p);
+	} else {
+		start = p;
+		for (; (*p != '\0') && !FILTER_IS_SPACE(*p); p++);
+		string_copy_untilp(value, start, p);
+	}
+	*cur = p;
+
+	return (**value == '\0') ? -1 : 1;
+}
+
+/**
+ * Compiles a filter expression.
+ * @warning The object allocated by this function must be free'd after use.
+ *
+ * @param expr  Filter expression.
+ * @param icase Should titles be matched ignoring ASCII case?
+ *
+ * @return Compiled filter or NULL in case of an error. Check errno, which will
+ *         be EINVAL if the expression is malformed.
+ *
+ * @see filter_free
+ */
+filter_t* filter_new(const char *expr, bool icase) {
+	filter_t *filter;
+	const char *cur;
+	const char *key;
+	char *value;
+	size_t klen;
+	bool ok;
+	int ret;
+
+	/* Allocate our object. */
+	filter = (filter_t *)calloc(1, sizeof(filter_t));
+	if (filter == NULL)
+		return NULL;
+	filter->from = INT32_MIN;
+	filter->to = INT32_MAX;
+	filter->max_size = UINT64_MAX;
+	filter->icase = icase;
+
+	/* Compile every condition. */
+	cur = expr;
+	value = NULL;
+	while ((ret = filter_next(&cur, &key, &klen, &value)) > 0) {
+		if ((klen == 4) && (strncmp(key, "date", 4) == 0)) {
+			ok = filter_compile_date(filter, value);
+		} else if ((klen == 6) && (strncmp(key, "format", 6) == 0)) {
+			ok = filter_compile_format(filter, value);
+		} else if ((klen == 5) && (strncmp(key, "title", 5) == 0)) {
+			ok = filter_compile_title(filter, value);
+		} else if ((klen == 4) && (strncmp(key, "size", 4) == 0)) {
+			ok = filter_compile_size(filter, value);
+		} else {
+			ok = false;
+		}
+
+		if (!ok) {
+			ret = -1;
+			break;
+		}
+	}
+	if (value)
+		free(value);
+	if (ret < 0) {
+		filter_free(filter);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return filter;
+}
+
+/**
+ * Frees up a compiled filter.
+ *
+ * @param filter Filter object to be free'd.
+ */
+void filter_free(filter_t *filter) {
+	size_t i;
+
+	/* Do we even have anything to do? */
+	if (filter == NULL)
+		return;
+
+	for (i = 0; i < filter->nformats; i++)
+		free(filter->formats[i]);
+	if (filter->formats)
+		free(filter->formats);
+	if (filter->glob)
+		free(filter->glob);
+	if (filter->has_regex)
+		regfree(&filter->regex);
+	free(filter);
+}
+
+/**
+ * Checks if a note's file name passes every condition that can be checked
+ * without touching the file system. Names that aren't of notes never do.
+ *
+ * @param filter Filter object.
+ * @param name   File name of the note. (Not a path)
+ *
+ * @return TRUE if the name passes the filter.
+ */
+bool filter_match_name(const filter_t *filter, const char *name) {
+	note_fname_t parsed;
+
+	if (!note_parse_fname(name, &parsed))
+		return false;
+
+	return filter_match_fields(filter, parsed.days, parsed.title,
+							   parsed.title_len, parsed.format);
+}
+
+/**
+ * Checks if the information parsed out of a note's file name passes every
+ * condition that can be checked without touching the file system.
+ *
+ * @param filter    Filter object.
+ * @param days      Date of the note as a number of days since 1970-01-01.
+ * @param title     Title of the note. (Doesn't need to be NULL terminated)
+ * @param title_len Length of the title.
+ * @param format    Format of the note.
+ *
+ * @return TRUE if the note passes the filter.
+ */
+bool filter_match_fields(const filter_t *filter, int32_t days,
+						 const char *title, size_t title_len,
+						 const char *format) {
+	char buf[FILTER_TITLE_MAX];
+	size_t i;
+
+	/* Dates are the cheapest thing to check. */
+	if ((days < filter->from) || (days > filter->to))
+		return false;
+
+	/* Formats. */
+	if (filter->nformats > 0) {
+		for (i = 0; i < filter->nformats; i++) {
+			if (strcasecmp(format, filter->formats[i]) == 0)
+				break;
+		}
+		if (i == filter->nformats)
+			return false;
+	}
+
+	/* Titles. */
+	if ((filter->glob != NULL) &&
+			!filter_glob(filter->glob, title, title + title_len,
+						 filter->icase)) {
+		return false;
+	}
+	if (filter->has_regex) {
+		if (title_len >= FILTER_TITLE_MAX)
+			return false;
+		memcpy(buf, title, title_len);
+		buf[title_len] = '\0';
+		if (regexec(&filter->regex, buf, 0, NULL, 0) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Checks if a note's size is within the bounds of the filter.
+ *
+ * @param filter Filter object.
+ * @param size   Size of the note in bytes.
+ *
+ * @return TRUE if the size passes the filter.
+ */
+bool filter_match_size(const filter_t *filter, uint64_t size) {
+	return (size >= filter->min_size) && (size <= filter->max_size);
+}
+
+/**
+ * Checks if a file inside a directory passes the filter. Its name is checked
+ * first, and it's only stat'ed if it passed and the filter has size bounds.
+ *
+ * @param filter Filter object.
+ * @param dirfd  Directory the file is in.
+ * @param name   Name of the file.
+ *
+ * @return TRUE if the file passes the filter.
+ */
+bool filter_match_at(const filter_t *filter, int dirfd, const char *name) {
+	struct stat st;
+
+	if (!filter_match_name(filter, name))
+		return false;
+	if (!filter_needs_stat(filter))
+		return true;
+
+	STATS_INC(STATS_SYS_STAT);
+	if (fstatat(dirfd, name, &st, 0) != 0)
+		return false;
+
+	return filter_match_size(filter, (uint64_t)st.st_size);
+}
+
+/**
+ * Checks if the filter has conditions that can't be checked from the file name
+ * alone.
+ *
+ * @param filter Filter object.
+ *
+ * @return TRUE if files must be stat'ed to be checked.
+ */
+bool filter_needs_stat(const filter_t *filter) {
+	return (filter->min_size > 0) || (filter->max_size != UINT64_MAX);
+}
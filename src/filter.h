@@ -0,0 +1,56 @@
+/**
+ * filter.h
+ * Compiled predicates that pick notes straight from their file names.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _FILTER_H
+#define _FILTER_H
+
+#include <regex.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Compiled filter expression. Every condition that was given must hold.
+ */
+typedef struct {
+	int32_t from;
+	int32_t to;
+
+	char **formats;
+	size_t nformats;
+
+	char *glob;
+	regex_t regex;
+	bool has_regex;
+	bool icase;
+
+	uint64_t min_size;
+	uint64_t max_size;
+} filter_t;
+
+/* Construction and destruction. */
+filter_t* filter_new(const char *expr, bool icase);
+void filter_free(filter_t *filter);
+
+/* Matching. */
+bool filter_match_name(const filter_t *filter, const char *name);
+bool filter_match_fields(const filter_t *filter, int32_t days,
+						 const char *title, size_t title_len,
+						 const char *format);
+bool filter_match_size(const filter_t *filter, uint64_t size);
+bool filter_match_at(const filter_t *filter, int dirfd, const char *name);
+bool filter_needs_stat(const filter_t *filter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _FILTER_H */
@@ -8,14 +8,34 @@
 #include "fsutils.h"
 
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#ifdef __linux__
+	#include <sys/syscall.h>
+#endif /* __linux__ */
 
+#include "stats.h"
 #include "strutils.h"
 
+#ifdef __linux__
+/**
+ * Raw directory entry as returned by the getdents64 system call.
+ */
+struct linux_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[1];
+};
+#endif /* __linux__ */
+
 /**
  * Appends a path to an existing path.
  *
@@ -45,6 +65,7 @@ size_t fs_pathcat(char **path, const char *append) {
 
 	/* Allocate enough space for us append the path and set our cursor. */
 	*path = (char *)realloc(*path, (len + len_buf + 1) * sizeof(char));
+	STATS_INC(STATS_ALLOCS);
 	cur = *path + len;
 	len_buf = 0;
 
@@ -82,6 +103,24 @@ bool fs_exists(const char *fname) {
 	return access(fname, F_OK) == 0;
 }
 
+/**
+ * Gets the modification time of a file with the best precision available.
+ *
+ * @param st File information as returned by stat.
+ *
+ * @return Modification time in nanoseconds since the epoch.
+ */
+int64_t fs_stat_mtime(const struct stat *st) {
+#if defined(__APPLE__)
+	return ((int64_t)st->st_mtimespec.tv_sec * 1000000000) +
+		st->st_mtimespec.tv_nsec;
+#elif defined(__linux__)
+	return ((int64_t)st->st_mtim.tv_sec * 1000000000) + st->st_mtim.tv_nsec;
+#else
+	return (int64_t)st->st_mtime * 1000000000;
+#endif /* __APPLE__ */
+}
+
 /**
  * A safer version of basename that does not modify the path argument and will
  * always return a pointer inside the original path.
@@ -102,6 +141,36 @@ const char* fs_basename(const char *path) {
 	return basename;
 }
 
+/**
+ * Gets the path of a file relative to a directory it's inside of, as a pointer
+ * inside the original path.
+ *
+ * @param path     Path to the file.
+ * @param basepath Path to the directory, as it appears at the start of the
+ *                 file's path.
+ *
+ * @return Pointer inside the path past the directory or to the file name if the
+ *         file isn't inside of it.
+ */
+const char* fs_relpath(const char *path, const char *basepath) {
+	size_t blen;
+
+	/* Make sure the file is actually inside the directory. */
+	blen = strlen(basepath);
+	if ((strncmp(path, basepath, blen) != 0) ||
+			((path[blen] != PATH_SEP) && (blen > 0) &&
+			 (basepath[blen - 1] != PATH_SEP))) {
+		return fs_basename(path);
+	}
+
+	/* Skip over the directory. */
+	path += blen;
+	while (*path == PATH_SEP)
+		path++;
+
+	return path;
+}
+
 /**
  * Gets the extension of a filename as a pointer inside the original path. Does
  * not include the separating dot.
@@ -131,6 +200,7 @@ const char* fs_extname(const char *fname) {
  * @return Directory handle or NULL in case of an error.
  */
 DIRHANDLE fs_opendir(const char* path) {
+	STATS_INC(STATS_SYS_OPEN);
 	return opendir(path);
 }
 
@@ -145,6 +215,8 @@ DIRHANDLE fs_opendir(const char* path) {
  *
  * @return Path to a regular file name in the directory or NULL if no more items
  *         are available. (This is allocated internally and must be free'd)
+ *
+ * @see fs_dirscan_next
  */
 char* fs_readdir(DIRHANDLE hnd, const char *basepath) {
 	const struct dirent* de;
@@ -153,29 +225,294 @@ char* fs_readdir(DIRHANDLE hnd, const char *basepath) {
 
 	/* Try to get the first regular file in the directory. */
 	fname = NULL;
+	STATS_BEGIN(STATS_PHASE_SCAN);
 	while ((de = readdir(hnd)) != NULL) {
+		STATS_INC(STATS_DIRENTS);
+
 		/* Ignore dotfiles. */
 		if (de->d_name[0] == '.')
 			continue;
 
+		/* Only ask the filesystem when the entry doesn't tell us its type. */
+		if ((de->d_type == DT_UNKNOWN) || (de->d_type == DT_LNK)) {
+			STATS_INC(STATS_SYS_STAT);
+			if (fstatat(dirfd(hnd), de->d_name, &st, 0) != 0)
+				continue;
+			if (!S_ISREG(st.st_mode))
+				continue;
+		} else if (de->d_type != DT_REG) {
+			continue;
+		}
+
 		/* Construct a proper path to the file. */
 		string_copy(&fname, basepath);
 		fs_pathcat(&fname, de->d_name);
+		STATS_INC(STATS_ALLOCS);
+		STATS_END(STATS_PHASE_SCAN);
 
-		/* Get some data on the item. */
-		stat(fname, &st);
-
-		/* Check if we are dealing with a regular file. */
-		if (S_ISREG(st.st_mode))
-			return fname;
+		return fname;
 	}
 
 	/* Looks like we've reached the end of the file listing. */
-	if (fname)
-		free(fname);
+	STATS_END(STATS_PHASE_SCAN);
 	return NULL;
 }
 
+/**
+ * Opens a batched directory scanner. Instead of allocating a path and issuing a
+ * stat for every entry, the scanner trusts the type reported by the directory
+ * itself and returns entries in chunks from a reusable buffer.
+ *
+ * @warning The scanner must be closed with fs_dirscan_close after use.
+ *
+ * @param scan  Scanner object to be initialized.
+ * @param path  Path to the directory.
+ * @param flags Types of entries to report. (FS_SCAN_FILES and/or FS_SCAN_DIRS)
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ *
+ * @see fs_dirscan_next
+ * @see fs_dirscan_close
+ */
+bool fs_dirscan_open(fs_dirscan_t *scan, const char *path, int flags) {
+	return fs_dirscan_openat(scan, AT_FDCWD, path, flags);
+}
+
+/**
+ * Opens a directory relative to another one for scanning. This avoids having
+ * the kernel walk the whole path again for every directory of a deep tree.
+ * @warning The scanner must be closed with fs_dirscan_close after use.
+ *
+ * @param scan  Scanner object to be initialized.
+ * @param dirfd Descriptor of the parent directory or AT_FDCWD.
+ * @param path  Path to the directory relative to the parent.
+ * @param flags Types of entries to report. (FS_SCAN_FILES and/or FS_SCAN_DIRS)
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ *
+ * @see fs_dirscan_open
+ * @see fs_dirscan_close
+ */
+bool fs_dirscan_openat(fs_dirscan_t *scan, int dirfd, const char *path,
+					   int flags) {
+	/* Set things up. */
+	scan->flags = flags;
+	scan->dir = NULL;
+	scan->buf = NULL;
+	scan->entries = NULL;
+	scan->buf_len = 0;
+	scan->buf_pos = 0;
+	scan->eof = false;
+	scan->err = 0;
+	scan->cap = FS_DIRSCAN_BUFSIZE / 16;
+
+	/* Open the directory. */
+	STATS_INC(STATS_SYS_OPEN);
+	scan->fd = openat(dirfd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (scan->fd < 0)
+		return false;
+
+	/* Allocate the reusable buffers. */
+	scan->buf = (char *)malloc(FS_DIRSCAN_BUFSIZE * sizeof(char));
+	scan->entries = (fs_dirent_t *)malloc(scan->cap * sizeof(fs_dirent_t));
+	STATS_ADD(STATS_ALLOCS, 2);
+	if ((scan->buf == NULL) || (scan->entries == NULL)) {
+		fs_dirscan_close(scan);
+		return false;
+	}
+
+#ifndef __linux__
+	/* Use the standard directory stream on other platforms. */
+	scan->dir = fdopendir(scan->fd);
+	if (scan->dir == NULL) {
+		fs_dirscan_close(scan);
+		return false;
+	}
+#endif /* !__linux__ */
+
+	return true;
+}
+
+/**
+ * Gets the descriptor of the directory being scanned. Useful for opening its
+ * entries with the *at family of functions.
+ *
+ * @param scan Directory scanner.
+ *
+ * @return Descriptor of the directory. Owned by the scanner.
+ */
+int fs_dirscan_fd(const fs_dirscan_t *scan) {
+	return scan->fd;
+}
+
+/**
+ * Checks if a directory entry should be reported by the scanner.
+ *
+ * @param scan   Directory scanner.
+ * @param name   Name of the entry.
+ * @param type   Type of the entry as reported by the directory (DT_*).
+ * @param is_dir Set to TRUE if the entry is a directory.
+ *
+ * @return Should this entry be reported?
+ */
+static bool fs_dirscan_accept(fs_dirscan_t *scan, const char *name,
+							  unsigned char type, bool *is_dir) {
+	struct stat st;
+
+	/* Ignore dotfiles. */
+	if (name[0] == '.')
+		return false;
+
+	/* Only ask the filesystem when the entry doesn't tell us its type. */
+	if ((type == DT_UNKNOWN) || (type == DT_LNK)) {
+		STATS_INC(STATS_SYS_STAT);
+		if (fstatat(scan->fd, name, &st, 0) != 0)
+			return false;
+
+		if (S_ISREG(st.st_mode)) {
+			type = DT_REG;
+		} else if (S_ISDIR(st.st_mode)) {
+			type = DT_DIR;
+		} else {
+			return false;
+		}
+	}
+
+	/* Check if this is something that we are interested in. */
+	*is_dir = type == DT_DIR;
+	if (type == DT_REG)
+		return (scan->flags & FS_SCAN_FILES) != 0;
+	if (type == DT_DIR)
+		return (scan->flags & FS_SCAN_DIRS) != 0;
+
+	return false;
+}
+
+/**
+ * Gets the next chunk of entries from a directory.
+ *
+ * @warning The returned entries are only valid until the next call to this
+ *          function or until the scanner is closed.
+ *
+ * @param scan    Directory scanner.
+ * @param entries Pointer that will hold the chunk of entries.
+ *
+ * @return Number of entries in the chunk or 0 if we've reached the end of the
+ *         directory or an error occurred. Check fs_dirscan_error to tell them
+ *         apart.
+ *
+ * @see fs_dirscan_error
+ */
+size_t fs_dirscan_next(fs_dirscan_t *scan, const fs_dirent_t **entries) {
+	size_t count;
+	bool is_dir;
+#ifdef __linux__
+	const struct linux_dirent64 *de;
+	long n;
+#else
+	const struct dirent *de;
+	size_t len;
+#endif /* __linux__ */
+
+	*entries = scan->entries;
+	count = 0;
+
+	STATS_BEGIN(STATS_PHASE_SCAN);
+	while ((count == 0) && !scan->eof) {
+#ifdef __linux__
+		/* Get a whole batch of entries in a single system call. */
+		STATS_INC(STATS_SYS_GETDENTS);
+		n = syscall(SYS_getdents64, scan->fd, scan->buf, FS_DIRSCAN_BUFSIZE);
+		if (n <= 0) {
+			if (n < 0)
+				scan->err = errno;
+			scan->eof = true;
+			break;
+		}
+
+		/* Go through the batch picking the entries we are interested in. */
+		scan->buf_len = (size_t)n;
+		for (scan->buf_pos = 0; scan->buf_pos < scan->buf_len;
+			 scan->buf_pos += de->d_reclen) {
+			de = (const struct linux_dirent64 *)(scan->buf + scan->buf_pos);
+			STATS_INC(STATS_DIRENTS);
+			if (!fs_dirscan_accept(scan, de->d_name, de->d_type, &is_dir))
+				continue;
+
+			scan->entries[count].name = de->d_name;
+			scan->entries[count].is_dir = is_dir;
+			count++;
+		}
+#else
+		/* Copy entries into our buffer while there's room for another one. */
+		scan->buf_pos = 0;
+		while ((count < scan->cap) &&
+			   ((FS_DIRSCAN_BUFSIZE - scan->buf_pos) > 256)) {
+			errno = 0;
+			de = readdir(scan->dir);
+			if (de == NULL) {
+				scan->err = errno;
+				scan->eof = true;
+				break;
+			}
+			STATS_INC(STATS_DIRENTS);
+			if (!fs_dirscan_accept(scan, de->d_name, de->d_type, &is_dir))
+				continue;
+
+			len = strlen(de->d_name) + 1;
+			memcpy(scan->buf + scan->buf_pos, de->d_name, len);
+			scan->entries[count].name = scan->buf + scan->buf_pos;
+			scan->entries[count].is_dir = is_dir;
+			scan->buf_pos += len;
+			count++;
+		}
+#endif /* __linux__ */
+	}
+	STATS_END(STATS_PHASE_SCAN);
+
+	return count;
+}
+
+/**
+ * Gets the error that stopped a directory scanner before it got to the end of
+ * the directory.
+ *
+ * @param scan Directory scanner.
+ *
+ * @return 0 if the whole directory was read, otherwise an errno value.
+ */
+int fs_dirscan_error(const fs_dirscan_t *scan) {
+	return scan->err;
+}
+
+/**
+ * Closes a directory scanner and frees up its resources.
+ *
+ * @param scan Directory scanner.
+ */
+void fs_dirscan_close(fs_dirscan_t *scan) {
+	/* Close the directory. */
+	if (scan->dir != NULL) {
+		STATS_INC(STATS_SYS_CLOSE);
+		closedir(scan->dir);
+	} else if (scan->fd >= 0) {
+		STATS_INC(STATS_SYS_CLOSE);
+		close(scan->fd);
+	}
+	scan->dir = NULL;
+	scan->fd = -1;
+
+	/* Free the buffers. */
+	if (scan->buf)
+		free(scan->buf);
+	if (scan->entries)
+		free(scan->entries);
+	scan->buf = NULL;
+	scan->entries = NULL;
+}
+
 /**
  * Closes an open directory handle.
  *
@@ -185,28 +522,61 @@ char* fs_readdir(DIRHANDLE hnd, const char *basepath) {
  *         -1 on error.
  */
 int fs_closedir(DIRHANDLE hnd) {
+	STATS_INC(STATS_SYS_CLOSE);
 	return closedir(hnd);
 }
 
+/**
+ * Reads a whole block from a file descriptor starting at the beginning of the
+ * file, without touching its current cursor position.
+ *
+ * @param fd  File descriptor to read from.
+ * @param buf Buffer that will hold the contents. Must be at least len long.
+ * @param len Number of bytes to read.
+ *
+ * @return Number of bytes actually read or -1 in case of an error.
+ */
+static ssize_t fs_fdread(int fd, char *buf, size_t len) {
+	size_t total;
+	ssize_t n;
+
+	/* Keep reading until we get everything or hit the end of the file. */
+	total = 0;
+	while (total < len) {
+		STATS_INC(STATS_SYS_READ);
+		n = pread(fd, buf + total, len - total, (off_t)total);
+		if (n < 0)
+			return -1;
+		if (n == 0)
+			break;
+
+		total += n;
+		STATS_ADD(STATS_BYTES_READ, n);
+	}
+
+	return (ssize_t)total;
+}
+
 /**
  * Gets a file's content size in bytes.
- * @warning This function will reset the file handle cursor to the beginning.
  *
  * @param fh Opened file handle.
  *
  * @return File contents size in bytes.
  */
 size_t fs_fsize(FILE *fh) {
-	size_t len;
-
-	/* Get the length of the file. */
-	fseek(fh, 0L, SEEK_END);
-	len = ftell(fh);
+	struct stat st;
 
-	/* Ensure we come back to the beginning of the file. */
-	fseek(fh, 0L, SEEK_SET);
+	/* Ask the filesystem directly instead of seeking around. */
+	STATS_BEGIN(STATS_PHASE_STAT);
+	STATS_INC(STATS_SYS_STAT);
+	if (fstat(fileno(fh), &st) != 0) {
+		STATS_END(STATS_PHASE_STAT);
+		return 0;
+	}
+	STATS_END(STATS_PHASE_STAT);
 
-	return len;
+	return (size_t)st.st_size;
 }
 
 /**
@@ -222,9 +592,8 @@ size_t fs_fsize(FILE *fh) {
  */
 char* fs_fslurp(FILE *fh) {
 	char *contents;
-	char *buf;
 	size_t len;
-	int c;
+	ssize_t n;
 
 	/* Get the file size. */
 	len = fs_fsize(fh);
@@ -235,16 +604,149 @@ char* fs_fslurp(FILE *fh) {
 	contents = (char *)malloc((len + 1) * sizeof(char));
 	if (contents == NULL)
 		return NULL;
-
-	/* Read entire file into the string. */
-	buf = contents;
-	while ((c = fgetc(fh)) != EOF) {
-		*buf = (char)c;
-		buf++;
+	STATS_INC(STATS_ALLOCS);
+
+	/* Read entire file into the string in one go. */
+	STATS_BEGIN(STATS_PHASE_READ);
+	n = fs_fdread(fileno(fh), contents, len);
+	STATS_END(STATS_PHASE_READ);
+	if (n < 0) {
+		free(contents);
+		return NULL;
 	}
 
 	/* Ensure string is properly terminated. */
-	*buf = '\0';
+	contents[n] = '\0';
 
 	return contents;
 }
+
+/**
+ * Gets a read-only view over the entire contents of a file without copying it
+ * around. Big files get memory mapped, while small ones are read in a single
+ * call, since mapping them would cost more than reading.
+ *
+ * @warning The view must be released with fs_fview_release after use. Its data
+ *          isn't guaranteed to be NULL terminated.
+ *
+ * @param fh   Opened file handle.
+ * @param view View object to be populated.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ *
+ * @see fs_fdview
+ * @see fs_fview_release
+ */
+bool fs_fview(FILE *fh, fs_view_t *view) {
+	return fs_fdview(fileno(fh), view);
+}
+
+/**
+ * Gets a read-only view over the entire contents of a file straight from its
+ * file descriptor. The descriptor may be closed as soon as this returns.
+ *
+ * @warning The view must be released with fs_fview_release after use. Its data
+ *          isn't guaranteed to be NULL terminated.
+ *
+ * @param fd   Opened file descriptor.
+ * @param view View object to be populated.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ *
+ * @see fs_fview
+ * @see fs_fview_release
+ */
+bool fs_fdview(int fd, fs_view_t *view) {
+	struct stat st;
+	char *buf;
+	ssize_t n;
+	void *map;
+
+	/* Set up an empty view. */
+	view->data = "";
+	view->len = 0;
+	view->mapped = false;
+	view->borrowed = false;
+
+	/* Get the file size. */
+	STATS_BEGIN(STATS_PHASE_STAT);
+	STATS_INC(STATS_SYS_STAT);
+	if (fstat(fd, &st) != 0) {
+		STATS_END(STATS_PHASE_STAT);
+		return false;
+	}
+	STATS_END(STATS_PHASE_STAT);
+	view->len = (size_t)st.st_size;
+	if (view->len == 0)
+		return true;
+
+	/* Map big files straight into our address space. */
+	if (view->len >= FS_VIEW_MMAP_THRESHOLD) {
+		STATS_INC(STATS_SYS_MMAP);
+		map = mmap(NULL, view->len, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED) {
+			STATS_ADD(STATS_BYTES_MAPPED, view->len);
+			posix_madvise(map, view->len, POSIX_MADV_SEQUENTIAL);
+
+			view->data = (const char *)map;
+			view->mapped = true;
+
+			return true;
+		}
+	}
+
+	/* Read small files (or ones we couldn't map) in one go. */
+	buf = (char *)malloc((view->len + 1) * sizeof(char));
+	if (buf == NULL) {
+		view->len = 0;
+		return false;
+	}
+	STATS_INC(STATS_ALLOCS);
+	STATS_BEGIN(STATS_PHASE_READ);
+	n = fs_fdread(fd, buf, view->len);
+	STATS_END(STATS_PHASE_READ);
+	if (n <= 0) {
+		free(buf);
+		view->len = 0;
+		return n == 0;
+	}
+
+	/* Ensure the buffer is properly terminated as a courtesy. */
+	buf[n] = '\0';
+	view->data = buf;
+	view->len = (size_t)n;
+
+	return true;
+}
+
+/**
+ * Releases the resources held by a file contents view. Borrowed views, which
+ * point into memory owned by someone else, are simply reset.
+ *
+ * @param view View to be released.
+ *
+ * @see fs_fview
+ */
+void fs_fview_release(fs_view_t *view) {
+	/* Do we even have anything to do? */
+	if ((view->len == 0) || view->borrowed) {
+		view->data = "";
+		view->len = 0;
+		view->borrowed = false;
+		return;
+	}
+
+	/* Release the backing memory. */
+	if (view->mapped) {
+		munmap((void *)view->data, view->len);
+	} else {
+		free((void *)view->data);
+	}
+
+	/* Reset the view. */
+	view->data = "";
+	view->len = 0;
+	view->mapped = false;
+}
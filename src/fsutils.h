@@ -13,6 +13,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <dirent.h>
+#include <sys/stat.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -28,20 +29,88 @@ extern "C" {
 /* Platform-agnostic directory handle. */
 typedef DIR* DIRHANDLE;
 
+/* Files smaller than this are read in a single call instead of mapped. */
+#ifndef FS_VIEW_MMAP_THRESHOLD
+	#define FS_VIEW_MMAP_THRESHOLD (64 * 1024)
+#endif /* FS_VIEW_MMAP_THRESHOLD */
+
+/* Size of the buffer used by the batched directory scanner. */
+#ifndef FS_DIRSCAN_BUFSIZE
+	#define FS_DIRSCAN_BUFSIZE (32 * 1024)
+#endif /* FS_DIRSCAN_BUFSIZE */
+
+/* Types of entries that the directory scanner should report. */
+#define FS_SCAN_FILES 0x01
+#define FS_SCAN_DIRS  0x02
+
+/**
+ * Directory entry returned by the batched directory scanner.
+ *
+ * @warning The name points inside the scanner's buffer and is only valid until
+ *          the next chunk is requested.
+ */
+typedef struct {
+	const char *name;
+	bool is_dir;
+} fs_dirent_t;
+
+/**
+ * Batched directory scanner that reuses its buffers between chunks.
+ */
+typedef struct {
+	int fd;
+	int flags;
+	DIR *dir;
+
+	char *buf;
+	size_t buf_len;
+	size_t buf_pos;
+	bool eof;
+	int err;
+
+	fs_dirent_t *entries;
+	size_t cap;
+} fs_dirscan_t;
+
+/**
+ * Borrowed read-only view over the contents of a file.
+ *
+ * @warning The data isn't guaranteed to be NULL terminated, always use len.
+ */
+typedef struct {
+	const char *data;
+	size_t len;
+
+	bool mapped;
+	bool borrowed;
+} fs_view_t;
+
 /* Directory operations. */
 DIRHANDLE fs_opendir(const char* path);
 char* fs_readdir(DIRHANDLE hnd, const char* basepath);
 int fs_closedir(DIRHANDLE hnd);
+bool fs_dirscan_open(fs_dirscan_t *scan, const char *path, int flags);
+bool fs_dirscan_openat(fs_dirscan_t *scan, int dirfd, const char *path,
+					   int flags);
+int fs_dirscan_fd(const fs_dirscan_t *scan);
+size_t fs_dirscan_next(fs_dirscan_t *scan, const fs_dirent_t **entries);
+int fs_dirscan_error(const fs_dirscan_t *scan);
+void fs_dirscan_close(fs_dirscan_t *scan);
 
 /* File path operations. */
 bool fs_exists(const char *fname);
+int64_t fs_stat_mtime(const struct stat *st);
 size_t fs_pathcat(char **path, const char *append);
 const char* fs_basename(const char *path);
+const char* fs_relpath(const char *path, const char *basepath);
 const char* fs_extname(const char *fname);
 
 /* File contents operations. */
 size_t fs_fsize(FILE *fh);
 char* fs_fslurp(FILE *fh);
+bool fs_fview(FILE *fh, fs_view_t *view);
+bool fs_fdview(int fd, fs_view_t *view);
+void fs_fview_release(fs_view_t *view);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,1474 @@
+/**
+ * ftindex.c
+ * Full-text inverted index over the contents of the notes in a workspace.
+ *
+ * Every note is a document identified by its path relative to the workspace.
+ * Whenever a note changes its old document is marked as dead and a new one is
+ * appended, so posting lists only ever grow at the end and document IDs stay
+ * sorted, which is what allows them to be stored as varint encoded deltas. Dead
+ * documents are compacted away once they outnumber the live ones.
+ *
+ * Tags found by the Markdown extractor are indexed as terms of their own, with
+ * a leading # that the tokenizer never produces, so they share the documents
+ * and posting lists with everything else without ever showing up in searches.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "ftindex.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fsutils.h"
+#include "markdown.h"
+#include "strutils.h"
+
+/* Size of the fixed parts of the index file. */
+#define FTINDEX_HEADER_SIZE 16
+
+/* Minimum number of documents before we bother compacting the index. */
+#define FTINDEX_COMPACT_MIN 64
+
+/**
+ * Growable byte buffer used to serialize the index.
+ */
+typedef struct {
+	uint8_t *data;
+	size_t len;
+	size_t cap;
+} ftindex_buf_t;
+
+/**
+ * State of a document being indexed.
+ */
+typedef struct {
+	ftindex_t *idx;
+	uint32_t id;
+
+	uint32_t *touched;
+	size_t ntouched;
+	size_t cap;
+	bool failed;
+} ftindex_indexing_t;
+
+/**
+ * Ensures a byte buffer has room for a number of extra bytes.
+ *
+ * @param buf Byte buffer.
+ * @param len Number of extra bytes needed.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+static bool ftindex_buf_reserve(ftindex_buf_t *buf, size_t len) {
+	uint8_t *data;
+	size_t cap;
+
+	/* Do we even have to do anything? */
+	if ((buf->len + len) <= buf->cap)
+		return true;
+
+	/* Grow geometrically. */
+	cap = (buf->cap == 0) ? 16 : buf->cap * 2;
+	while (cap < (buf->len + len))
+		cap *= 2;
+	data = (uint8_t *)realloc(buf->data, cap);
+	if (data == NULL)
+		return false;
+	buf->data = data;
+	buf->cap = cap;
+
+	return true;
+}
+
+/**
+ * Appends raw bytes to a byte buffer.
+ *
+ * @param buf  Byte buffer.
+ * @param data Bytes to be appended.
+ * @param len  Number of bytes to append.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+static bool ftindex_buf_put(ftindex_buf_t *buf, const void *data, size_t len) {
+	if (!ftindex_buf_reserve(buf, len))
+		return false;
+
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+
+	return true;
+}
+
+/**
+ * Appends a varint encoded number to a byte buffer.
+ *
+ * @param data Buffer data pointer. (Will be reallocated if needed)
+ * @param len  Length of the buffer.
+ * @param cap  Capacity of the buffer.
+ * @param n    Number to be encoded.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+static bool ftindex_varint_put(uint8_t **data, size_t *len, size_t *cap,
+							   uint32_t n) {
+	ftindex_buf_t buf;
+	bool ret;
+
+	buf.data = *data;
+	buf.len = *len;
+	buf.cap = *cap;
+
+	/* Encode 7 bits at a time, with the high bit flagging a continuation. */
+	ret = ftindex_buf_reserve(&buf, 5);
+	if (ret) {
+		while (n >= 0x80) {
+			buf.data[buf.len++] = (uint8_t)(n | 0x80);
+			n >>= 7;
+		}
+		buf.data[buf.len++] = (uint8_t)n;
+	}
+
+	*data = buf.data;
+	*len = buf.len;
+	*cap = buf.cap;
+
+	return ret;
+}
+
+/**
+ * Decodes a varint encoded number.
+ *
+ * @param cur Cursor inside the buffer. Will be moved past the number.
+ * @param end End of the buffer.
+ * @param n   Decoded number.
+ *
+ * @return TRUE if the number was decoded.
+ *         FALSE if the buffer ended prematurely.
+ */
+static bool ftindex_varint_get(const uint8_t **cur, const uint8_t *end,
+							   uint32_t *n) {
+	unsigned int shift;
+
+	*n = 0;
+	for (shift = 0; (*cur < end) && (shift < 35); shift += 7) {
+		*n |= (uint32_t)(**cur & 0x7F) << shift;
+		if ((*((*cur)++) & 0x80) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * Gets the next token from a piece of text. Tokens are runs of ASCII letters
+ * and digits or any non-ASCII bytes (so that UTF-8 words stay together),
+ * lowercased and truncated to FTINDEX_TERM_MAX bytes.
+ *
+ * @param cur  Cursor inside the text. Will be moved past the token.
+ * @param end  End of the text.
+ * @param term Buffer of at least FTINDEX_TERM_MAX + 1 bytes that will hold the
+ *             NULL terminated token.
+ *
+ * @return Length of the token or 0 if we've reached the end of the text.
+ */
+size_t ftindex_next_token(const char **cur, const char *end, char *term) {
+	const char *buf;
+	size_t len;
+	unsigned char c;
+
+	/* Skip everything that isn't part of a word. */
+	buf = *cur;
+	while (buf < end) {
+		c = (unsigned char)*buf;
+		if (((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) ||
+				((c >= '0') && (c <= '9')) || (c >= 0x80)) {
+			break;
+		}
+		buf++;
+	}
+
+	/* Copy the word over. */
+	len = 0;
+	while (buf < end) {
+		c = (unsigned char)*buf;
+		if ((c >= 'A') && (c <= 'Z')) {
+			c += 'a' - 'A';
+		} else if (!(((c >= 'a') && (c <= 'z')) || ((c >= '0') && (c <= '9')) ||
+					 (c >= 0x80))) {
+			break;
+		}
+
+		if (len < FTINDEX_TERM_MAX)
+			term[len++] = (char)c;
+		buf++;
+	}
+	term[len] = '\0';
+
+	*cur = buf;
+	return len;
+}
+
+/**
+ * Turns a tag into the term it's indexed as: lowercased, prefixed with a # and
+ * truncated to the longest term that will be indexed.
+ *
+ * @param tag  Tag, with or without its leading #.
+ * @param len  Length of the tag.
+ * @param term Buffer that's at least FTINDEX_TERM_MAX + 1 long which will
+ *             hold the NULL terminated term.
+ *
+ * @return Length of the term.
+ */
+static size_t ftindex_tag_term(const char *tag, size_t len, char *term) {
+	size_t tlen;
+	char c;
+
+	if ((len > 0) && (*tag == '#')) {
+		tag++;
+		len--;
+	}
+
+	term[0] = '#';
+	for (tlen = 1; (tlen < FTINDEX_TERM_MAX) && (len > 0); tlen++, len--) {
+		c = *tag++;
+		term[tlen] = ((c >= 'A') && (c <= 'Z')) ? (char)(c + 'a' - 'A') : c;
+	}
+	term[tlen] = '\0';
+
+	return tlen;
+}
+
+/**
+ * Allocates a brand new empty full-text index.
+ * @warning The object allocated by this function must be free'd after use.
+ *
+ * @return Brand new full-text index or NULL in case of an error.
+ *
+ * @see ftindex_free
+ */
+ftindex_t* ftindex_new(void) {
+	ftindex_t *idx;
+
+	idx = (ftindex_t *)calloc(1, sizeof(ftindex_t));
+	return idx;
+}
+
+/**
+ * Frees up any resources allocated by a full-text index.
+ *
+ * @param idx Full-text index to be free'd.
+ */
+void ftindex_free(ftindex_t *idx) {
+	size_t i;
+
+	/* Do we even have anything to do? */
+	if (idx == NULL)
+		return;
+
+	/* Free the terms. */
+	for (i = 0; i < idx->nterms; i++) {
+		free(idx->terms[i].term);
+		if (idx->terms[i].data)
+			free(idx->terms[i].data);
+	}
+	if (idx->terms)
+		free(idx->terms);
+	if (idx->term_slots)
+		free(idx->term_slots);
+
+	/* Free the documents. */
+	for (i = 0; i < idx->ndocs; i++)
+		free(idx->docs[i].name);
+	if (idx->docs)
+		free(idx->docs);
+	if (idx->doc_slots)
+		free(idx->doc_slots);
+
+	if (idx->root)
+		free(idx->root);
+	free(idx);
+}
+
+/**
+ * Finds the slot where a term is (or should be) in the term hash table.
+ *
+ * @param idx  Full-text index.
+ * @param term Term to look for.
+ * @param hash Hash of the term.
+ *
+ * @return Slot index. Its value will be 0 if the term isn't in the table.
+ */
+static size_t ftindex_term_slot(const ftindex_t *idx, const char *term,
+								uint32_t hash) {
+	size_t mask;
+	size_t i;
+	uint32_t v;
+
+	mask = idx->term_nslots - 1;
+	for (i = hash & mask; (v = idx->term_slots[i]) != 0; i = (i + 1) & mask) {
+		if ((idx->terms[v - 1].hash == hash) &&
+				(strcmp(idx->terms[v - 1].term, term) == 0)) {
+			break;
+		}
+	}
+
+	return i;
+}
+
+/**
+ * Rebuilds a hash table with a new number of slots.
+ *
+ * @param idx   Full-text index.
+ * @param terms Are we rebuilding the term table? Otherwise the document one.
+ * @param size  New number of slots. (Must be a power of two)
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+static bool ftindex_rehash(ftindex_t *idx, bool terms, size_t size) {
+	uint32_t *slots;
+	size_t mask;
+	size_t i;
+	size_t j;
+
+	slots = (uint32_t *)calloc(size, sizeof(uint32_t));
+	if (slots == NULL)
+		return false;
+
+	/* Re-insert everything. */
+	mask = size - 1;
+	if (terms) {
+		for (i = 0; i < idx->nterms; i++) {
+			for (j = idx->terms[i].hash & mask; slots[j] != 0; j = (j + 1) & mask);
+			slots[j] = (uint32_t)(i + 1);
+		}
+
+		if (idx->term_slots)
+			free(idx->term_slots);
+		idx->term_slots = slots;
+		idx->term_nslots = size;
+	} else {
+		for (i = 0; i < idx->ndocs; i++) {
+			j = string_hash(idx->docs[i].name, strlen(idx->docs[i].name)) & mask;
+			for (; slots[j] != 0; j = (j + 1) & mask) {
+				/* Newer documents shadow older ones with the same name. */
+				if (strcmp(idx->docs[slots[j] - 1].name, idx->docs[i].name) == 0)
+					break;
+			}
+			slots[j] = (uint32_t)(i + 1);
+		}
+
+		if (idx->doc_slots)
+			free(idx->doc_slots);
+		idx->doc_slots = slots;
+		idx->doc_nslots = size;
+	}
+
+	return true;
+}
+
+/**
+ * Gets a term from the index, creating it if needed.
+ *
+ * @param idx  Full-text index.
+ * @param term Term to look for.
+ * @param len  Length of the term.
+ *
+ * @return Term object or NULL if we couldn't allocate enough memory.
+ */
+static ftindex_term_t* ftindex_term_get(ftindex_t *idx, const char *term,
+										size_t len) {
+	ftindex_term_t *terms;
+	ftindex_term_t *t;
+	uint32_t hash;
+	size_t slot;
+
+	/* Keep the table at most half full. */
+	if (((idx->nterms + 1) * 2) > idx->term_nslots) {
+		if (!ftindex_rehash(idx, true,
+				(idx->term_nslots == 0) ? 1024 : idx->term_nslots * 2)) {
+			return NULL;
+		}
+	}
+
+	/* Look for the term. */
+	hash = string_hash(term, len);
+	slot = ftindex_term_slot(idx, term, hash);
+	if (idx->term_slots[slot] != 0)
+		return &idx->terms[idx->term_slots[slot] - 1];
+
+	/* Make room for a new one. */
+	if (idx->nterms == idx->terms_cap) {
+		terms = (ftindex_term_t *)realloc(idx->terms,
+			((idx->terms_cap == 0) ? 1024 : idx->terms_cap * 2) *
+			sizeof(ftindex_term_t));
+		if (terms == NULL)
+			return NULL;
+		idx->terms = terms;
+		idx->terms_cap = (idx->terms_cap == 0) ? 1024 : idx->terms_cap * 2;
+	}
+
+	/* Create it. */
+	t = &idx->terms[idx->nterms];
+	memset(t, 0, sizeof(ftindex_term_t));
+	t->term = NULL;
+	string_copy_untilp(&t->term, term, term + len);
+	t->hash = hash;
+	idx->term_slots[slot] = (uint32_t)(++idx->nterms);
+
+	return t;
+}
+
+/**
+ * Finds an existing term in the index.
+ *
+ * @param idx  Full-text index.
+ * @param term Term to look for.
+ *
+ * @return Term object or NULL if it isn't in the index.
+ */
+static const ftindex_term_t* ftindex_term_find(const ftindex_t *idx,
+											   const char *term) {
+	size_t slot;
+
+	if (idx->term_nslots == 0)
+		return NULL;
+
+	slot = ftindex_term_slot(idx, term, string_hash(term, strlen(term)));
+	if (idx->term_slots[slot] == 0)
+		return NULL;
+
+	return &idx->terms[idx->term_slots[slot] - 1];
+}
+
+/**
+ * Finds the latest document with a name.
+ *
+ * @param idx  Full-text index.
+ * @param name Name of the document.
+ *
+ * @return Document object or NULL if it isn't in the index.
+ */
+static ftindex_doc_t* ftindex_doc_find(const ftindex_t *idx, const char *name) {
+	size_t mask;
+	size_t i;
+	uint32_t v;
+
+	if (idx->doc_nslots == 0)
+		return NULL;
+
+	mask = idx->doc_nslots - 1;
+	for (i = string_hash(name, strlen(name)) & mask;
+		 (v = idx->doc_slots[i]) != 0; i = (i + 1) & mask) {
+		if (strcmp(idx->docs[v - 1].name, name) == 0)
+			return &idx->docs[v - 1];
+	}
+
+	return NULL;
+}
+
+/**
+ * Appends a new document to the index and makes it the latest one with its
+ * name.
+ *
+ * @param idx  Full-text index.
+ * @param name Name of the document.
+ *
+ * @return Document object or NULL if we couldn't allocate enough memory.
+ */
+static ftindex_doc_t* ftindex_doc_push(ftindex_t *idx, const char *name) {
+	ftindex_doc_t *docs;
+	ftindex_doc_t *doc;
+	size_t mask;
+	size_t i;
+	uint32_t v;
+
+	/* Keep the table at most half full. */
+	if (((idx->ndocs + 1) * 2) > idx->doc_nslots) {
+		if (!ftindex_rehash(idx, false,
+				(idx->doc_nslots == 0) ? 256 : idx->doc_nslots * 2)) {
+			return NULL;
+		}
+	}
+
+	/* Make room for the document. */
+	if (idx->ndocs == idx->docs_cap) {
+		docs = (ftindex_doc_t *)realloc(idx->docs,
+			((idx->docs_cap == 0) ? 256 : idx->docs_cap * 2) *
+			sizeof(ftindex_doc_t));
+		if (docs == NULL)
+			return NULL;
+		idx->docs = docs;
+		idx->docs_cap = (idx->docs_cap == 0) ? 256 : idx->docs_cap * 2;
+	}
+
+	/* Populate it. */
+	doc = &idx->docs[idx->ndocs];
+	memset(doc, 0, sizeof(ftindex_doc_t));
+	string_copy(&doc->name, name);
+
+	/* Point the name to the new document. */
+	mask = idx->doc_nslots - 1;
+	for (i = string_hash(name, strlen(name)) & mask;
+		 (v = idx->doc_slots[i]) != 0; i = (i + 1) & mask) {
+		if (strcmp(idx->docs[v - 1].name, name) == 0)
+			break;
+	}
+	idx->doc_slots[i] = (uint32_t)(++idx->ndocs);
+
+	return doc;
+}
+
+/**
+ * Marks a document as dead.
+ *
+ * @param idx Full-text index.
+ * @param doc Document to be killed.
+ */
+static void ftindex_doc_kill(ftindex_t *idx, ftindex_doc_t *doc) {
+	if (!doc->alive)
+		return;
+
+	doc->alive = false;
+	doc->note = NULL;
+	idx->alive--;
+	idx->total_length -= doc->length;
+	idx->dirty = true;
+}
+
+/**
+ * Counts an occurrence of a term in the document being indexed.
+ *
+ * @param ix   Indexing state.
+ * @param term Term that was found.
+ * @param len  Length of the term.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+static bool ftindex_touch(ftindex_indexing_t *ix, const char *term,
+						  size_t len) {
+	ftindex_term_t *t;
+	uint32_t *buf;
+
+	t = ftindex_term_get(ix->idx, term, len);
+	if (t == NULL)
+		return false;
+
+	/* Keep track of the terms we've touched in this document. */
+	if (t->cur_doc != (ix->id + 1)) {
+		if (ix->ntouched == ix->cap) {
+			ix->cap = (ix->cap == 0) ? 256 : ix->cap * 2;
+			buf = (uint32_t *)realloc(ix->touched, ix->cap * sizeof(uint32_t));
+			if (buf == NULL)
+				return false;
+			ix->touched = buf;
+		}
+		ix->touched[ix->ntouched++] = (uint32_t)(t - ix->idx->terms);
+		t->cur_doc = ix->id + 1;
+		t->cur_tf = 0;
+	}
+	t->cur_tf++;
+
+	return true;
+}
+
+/**
+ * Indexes a tag found in the document, lowercased and prefixed with a # so
+ * that it can never be mistaken for a word.
+ *
+ * @param item Piece of structure found in the document.
+ * @param ctx  Indexing state.
+ *
+ * @return TRUE if the parser should keep going.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+static bool ftindex_md_func(const md_item_t *item, void *ctx) {
+	ftindex_indexing_t *ix;
+	char term[FTINDEX_TERM_MAX + 1];
+	size_t len;
+
+	ix = (ftindex_indexing_t *)ctx;
+	if (item->kind != MD_TAG)
+		return true;
+
+	len = ftindex_tag_term(item->text, item->len, term);
+	if (!ftindex_touch(ix, term, len)) {
+		ix->failed = true;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Indexes the contents of a new document.
+ *
+ * @param idx      Full-text index.
+ * @param doc      Document being indexed. (Must be the last one)
+ * @param contents Contents of the document.
+ * @param len      Length of the contents.
+ * @param flags    Markdown parser flags for the document's format.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+static bool ftindex_doc_index(ftindex_t *idx, ftindex_doc_t *doc,
+							  const char *contents, size_t len, int flags) {
+	char term[FTINDEX_TERM_MAX + 1];
+	ftindex_indexing_t ix;
+	const char *cur;
+	const char *end;
+	ftindex_term_t *t;
+	size_t tlen;
+	size_t i;
+
+	ix.idx = idx;
+	ix.id = (uint32_t)(doc - idx->docs);
+	ix.touched = NULL;
+	ix.ntouched = 0;
+	ix.cap = 0;
+	ix.failed = false;
+
+	/* Count the frequency of every term in the document. */
+	cur = contents;
+	end = contents + len;
+	while ((tlen = ftindex_next_token(&cur, end, term)) > 0) {
+		if (!ftindex_touch(&ix, term, tlen)) {
+			ix.failed = true;
+			break;
+		}
+		doc->length++;
+	}
+
+	/* Tags are terms too, but they don't make the document any longer. */
+	if (!ix.failed)
+		md_parse(contents, len, flags, ftindex_md_func, &ix);
+
+	/* Append the document to the posting lists of its terms. */
+	for (i = 0; i < ix.ntouched; i++) {
+		t = &idx->terms[ix.touched[i]];
+		if (!ftindex_varint_put(&t->data, &t->len, &t->cap,
+								ix.id - t->last_doc) ||
+				!ftindex_varint_put(&t->data, &t->len, &t->cap, t->cur_tf)) {
+			ix.failed = true;
+		}
+		t->last_doc = ix.id;
+		t->count++;
+		t->cur_doc = 0;
+	}
+	if (ix.touched)
+		free(ix.touched);
+
+	/* Bring the document to life. */
+	doc->alive = true;
+	idx->alive++;
+	idx->total_length += doc->length;
+	idx->dirty = true;
+
+	return !ix.failed;
+}
+
+/**
+ * Gets rid of dead documents, renumbering the live ones and rewriting every
+ * posting list.
+ *
+ * @param idx Full-text index.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+static bool ftindex_compact(ftindex_t *idx) {
+	ftindex_term_t *t;
+	const uint8_t *cur;
+	const uint8_t *end;
+	uint32_t *remap;
+	uint8_t *data;
+	size_t len;
+	size_t cap;
+	uint32_t count;
+	uint32_t last;
+	uint32_t doc;
+	uint32_t delta;
+	uint32_t tf;
+	size_t i;
+	size_t j;
+
+	/* Figure out the new document IDs. */
+	remap = (uint32_t *)malloc((idx->ndocs + 1) * sizeof(uint32_t));
+	if (remap == NULL)
+		return false;
+	for (i = 0, j = 0; i < idx->ndocs; i++)
+		remap[i] = idx->docs[i].alive ? (uint32_t)(j++) : UINT32_MAX;
+
+	/* Rewrite the posting lists. */
+	for (i = 0; i < idx->nterms; i++) {
+		t = &idx->terms[i];
+		data = NULL;
+		len = 0;
+		cap = 0;
+		count = 0;
+		last = 0;
+		doc = 0;
+
+		cur = t->data;
+		end = t->data + t->len;
+		while ((cur < end) && ftindex_varint_get(&cur, end, &delta) &&
+			   ftindex_varint_get(&cur, end, &tf)) {
+			doc += delta;
+			if (doc >= idx->ndocs)
+				break;
+			if (remap[doc] == UINT32_MAX)
+				continue;
+
+			if (!ftindex_varint_put(&data, &len, &cap, remap[doc] - last) ||
+					!ftindex_varint_put(&data, &len, &cap, tf)) {
+				free(data);
+				free(remap);
+				return false;
+			}
+			last = remap[doc];
+			count++;
+		}
+
+		if (t->data)
+			free(t->data);
+		t->data = data;
+		t->len = len;
+		t->cap = cap;
+		t->count = count;
+		t->last_doc = last;
+	}
+
+	/* Drop the dead documents. */
+	for (i = 0, j = 0; i < idx->ndocs; i++) {
+		if (remap[i] == UINT32_MAX) {
+			free(idx->docs[i].name);
+			continue;
+		}
+
+		idx->docs[j++] = idx->docs[i];
+	}
+	idx->ndocs = j;
+	free(remap);
+
+	return ftindex_rehash(idx, false, idx->doc_nslots);
+}
+
+/**
+ * Gets the name a note is known by in the index, which is its path relative to
+ * the workspace, so that notes with the same file name in different folders
+ * are kept apart.
+ *
+ * @param idx  Full-text index.
+ * @param note Note object.
+ *
+ * @return Name of the note's document, pointing inside the note's path.
+ */
+static const char* ftindex_doc_name(const ftindex_t *idx, const note_t *note) {
+	if (idx->root == NULL)
+		return fs_basename(note_get_path(note));
+
+	return fs_relpath(note_get_path(note), idx->root);
+}
+
+/**
+ * Brings the index up to date with a single note. Does nothing if the note
+ * hasn't changed since it was last indexed.
+ *
+ * @param idx  Full-text index.
+ * @param note Note to be indexed.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ */
+bool ftindex_update_note(ftindex_t *idx, note_t *note) {
+	ftindex_doc_t *doc;
+	const char *name;
+	const char *contents;
+	fs_view_t view;
+	struct stat st;
+	size_t len;
+	bool loaded;
+	bool ret;
+
+	/* Ensure we know the current state of the note's file, since editing a
+	 * note in place doesn't touch its directory. Notes that only exist in
+	 * memory, like the ones from a pack, are taken as they are. */
+	if (note_get_path(note) == NULL)
+		return false;
+	if (note_stat(note, &st)) {
+		note_set_stat(note, &st);
+	} else if (!note_is_loaded(note)) {
+		return false;
+	}
+
+	/* Check if the note has changed since we last saw it. */
+	name = ftindex_doc_name(idx, note);
+	doc = ftindex_doc_find(idx, name);
+	if ((doc != NULL) && doc->alive && (doc->size == note_get_size(note)) &&
+			(doc->mtime == note_get_mtime(note))) {
+		doc->note = note;
+		return true;
+	}
+
+	/* Get the contents of the note. */
+	loaded = note_is_loaded(note);
+	if (loaded) {
+		contents = note_get_content(note, &len);
+	} else {
+		if (!note_fh_view(note, &view))
+			return false;
+		note_fh_close(note);
+		contents = view.data;
+		len = view.len;
+	}
+
+	/* Replace the old document with a new one. */
+	if (doc != NULL)
+		ftindex_doc_kill(idx, doc);
+	doc = ftindex_doc_push(idx, name);
+	ret = doc != NULL;
+	if (ret) {
+		doc->size = note_get_size(note);
+		doc->mtime = note_get_mtime(note);
+		doc->note = note;
+		ret = ftindex_doc_index(idx, doc, contents, len,
+								md_flags_for(note_get_format(note)));
+	}
+
+	if (!loaded)
+		note_fh_view_release(&view);
+	if (!ret)
+		errno = ENOMEM;
+
+	return ret;
+}
+
+/**
+ * Removes a note from the index.
+ *
+ * @param idx  Full-text index.
+ * @param note Note to be removed.
+ *
+ * @return TRUE if the note was in the index.
+ *         FALSE if it wasn't found.
+ */
+bool ftindex_remove_note(ftindex_t *idx, const note_t *note) {
+	ftindex_doc_t *doc;
+
+	doc = ftindex_doc_find(idx, ftindex_doc_name(idx, note));
+	if ((doc == NULL) || !doc->alive)
+		return false;
+
+	ftindex_doc_kill(idx, doc);
+	return true;
+}
+
+/**
+ * Brings the index up to date with the notes in a workspace, only reindexing
+ * the ones that have changed and forgetting the ones that are gone.
+ *
+ * @param idx  Full-text index.
+ * @param list Every note in the workspace.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ */
+bool ftindex_update(ftindex_t *idx, notelist_t *list) {
+	size_t i;
+	bool ret;
+
+	/* Forget about any previous associations. */
+	for (i = 0; i < idx->ndocs; i++)
+		idx->docs[i].note = NULL;
+
+	/* Update each note. */
+	ret = true;
+	for (i = 0; i < notelist_len(list); i++) {
+		if (!ftindex_update_note(idx, notelist_get(list, i)))
+			ret = false;
+	}
+
+	/* Get rid of the notes that aren't in the workspace anymore. */
+	for (i = 0; i < idx->ndocs; i++) {
+		if (idx->docs[i].alive && (idx->docs[i].note == NULL))
+			ftindex_doc_kill(idx, &idx->docs[i]);
+	}
+
+	/* Compact the index if it's mostly dead weight. */
+	if ((idx->ndocs >= FTINDEX_COMPACT_MIN) &&
+			((idx->ndocs - idx->alive) > idx->alive)) {
+		if (!ftindex_compact(idx))
+			ret = false;
+	}
+
+	return ret;
+}
+
+/**
+ * Sorting function for search results. Best scores first, then by date.
+ *
+ * @param a Search result.
+ * @param b Another search result.
+ *
+ * @return Comparison result as expected by qsort.
+ */
+static int ftindex_hit_cmp(const void *a, const void *b) {
+	const ftindex_hit_t *ha;
+	const ftindex_hit_t *hb;
+
+	ha = (const ftindex_hit_t *)a;
+	hb = (const ftindex_hit_t *)b;
+	if (ha->score != hb->score)
+		return (ha->score > hb->score) ? -1 : 1;
+
+	return note_cmp(ha->note, hb->note);
+}
+
+/**
+ * Searches the index for notes containing any of the words in a query, ranking
+ * them using BM25.
+ *
+ * @warning This function allocates the results array. You are responsible for
+ *          freeing it.
+ *
+ * @param idx   Full-text index.
+ * @param query Words to search for.
+ * @param hits  Pointer that will hold the results array, best matches first.
+ *              (Allocated by this function)
+ *
+ * @return Number of results found.
+ */
+size_t ftindex_search(const ftindex_t *idx, const char *query,
+					  ftindex_hit_t **hits) {
+	char term[FTINDEX_TERM_MAX + 1];
+	const ftindex_term_t *seen[64];
+	const ftindex_term_t *t;
+	const uint8_t *cur;
+	const uint8_t *end;
+	const char *qcur;
+	const char *qend;
+	double *scores;
+	double avgdl;
+	double idf;
+	double dl;
+	uint32_t delta;
+	uint32_t doc;
+	uint32_t df;
+	uint32_t tf;
+	size_t nseen;
+	size_t count;
+	size_t i;
+
+	*hits = NULL;
+	if (idx->alive == 0)
+		return 0;
+
+	/* Set up the score accumulators. */
+	scores = (double *)calloc(idx->ndocs, sizeof(double));
+	if (scores == NULL)
+		return 0;
+	avgdl = (double)idx->total_length / (double)idx->alive;
+	if (avgdl <= 0)
+		avgdl = 1;
+
+	/* Go through the unique terms in the query. */
+	nseen = 0;
+	qcur = query;
+	qend = query + strlen(query);
+	while ((nseen < 64) && (ftindex_next_token(&qcur, qend, term) > 0)) {
+		t = ftindex_term_find(idx, term);
+		if (t == NULL)
+			continue;
+		for (i = 0; (i < nseen) && (seen[i] != t); i++);
+		if (i < nseen)
+			continue;
+		seen[nseen++] = t;
+
+		/* Count the live documents containing the term. */
+		df = 0;
+		doc = 0;
+		cur = t->data;
+		end = t->data + t->len;
+		while ((cur < end) && ftindex_varint_get(&cur, end, &delta) &&
+			   ftindex_varint_get(&cur, end, &tf)) {
+			doc += delta;
+			if (doc >= idx->ndocs)
+				break;
+			if (idx->docs[doc].alive)
+				df++;
+		}
+		if (df == 0)
+			continue;
+		idf = log(1.0 + (((double)idx->alive - df + 0.5) / (df + 0.5)));
+
+		/* Score the documents. */
+		doc = 0;
+		cur = t->data;
+		while ((cur < end) && ftindex_varint_get(&cur, end, &delta) &&
+			   ftindex_varint_get(&cur, end, &tf)) {
+			doc += delta;
+			if (doc >= idx->ndocs)
+				break;
+			if (!idx->docs[doc].alive || (idx->docs[doc].note == NULL))
+				continue;
+
+			dl = (double)idx->docs[doc].length;
+			scores[doc] += idf * ((tf * (FTINDEX_BM25_K1 + 1)) /
+				(tf + FTINDEX_BM25_K1 * (1 - FTINDEX_BM25_B +
+										 FTINDEX_BM25_B * (dl / avgdl))));
+		}
+	}
+
+	/* Gather the results. */
+	count = 0;
+	for (i = 0; i < idx->ndocs; i++) {
+		if (scores[i] > 0)
+			count++;
+	}
+	if (count > 0) {
+		*hits = (ftindex_hit_t *)malloc(count * sizeof(ftindex_hit_t));
+		if (*hits == NULL) {
+			free(scores);
+			return 0;
+		}
+
+		count = 0;
+		for (i = 0; i < idx->ndocs; i++) {
+			if (scores[i] <= 0)
+				continue;
+
+			(*hits)[count].note = idx->docs[i].note;
+			(*hits)[count].score = scores[i];
+			count++;
+		}
+		qsort(*hits, count, sizeof(ftindex_hit_t), ftindex_hit_cmp);
+	}
+
+	free(scores);
+	return count;
+}
+
+/**
+ * Sorting function for tagged notes by date.
+ *
+ * @param a Pointer to a note pointer.
+ * @param b Pointer to another note pointer.
+ *
+ * @return Comparison result as expected by qsort.
+ */
+static int ftindex_note_cmp(const void *a, const void *b) {
+	return note_cmp(*(note_t * const *)a, *(note_t * const *)b);
+}
+
+/**
+ * Counts the live documents in a posting list, optionally gathering their
+ * notes.
+ *
+ * @param idx   Full-text index.
+ * @param t     Term whose posting list should be walked.
+ * @param notes Array that will hold the notes or NULL to just count them. Must
+ *              be at least as long as the number of documents in the list.
+ *
+ * @return Number of live documents that have a note associated with them.
+ */
+static size_t ftindex_term_notes(const ftindex_t *idx, const ftindex_term_t *t,
+								 note_t **notes) {
+	const uint8_t *cur;
+	const uint8_t *end;
+	uint32_t delta;
+	uint32_t doc;
+	uint32_t tf;
+	size_t count;
+
+	count = 0;
+	doc = 0;
+	cur = t->data;
+	end = t->data + t->len;
+	while ((cur < end) && ftindex_varint_get(&cur, end, &delta) &&
+		   ftindex_varint_get(&cur, end, &tf)) {
+		doc += delta;
+		if (doc >= idx->ndocs)
+			break;
+		if (!idx->docs[doc].alive || (idx->docs[doc].note == NULL))
+			continue;
+
+		if (notes != NULL)
+			notes[count] = idx->docs[doc].note;
+		count++;
+	}
+
+	return count;
+}
+
+/**
+ * Finds every note that has a tag.
+ *
+ * @warning This function allocates the results array. You are responsible for
+ *          freeing it.
+ *
+ * @param idx   Full-text index.
+ * @param tag   Tag to look for, with or without its leading #. Case doesn't
+ *              matter.
+ * @param notes Pointer that will hold the notes, sorted by date. (Allocated by
+ *              this function)
+ *
+ * @return Number of notes found.
+ */
+size_t ftindex_tagged(const ftindex_t *idx, const char *tag, note_t ***notes) {
+	char term[FTINDEX_TERM_MAX + 1];
+	const ftindex_term_t *t;
+	size_t count;
+
+	*notes = NULL;
+	ftindex_tag_term(tag, strlen(tag), term);
+	t = ftindex_term_find(idx, term);
+	if ((t == NULL) || (t->count == 0))
+		return 0;
+
+	/* Gather the notes. */
+	*notes = (note_t **)malloc(t->count * sizeof(note_t *));
+	if (*notes == NULL)
+		return 0;
+	count = ftindex_term_notes(idx, t, *notes);
+	if (count == 0) {
+		free(*notes);
+		*notes = NULL;
+		return 0;
+	}
+	qsort(*notes, count, sizeof(note_t *), ftindex_note_cmp);
+
+	return count;
+}
+
+/**
+ * Sorting function for tags. Most used first, then alphabetically.
+ *
+ * @param a Tag.
+ * @param b Another tag.
+ *
+ * @return Comparison result as expected by qsort.
+ */
+static int ftindex_tag_cmp(const void *a, const void *b) {
+	const ftindex_tag_t *ta;
+	const ftindex_tag_t *tb;
+
+	ta = (const ftindex_tag_t *)a;
+	tb = (const ftindex_tag_t *)b;
+	if (ta->count != tb->count)
+		return (ta->count > tb->count) ? -1 : 1;
+
+	return strcmp(ta->tag, tb->tag);
+}
+
+/**
+ * Lists every tag in use along with the number of notes that have it.
+ *
+ * @warning This function allocates the results array. You are responsible for
+ *          freeing it, but not the tags, which belong to the index.
+ *
+ * @param idx  Full-text index.
+ * @param tags Pointer that will hold the tags, most used first. (Allocated by
+ *             this function)
+ *
+ * @return Number of tags found.
+ */
+size_t ftindex_tags(const ftindex_t *idx, ftindex_tag_t **tags) {
+	const ftindex_term_t *t;
+	size_t count;
+	size_t n;
+	size_t i;
+
+	/* Count the tags. */
+	*tags = NULL;
+	count = 0;
+	for (i = 0; i < idx->nterms; i++) {
+		if (idx->terms[i].term[0] == '#')
+			count++;
+	}
+	if (count == 0)
+		return 0;
+	*tags = (ftindex_tag_t *)malloc(count * sizeof(ftindex_tag_t));
+	if (*tags == NULL)
+		return 0;
+
+	/* Gather the ones that are still in use. */
+	count = 0;
+	for (i = 0; i < idx->nterms; i++) {
+		t = &idx->terms[i];
+		if (t->term[0] != '#')
+			continue;
+
+		n = ftindex_term_notes(idx, t, NULL);
+		if (n == 0)
+			continue;
+		(*tags)[count].tag = t->term + 1;
+		(*tags)[count].count = n;
+		count++;
+	}
+	if (count == 0) {
+		free(*tags);
+		*tags = NULL;
+		return 0;
+	}
+	qsort(*tags, count, sizeof(ftindex_tag_t), ftindex_tag_cmp);
+
+	return count;
+}
+
+/**
+ * Saves the index to the workspace, atomically replacing the old one. Does
+ * nothing if the index hasn't changed since it was loaded.
+ *
+ * @param idx  Full-text index.
+ * @param path Path to the workspace directory.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ */
+bool ftindex_save(ftindex_t *idx, const char *path) {
+	ftindex_buf_t buf;
+	const ftindex_doc_t *doc;
+	const ftindex_term_t *t;
+	char *idxpath;
+	char *tmppath;
+	uint32_t u32;
+	uint16_t u16;
+	uint8_t u8;
+	size_t i;
+	ssize_t n;
+	bool ret;
+	int fd;
+
+	/* Do we even have to do anything? */
+	if (!idx->dirty)
+		return true;
+
+	/* Build the header. */
+	memset(&buf, 0, sizeof(ftindex_buf_t));
+	u32 = FTINDEX_MAGIC;
+	ret = ftindex_buf_put(&buf, &u32, sizeof(uint32_t));
+	u32 = FTINDEX_VERSION;
+	ret = ret && ftindex_buf_put(&buf, &u32, sizeof(uint32_t));
+	u32 = (uint32_t)idx->ndocs;
+	ret = ret && ftindex_buf_put(&buf, &u32, sizeof(uint32_t));
+	u32 = (uint32_t)idx->nterms;
+	ret = ret && ftindex_buf_put(&buf, &u32, sizeof(uint32_t));
+
+	/* Serialize the documents. */
+	for (i = 0; ret && (i < idx->ndocs); i++) {
+		doc = &idx->docs[i];
+		u16 = (uint16_t)strlen(doc->name);
+		u8 = doc->alive ? 1 : 0;
+		ret = ftindex_buf_put(&buf, &doc->size, sizeof(uint64_t)) &&
+			ftindex_buf_put(&buf, &doc->mtime, sizeof(int64_t)) &&
+			ftindex_buf_put(&buf, &doc->length, sizeof(uint32_t)) &&
+			ftindex_buf_put(&buf, &u8, sizeof(uint8_t)) &&
+			ftindex_buf_put(&buf, &u16, sizeof(uint16_t)) &&
+			ftindex_buf_put(&buf, doc->name, u16);
+	}
+
+	/* Serialize the terms and their posting lists. */
+	for (i = 0; ret && (i < idx->nterms); i++) {
+		t = &idx->terms[i];
+		u8 = (uint8_t)strlen(t->term);
+		u32 = (uint32_t)t->len;
+		ret = ftindex_buf_put(&buf, &u8, sizeof(uint8_t)) &&
+			ftindex_buf_put(&buf, t->term, u8) &&
+			ftindex_buf_put(&buf, &t->count, sizeof(uint32_t)) &&
+			ftindex_buf_put(&buf, &t->last_doc, sizeof(uint32_t)) &&
+			ftindex_buf_put(&buf, &u32, sizeof(uint32_t)) &&
+			ftindex_buf_put(&buf, t->data, t->len);
+	}
+	if (!ret) {
+		if (buf.data)
+			free(buf.data);
+		errno = ENOMEM;
+		return false;
+	}
+
+	/* Build the paths to the index file. */
+	idxpath = NULL;
+	string_copy(&idxpath, path);
+	fs_pathcat(&idxpath, FTINDEX_FNAME);
+	tmppath = NULL;
+	string_copy(&tmppath, idxpath);
+	string_concat(&tmppath, ".tmp");
+
+	/* Write everything to a temporary file and replace the old index. */
+	ret = false;
+	fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd >= 0) {
+		n = write(fd, buf.data, buf.len);
+		close(fd);
+		ret = (n >= 0) && ((size_t)n == buf.len) &&
+			(rename(tmppath, idxpath) == 0);
+		if (!ret)
+			unlink(tmppath);
+	}
+	if (ret)
+		idx->dirty = false;
+
+	free(buf.data);
+	free(tmppath);
+	free(idxpath);
+
+	return ret;
+}
+
+/**
+ * Parses a serialized index.
+ *
+ * @param idx Empty full-text index to be populated.
+ * @param buf Contents of the index file.
+ * @param len Length of the contents.
+ *
+ * @return TRUE if the index was valid.
+ *         FALSE if it's corrupt, from another version, or we ran out of memory.
+ */
+static bool ftindex_parse(ftindex_t *idx, const char *buf, size_t len) {
+	ftindex_doc_t *doc;
+	ftindex_term_t *t;
+	uint32_t magic;
+	uint32_t version;
+	uint32_t ndocs;
+	uint32_t nterms;
+	uint32_t u32;
+	uint16_t u16;
+	uint8_t u8;
+	size_t pos;
+	uint32_t i;
+	char *name;
+	bool ret;
+
+	/* Check the header. */
+	if (len < FTINDEX_HEADER_SIZE)
+		return false;
+	memcpy(&magic, buf, sizeof(uint32_t));
+	memcpy(&version, buf + 4, sizeof(uint32_t));
+	memcpy(&ndocs, buf + 8, sizeof(uint32_t));
+	memcpy(&nterms, buf + 12, sizeof(uint32_t));
+	if ((magic != FTINDEX_MAGIC) || (version != FTINDEX_VERSION))
+		return false;
+	pos = FTINDEX_HEADER_SIZE;
+
+	/* Read the documents. */
+	name = NULL;
+	ret = true;
+	for (i = 0; ret && (i < ndocs); i++) {
+		ret = false;
+		if ((len - pos) < 23)
+			break;
+		memcpy(&u16, buf + pos + 21, sizeof(uint16_t));
+		if ((len - pos - 23) < u16)
+			break;
+		string_copy_untilp(&name, buf + pos + 23, buf + pos + 23 + u16);
+
+		doc = ftindex_doc_push(idx, name);
+		if (doc == NULL)
+			break;
+		ret = true;
+		memcpy(&doc->size, buf + pos, sizeof(uint64_t));
+		memcpy(&doc->mtime, buf + pos + 8, sizeof(int64_t));
+		memcpy(&doc->length, buf + pos + 16, sizeof(uint32_t));
+		doc->alive = buf[pos + 20] != 0;
+		if (doc->alive) {
+			idx->alive++;
+			idx->total_length += doc->length;
+		}
+		pos += 23 + u16;
+	}
+	if (name)
+		free(name);
+	if (!ret)
+		return false;
+
+	/* Read the terms. */
+	for (i = 0; i < nterms; i++) {
+		if ((len - pos) < 1)
+			return false;
+		u8 = (uint8_t)buf[pos];
+		if ((len - pos - 1) < ((size_t)u8 + 12))
+			return false;
+
+		t = ftindex_term_get(idx, buf + pos + 1, u8);
+		if (t == NULL)
+			return false;
+		pos += 1 + u8;
+		memcpy(&t->count, buf + pos, sizeof(uint32_t));
+		memcpy(&t->last_doc, buf + pos + 4, sizeof(uint32_t));
+		memcpy(&u32, buf + pos + 8, sizeof(uint32_t));
+		pos += 12;
+		if (((len - pos) < u32) || (t->last_doc >= ndocs) || (t->data != NULL))
+			return false;
+
+		t->data = (uint8_t *)malloc((u32 > 0) ? u32 : 1);
+		if (t->data == NULL)
+			return false;
+		memcpy(t->data, buf + pos, u32);
+		t->len = u32;
+		t->cap = u32;
+		pos += u32;
+	}
+
+	return true;
+}
+
+/**
+ * Opens the full-text index stored in a workspace. If there isn't one (or it's
+ * unusable) an empty index is returned, which will be populated by the first
+ * update.
+ * @warning The object allocated by this function must be free'd after use.
+ *
+ * @param path Path to the workspace directory.
+ *
+ * @return Full-text index or NULL if we couldn't allocate enough memory.
+ *
+ * @see ftindex_update
+ * @see ftindex_free
+ */
+ftindex_t* ftindex_open(const char *path) {
+	ftindex_t *idx;
+	fs_view_t view;
+	char *idxpath;
+	FILE *fh;
+
+	idx = ftindex_new();
+	if (idx == NULL)
+		return NULL;
+	string_copy(&idx->root, path);
+
+	/* Open the index file. */
+	idxpath = NULL;
+	string_copy(&idxpath, path);
+	fs_pathcat(&idxpath, FTINDEX_FNAME);
+	fh = fopen(idxpath, "rb");
+	free(idxpath);
+	if (fh == NULL)
+		return idx;
+
+	/* Read it in one go and parse it. */
+	if (fs_fview(fh, &view)) {
+		if (!ftindex_parse(idx, view.data, view.len)) {
+			ftindex_free(idx);
+			idx = ftindex_new();
+			if (idx != NULL) {
+				string_copy(&idx->root, path);
+				idx->dirty = true;
+			}
+		}
+		fs_fview_release(&view);
+	}
+	fclose(fh);
+
+	return idx;
+}
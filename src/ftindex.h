@@ -0,0 +1,132 @@
+/**
+ * ftindex.h
+ * Full-text inverted index over the contents of the notes in a workspace.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _FTINDEX_H
+#define _FTINDEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "note.h"
+#include "notelist.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Name of the full-text index file inside the workspace. */
+#define FTINDEX_FNAME ".notein.fts"
+
+/* Index file format identification. */
+#define FTINDEX_MAGIC   0x5354464EUL /* "NFTS" */
+#define FTINDEX_VERSION 2
+
+/* Longest term that will be indexed. Longer words are truncated. */
+#define FTINDEX_TERM_MAX 64
+
+/* BM25 ranking parameters. */
+#define FTINDEX_BM25_K1 1.2
+#define FTINDEX_BM25_B  0.75
+
+/**
+ * Posting list of a single term. Entries are stored as varint encoded deltas
+ * between document IDs followed by the term frequency in that document.
+ */
+typedef struct {
+	char *term;
+	uint32_t hash;
+
+	uint8_t *data;
+	size_t len;
+	size_t cap;
+	uint32_t count;
+	uint32_t last_doc;
+
+	uint32_t cur_doc;
+	uint32_t cur_tf;
+} ftindex_term_t;
+
+/**
+ * Document (note) known to the index.
+ */
+typedef struct {
+	char *name;
+	uint64_t size;
+	int64_t mtime;
+	uint32_t length;
+	bool alive;
+
+	note_t *note;
+} ftindex_doc_t;
+
+/**
+ * Search result.
+ */
+typedef struct {
+	note_t *note;
+	double score;
+} ftindex_hit_t;
+
+/**
+ * Full-text index object.
+ */
+typedef struct {
+	ftindex_term_t *terms;
+	size_t nterms;
+	size_t terms_cap;
+	uint32_t *term_slots;
+	size_t term_nslots;
+
+	ftindex_doc_t *docs;
+	size_t ndocs;
+	size_t docs_cap;
+	uint32_t *doc_slots;
+	size_t doc_nslots;
+
+	size_t alive;
+	uint64_t total_length;
+	bool dirty;
+
+	char *root;
+} ftindex_t;
+
+/**
+ * Tag in use by the notes.
+ */
+typedef struct {
+	const char *tag;
+	size_t count;
+} ftindex_tag_t;
+
+/* Construction and destruction. */
+ftindex_t* ftindex_new(void);
+ftindex_t* ftindex_open(const char *path);
+void ftindex_free(ftindex_t *idx);
+
+/* Persistence. */
+bool ftindex_save(ftindex_t *idx, const char *path);
+
+/* Updating. */
+bool ftindex_update(ftindex_t *idx, notelist_t *list);
+bool ftindex_update_note(ftindex_t *idx, note_t *note);
+bool ftindex_remove_note(ftindex_t *idx, const note_t *note);
+
+/* Querying. */
+size_t ftindex_search(const ftindex_t *idx, const char *query,
+					  ftindex_hit_t **hits);
+size_t ftindex_tagged(const ftindex_t *idx, const char *tag, note_t ***notes);
+size_t ftindex_tags(const ftindex_t *idx, ftindex_tag_t **tags);
+
+/* Tokenizing. */
+size_t ftindex_next_token(const char **cur, const char *end, char *term);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _FTINDEX_H */
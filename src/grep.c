@@ -0,0 +1,277 @@
+/**
+ * grep.c
+ * Searches the contents of every note in a workspace for a literal pattern.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "grep.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "matcher.h"
+#include "note.h"
+
+/**
+ * Matching lines found in a single note.
+ */
+typedef struct {
+	char *data;
+	size_t len;
+	size_t cap;
+	size_t count;
+	int err;
+} grep_result_t;
+
+/**
+ * Shared state of the grep workers. Each worker streams the notes through a
+ * reader of its own, which is set up the first time it's needed.
+ */
+typedef struct {
+	const matcher_t *m;
+	grep_result_t *results;
+	note_reader_t *readers;
+} grep_ctx_t;
+
+/**
+ * Appends data to a result buffer.
+ *
+ * @param res  Result object.
+ * @param data Data to be appended.
+ * @param len  Length of the data.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+static bool grep_result_put(grep_result_t *res, const char *data, size_t len) {
+	char *buf;
+	size_t cap;
+
+	/* Make room for the data. */
+	if ((res->len + len) > res->cap) {
+		cap = (res->cap == 0) ? 256 : res->cap * 2;
+		while (cap < (res->len + len))
+			cap *= 2;
+		buf = (char *)realloc(res->data, cap * sizeof(char));
+		if (buf == NULL)
+			return false;
+		res->data = buf;
+		res->cap = cap;
+	}
+
+	memcpy(res->data + res->len, data, len);
+	res->len += len;
+
+	return true;
+}
+
+/**
+ * Records a matching line. Nothing is recorded if it doesn't fit entirely.
+ *
+ * @param res    Result object.
+ * @param dates  Date of the note as a string.
+ * @param title  Title of the note.
+ * @param lineno Number of the line.
+ * @param line   Matching line.
+ * @param len    Length of the line without its line feed.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+static bool grep_result_line(grep_result_t *res, const char *dates,
+							 const char *title, unsigned long lineno,
+							 const char *line, size_t len) {
+	char prefix[NOTE_DATESTR_LEN + 32];
+	size_t start;
+
+	start = res->len;
+	sprintf(prefix, "%s\t", dates);
+	if (grep_result_put(res, prefix, strlen(prefix)) &&
+			grep_result_put(res, title, strlen(title))) {
+		sprintf(prefix, "\t%lu\t", lineno);
+		if (grep_result_put(res, prefix, strlen(prefix)) &&
+				grep_result_put(res, line, len) &&
+				grep_result_put(res, "\n", 1)) {
+			res->count++;
+			return true;
+		}
+	}
+
+	/* Take back whatever part of the line made it in. */
+	res->len = start;
+	return false;
+}
+
+/**
+ * Searches the contents of a single note, recording every matching line.
+ *
+ * @param note   Note object.
+ * @param index  Index of the note in the collection.
+ * @param worker Number of the worker searching it.
+ * @param ctx    Shared grep state.
+ */
+static void grep_note(note_t *note, size_t index, size_t worker, void *ctx) {
+	grep_ctx_t *grep;
+	grep_result_t *res;
+	note_reader_t *rd;
+	const char *data;
+	const char *end;
+	const char *cur;
+	const char *line;
+	const char *found;
+	const char *eol;
+	const char *nl;
+	char dates[NOTE_DATESTR_LEN];
+	const char *title;
+	unsigned long lineno;
+	size_t len;
+
+	grep = (grep_ctx_t *)ctx;
+	res = &grep->results[index];
+	rd = &grep->readers[worker];
+
+	/* Stream through the contents without keeping them around. */
+	if ((rd->buf == NULL) && !note_reader_init(rd, 0)) {
+		res->err = ENOMEM;
+		return;
+	}
+	if (!note_reader_open(rd, note)) {
+		res->err = errno;
+		return;
+	}
+
+	note_get_datestr(note, dates);
+	title = note_get_title(note);
+
+	/* Go through every match, a block of whole lines at a time. */
+	lineno = 1;
+	while ((len = note_reader_lines(rd, &data)) > 0) {
+		end = data + len;
+		cur = data;
+		line = data;
+		while ((cur < end) &&
+			   ((found = matcher_find(grep->m, cur, end - cur)) != NULL)) {
+			/* Figure out which line we are in. */
+			while ((nl = (const char *)memchr(line, '\n', found - line)) !=
+					NULL) {
+				line = nl + 1;
+				lineno++;
+			}
+			eol = (const char *)memchr(found, '\n', end - found);
+			if (eol == NULL)
+				eol = end;
+
+			/* Record the line. */
+			if (!grep_result_line(res, dates, title, lineno, line,
+								  (size_t)(eol - line))) {
+				res->err = ENOMEM;
+				note_reader_close(rd);
+				return;
+			}
+
+			/* Only report each line once. */
+			if (eol == end) {
+				line = end;
+				break;
+			}
+			cur = eol + 1;
+			line = cur;
+			lineno++;
+		}
+
+		/* Keep counting the lines until the end of the block. */
+		while ((nl = (const char *)memchr(line, '\n', end - line)) != NULL) {
+			line = nl + 1;
+			lineno++;
+		}
+	}
+
+	/* Make sure we've actually gone through all of it. */
+	if (rd->err != 0)
+		res->err = rd->err;
+	note_reader_close(rd);
+}
+
+/**
+ * Searches the contents of every note in a workspace for a literal pattern
+ * using a pool of worker threads, printing each matching line with the date
+ * and title of its note and its line number. Results are printed in the same
+ * order as the notes in the collection, including the ones found in notes that
+ * couldn't be read all the way through.
+ *
+ * @param list    Notes in the workspace.
+ * @param opts    Loading options or NULL to use the defaults.
+ * @param pattern Literal pattern to look for.
+ * @param icase   Should ASCII letters be matched regardless of their case?
+ * @param out     Where the results should be printed to.
+ * @param count   Will hold the number of matching lines printed.
+ *
+ * @return TRUE if every note was searched.
+ *         FALSE if an error occurred. Check errno, which is the error of the
+ *         first note that failed.
+ */
+bool grep_workspace(notelist_t *list, const loader_opts_t *opts,
+					const char *pattern, bool icase, FILE *out,
+					size_t *count) {
+	grep_ctx_t grep;
+	matcher_t *m;
+	size_t i;
+	int err;
+
+	/* Compile the pattern. */
+	*count = 0;
+	if (*pattern == '\0') {
+		errno = EINVAL;
+		return false;
+	}
+	m = matcher_new(pattern, icase);
+	if (m == NULL)
+		return false;
+
+	/* Search every note in parallel. */
+	grep.m = m;
+	grep.results = (grep_result_t *)calloc(notelist_len(list) + 1,
+										   sizeof(grep_result_t));
+	grep.readers = (note_reader_t *)calloc(LOADER_MAX_THREADS,
+										   sizeof(note_reader_t));
+	if ((grep.results == NULL) || (grep.readers == NULL)) {
+		if (grep.results)
+			free(grep.results);
+		if (grep.readers)
+			free(grep.readers);
+		matcher_free(m);
+		errno = ENOMEM;
+		return false;
+	}
+	loader_foreach_workers(list, opts, grep_note, &grep);
+
+	/* Print the results in order. */
+	err = 0;
+	for (i = 0; i < notelist_len(list); i++) {
+		if ((err == 0) && (grep.results[i].err != 0))
+			err = grep.results[i].err;
+		if (grep.results[i].data == NULL)
+			continue;
+
+		fwrite(grep.results[i].data, sizeof(char), grep.results[i].len, out);
+		*count += grep.results[i].count;
+		free(grep.results[i].data);
+	}
+
+	/* Clean up the readers that were actually set up. */
+	for (i = 0; i < LOADER_MAX_THREADS; i++) {
+		if (grep.readers[i].buf != NULL)
+			note_reader_release(&grep.readers[i]);
+	}
+	free(grep.readers);
+	free(grep.results);
+	matcher_free(m);
+
+	if (err != 0) {
+		errno = err;
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,31 @@
+/**
+ * grep.h
+ * Searches the contents of every note in a workspace for a literal pattern.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _GREP_H
+#define _GREP_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "loader.h"
+#include "notelist.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Searching. */
+bool grep_workspace(notelist_t *list, const loader_opts_t *opts,
+					const char *pattern, bool icase, FILE *out,
+					size_t *count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _GREP_H */
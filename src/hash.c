@@ -0,0 +1,168 @@
+/**
+ * hash.c
+ * Fast non-cryptographic hashing of note contents.
+ *
+ * This is an implementation of XXH64. The bulk of the input is consumed in
+ * 32 byte stripes by four independent accumulators, which keeps every
+ * multiplier of the processor busy, and the result is compatible with every
+ * other implementation of the algorithm, so hashes can be checked with the
+ * usual tools.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "hash.h"
+
+#include <string.h>
+
+/* XXH64 primes. */
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+/* Rotates a 64-bit integer to the left. */
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+/**
+ * Reads a little-endian 64-bit integer from a possibly unaligned address.
+ *
+ * @param p Address to read from.
+ *
+ * @return Integer that was read.
+ */
+static uint64_t hash_read64(const uint8_t *p) {
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(uint64_t));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+	v = __builtin_bswap64(v);
+#endif /* __BYTE_ORDER__ */
+
+	return v;
+}
+
+/**
+ * Reads a little-endian 32-bit integer from a possibly unaligned address.
+ *
+ * @param p Address to read from.
+ *
+ * @return Integer that was read.
+ */
+static uint32_t hash_read32(const uint8_t *p) {
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(uint32_t));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+	v = __builtin_bswap32(v);
+#endif /* __BYTE_ORDER__ */
+
+	return v;
+}
+
+/**
+ * Mixes a lane of input into an accumulator.
+ *
+ * @param acc   Accumulator.
+ * @param input Lane of input.
+ *
+ * @return New value of the accumulator.
+ */
+static uint64_t hash_round(uint64_t acc, uint64_t input) {
+	acc += input * PRIME64_2;
+	acc = ROTL64(acc, 31);
+	acc *= PRIME64_1;
+
+	return acc;
+}
+
+/**
+ * Merges an accumulator into the hash when converging them.
+ *
+ * @param hash Hash so far.
+ * @param acc  Accumulator.
+ *
+ * @return New value of the hash.
+ */
+static uint64_t hash_merge(uint64_t hash, uint64_t acc) {
+	hash ^= hash_round(0, acc);
+	hash = (hash * PRIME64_1) + PRIME64_4;
+
+	return hash;
+}
+
+/**
+ * Hashes a block of memory using XXH64.
+ *
+ * @param data Data to be hashed.
+ * @param len  Length of the data.
+ * @param seed Seed of the hash. Use HASH_SEED for anything that's persisted.
+ *
+ * @return Hash of the data.
+ */
+uint64_t hash_xxh64(const void *data, size_t len, uint64_t seed) {
+	const uint8_t *p;
+	const uint8_t *end;
+	const uint8_t *limit;
+	uint64_t v1;
+	uint64_t v2;
+	uint64_t v3;
+	uint64_t v4;
+	uint64_t hash;
+
+	p = (const uint8_t *)data;
+	end = p + len;
+
+	/* Consume the input in stripes with four independent accumulators. */
+	if (len >= 32) {
+		limit = end - 32;
+		v1 = seed + PRIME64_1 + PRIME64_2;
+		v2 = seed + PRIME64_2;
+		v3 = seed;
+		v4 = seed - PRIME64_1;
+
+		do {
+			v1 = hash_round(v1, hash_read64(p));
+			v2 = hash_round(v2, hash_read64(p + 8));
+			v3 = hash_round(v3, hash_read64(p + 16));
+			v4 = hash_round(v4, hash_read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+
+		hash = ROTL64(v1, 1) + ROTL64(v2, 7) + ROTL64(v3, 12) + ROTL64(v4, 18);
+		hash = hash_merge(hash, v1);
+		hash = hash_merge(hash, v2);
+		hash = hash_merge(hash, v3);
+		hash = hash_merge(hash, v4);
+	} else {
+		hash = seed + PRIME64_5;
+	}
+	hash += (uint64_t)len;
+
+	/* Take care of whatever is left. */
+	while ((p + 8) <= end) {
+		hash ^= hash_round(0, hash_read64(p));
+		hash = (ROTL64(hash, 27) * PRIME64_1) + PRIME64_4;
+		p += 8;
+	}
+	if ((p + 4) <= end) {
+		hash ^= (uint64_t)hash_read32(p) * PRIME64_1;
+		hash = (ROTL64(hash, 23) * PRIME64_2) + PRIME64_3;
+		p += 4;
+	}
+	while (p < end) {
+		hash ^= (uint64_t)(*p) * PRIME64_5;
+		hash = ROTL64(hash, 11) * PRIME64_1;
+		p++;
+	}
+
+	/* Avalanche. */
+	hash ^= hash >> 33;
+	hash *= PRIME64_2;
+	hash ^= hash >> 29;
+	hash *= PRIME64_3;
+	hash ^= hash >> 32;
+
+	return hash;
+}
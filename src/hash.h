@@ -0,0 +1,28 @@
+/**
+ * hash.h
+ * Fast non-cryptographic hashing of note contents.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _HASH_H
+#define _HASH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Seed used for every content hash so that they can be persisted. */
+#define HASH_SEED 0
+
+/* Hashing. */
+uint64_t hash_xxh64(const void *data, size_t len, uint64_t seed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _HASH_H */
@@ -0,0 +1,536 @@
+/**
+ * ioring.c
+ * Batched loading of note contents through io_uring.
+ *
+ * Notes are loaded in batches. First an openat and a statx are queued for every
+ * note of the batch, then a read into a buffer sized after the file, hard
+ * linked to a close of the descriptor. Each stage is submitted with a single
+ * system call, so a whole batch of notes costs a couple of round trips to the
+ * kernel instead of several per note. The ring is driven with raw system calls
+ * so that we don't depend on liburing. When io_uring isn't available, either
+ * because of the platform, the kernel or a sandbox, the contents are loaded by
+ * the regular pool of worker threads instead.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "ioring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fsutils.h"
+#include "note.h"
+#include "stats.h"
+
+#ifdef __linux__
+	#include <sys/mman.h>
+	#include <sys/syscall.h>
+	#ifdef __NR_io_uring_setup
+		#include <linux/io_uring.h>
+		#include <linux/stat.h>
+		#define IORING_AVAILABLE
+	#endif /* __NR_io_uring_setup */
+#endif /* __linux__ */
+
+#ifdef IORING_AVAILABLE
+/* Stages of a note's trip through the ring, stored in the user data. */
+#define IORING_TAG_OPEN  0
+#define IORING_TAG_STATX 1
+#define IORING_TAG_READ  2
+#define IORING_TAG_CLOSE 3
+
+/**
+ * Memory mapped io_uring instance.
+ */
+typedef struct {
+	int fd;
+
+	void *sq_ptr;
+	size_t sq_len;
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	unsigned int sq_entries;
+	struct io_uring_sqe *sqes;
+	size_t sqes_len;
+	unsigned int queued;
+
+	void *cq_ptr;
+	size_t cq_len;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+} ioring_t;
+
+/**
+ * State of a note in the current batch.
+ */
+typedef struct {
+	note_t *note;
+	int fd;
+	int err;
+	char *buf;
+	struct statx stx;
+} ioring_slot_t;
+
+/**
+ * Sets up a ring with a number of submission queue entries.
+ *
+ * @param ring    Ring object to be initialized.
+ * @param entries Number of submission queue entries.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if io_uring isn't available. Check errno.
+ */
+static bool ioring_setup(ioring_t *ring, unsigned int entries) {
+	struct io_uring_params p;
+	int err;
+
+	memset(ring, 0, sizeof(ioring_t));
+	memset(&p, 0, sizeof(p));
+	ring->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+	if (ring->fd < 0)
+		return false;
+
+	/* Map the submission and completion queues. */
+	ring->sq_len = p.sq_off.array + (p.sq_entries * sizeof(unsigned int));
+	ring->cq_len = p.cq_off.cqes + (p.cq_entries * sizeof(struct io_uring_cqe));
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_len > ring->sq_len)
+			ring->sq_len = ring->cq_len;
+		ring->cq_len = ring->sq_len;
+	}
+	ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+						MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ptr == MAP_FAILED)
+		goto fail;
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cq_ptr = ring->sq_ptr;
+	} else {
+		ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+							MAP_SHARED | MAP_POPULATE, ring->fd,
+							IORING_OFF_CQ_RING);
+		if (ring->cq_ptr == MAP_FAILED) {
+			ring->cq_ptr = NULL;
+			goto fail;
+		}
+	}
+
+	/* Map the submission queue entries themselves. */
+	ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqes_len,
+		PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+		IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		ring->sqes = NULL;
+		goto fail;
+	}
+
+	/* Find our way around the queues. */
+	ring->sq_head = (unsigned int *)((char *)ring->sq_ptr + p.sq_off.head);
+	ring->sq_tail = (unsigned int *)((char *)ring->sq_ptr + p.sq_off.tail);
+	ring->sq_mask = (unsigned int *)((char *)ring->sq_ptr + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned int *)((char *)ring->sq_ptr + p.sq_off.array);
+	ring->sq_entries = p.sq_entries;
+	ring->cq_head = (unsigned int *)((char *)ring->cq_ptr + p.cq_off.head);
+	ring->cq_tail = (unsigned int *)((char *)ring->cq_ptr + p.cq_off.tail);
+	ring->cq_mask = (unsigned int *)((char *)ring->cq_ptr + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ptr +
+										 p.cq_off.cqes);
+
+	return true;
+
+fail:
+	err = errno;
+	if (ring->sq_ptr && (ring->sq_ptr != MAP_FAILED))
+		munmap(ring->sq_ptr, ring->sq_len);
+	if (ring->cq_ptr && (ring->cq_ptr != ring->sq_ptr))
+		munmap(ring->cq_ptr, ring->cq_len);
+	close(ring->fd);
+	errno = err;
+
+	return false;
+}
+
+/**
+ * Tears down a ring.
+ *
+ * @param ring Ring object.
+ */
+static void ioring_teardown(ioring_t *ring) {
+	munmap(ring->sqes, ring->sqes_len);
+	if (ring->cq_ptr != ring->sq_ptr)
+		munmap(ring->cq_ptr, ring->cq_len);
+	munmap(ring->sq_ptr, ring->sq_len);
+	close(ring->fd);
+}
+
+/**
+ * Gets the next free submission queue entry, already cleared.
+ *
+ * @param ring Ring object.
+ *
+ * @return Submission queue entry. The batches are sized so that there's
+ *         always one available.
+ */
+static struct io_uring_sqe* ioring_get_sqe(ioring_t *ring) {
+	struct io_uring_sqe *sqe;
+	unsigned int tail;
+	unsigned int idx;
+
+	tail = *ring->sq_tail + ring->queued;
+	idx = tail & *ring->sq_mask;
+	sqe = &ring->sqes[idx];
+	ring->sq_array[idx] = idx;
+	ring->queued++;
+
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	return sqe;
+}
+
+/**
+ * Submits every queued entry and waits for all of them to complete.
+ *
+ * @param ring Ring object.
+ *
+ * @return Number of entries submitted or -1 in case of an error.
+ */
+static int ioring_submit_and_wait(ioring_t *ring) {
+	unsigned int count;
+	int ret;
+
+	/* Publish the new entries to the kernel. */
+	count = ring->queued;
+	__atomic_store_n(ring->sq_tail, *ring->sq_tail + count, __ATOMIC_RELEASE);
+	ring->queued = 0;
+
+	/* Wait for everything in a single system call. */
+	do {
+		ret = (int)syscall(__NR_io_uring_enter, ring->fd, count, count,
+						   IORING_ENTER_GETEVENTS, NULL, 0);
+	} while ((ret < 0) && (errno == EINTR));
+	if (ret < 0)
+		return -1;
+
+	STATS_INC(STATS_URING_ENTERS);
+	STATS_ADD(STATS_URING_SQES, count);
+	STATS_MAX(STATS_URING_MAX_DEPTH, count);
+
+	return (int)count;
+}
+
+/**
+ * Goes through the completed entries, storing their results in the slots.
+ *
+ * @param ring  Ring object.
+ * @param slots Slots of the batch.
+ */
+static void ioring_reap(ioring_t *ring, ioring_slot_t *slots) {
+	struct io_uring_cqe *cqe;
+	ioring_slot_t *slot;
+	unsigned int head;
+	unsigned int tail;
+
+	head = *ring->cq_head;
+	tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+	for (; head != tail; head++) {
+		cqe = &ring->cqes[head & *ring->cq_mask];
+		slot = &slots[cqe->user_data >> 2];
+
+		switch (cqe->user_data & 3) {
+			case IORING_TAG_OPEN:
+				slot->fd = (cqe->res >= 0) ? cqe->res : -1;
+				if (cqe->res < 0)
+					slot->err = -cqe->res;
+				break;
+			case IORING_TAG_STATX:
+				if (cqe->res < 0)
+					slot->err = -cqe->res;
+				break;
+			case IORING_TAG_READ:
+				if (cqe->res < 0) {
+					slot->err = -cqe->res;
+					break;
+				}
+
+				/* Hand the buffer over to the note. */
+				slot->buf[cqe->res] = '\0';
+				if (cqe->res > 0) {
+					slot->note->content.data = slot->buf;
+					slot->note->content.len = (size_t)cqe->res;
+					slot->note->content.mapped = false;
+					slot->note->content.borrowed = false;
+					slot->buf = NULL;
+					note_hash(slot->note);
+				}
+				STATS_ADD(STATS_BYTES_READ, cqe->res);
+				break;
+			default:
+				break;
+		}
+	}
+	__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/**
+ * Loads a batch of notes through the ring.
+ *
+ * @param ring   Ring object.
+ * @param slots  Slots of the batch with their notes set.
+ * @param count  Number of notes in the batch.
+ * @param report Report to be updated.
+ *
+ * @return FALSE if the ring stopped working. Notes that weren't loaded still
+ *         have their slot errors set.
+ */
+static bool ioring_batch(ioring_t *ring, ioring_slot_t *slots, size_t count,
+						 ioring_report_t *report) {
+	struct io_uring_sqe *sqe;
+	ioring_slot_t *slot;
+	workspace_t *ws;
+	const char *name;
+	size_t size;
+	size_t i;
+	int dirfd;
+	int n;
+
+	/* Open every note and find out how big it is. */
+	for (i = 0; i < count; i++) {
+		slot = &slots[i];
+		slot->fd = -1;
+		slot->err = 0;
+		slot->buf = NULL;
+
+		/* Reach notes relative to their workspace, just like the loader. */
+		ws = note_get_workspace(slot->note);
+		name = (ws != NULL) ?
+			workspace_relname(ws, note_get_path(slot->note)) : NULL;
+		if (name != NULL) {
+			dirfd = workspace_get_fd(ws);
+		} else {
+			dirfd = AT_FDCWD;
+			name = note_get_path(slot->note);
+		}
+
+		sqe = ioring_get_sqe(ring);
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->fd = dirfd;
+		sqe->addr = (unsigned long)name;
+		sqe->open_flags = O_RDONLY | O_CLOEXEC;
+		sqe->user_data = (i << 2) | IORING_TAG_OPEN;
+
+		sqe = ioring_get_sqe(ring);
+		sqe->opcode = IORING_OP_STATX;
+		sqe->fd = dirfd;
+		sqe->addr = (unsigned long)name;
+		sqe->len = STATX_SIZE;
+		sqe->off = (unsigned long)&slot->stx;
+		sqe->user_data = (i << 2) | IORING_TAG_STATX;
+	}
+	STATS_ADD(STATS_SYS_OPEN, count);
+	STATS_ADD(STATS_SYS_STAT, count);
+	n = ioring_submit_and_wait(ring);
+	if (n < 0)
+		return false;
+	report->sqes += n;
+	if ((size_t)n > report->max_depth)
+		report->max_depth = n;
+	ioring_reap(ring, slots);
+
+	/* Read them into buffers of the right size and close them. */
+	for (i = 0; i < count; i++) {
+		slot = &slots[i];
+		if (slot->fd < 0)
+			continue;
+
+		/* Big or empty files are better off with the regular loader. */
+		size = (size_t)slot->stx.stx_size;
+		if ((slot->err == 0) && (size > 0) && (size < FS_VIEW_MMAP_THRESHOLD))
+			slot->buf = (char *)malloc((size + 1) * sizeof(char));
+		if (slot->buf != NULL) {
+			STATS_INC(STATS_ALLOCS);
+			STATS_INC(STATS_SYS_READ);
+			sqe = ioring_get_sqe(ring);
+			sqe->opcode = IORING_OP_READ;
+			sqe->fd = slot->fd;
+			sqe->addr = (unsigned long)slot->buf;
+			sqe->len = (unsigned int)size;
+			sqe->off = 0;
+			sqe->flags = IOSQE_IO_HARDLINK;
+			sqe->user_data = (i << 2) | IORING_TAG_READ;
+		} else if ((slot->err == 0) && (size > 0)) {
+			slot->err = EFBIG;
+		}
+
+		sqe = ioring_get_sqe(ring);
+		sqe->opcode = IORING_OP_CLOSE;
+		sqe->fd = slot->fd;
+		sqe->user_data = (i << 2) | IORING_TAG_CLOSE;
+		STATS_INC(STATS_SYS_CLOSE);
+	}
+	n = ioring_submit_and_wait(ring);
+	if (n < 0) {
+		/* Don't leave the descriptors behind. */
+		for (i = 0; i < count; i++) {
+			if (slots[i].fd >= 0)
+				close(slots[i].fd);
+		}
+		return false;
+	}
+	report->sqes += n;
+	if ((size_t)n > report->max_depth)
+		report->max_depth = n;
+	ioring_reap(ring, slots);
+	report->batches++;
+
+	return true;
+}
+#endif /* IORING_AVAILABLE */
+
+/**
+ * Loads the contents of a single note. Used for the fallback.
+ *
+ * @param note  Note object.
+ * @param index Index of the note in the collection.
+ * @param ctx   Unused.
+ */
+static void ioring_fallback_func(note_t *note, size_t index, void *ctx) {
+	loader_note_load(note);
+}
+
+/**
+ * Checks if io_uring can be used on this machine.
+ *
+ * @return TRUE if we were able to set up a ring.
+ */
+bool ioring_supported(void) {
+#ifdef IORING_AVAILABLE
+	ioring_t ring;
+
+	if (!ioring_setup(&ring, 2))
+		return false;
+	ioring_teardown(&ring);
+
+	return true;
+#else
+	return false;
+#endif /* IORING_AVAILABLE */
+}
+
+/**
+ * Loads the contents of a contiguous range of notes in batches through
+ * io_uring, falling back to the pool of worker threads for anything it
+ * couldn't load, or for everything if io_uring isn't available.
+ *
+ * @param list   Note collection.
+ * @param first  Index of the first note in the range.
+ * @param count  Number of notes in the range.
+ * @param opts   Loading options or NULL to use the defaults. The queue depth
+ *               sets how many notes are loaded per batch.
+ * @param report Will hold information about how the load went. (Optional)
+ *
+ * @return TRUE if io_uring was used.
+ *         FALSE if everything was loaded by the fallback.
+ */
+bool ioring_load_range(notelist_t *list, size_t first, size_t count,
+					   const loader_opts_t *opts, ioring_report_t *report) {
+	ioring_report_t dummy;
+#ifdef IORING_AVAILABLE
+	ioring_slot_t *slots;
+	ioring_t ring;
+	note_t *note;
+	size_t depth;
+	size_t done;
+	size_t batch;
+	size_t n;
+	size_t i;
+#endif /* IORING_AVAILABLE */
+
+	if (report == NULL)
+		report = &dummy;
+	memset(report, 0, sizeof(ioring_report_t));
+	if (first > notelist_len(list))
+		first = notelist_len(list);
+	if (count > (notelist_len(list) - first))
+		count = notelist_len(list) - first;
+
+#ifdef IORING_AVAILABLE
+	/* Figure out the size of our batches. */
+	depth = ((opts == NULL) || (opts->queue_depth == 0)) ?
+		IORING_DEFAULT_DEPTH : opts->queue_depth;
+	if (depth > IORING_MAX_DEPTH)
+		depth = IORING_MAX_DEPTH;
+
+	/* Set up a ring with two entries per note of a batch. */
+	slots = (ioring_slot_t *)malloc(depth * sizeof(ioring_slot_t));
+	if (slots == NULL)
+		goto fallback;
+	if (!ioring_setup(&ring, (unsigned int)(depth * 2))) {
+		free(slots);
+		goto fallback;
+	}
+	report->uring = true;
+
+	/* Go through the notes in batches. */
+	for (done = 0; done < count; done += n) {
+		/* Gather the notes that still need loading. */
+		batch = 0;
+		for (n = 0; ((done + n) < count) && (batch < depth); n++) {
+			note = notelist_get(list, first + done + n);
+			if (note_is_loaded(note))
+				continue;
+
+			/* Notes without a path are left for the fallback. */
+			if (note_get_path(note) == NULL) {
+				loader_note_load(note);
+				report->fallbacks++;
+				continue;
+			}
+
+			slots[batch++].note = note;
+		}
+		if (batch == 0)
+			continue;
+
+		/* Load them and pick up whatever the ring couldn't. */
+		if (!ioring_batch(&ring, slots, batch, report)) {
+			ioring_teardown(&ring);
+			free(slots);
+			first += done;
+			count -= done;
+			goto fallback;
+		}
+		for (i = 0; i < batch; i++) {
+			if (slots[i].buf)
+				free(slots[i].buf);
+			if (!note_is_loaded(slots[i].note)) {
+				/* Empty files are loaded just fine by the ring. */
+				if (slots[i].err == 0) {
+					slots[i].note->content.data = "";
+					slots[i].note->content.len = 0;
+					slots[i].note->content.mapped = false;
+					slots[i].note->content.borrowed = false;
+					note_hash(slots[i].note);
+					continue;
+				}
+
+				loader_note_load(slots[i].note);
+				report->fallbacks++;
+			}
+		}
+	}
+
+	ioring_teardown(&ring);
+	free(slots);
+	return true;
+
+fallback:
+#endif /* IORING_AVAILABLE */
+	loader_foreach_range(list, first, count, opts, ioring_fallback_func, NULL);
+	return false;
+}
@@ -0,0 +1,47 @@
+/**
+ * ioring.h
+ * Batched loading of note contents through io_uring.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _IORING_H
+#define _IORING_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "loader.h"
+#include "notelist.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Default number of notes loaded per batch. */
+#define IORING_DEFAULT_DEPTH 64
+
+/* Maximum number of notes loaded per batch. */
+#define IORING_MAX_DEPTH 4096
+
+/**
+ * Information about how a batched load went.
+ */
+typedef struct {
+	bool uring;
+	size_t batches;
+	size_t sqes;
+	size_t max_depth;
+	size_t fallbacks;
+} ioring_report_t;
+
+/* Loading. */
+bool ioring_supported(void);
+bool ioring_load_range(notelist_t *list, size_t first, size_t count,
+					   const loader_opts_t *opts, ioring_report_t *report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _IORING_H */
@@ -0,0 +1,690 @@
+/**
+ * loader.c
+ * Loads a whole workspace of notes using every core available.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "loader.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fsutils.h"
+#include "ioring.h"
+#include "walk.h"
+
+/* Number of entries a worker takes from the queue at a time. */
+#define LOADER_GRAB 32
+
+/**
+ * Shared queue of directory entries waiting to be loaded.
+ */
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	const char **names;
+	size_t len;
+	size_t cap;
+	size_t head;
+	bool done;
+
+	char **blocks;
+	size_t nblocks;
+
+	const char *basepath;
+	bool content;
+} loader_queue_t;
+
+/**
+ * Worker thread state.
+ */
+typedef struct {
+	loader_queue_t *queue;
+	notelist_t *list;
+	pthread_t thread;
+} loader_worker_t;
+
+/**
+ * Shared state of the workers going through a note collection.
+ */
+typedef struct {
+	pthread_mutex_t lock;
+	notelist_t *list;
+	size_t next;
+	size_t end;
+	size_t workers;
+
+	loader_func_t func;
+	loader_wfunc_t wfunc;
+	void *ctx;
+} loader_foreach_t;
+
+/**
+ * Populates a loader options object with sensible defaults.
+ *
+ * @param opts Loader options object.
+ */
+void loader_opts_init(loader_opts_t *opts) {
+	opts->threads = 0;
+	opts->content = true;
+	opts->depth = 0;
+	opts->queue_depth = 0;
+	opts->filter = NULL;
+}
+
+/**
+ * Gets the number of processors currently online.
+ *
+ * @return Number of processors available. (At least 1)
+ */
+size_t loader_ncpus(void) {
+	long n;
+
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+	return (n < 1) ? 1 : (size_t)n;
+}
+
+/**
+ * Pushes a chunk of directory entries into the queue, copying their names into
+ * a single block that lives until the queue is destroyed.
+ *
+ * @param queue   Loader queue.
+ * @param entries Chunk of directory entries.
+ * @param count   Number of entries in the chunk.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+static bool loader_queue_push(loader_queue_t *queue,
+							  const fs_dirent_t *entries, size_t count) {
+	const char **names;
+	char **blocks;
+	char *block;
+	char *buf;
+	size_t total;
+	size_t len;
+	size_t i;
+
+	/* Copy the names over to a single block. */
+	total = 0;
+	for (i = 0; i < count; i++)
+		total += strlen(entries[i].name) + 1;
+	block = (char *)malloc(total * sizeof(char));
+	if (block == NULL)
+		return false;
+
+	pthread_mutex_lock(&queue->lock);
+
+	/* Make room for the new entries. */
+	blocks = (char **)realloc(queue->blocks,
+							  (queue->nblocks + 1) * sizeof(char *));
+	if (blocks == NULL)
+		goto fail;
+	queue->blocks = blocks;
+	queue->blocks[queue->nblocks++] = block;
+	if ((queue->len + count) > queue->cap) {
+		queue->cap = (queue->cap == 0) ? 1024 : queue->cap * 2;
+		while (queue->cap < (queue->len + count))
+			queue->cap *= 2;
+
+		names = (const char **)realloc(queue->names,
+									   queue->cap * sizeof(const char *));
+		if (names == NULL) {
+			queue->nblocks--;
+			goto fail;
+		}
+		queue->names = names;
+	}
+
+	/* Populate the queue. */
+	buf = block;
+	for (i = 0; i < count; i++) {
+		len = strlen(entries[i].name) + 1;
+		memcpy(buf, entries[i].name, len);
+		queue->names[queue->len++] = buf;
+		buf += len;
+	}
+
+	/* Wake up the workers. */
+	pthread_cond_broadcast(&queue->cond);
+	pthread_mutex_unlock(&queue->lock);
+
+	return true;
+
+fail:
+	pthread_mutex_unlock(&queue->lock);
+	free(block);
+	return false;
+}
+
+/**
+ * Loads a single note from the workspace.
+ *
+ * @param queue Loader queue.
+ * @param path  Scratch buffer for building paths. (Will be reallocated)
+ * @param plen  Size of the scratch buffer.
+ * @param name  File name of the note inside the workspace.
+ * @param arena Arena to allocate the note from or NULL to use the heap.
+ *
+ * @return Loaded note or NULL if it couldn't be parsed.
+ */
+static note_t* loader_load_note(loader_queue_t *queue, char **path,
+								size_t *plen, const char *name,
+								arena_t *arena) {
+	note_t *note;
+	size_t blen;
+	size_t nlen;
+	char *buf;
+
+	/* Ensure our scratch buffer has enough space for the path. */
+	blen = strlen(queue->basepath);
+	nlen = strlen(name);
+	if ((blen + nlen + 2) > *plen) {
+		buf = (char *)realloc(*path, (blen + nlen + 2) * sizeof(char));
+		if (buf == NULL)
+			return NULL;
+		*path = buf;
+		*plen = blen + nlen + 2;
+	}
+
+	/* Build the path to the note. */
+	buf = *path;
+	memcpy(buf, queue->basepath, blen);
+	if ((blen > 0) && (buf[blen - 1] != PATH_SEP))
+		buf[blen++] = PATH_SEP;
+	memcpy(buf + blen, name, nlen + 1);
+
+	/* Parse the note and load its contents if needed. */
+	note = note_from_fname_arena(buf, arena);
+	if ((note != NULL) && queue->content)
+		loader_note_load(note);
+
+	return note;
+}
+
+/**
+ * Worker thread that keeps pulling entries from the queue until there's nothing
+ * left to load.
+ *
+ * @param arg Worker state object.
+ *
+ * @return Always NULL.
+ */
+static void* loader_worker(void *arg) {
+	loader_worker_t *worker;
+	loader_queue_t *queue;
+	const char *names[LOADER_GRAB];
+	note_t *note;
+	char *path;
+	size_t plen;
+	size_t count;
+	size_t i;
+
+	worker = (loader_worker_t *)arg;
+	queue = worker->queue;
+	path = NULL;
+	plen = 0;
+
+	for (;;) {
+		/* Wait for something to be in the queue. */
+		pthread_mutex_lock(&queue->lock);
+		while ((queue->head == queue->len) && !queue->done)
+			pthread_cond_wait(&queue->cond, &queue->lock);
+		if (queue->head == queue->len) {
+			pthread_mutex_unlock(&queue->lock);
+			break;
+		}
+
+		/* Grab a bunch of entries at once to keep contention low. */
+		count = queue->len - queue->head;
+		if (count > LOADER_GRAB)
+			count = LOADER_GRAB;
+		memcpy(names, queue->names + queue->head, count * sizeof(const char *));
+		queue->head += count;
+		pthread_mutex_unlock(&queue->lock);
+
+		/* Load the notes. */
+		for (i = 0; i < count; i++) {
+			note = loader_load_note(queue, &path, &plen, names[i],
+									notelist_arena(worker->list));
+			if ((note != NULL) && !notelist_push(worker->list, note))
+				note_free(note);
+		}
+	}
+
+	if (path)
+		free(path);
+
+	return NULL;
+}
+
+/**
+ * Loads every note in a workspace directory using a pool of worker threads. The
+ * main thread enumerates the directory and feeds a shared queue while the
+ * workers parse the file names and optionally load their contents.
+ *
+ * @param path Path to the workspace directory.
+ * @param opts Loading options or NULL to use the defaults. If a depth is set
+ *             subdirectories are loaded as well. If a queue depth is set the
+ *             contents are loaded in batches through io_uring afterwards.
+ * @param list Note collection to append the notes to. They will be sorted by
+ *             date, title and format. If it uses an arena the notes will be
+ *             allocated from it.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ *
+ * @see loader_opts_init
+ * @see notelist_use_arena
+ * @see walk_load
+ */
+bool loader_load(const char *path, const loader_opts_t *opts,
+				 notelist_t *list) {
+	loader_opts_t defopts;
+	loader_opts_t metaopts;
+	loader_queue_t queue;
+	loader_worker_t *workers;
+	fs_dirscan_t scan;
+	const fs_dirent_t *entries;
+	fs_dirent_t *kept;
+	fs_dirent_t *grown;
+	size_t kept_cap;
+	size_t nthreads;
+	size_t started;
+	size_t count;
+	size_t nkept;
+	size_t i;
+	bool ret;
+	int err;
+
+	/* Use the default options if none were provided. */
+	if (opts == NULL) {
+		loader_opts_init(&defopts);
+		opts = &defopts;
+	}
+
+	/* Batched loading of the contents only happens once we know every note. */
+	if (opts->content && (opts->queue_depth > 0)) {
+		metaopts = *opts;
+		metaopts.content = false;
+		if (!loader_load(path, &metaopts, list))
+			return false;
+
+		loader_load_contents(list, opts);
+		return true;
+	}
+
+	/* Subdirectories need a proper traversal. */
+	if (opts->depth > 0)
+		return walk_load(path, opts, list);
+
+	/* Figure out how many workers we should use. */
+	nthreads = (opts->threads == 0) ? loader_ncpus() : opts->threads;
+	if (nthreads > LOADER_MAX_THREADS)
+		nthreads = LOADER_MAX_THREADS;
+
+	/* Open the workspace. */
+	if (!fs_dirscan_open(&scan, path, FS_SCAN_FILES))
+		return false;
+
+	/* Set up the queue. */
+	memset(&queue, 0, sizeof(loader_queue_t));
+	pthread_mutex_init(&queue.lock, NULL);
+	pthread_cond_init(&queue.cond, NULL);
+	queue.basepath = path;
+	queue.content = opts->content;
+
+	/* Spin up the workers. */
+	workers = (loader_worker_t *)calloc(nthreads, sizeof(loader_worker_t));
+	if (workers == NULL) {
+		fs_dirscan_close(&scan);
+		return false;
+	}
+	for (started = 0; started < nthreads; started++) {
+		workers[started].queue = &queue;
+		workers[started].list = notelist_new();
+		if (workers[started].list == NULL)
+			break;
+
+		/* Each worker gets its own arena if the notes should live in one. */
+		if ((notelist_arena(list) != NULL) &&
+				!notelist_use_arena(workers[started].list)) {
+			notelist_free(workers[started].list);
+			break;
+		}
+
+		if (pthread_create(&workers[started].thread, NULL, loader_worker,
+						   &workers[started]) != 0) {
+			notelist_free(workers[started].list);
+			break;
+		}
+	}
+
+	/* Feed the queue. */
+	ret = true;
+	err = 0;
+	kept = NULL;
+	kept_cap = 0;
+	while ((count = fs_dirscan_next(&scan, &entries)) > 0) {
+		/* Leave out the entries that don't pass the filter right away. */
+		if (opts->filter != NULL) {
+			if (count > kept_cap) {
+				grown = (fs_dirent_t *)realloc(kept,
+											   count * sizeof(fs_dirent_t));
+				if (grown == NULL) {
+					ret = false;
+					err = ENOMEM;
+					break;
+				}
+				kept = grown;
+				kept_cap = count;
+			}
+
+			nkept = 0;
+			for (i = 0; i < count; i++) {
+				if (filter_match_at(opts->filter, fs_dirscan_fd(&scan),
+									entries[i].name)) {
+					kept[nkept++] = entries[i];
+				}
+			}
+			if (nkept == 0)
+				continue;
+
+			entries = kept;
+			count = nkept;
+		}
+
+		if (!loader_queue_push(&queue, entries, count)) {
+			ret = false;
+			err = ENOMEM;
+			break;
+		}
+	}
+	if (ret && (fs_dirscan_error(&scan) != 0)) {
+		ret = false;
+		err = fs_dirscan_error(&scan);
+	}
+	fs_dirscan_close(&scan);
+	if (kept)
+		free(kept);
+
+	/* Let the workers know that nothing else is coming. */
+	pthread_mutex_lock(&queue.lock);
+	queue.done = true;
+	pthread_cond_broadcast(&queue.cond);
+	pthread_mutex_unlock(&queue.lock);
+
+	/* Do the work ourselves if we couldn't spin up any threads. */
+	if (started == 0) {
+		workers[0].queue = &queue;
+		workers[0].list = list;
+		loader_worker(&workers[0]);
+	}
+
+	/* Wait for the workers and gather their results. */
+	for (i = 0; i < started; i++) {
+		pthread_join(workers[i].thread, NULL);
+		if (!notelist_extend(list, workers[i].list)) {
+			ret = false;
+			err = ENOMEM;
+		}
+		if (notelist_arena(list) != NULL)
+			arena_merge(notelist_arena(list), notelist_arena(workers[i].list));
+		notelist_free(workers[i].list);
+	}
+
+	/* Ensure the output is deterministic. */
+	notelist_sort(list);
+
+	/* Clean up. */
+	for (i = 0; i < queue.nblocks; i++)
+		free(queue.blocks[i]);
+	if (queue.blocks)
+		free(queue.blocks);
+	if (queue.names)
+		free(queue.names);
+	pthread_cond_destroy(&queue.cond);
+	pthread_mutex_destroy(&queue.lock);
+	free(workers);
+
+	if (!ret)
+		errno = err;
+	return ret;
+}
+
+/**
+ * Worker thread that keeps taking notes from a collection until every one of
+ * them has been taken care of.
+ *
+ * @param arg Shared state object.
+ *
+ * @return Always NULL.
+ */
+static void* loader_foreach_worker(void *arg) {
+	loader_foreach_t *state;
+	size_t worker;
+	size_t start;
+	size_t end;
+
+	/* Figure out who we are. */
+	state = (loader_foreach_t *)arg;
+	pthread_mutex_lock(&state->lock);
+	worker = state->workers++;
+	pthread_mutex_unlock(&state->lock);
+
+	for (;;) {
+		/* Grab a bunch of notes at once to keep contention low. */
+		pthread_mutex_lock(&state->lock);
+		start = state->next;
+		end = start + LOADER_GRAB;
+		if (end > state->end)
+			end = state->end;
+		state->next = end;
+		pthread_mutex_unlock(&state->lock);
+
+		if (start == end)
+			break;
+
+		/* Process them. */
+		for (; start < end; start++) {
+			if (state->wfunc != NULL) {
+				state->wfunc(state->list->notes[start], start, worker,
+							 state->ctx);
+			} else {
+				state->func(state->list->notes[start], start, state->ctx);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Calls one of two kinds of functions on a contiguous range of notes of a
+ * collection using a pool of worker threads.
+ *
+ * @param list  Note collection.
+ * @param first Index of the first note in the range.
+ * @param count Number of notes in the range.
+ * @param opts  Loading options or NULL to use the defaults.
+ * @param func  Function to be called for every note or NULL.
+ * @param wfunc Function to be called for every note along with the number of
+ *              the worker if func is NULL.
+ * @param ctx   Context to be passed to the function.
+ */
+static void loader_foreach_run(notelist_t *list, size_t first, size_t count,
+							   const loader_opts_t *opts, loader_func_t func,
+							   loader_wfunc_t wfunc, void *ctx) {
+	loader_foreach_t state;
+	pthread_t *threads;
+	size_t nthreads;
+	size_t started;
+	size_t i;
+
+	/* Figure out how many workers we should use. */
+	nthreads = ((opts == NULL) || (opts->threads == 0)) ? loader_ncpus() :
+		opts->threads;
+	if (nthreads > LOADER_MAX_THREADS)
+		nthreads = LOADER_MAX_THREADS;
+	if (first > list->len)
+		first = list->len;
+	if (count > (list->len - first))
+		count = list->len - first;
+	if (nthreads > ((count + LOADER_GRAB - 1) / LOADER_GRAB))
+		nthreads = (count + LOADER_GRAB - 1) / LOADER_GRAB;
+
+	/* Set up the shared state. */
+	pthread_mutex_init(&state.lock, NULL);
+	state.list = list;
+	state.next = first;
+	state.end = first + count;
+	state.workers = 0;
+	state.func = func;
+	state.wfunc = wfunc;
+	state.ctx = ctx;
+
+	/* Spin up the workers. The calling thread counts as one of them. */
+	started = 0;
+	threads = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+	if (threads != NULL) {
+		for (; (started + 1) < nthreads; started++) {
+			if (pthread_create(&threads[started], NULL, loader_foreach_worker,
+							   &state) != 0) {
+				break;
+			}
+		}
+	}
+
+	/* Help out (or do everything if we couldn't spin up any threads). */
+	loader_foreach_worker(&state);
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	if (threads)
+		free(threads);
+	pthread_mutex_destroy(&state.lock);
+}
+
+/**
+ * Calls a function on every note of a collection using a pool of worker
+ * threads. The function may be called concurrently for different notes.
+ *
+ * @param list Note collection.
+ * @param opts Loading options or NULL to use the defaults.
+ * @param func Function to be called for every note.
+ * @param ctx  Context to be passed to the function.
+ */
+void loader_foreach(notelist_t *list, const loader_opts_t *opts,
+					loader_func_t func, void *ctx) {
+	loader_foreach_range(list, 0, list->len, opts, func, ctx);
+}
+
+/**
+ * Calls a function on a contiguous range of notes of a collection using a pool
+ * of worker threads. The function may be called concurrently for different
+ * notes.
+ *
+ * @param list  Note collection.
+ * @param first Index of the first note in the range.
+ * @param count Number of notes in the range.
+ * @param opts  Loading options or NULL to use the defaults.
+ * @param func  Function to be called for every note.
+ * @param ctx   Context to be passed to the function.
+ */
+void loader_foreach_range(notelist_t *list, size_t first, size_t count,
+						  const loader_opts_t *opts, loader_func_t func,
+						  void *ctx) {
+	loader_foreach_run(list, first, count, opts, func, NULL, ctx);
+}
+
+/**
+ * Calls a function on every note of a collection using a pool of worker
+ * threads, telling it which worker is calling, so that it can keep state of
+ * its own for each one instead of setting it up for every note.
+ *
+ * @param list Note collection.
+ * @param opts Loading options or NULL to use the defaults.
+ * @param func Function to be called for every note.
+ * @param ctx  Context to be passed to the function.
+ */
+void loader_foreach_workers(notelist_t *list, const loader_opts_t *opts,
+							loader_wfunc_t func, void *ctx) {
+	loader_foreach_run(list, 0, list->len, opts, NULL, func, ctx);
+}
+
+/**
+ * Loads the contents of a single note, letting the user know if they couldn't
+ * be read, since the note is still printed, only without its contents.
+ *
+ * @param note Note object.
+ *
+ * @return TRUE if the contents were loaded.
+ *         FALSE if an error occurred. Check errno.
+ */
+bool loader_note_load(note_t *note) {
+	const char *path;
+	int err;
+
+	if (note_load(note))
+		return true;
+
+	err = errno;
+	path = note_get_path(note);
+	fprintf(stderr, "Couldn't load the contents of '%s': %s\n",
+			(path != NULL) ? path : note_get_title(note), strerror(err));
+	errno = err;
+
+	return false;
+}
+
+/**
+ * Loads the contents of a single note. Used by loader_load_contents.
+ *
+ * @param note  Note object.
+ * @param index Index of the note in the collection.
+ * @param ctx   Unused.
+ */
+static void loader_contents_func(note_t *note, size_t index, void *ctx) {
+	loader_note_load(note);
+}
+
+/**
+ * Loads the contents of every note in an already populated collection using a
+ * pool of worker threads, or in batches through io_uring if a queue depth was
+ * set.
+ *
+ * @param list Note collection.
+ * @param opts Loading options or NULL to use the defaults.
+ *
+ * @see loader_load_range
+ */
+void loader_load_contents(notelist_t *list, const loader_opts_t *opts) {
+	loader_load_range(list, 0, notelist_len(list), opts);
+}
+
+/**
+ * Loads the contents of a contiguous range of notes in an already populated
+ * collection using a pool of worker threads, or in batches through io_uring if
+ * a queue depth was set.
+ *
+ * @param list  Note collection.
+ * @param first Index of the first note in the range.
+ * @param count Number of notes in the range.
+ * @param opts  Loading options or NULL to use the defaults.
+ *
+ * @see ioring_load_range
+ */
+void loader_load_range(notelist_t *list, size_t first, size_t count,
+					   const loader_opts_t *opts) {
+	if ((opts != NULL) && (opts->queue_depth > 0)) {
+		ioring_load_range(list, first, count, opts, NULL);
+		return;
+	}
+
+	loader_foreach_range(list, first, count, opts, loader_contents_func, NULL);
+}
@@ -0,0 +1,79 @@
+/**
+ * loader.h
+ * Loads a whole workspace of notes using every core available.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _LOADER_H
+#define _LOADER_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "filter.h"
+#include "notelist.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Maximum number of worker threads the loader will spawn. */
+#ifndef LOADER_MAX_THREADS
+	#define LOADER_MAX_THREADS 256
+#endif /* LOADER_MAX_THREADS */
+
+/**
+ * Function called for every note by loader_foreach.
+ *
+ * @param note  Note object.
+ * @param index Index of the note in the collection.
+ * @param ctx   Context passed to loader_foreach.
+ */
+typedef void (*loader_func_t)(note_t *note, size_t index, void *ctx);
+
+/**
+ * Function called for every note by loader_foreach_workers.
+ *
+ * @param note   Note object.
+ * @param index  Index of the note in the collection.
+ * @param worker Number of the worker calling it, below LOADER_MAX_THREADS.
+ *               Calls with the same number never happen concurrently.
+ * @param ctx    Context passed to loader_foreach_workers.
+ */
+typedef void (*loader_wfunc_t)(note_t *note, size_t index, size_t worker,
+							   void *ctx);
+
+/**
+ * Workspace loading options.
+ */
+typedef struct {
+	size_t threads;
+	bool content;
+	size_t depth;
+	size_t queue_depth;
+	const filter_t *filter;
+} loader_opts_t;
+
+/* Loading. */
+void loader_opts_init(loader_opts_t *opts);
+size_t loader_ncpus(void);
+bool loader_load(const char *path, const loader_opts_t *opts,
+				 notelist_t *list);
+bool loader_note_load(note_t *note);
+void loader_load_contents(notelist_t *list, const loader_opts_t *opts);
+void loader_load_range(notelist_t *list, size_t first, size_t count,
+					   const loader_opts_t *opts);
+void loader_foreach(notelist_t *list, const loader_opts_t *opts,
+					loader_func_t func, void *ctx);
+void loader_foreach_range(notelist_t *list, size_t first, size_t count,
+						  const loader_opts_t *opts, loader_func_t func,
+						  void *ctx);
+void loader_foreach_workers(notelist_t *list, const loader_opts_t *opts,
+							loader_wfunc_t func, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _LOADER_H */
@@ -6,64 +6,1302 @@
  */
 
 #include <errno.h>
+#include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "dateutils.h"
+#include "filter.h"
 #include "fsutils.h"
+#include "ftindex.h"
+#include "grep.h"
+#include "loader.h"
+#include "manifest.h"
+#include "markdown.h"
+#include "metastore.h"
 #include "note.h"
+#include "notelist.h"
+#include "output.h"
+#include "pack.h"
+#include "query.h"
+#include "server.h"
+#include "stats.h"
+#include "strutils.h"
+#include "trie.h"
+#include "walk.h"
+#include "watch.h"
+#include "workspace.h"
+#include "wsindex.h"
+
+/* Number of notes printed by the recent command by default. */
+#define RECENT_DEFAULT 20
 
 /**
- * Program's main entry point.
+ * Command line options.
+ */
+typedef struct {
+	loader_opts_t loader;
+	bool use_index;
+	bool use_arena;
+	bool icase;
+	bool stats;
+	bool compress;
+	output_fmt_t fmt;
+	pack_t *pack;
+} options_t;
+
+/**
+ * Command handler function.
  *
- * @param argc Number of command line arguments provided.
- * @param argv Command line arguments.
+ * @param notes Notes in the workspace.
+ * @param path  Path to the workspace.
+ * @param opts  Command line options.
+ * @param argc  Number of command arguments.
+ * @param argv  Command arguments.
  *
  * @return Return code.
  */
-int main(int argc, char **argv) {
-	DIRHANDLE dir;
-	char *fname;
+typedef int (*command_func_t)(notelist_t *notes, const char *path,
+							  const options_t *opts, int argc, char **argv);
+
+/**
+ * Command that can be issued from the command line.
+ */
+typedef struct {
+	const char *name;
+	command_func_t func;
+	bool load;
+	bool content;
+	bool reads;
+} command_t;
+
+/* Command handlers. */
+static int cmd_list(notelist_t *notes, const char *path, const options_t *opts,
+					int argc, char **argv);
+static int cmd_search(notelist_t *notes, const char *path,
+					  const options_t *opts, int argc, char **argv);
+static int cmd_grep(notelist_t *notes, const char *path, const options_t *opts,
+					int argc, char **argv);
+static int cmd_watch(notelist_t *notes, const char *path,
+					 const options_t *opts, int argc, char **argv);
+static int cmd_range(notelist_t *notes, const char *path,
+					 const options_t *opts, int argc, char **argv);
+static int cmd_recent(notelist_t *notes, const char *path,
+					  const options_t *opts, int argc, char **argv);
+static int cmd_pack(notelist_t *notes, const char *path, const options_t *opts,
+					int argc, char **argv);
+static int cmd_unpack(notelist_t *notes, const char *path,
+					  const options_t *opts, int argc, char **argv);
+static int cmd_changed(notelist_t *notes, const char *path,
+					   const options_t *opts, int argc, char **argv);
+static int cmd_title(notelist_t *notes, const char *path, const options_t *opts,
+					 int argc, char **argv);
+static int cmd_tags(notelist_t *notes, const char *path, const options_t *opts,
+					int argc, char **argv);
+static int cmd_todo(notelist_t *notes, const char *path, const options_t *opts,
+					int argc, char **argv);
+static int cmd_serve(notelist_t *notes, const char *path,
+					 const options_t *opts, int argc, char **argv);
+static int cmd_client(notelist_t *notes, const char *path,
+					  const options_t *opts, int argc, char **argv);
+
+/* Available commands. The first one is the default. */
+static const command_t commands[] = {
+	{ "list", cmd_list, true, true, false },
+	{ "search", cmd_search, true, false, true },
+	{ "grep", cmd_grep, true, false, true },
+	{ "watch", cmd_watch, false, false, false },
+	{ "range", cmd_range, false, true, false },
+	{ "recent", cmd_recent, false, true, false },
+	{ "pack", cmd_pack, true, false, true },
+	{ "unpack", cmd_unpack, true, true, true },
+	{ "changed", cmd_changed, true, false, true },
+	{ "title", cmd_title, true, false, false },
+	{ "tags", cmd_tags, true, false, true },
+	{ "todo", cmd_todo, true, false, true },
+	{ "serve", cmd_serve, false, false, false },
+	{ "client", cmd_client, false, false, false },
+	{ NULL, NULL, false, false, false }
+};
+
+/* Long command line options. */
+static const struct option long_opts[] = {
+	{ "stats", no_argument, NULL, 'S' },
+	{ NULL, 0, NULL, 0 }
+};
+
+/**
+ * Prints out the program's usage information.
+ *
+ * @param name Name of the program executable.
+ */
+static void usage(const char *name) {
+	fprintf(stderr, "Usage: %s [-j threads] [-n] [-I] [-A] [-i] [-r] "
+			"[-d depth] [-q depth] [-f format] [-w filter] [-z] [--stats] [command] "
+			"workspace [args]\n\n", name);
+	fprintf(stderr, "Commands:\n");
+	fprintf(stderr, "    list            Prints every note. (Default)\n");
+	fprintf(stderr, "    search words    Searches the contents of the notes.\n");
+	fprintf(stderr, "    grep pattern    Prints every line containing a "
+			"literal pattern.\n");
+	fprintf(stderr, "    watch           Keeps running and prints every change "
+			"to the notes.\n");
+	fprintf(stderr, "    range from [to] Prints the notes between two "
+			"YYYY-MM-DD dates.\n");
+	fprintf(stderr, "    recent [count]  Prints the most recent notes. "
+			"(Defaults to %d)\n", RECENT_DEFAULT);
+	fprintf(stderr, "    pack file       Packs the workspace into a single "
+			"file.\n");
+	fprintf(stderr, "    unpack dir      Extracts a pack into a directory.\n");
+	fprintf(stderr, "    changed [file]  Prints the notes that changed since "
+			"it last ran.\n");
+	fprintf(stderr, "    title mode text Finds notes by exact, prefix or fuzzy "
+			"[distance] title.\n");
+	fprintf(stderr, "    tags [tag]      Prints the notes with a tag or every "
+			"tag in use.\n");
+	fprintf(stderr, "    todo            Prints every open TODO item.\n");
+	fprintf(stderr, "    serve           Keeps the workspace in memory and "
+			"answers clients.\n");
+	fprintf(stderr, "    client req      Asks a running server to ping, list, "
+			"lookup, search or read.\n");
+	fprintf(stderr, "\nA pack file can be used anywhere a workspace is "
+			"expected.\n");
+	fprintf(stderr, "\nOptions:\n");
+	fprintf(stderr, "    -j threads  Number of loader threads. (Defaults to "
+			"the number of cores)\n");
+	fprintf(stderr, "    -n          Don't load or print the contents of the "
+			"notes.\n");
+	fprintf(stderr, "    -I          Don't use the workspace metadata index.\n");
+	fprintf(stderr, "    -A          Allocate each note separately instead of "
+			"using an arena.\n");
+	fprintf(stderr, "    -i          Ignore ASCII case when matching.\n");
+	fprintf(stderr, "    -r          Also load the notes in subdirectories. "
+			"(Not for watch or serve)\n");
+	fprintf(stderr, "    -d depth    Only go this deep into subdirectories.\n");
+	fprintf(stderr, "    -q depth    Load contents in batches of this many "
+			"notes through io_uring.\n");
+	fprintf(stderr, "    -f format   Print notes as text, json (JSON Lines) or "
+			"tsv.\n");
+	fprintf(stderr, "    -w filter   Only load the notes that pass a filter. "
+			"(See the README)\n");
+	fprintf(stderr, "    -z          Compress notes when packing.\n");
+	fprintf(stderr, "    --stats     Print where the time went when done.\n");
+}
+
+/**
+ * Prints a contiguous range of notes in the output format chosen by the user,
+ * including their contents if they were loaded.
+ *
+ * @param notes   Note collection.
+ * @param first   Index of the first note to print.
+ * @param count   Number of notes to print.
+ * @param reverse Print them from the last one to the first one?
+ * @param header  Header to print before the notes in the text format or NULL.
+ * @param opts    Command line options.
+ *
+ * @return TRUE if everything was written out.
+ *         FALSE if an error occurred. Check errno.
+ */
+static bool print_notes(const notelist_t *notes, size_t first, size_t count,
+						bool reverse, const char *header,
+						const options_t *opts) {
+	output_t *out;
+	size_t i;
+
+	/* Make sure we don't get mixed up with anything printed before. */
+	fflush(stdout);
+	out = output_new(STDOUT_FILENO, opts->fmt, opts->loader.content);
+	if (out == NULL)
+		return false;
 
-	/* Open the note directory. */
-	dir = fs_opendir(argv[1]);
-	if (dir == NULL) {
-		printf("An error occurred while opening the directory '%s': %s\n",
-			   argv[1], strerror(errno));
+	/* Go through the notes. */
+	if ((header != NULL) && (opts->fmt == OUTPUT_TEXT))
+		output_puts(out, header);
+	for (i = 0; i < count; i++) {
+		output_note(out, notelist_get(notes, (reverse) ?
+										 (first + count - i - 1) :
+										 (first + i)));
+	}
+
+	return output_free(out);
+}
+
+/**
+ * Prints every note in the workspace.
+ *
+ * @param notes Notes in the workspace.
+ * @param path  Path to the workspace.
+ * @param opts  Command line options.
+ * @param argc  Number of command arguments.
+ * @param argv  Command arguments.
+ *
+ * @return Return code.
+ */
+static int cmd_list(notelist_t *notes, const char *path, const options_t *opts,
+					int argc, char **argv) {
+	/* Go through the notes in the workspace. */
+	if (!print_notes(notes, 0, notelist_len(notes), false, "Go these files:\n",
+					 opts)) {
 		return errno;
 	}
 
-	/* Go through the files inside of the directory. */
-	fname = NULL;
-	printf("Go these files:\n");
-	while ((fname = fs_readdir(dir, argv[1])) != NULL) {
-		note_t *note;
-		char *contents;
-
-		printf("%s\n", fname);
-		note = note_from_fname(fname);
-		note_debug_print(note);
-
-		contents = note_fh_slurp(note);
-		if (contents == NULL) {
-			printf("An error occurred while slurping the note: %s\n",
+	return 0;
+}
+
+/**
+ * Opens the full-text index of the workspace and brings it up to date with its
+ * notes, saving it back unless we're working with a pack or only a filtered
+ * part of the workspace.
+ * @warning The object allocated by this function must be free'd after use.
+ *
+ * @param notes Notes in the workspace.
+ * @param path  Path to the workspace.
+ * @param opts  Command line options.
+ *
+ * @return Full-text index or NULL if we couldn't allocate enough memory.
+ */
+static ftindex_t* open_ftindex(notelist_t *notes, const char *path,
+							   const options_t *opts) {
+	ftindex_t *idx;
+
+	idx = ftindex_open(path);
+	if (idx == NULL)
+		return NULL;
+	if (!ftindex_update(idx, notes)) {
+		fprintf(stderr, "An error occurred while indexing the notes: %s\n",
 				strerror(errno));
+	}
+	if ((opts->pack == NULL) && (opts->loader.filter == NULL) &&
+			!ftindex_save(idx, path)) {
+		fprintf(stderr, "An error occurred while saving the search index: "
+				"%s\n", strerror(errno));
+	}
+
+	return idx;
+}
+
+/**
+ * Searches the contents of the notes in the workspace using the full-text
+ * index, bringing it up to date first.
+ *
+ * @param notes Notes in the workspace.
+ * @param path  Path to the workspace.
+ * @param opts  Command line options.
+ * @param argc  Number of command arguments.
+ * @param argv  Command arguments. (Words to search for)
+ *
+ * @return Return code.
+ */
+static int cmd_search(notelist_t *notes, const char *path,
+					  const options_t *opts, int argc, char **argv) {
+	ftindex_t *idx;
+	ftindex_hit_t *hits;
+	char *query;
+	char dates[NOTE_DATESTR_LEN];
+	size_t count;
+	size_t i;
+
+	/* Build the query. */
+	if (argc < 1) {
+		fprintf(stderr, "No search words were provided.\n");
+		return 1;
+	}
+	query = NULL;
+	string_copy(&query, argv[0]);
+	for (i = 1; i < (size_t)argc; i++) {
+		string_concat(&query, " ");
+		string_concat(&query, argv[i]);
+	}
+
+	/* Bring the index up to date. */
+	idx = open_ftindex(notes, path, opts);
+	if (idx == NULL) {
+		free(query);
+		return ENOMEM;
+	}
+
+	/* Print the results. */
+	count = ftindex_search(idx, query, &hits);
+	for (i = 0; i < count; i++) {
+		note_get_datestr(hits[i].note, dates);
+
+		printf("%.4f\t%s\t%s\t%s\n", hits[i].score, dates,
+			   note_get_title(hits[i].note), note_get_path(hits[i].note));
+	}
+
+	if (hits)
+		free(hits);
+	ftindex_free(idx);
+	free(query);
+
+	return (count > 0) ? 0 : 1;
+}
+
+/**
+ * Prints every line of every note that contains a literal pattern.
+ *
+ * @param notes Notes in the workspace.
+ * @param path  Path to the workspace.
+ * @param opts  Command line options.
+ * @param argc  Number of command arguments.
+ * @param argv  Command arguments. (Pattern to look for)
+ *
+ * @return Return code.
+ */
+static int cmd_grep(notelist_t *notes, const char *path, const options_t *opts,
+					int argc, char **argv) {
+	size_t count;
+
+	if ((argc != 1) || (argv[0][0] == '\0')) {
+		fprintf(stderr, "A single non-empty pattern must be provided.\n");
+		return 1;
+	}
+
+	if (!grep_workspace(notes, &opts->loader, argv[0], opts->icase, stdout,
+						&count)) {
+		fprintf(stderr, "An error occurred while searching '%s': %s\n", path,
+				strerror(errno));
+		return 1;
+	}
+
+	return (count > 0) ? 0 : 1;
+}
+
+/**
+ * Prints out a change to the workspace as it's applied by the watcher.
+ *
+ * @param event Type of change.
+ * @param note  Affected note or NULL for rescans.
+ * @param ctx   Unused.
+ */
+static void watch_print(watch_event_t event, const note_t *note, void *ctx) {
+	char dates[NOTE_DATESTR_LEN];
+	char type;
+
+	/* Let the user know that we've started over. */
+	if (note == NULL) {
+		printf("*\n");
+		return;
+	}
+
+	switch (event) {
+		case WATCH_ADDED:
+			type = '+';
+			break;
+		case WATCH_REMOVED:
+			type = '-';
+			break;
+		default:
+			type = '~';
+			break;
+	}
+
+	note_get_datestr(note, dates);
+	printf("%c\t%s\t%s\t%s\n", type, dates, note_get_title(note),
+		   note_get_path(note));
+}
+
+/**
+ * Keeps the workspace loaded in memory, applying and printing every change made
+ * to it until the workspace directory goes away.
+ *
+ * @param notes Unused. The watcher loads the workspace itself.
+ * @param path  Path to the workspace.
+ * @param opts  Command line options.
+ * @param argc  Number of command arguments.
+ * @param argv  Command arguments.
+ *
+ * @return Return code.
+ */
+static int cmd_watch(notelist_t *notes, const char *path,
+					 const options_t *opts, int argc, char **argv) {
+	watch_t *w;
+
+	/* Packs never change under us. */
+	if (opts->pack != NULL) {
+		fprintf(stderr, "Packs can't be watched, only workspaces.\n");
+		return 1;
+	}
+	if (opts->loader.depth > 0) {
+		fprintf(stderr, "Subdirectories can't be watched, only the top of a "
+				"workspace.\n");
+		return 1;
+	}
+
+	/* Start watching. */
+	w = watch_new(path, &opts->loader);
+	if (w == NULL) {
+		fprintf(stderr, "An error occurred while watching '%s': %s\n", path,
+				strerror(errno));
+		return 1;
+	}
+	printf("Watching %lu notes.\n", (unsigned long)watch_count(w));
+	fflush(stdout);
+
+	/* Apply the changes as they come. */
+	while (watch_poll(w, -1, watch_print, NULL) >= 0)
+		fflush(stdout);
+
+	watch_free(w);
+	return 0;
+}
+
+/**
+ * Loads the metadata of every note without their contents, either from the
+ * metadata index or by walking the workspace and its subdirectories. Notes
+ * coming from a pack have their contents attached unless told otherwise, since
+ * they can't be loaded later.
+ *
+ * @param notes Note collection to be populated.
+ * @param path  Path to the workspace.
+ * @param opts  Command line options.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ */
+static bool load_metadata(notelist_t *notes, const char *path,
+						  const options_t *opts) {
+	loader_opts_t lopts;
+
+	if (opts->pack != NULL)
+		return pack_load(opts->pack, opts->loader.content,
+						 opts->loader.filter, notes);
+	if (opts->use_index)
+		return wsindex_load(path, notes);
+
+	lopts = opts->loader;
+	lopts.content = false;
+	return loader_load(path, &lopts, notes);
+}
+
+/**
+ * Checks if the metadata of the notes should be loaded into a compact store
+ * instead of a note collection, which is the case when every note has to be
+ * looked at to answer a query and they all come from a single directory.
+ *
+ * @param opts Command line options.
+ *
+ * @return TRUE if a metadata store should be used.
+ */
+static bool use_store(const options_t *opts) {
+	return (opts->pack == NULL) && (opts->loader.depth == 0) &&
+		(opts->use_index || (opts->loader.filter != NULL));
+}
+
+/**
+ * Loads the metadata of every note into a compact store, sorted, either from
+ * the metadata index or from the entries of the workspace directory.
+ * @warning The object allocated by this function must be free'd after use.
+ *
+ * @param path Path to the workspace.
+ * @param opts Command line options.
+ *
+ * @return Metadata store or NULL if an error occurred. Check errno.
+ */
+static metastore_t* load_store(const char *path, const options_t *opts) {
+	metastore_t *store;
+	bool ret;
+	int err;
+
+	store = metastore_new();
+	if (store == NULL)
+		return NULL;
+
+	if (opts->use_index) {
+		ret = wsindex_load_meta(path, store);
+	} else {
+		ret = metastore_scan(store, path, opts->loader.filter);
+	}
+	if (!ret || !metastore_sort(store)) {
+		err = errno;
+		metastore_free(store);
+		errno = err;
+		return NULL;
+	}
+
+	return store;
+}
+
+/**
+ * Prints the notes written between two dates, newest last. When the metadata
+ * index is used, or a filter is given, the metadata is kept in a compact store
+ * and note objects are only created for the notes in range. When subdirectories
+ * are included the range is found with a binary search, otherwise only the
+ * entries in range are ever allocated. Either way only the matching notes have
+ * their contents loaded.
+ *
+ * @param notes Empty note collection to be populated.
+ * @param path  Path to the workspace.
+ * @param opts  Command line options.
+ * @param argc  Number of command arguments.
+ * @param argv  Command arguments. (Earliest and optionally latest date)
+ *
+ * @return Return code.
+ */
+static int cmd_range(notelist_t *notes, const char *path,
+					 const options_t *opts, int argc, char **argv) {
+	metastore_t *store;
+	int32_t from;
+	int32_t to;
+	size_t first;
+	size_t count;
+	bool ret;
+
+	/* Parse the dates. */
+	if ((argc < 1) || (argc > 2) || (strlen(argv[0]) != DATE_STR_LEN) ||
+			!date_parse(argv[0], &from)) {
+		fprintf(stderr, "A valid YYYY-MM-DD starting date must be provided.\n");
+		return 1;
+	}
+	to = date_days_from_civil(9999, 12, 31);
+	if ((argc > 1) && ((strlen(argv[1]) != DATE_STR_LEN) ||
+					   !date_parse(argv[1], &to))) {
+		fprintf(stderr, "The ending date must be in the YYYY-MM-DD format.\n");
+		return 1;
+	}
+
+	/* Find the notes in range. */
+	first = 0;
+	if (use_store(opts)) {
+		store = load_store(path, opts);
+		ret = store != NULL;
+		if (ret) {
+			count = metastore_range(store, from, to, &first);
+			ret = metastore_export(store, first, count, notes);
+			metastore_free(store);
 		}
-		printf("---\n%s\n---\n", contents);
-		free(contents);
-		printf("\n");
+		first = 0;
+		count = notelist_len(notes);
+	} else if ((opts->pack != NULL) || (opts->loader.depth > 0) ||
+			   (opts->loader.filter != NULL)) {
+		ret = load_metadata(notes, path, opts);
+		count = (ret) ? notelist_range(notes, date_from_days(from),
+									   date_from_days(to), &first) : 0;
+	} else {
+		ret = query_range(path, date_from_days(from), date_from_days(to),
+						  notes);
+		count = notelist_len(notes);
+	}
+	if (!ret) {
+		fprintf(stderr, "An error occurred while querying '%s': %s\n", path,
+				strerror(errno));
+		return 1;
+	}
 
-		free(fname);
-		fname = NULL;
-		free(note);
+	/* Load and print them. */
+	if (opts->loader.content)
+		loader_load_range(notes, first, count, &opts->loader);
+	if (!print_notes(notes, first, count, false, NULL, opts))
+		return errno;
+
+	return (count > 0) ? 0 : 1;
+}
+
+/**
+ * Prints the most recent notes, newest first. When the metadata index is used,
+ * or a filter is given, they're taken from the end of a sorted metadata store
+ * and only they become note objects. When subdirectories are included they're
+ * taken from the end of the sorted collection, otherwise the directory is
+ * scanned keeping only the most recent entries in a bounded heap. Either way
+ * only those notes have their contents loaded.
+ *
+ * @param notes Empty note collection to be populated.
+ * @param path  Path to the workspace.
+ * @param opts  Command line options.
+ * @param argc  Number of command arguments.
+ * @param argv  Command arguments. (Optional number of notes)
+ *
+ * @return Return code.
+ */
+static int cmd_recent(notelist_t *notes, const char *path,
+					  const options_t *opts, int argc, char **argv) {
+	metastore_t *store;
+	size_t first;
+	size_t count;
+	bool ret;
+
+	/* How many notes should we get? */
+	count = RECENT_DEFAULT;
+	if (argc > 0)
+		count = (size_t)strtoul(argv[0], NULL, 10);
+
+	/* Find the most recent notes. */
+	if (use_store(opts)) {
+		store = load_store(path, opts);
+		ret = store != NULL;
+		if (ret) {
+			if (count > metastore_len(store))
+				count = metastore_len(store);
+			ret = metastore_export(store, metastore_len(store) - count, count,
+								   notes);
+			metastore_free(store);
+		}
+		first = 0;
+		count = notelist_len(notes);
+	} else if ((opts->pack != NULL) || (opts->loader.depth > 0) ||
+			   (opts->loader.filter != NULL)) {
+		ret = load_metadata(notes, path, opts);
+		if (count > notelist_len(notes))
+			count = notelist_len(notes);
+		first = notelist_len(notes) - count;
+	} else {
+		ret = query_recent(path, count, notes);
+		count = notelist_len(notes);
+		first = 0;
+	}
+	if (!ret) {
+		fprintf(stderr, "An error occurred while querying '%s': %s\n", path,
+				strerror(errno));
+		return 1;
 	}
 
-	/* Close the directory handle. */
-	if (fs_closedir(dir)) {
-		printf("An error occurred while closing the notes directory: %s\n",
-			   strerror(errno));
+	/* Load and print them. */
+	if (opts->loader.content)
+		loader_load_range(notes, first, count, &opts->loader);
+	if (!print_notes(notes, first, count, true, NULL, opts))
 		return errno;
+
+	return (count > 0) ? 0 : 1;
+}
+
+/**
+ * Packs every note in the workspace into a single file.
+ *
+ * @param notes Notes in the workspace.
+ * @param path  Path to the workspace.
+ * @param opts  Command line options.
+ * @param argc  Number of command arguments.
+ * @param argv  Command arguments. (Path to the pack file)
+ *
+ * @return Return code.
+ */
+static int cmd_pack(notelist_t *notes, const char *path, const options_t *opts,
+					int argc, char **argv) {
+	if (argc != 1) {
+		fprintf(stderr, "The path to the pack file must be provided.\n");
+		return 1;
 	}
 
+	if (!pack_write(notes, path, argv[0], opts->compress)) {
+		fprintf(stderr, "An error occurred while packing '%s': %s\n", path,
+				strerror(errno));
+		return 1;
+	}
+	printf("Packed %lu notes into '%s'.\n",
+		   (unsigned long)notelist_len(notes), argv[0]);
+
 	return 0;
 }
+
+/**
+ * Extracts every note in a pack into a directory.
+ *
+ * @param notes Notes in the pack.
+ * @param path  Path to the pack file.
+ * @param opts  Command line options.
+ * @param argc  Number of command arguments.
+ * @param argv  Command arguments. (Path to the destination directory)
+ *
+ * @return Return code.
+ */
+static int cmd_unpack(notelist_t *notes, const char *path,
+					  const options_t *opts, int argc, char **argv) {
+	if (opts->pack == NULL) {
+		fprintf(stderr, "'%s' isn't a pack file.\n", path);
+		return 1;
+	}
+	if (argc != 1) {
+		fprintf(stderr, "The destination directory must be provided.\n");
+		return 1;
+	}
+
+	if (!pack_extract(notes, path, argv[0])) {
+		fprintf(stderr, "An error occurred while unpacking into '%s': %s\n",
+				argv[0], strerror(errno));
+		return 1;
+	}
+	printf("Unpacked %lu notes into '%s'.\n",
+		   (unsigned long)notelist_len(notes), argv[0]);
+
+	return 0;
+}
+
+/**
+ * Prints a change found by manifest_changed_since.
+ *
+ * @param change Kind of change.
+ * @param note   Note that was added or changed. NULL if it was removed.
+ * @param path   Path to the note.
+ * @param ctx    Unused.
+ */
+static void print_change(manifest_change_t change, note_t *note,
+						 const char *path, void *ctx) {
+	static const char marks[] = { 'A', 'M', 'D' };
+
+	printf("%c\t%s\n", marks[change], path);
+}
+
+/**
+ * Prints every note that was added, changed or removed since the last time the
+ * command ran, and records the current state for the next time.
+ *
+ * @param notes Notes in the workspace.
+ * @param path  Path to the workspace.
+ * @param opts  Command line options.
+ * @param argc  Number of command arguments.
+ * @param argv  Command arguments. (Optional path to the manifest file)
+ *
+ * @return Return code.
+ */
+static int cmd_changed(notelist_t *notes, const char *path,
+					   const options_t *opts, int argc, char **argv) {
+	char depthname[sizeof(MANIFEST_DEPTH_FNAME) + 20];
+	manifest_t *manifest;
+	char *fname;
+	size_t count;
+	size_t depth;
+
+	/* Notes left out by a filter would look like they were deleted. */
+	if (opts->loader.filter != NULL) {
+		fprintf(stderr, "Filters can't be used to look for changes.\n");
+		return 1;
+	}
+
+	/* Figure out where the manifest lives. Loads that reach a different set of
+	 * notes each keep their own. */
+	fname = NULL;
+	depth = (opts->pack != NULL) ? 0 : opts->loader.depth;
+	if (argc > 0) {
+		string_copy(&fname, argv[0]);
+	} else if (opts->pack != NULL) {
+		string_copy(&fname, path);
+		string_concat(&fname, ".sum");
+	} else if (depth > 0) {
+		sprintf(depthname, MANIFEST_DEPTH_FNAME, (unsigned long)depth);
+		string_copy(&fname, path);
+		fs_pathcat(&fname, depthname);
+	} else {
+		string_copy(&fname, path);
+		fs_pathcat(&fname, MANIFEST_FNAME);
+	}
+
+	/* Compare the notes against it. */
+	manifest = manifest_open(fname, depth);
+	if (manifest == NULL) {
+		free(fname);
+		return ENOMEM;
+	}
+	count = manifest_changed_since(manifest, path, notes, &opts->loader,
+								   print_change, NULL);
+
+	/* Remember how things are now. */
+	if (!manifest_update(manifest, path, notes, &opts->loader) ||
+			!manifest_save(manifest, fname)) {
+		fprintf(stderr, "An error occurred while saving the manifest '%s': "
+				"%s\n", fname, strerror(errno));
+	}
+	manifest_free(manifest);
+	free(fname);
+
+	return (count > 0) ? 0 : 1;
+}
+
+/**
+ * Finds notes by their title, either exactly, by a prefix or within an edit
+ * distance, and prints them sorted by date.
+ *
+ * @param notes Notes in the workspace.
+ * @param path  Path to the workspace.
+ * @param opts  Command line options.
+ * @param argc  Number of command arguments.
+ * @param argv  Command arguments. (Mode, title and optional distance)
+ *
+ * @return Return code.
+ */
+static int cmd_title(notelist_t *notes, const char *path, const options_t *opts,
+					 int argc, char **argv) {
+	output_t *out;
+	trie_t *trie;
+	uint32_t *found;
+	size_t count;
+	size_t i;
+	unsigned int dist;
+
+	/* Check the arguments. */
+	if ((argc < 2) || (argc > 3)) {
+		fprintf(stderr, "A lookup mode (exact, prefix or fuzzy) and a title "
+				"must be provided.\n");
+		return 1;
+	}
+	dist = 2;
+	if (argc > 2)
+		dist = (unsigned int)strtoul(argv[2], NULL, 10);
+
+	/* Build the trie and look the title up. */
+	trie = trie_new(notes, opts->icase);
+	if (trie == NULL)
+		return ENOMEM;
+	if (strcmp(argv[0], "exact") == 0) {
+		count = trie_exact(trie, argv[1], &found);
+	} else if (strcmp(argv[0], "prefix") == 0) {
+		count = trie_prefix(trie, argv[1], &found);
+	} else if (strcmp(argv[0], "fuzzy") == 0) {
+		count = trie_fuzzy(trie, argv[1], dist, &found);
+	} else {
+		fprintf(stderr, "Unknown lookup mode '%s'.\n", argv[0]);
+		trie_free(trie);
+		return 1;
+	}
+	trie_free(trie);
+
+	/* Print what we've found. */
+	fflush(stdout);
+	out = output_new(STDOUT_FILENO, opts->fmt, opts->loader.content);
+	if (out == NULL) {
+		if (found)
+			free(found);
+		return ENOMEM;
+	}
+	for (i = 0; i < count; i++)
+		output_note(out, notelist_get(notes, found[i]));
+	if (found)
+		free(found);
+	if (!output_free(out))
+		return errno;
+
+	return (count > 0) ? 0 : 1;
+}
+
+/**
+ * Prints the notes that have a tag, or every tag in use along with how many
+ * notes have it, straight from the full-text index.
+ *
+ * @param notes Notes in the workspace.
+ * @param path  Path to the workspace.
+ * @param opts  Command line options.
+ * @param argc  Number of command arguments.
+ * @param argv  Command arguments. (Optional tag to look for)
+ *
+ * @return Return code.
+ */
+static int cmd_tags(notelist_t *notes, const char *path, const options_t *opts,
+					int argc, char **argv) {
+	ftindex_t *idx;
+	ftindex_tag_t *tags;
+	note_t **tagged;
+	output_t *out;
+	size_t count;
+	size_t i;
+
+	if (argc > 1) {
+		fprintf(stderr, "Only a single tag can be looked up at a time.\n");
+		return 1;
+	}
+
+	/* Bring the index up to date. */
+	idx = open_ftindex(notes, path, opts);
+	if (idx == NULL)
+		return ENOMEM;
+
+	/* List every tag in use. */
+	if (argc == 0) {
+		count = ftindex_tags(idx, &tags);
+		for (i = 0; i < count; i++)
+			printf("%lu\t#%s\n", (unsigned long)tags[i].count, tags[i].tag);
+
+		if (tags)
+			free(tags);
+		ftindex_free(idx);
+		return (count > 0) ? 0 : 1;
+	}
+
+	/* Print the notes that have the tag. */
+	count = ftindex_tagged(idx, argv[0], &tagged);
+	fflush(stdout);
+	out = output_new(STDOUT_FILENO, opts->fmt, opts->loader.content);
+	if (out != NULL) {
+		for (i = 0; i < count; i++)
+			output_note(out, tagged[i]);
+	}
+	if (tagged)
+		free(tagged);
+	ftindex_free(idx);
+	if ((out == NULL) || !output_free(out))
+		return errno;
+
+	return (count > 0) ? 0 : 1;
+}
+
+/**
+ * State of the TODO item printer.
+ */
+typedef struct {
+	const note_t *note;
+	char dates[NOTE_DATESTR_LEN];
+	char heading[MD_LINE_MAX];
+	size_t heading_len;
+	size_t count;
+} todo_state_t;
+
+/**
+ * Prints the open TODO items found in a note along with the heading they're
+ * under.
+ *
+ * @param item Piece of structure found in the note.
+ * @param ctx  TODO item printer state.
+ *
+ * @return Always TRUE to keep parsing.
+ */
+static bool todo_func(const md_item_t *item, void *ctx) {
+	todo_state_t *state;
+
+	state = (todo_state_t *)ctx;
+	switch (item->kind) {
+		case MD_HEADING:
+			/* The text won't be around once the note is read further. */
+			state->heading_len = (item->len < MD_LINE_MAX) ? item->len :
+				MD_LINE_MAX;
+			memcpy(state->heading, item->text, state->heading_len);
+			break;
+		case MD_TODO:
+			printf("%s\t%s\t%lu\t%.*s\t%.*s\n", state->dates,
+				   note_get_title(state->note), (unsigned long)item->line,
+				   (int)state->heading_len, state->heading, (int)item->len,
+				   item->text);
+			state->count++;
+			break;
+		default:
+			break;
+	}
+
+	return true;
+}
+
+/**
+ * Prints every open TODO item in the workspace, along with the note and line
+ * it's in and the heading it's under.
+ *
+ * @param notes Notes in the workspace.
+ * @param path  Path to the workspace.
+ * @param opts  Command line options.
+ * @param argc  Number of command arguments.
+ * @param argv  Command arguments.
+ *
+ * @return Return code.
+ */
+static int cmd_todo(notelist_t *notes, const char *path, const options_t *opts,
+					int argc, char **argv) {
+	todo_state_t state;
+	note_reader_t rd;
+	md_parser_t md;
+	note_t *note;
+	const char *chunk;
+	size_t len;
+	size_t i;
+
+	if (!note_reader_init(&rd, 0))
+		return ENOMEM;
+
+	/* Stream through the notes, so that big ones don't have to fit in memory. */
+	state.count = 0;
+	for (i = 0; i < notelist_len(notes); i++) {
+		note = notelist_get(notes, i);
+		if (!note_reader_open(&rd, note))
+			continue;
+
+		state.note = note;
+		note_get_datestr(note, state.dates);
+		state.heading_len = 0;
+		md_init(&md, md_flags_for(note_get_format(note)), todo_func, &state);
+		while ((len = note_reader_chunk(&rd, &chunk)) > 0)
+			md_feed(&md, chunk, len);
+		md_finish(&md);
+	}
+	note_reader_release(&rd);
+
+	return (state.count > 0) ? 0 : 1;
+}
+
+/**
+ * Keeps the workspace in memory, up to date with its directory, and answers
+ * the requests of clients over a socket inside of it until interrupted.
+ *
+ * @param notes Unused.
+ * @param path  Path to the workspace.
+ * @param opts  Command line options.
+ * @param argc  Number of command arguments.
+ * @param argv  Command arguments.
+ *
+ * @return Return code.
+ */
+static int cmd_serve(notelist_t *notes, const char *path,
+					 const options_t *opts, int argc, char **argv) {
+	server_t *srv;
+	bool ret;
+
+	/* Only whole workspace directories can be kept up to date. */
+	if (opts->pack != NULL) {
+		fprintf(stderr, "Packs can't be served, only workspaces.\n");
+		return 1;
+	}
+	if (opts->loader.filter != NULL) {
+		fprintf(stderr, "Filters can't be used when serving a workspace.\n");
+		return 1;
+	}
+	if (opts->loader.depth > 0) {
+		fprintf(stderr, "Subdirectories can't be served, only the top of a "
+				"workspace.\n");
+		return 1;
+	}
+
+	/* Start serving. */
+	srv = server_new(path, &opts->loader, opts->icase);
+	if (srv == NULL) {
+		fprintf(stderr, "An error occurred while serving '%s': %s\n", path,
+				strerror(errno));
+		return 1;
+	}
+	printf("Serving %lu notes on %s\n", (unsigned long)server_count(srv),
+		   server_sockpath(srv));
+	fflush(stdout);
+
+	ret = server_run(srv);
+	if (!ret) {
+		fprintf(stderr, "An error occurred while serving '%s': %s\n", path,
+				strerror(errno));
+	}
+	server_free(srv);
+
+	return (ret) ? 0 : 1;
+}
+
+/**
+ * Sends a request to the server of a workspace and prints its response.
+ *
+ * @param notes Unused.
+ * @param path  Path to the workspace.
+ * @param opts  Command line options.
+ * @param argc  Number of command arguments.
+ * @param argv  Command arguments. (Request verb and its argument)
+ *
+ * @return Return code.
+ */
+static int cmd_client(notelist_t *notes, const char *path,
+					  const options_t *opts, int argc, char **argv) {
+	char *arg;
+	int ret;
+	int i;
+
+	if (argc < 1) {
+		fprintf(stderr, "A request must be provided.\n");
+		return 1;
+	}
+
+	/* Everything after the verb is its argument. */
+	arg = NULL;
+	if (argc > 1)
+		string_copy(&arg, argv[1]);
+	for (i = 2; i < argc; i++) {
+		string_concat(&arg, " ");
+		string_concat(&arg, argv[i]);
+	}
+
+	ret = server_ask(path, argv[0], arg, STDOUT_FILENO, STDERR_FILENO);
+	if (ret < 0) {
+		fprintf(stderr, "Couldn't ask the server of '%s': %s\n", path,
+				strerror(errno));
+		ret = 1;
+	}
+	if (arg)
+		free(arg);
+
+	return ret;
+}
+
+/**
+ * Program's main entry point.
+ *
+ * @param argc Number of command line arguments provided.
+ * @param argv Command line arguments.
+ *
+ * @return Return code.
+ */
+int main(int argc, char **argv) {
+	options_t opts;
+	const command_t *cmd;
+	const char *where;
+	filter_t *filter;
+	workspace_t *ws;
+	notelist_t *notes;
+	const char *path;
+	struct stat st;
+	bool content;
+	bool ret;
+	int opt;
+	int rc;
+
+	/* Parse the command line arguments. */
+	loader_opts_init(&opts.loader);
+	opts.use_index = true;
+	opts.use_arena = true;
+	opts.icase = false;
+	opts.stats = false;
+	opts.compress = false;
+	opts.fmt = OUTPUT_TEXT;
+	opts.pack = NULL;
+	where = NULL;
+	while ((opt = getopt_long(argc, argv, "+j:nIAird:q:f:w:z", long_opts,
+							  NULL)) != -1) {
+		switch (opt) {
+			case 'j':
+				opts.loader.threads = (size_t)strtoul(optarg, NULL, 10);
+				break;
+			case 'n':
+				opts.loader.content = false;
+				break;
+			case 'I':
+				opts.use_index = false;
+				break;
+			case 'A':
+				opts.use_arena = false;
+				break;
+			case 'i':
+				opts.icase = true;
+				break;
+			case 'r':
+				opts.loader.depth = WALK_MAX_DEPTH;
+				break;
+			case 'd':
+				opts.loader.depth = (size_t)strtoul(optarg, NULL, 10);
+				break;
+			case 'q':
+				opts.loader.queue_depth = (size_t)strtoul(optarg, NULL, 10);
+				break;
+			case 'S':
+				opts.stats = true;
+				break;
+			case 'z':
+				opts.compress = true;
+				break;
+			case 'w':
+				where = optarg;
+				break;
+			case 'f':
+				if (!output_parse_fmt(optarg, &opts.fmt)) {
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+
+	/* Figure out which command we should run. */
+	cmd = commands;
+	if (optind < argc) {
+		const command_t *c;
+
+		for (c = commands; c->name != NULL; c++) {
+			if (strcmp(c->name, argv[optind]) == 0) {
+				cmd = c;
+				optind++;
+				break;
+			}
+		}
+	}
+	if (optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+	path = argv[optind++];
+	content = opts.loader.content;
+	if (!cmd->content)
+		opts.loader.content = false;
+	if (opts.loader.depth > 0)
+		opts.use_index = false;
+
+	/* Compile the filter, which the metadata index can't take into account. */
+	filter = NULL;
+	if (where != NULL) {
+		filter = filter_new(where, opts.icase);
+		if (filter == NULL) {
+			fprintf(stderr, "Invalid filter '%s': %s\n", where,
+					strerror(errno));
+			return 1;
+		}
+		opts.loader.filter = filter;
+		opts.use_index = false;
+	}
+
+	/* Regular files are packed workspaces. */
+	if ((stat(path, &st) == 0) && S_ISREG(st.st_mode)) {
+		opts.pack = pack_open(path);
+		if (opts.pack == NULL) {
+			fprintf(stderr, "An error occurred while opening the pack '%s': "
+					"%s\n", path, strerror(errno));
+			filter_free(filter);
+			return 1;
+		}
+		opts.use_index = false;
+		opts.loader.content = content;
+	}
+
+	/* Keep the workspace directory open so notes are reached relative to it. */
+	ws = NULL;
+	if (opts.pack == NULL)
+		ws = workspace_open(path);
+
+	/* Load the notes from the directory. */
+	notes = notelist_new();
+	if (opts.use_arena && !notelist_use_arena(notes)) {
+		notelist_free(notes);
+		workspace_free(ws);
+		pack_close(opts.pack);
+		filter_free(filter);
+		return ENOMEM;
+	}
+	notelist_use_workspace(notes, ws);
+	if (!cmd->load) {
+		ret = true;
+	} else if (opts.pack != NULL) {
+		/* Notes in a pack can't have their contents loaded later. */
+		ret = pack_load(opts.pack, opts.loader.content || cmd->reads,
+						opts.loader.filter, notes);
+	} else if (opts.use_index) {
+		ret = wsindex_load(path, notes);
+		if (ret && opts.loader.content)
+			loader_load_contents(notes, &opts.loader);
+	} else {
+		ret = loader_load(path, &opts.loader, notes);
+	}
+	if (!ret) {
+		printf("An error occurred while loading the directory '%s': %s\n",
+			   path, strerror(errno));
+		rc = errno;
+		notelist_free(notes);
+		workspace_free(ws);
+		pack_close(opts.pack);
+		filter_free(filter);
+		return rc;
+	}
+
+	/* Run the command. */
+	rc = cmd->func(notes, path, &opts, argc - optind, argv + optind);
+	notelist_free(notes);
+	workspace_free(ws);
+	pack_close(opts.pack);
+	filter_free(filter);
+
+	/* Let the user know where the time went. */
+	if (opts.stats) {
+		fflush(stdout);
+		stats_print(stderr);
+	}
+
+	return rc;
+}
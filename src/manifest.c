@@ -0,0 +1,569 @@
+/**
+ * manifest.c
+ * Record of the state of every note used to find out what changed since.
+ *
+ * A manifest holds the size, modification time and content hash of every note
+ * at some point in time. Comparing it against the notes as they are now uses
+ * the size and modification time as a cheap first filter, so only notes that
+ * look different ever get read, and the hash as the final word, so notes that
+ * were merely touched aren't reported. This lets anything derived from the
+ * notes only redo the work for the ones that actually changed.
+ *
+ * On disk it's a header followed by one record per note, sorted by their paths
+ * relative to the workspace or pack they're in. The header also records how
+ * deep into subdirectories the notes were loaded from, since comparing against
+ * a manifest taken at another depth would report the notes in between as added
+ * or removed.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "manifest.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fsutils.h"
+#include "note.h"
+#include "strutils.h"
+
+/* Sizes of the fixed parts of the manifest file. */
+#define MANIFEST_HEADER_SIZE 16
+#define MANIFEST_RECORD_SIZE 26
+
+/* State of a note as found by manifest_scan. */
+#define MANIFEST_SAME    0
+#define MANIFEST_NEW     1
+#define MANIFEST_SUSPECT 2
+
+/**
+ * Shared state of a manifest scan.
+ */
+typedef struct {
+	const manifest_t *since;
+	const char *basepath;
+	uint8_t *status;
+	uint8_t *seen;
+} manifest_scan_t;
+
+/**
+ * Creates a brand new empty manifest.
+ *
+ * @param depth How deep into subdirectories the notes are loaded from.
+ *
+ * @return Empty manifest or NULL if we couldn't allocate enough memory.
+ *
+ * @see manifest_free
+ */
+manifest_t* manifest_new(size_t depth) {
+	manifest_t *manifest;
+
+	manifest = (manifest_t *)malloc(sizeof(manifest_t));
+	if (manifest == NULL)
+		return NULL;
+
+	manifest->entries = NULL;
+	manifest->len = 0;
+	manifest->cap = 0;
+	manifest->depth = depth;
+
+	return manifest;
+}
+
+/**
+ * Frees every entry in a manifest and leaves it empty.
+ *
+ * @param manifest Manifest object.
+ */
+static void manifest_clear(manifest_t *manifest) {
+	size_t i;
+
+	for (i = 0; i < manifest->len; i++)
+		free(manifest->entries[i].path);
+	manifest->len = 0;
+}
+
+/**
+ * Frees up a manifest and every entry inside of it.
+ *
+ * @param manifest Manifest to be free'd.
+ */
+void manifest_free(manifest_t *manifest) {
+	/* Do we even have anything to do? */
+	if (manifest == NULL)
+		return;
+
+	manifest_clear(manifest);
+	if (manifest->entries)
+		free(manifest->entries);
+	free(manifest);
+}
+
+/**
+ * Appends an entry to a manifest.
+ *
+ * @param manifest Manifest object.
+ * @param path     Path to the note. (Copied)
+ * @param len      Length of the path.
+ * @param size     Size of the note.
+ * @param mtime    Modification time of the note.
+ * @param hash     Hash of the contents of the note.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+static bool manifest_push(manifest_t *manifest, const char *path, size_t len,
+						  uint64_t size, int64_t mtime, uint64_t hash) {
+	manifest_entry_t *entries;
+	manifest_entry_t *entry;
+	size_t cap;
+
+	/* Grow the array if needed. */
+	if (manifest->len == manifest->cap) {
+		cap = (manifest->cap == 0) ? 256 : manifest->cap * 2;
+		entries = (manifest_entry_t *)realloc(manifest->entries,
+											  cap * sizeof(manifest_entry_t));
+		if (entries == NULL)
+			return false;
+		manifest->entries = entries;
+		manifest->cap = cap;
+	}
+
+	/* Populate the entry. */
+	entry = &manifest->entries[manifest->len];
+	entry->path = (char *)malloc((len + 1) * sizeof(char));
+	if (entry->path == NULL)
+		return false;
+	memcpy(entry->path, path, len);
+	entry->path[len] = '\0';
+	entry->size = size;
+	entry->mtime = mtime;
+	entry->hash = hash;
+	manifest->len++;
+
+	return true;
+}
+
+/**
+ * qsort and bsearch comparison function for manifest entries by path.
+ *
+ * @param a Manifest entry.
+ * @param b Another manifest entry.
+ *
+ * @return Same as strcmp on their paths.
+ */
+static int manifest_entry_cmp(const void *a, const void *b) {
+	return strcmp(((const manifest_entry_t *)a)->path,
+				  ((const manifest_entry_t *)b)->path);
+}
+
+/**
+ * Parses a manifest file that has been read into memory.
+ *
+ * @param manifest Empty manifest object to be populated.
+ * @param buf      Contents of the manifest file.
+ * @param len      Length of the contents.
+ *
+ * @return TRUE if the manifest was valid.
+ *         FALSE if it's corrupt, from another version, was taken at another
+ *         depth or we ran out of memory.
+ */
+static bool manifest_parse(manifest_t *manifest, const char *buf, size_t len) {
+	uint64_t size;
+	int64_t mtime;
+	uint64_t hash;
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t depth;
+	uint16_t path_len;
+	size_t pos;
+	uint32_t i;
+
+	/* Check the header. */
+	if (len < MANIFEST_HEADER_SIZE)
+		return false;
+	memcpy(&magic, buf, sizeof(uint32_t));
+	memcpy(&version, buf + 4, sizeof(uint32_t));
+	memcpy(&count, buf + 8, sizeof(uint32_t));
+	memcpy(&depth, buf + 12, sizeof(uint32_t));
+	if ((magic != MANIFEST_MAGIC) || (version != MANIFEST_VERSION) ||
+			((size_t)depth != manifest->depth)) {
+		return false;
+	}
+
+	/* Go through the records. */
+	pos = MANIFEST_HEADER_SIZE;
+	for (i = 0; i < count; i++) {
+		if ((len - pos) < MANIFEST_RECORD_SIZE)
+			return false;
+
+		memcpy(&size, buf + pos, sizeof(uint64_t));
+		memcpy(&mtime, buf + pos + 8, sizeof(int64_t));
+		memcpy(&hash, buf + pos + 16, sizeof(uint64_t));
+		memcpy(&path_len, buf + pos + 24, sizeof(uint16_t));
+		pos += MANIFEST_RECORD_SIZE;
+
+		/* Paths are stored NULL terminated. */
+		if (((len - pos) < ((size_t)path_len + 1)) ||
+				(buf[pos + path_len] != '\0')) {
+			return false;
+		}
+		if (!manifest_push(manifest, buf + pos, path_len, size, mtime, hash))
+			return false;
+		pos += path_len + 1;
+	}
+
+	return true;
+}
+
+/**
+ * Opens a manifest file. A missing or invalid manifest, or one that was taken
+ * at another depth, results in an empty one, which makes every note look like
+ * it was just added.
+ *
+ * @param fname Path to the manifest file.
+ * @param depth How deep into subdirectories the notes are loaded from.
+ *
+ * @return Manifest object or NULL if we couldn't allocate enough memory.
+ *
+ * @see manifest_free
+ */
+manifest_t* manifest_open(const char *fname, size_t depth) {
+	manifest_t *manifest;
+	fs_view_t view;
+	FILE *fh;
+	bool valid;
+
+	manifest = manifest_new(depth);
+	if (manifest == NULL)
+		return NULL;
+
+	/* Read the whole thing in one go. */
+	fh = fopen(fname, "rb");
+	if (fh == NULL)
+		return manifest;
+	valid = fs_fview(fh, &view);
+	fclose(fh);
+	if (!valid)
+		return manifest;
+	valid = manifest_parse(manifest, view.data, view.len);
+	fs_fview_release(&view);
+
+	/* Start from scratch if we can't trust it. */
+	if (!valid) {
+		manifest_clear(manifest);
+		return manifest;
+	}
+	if (manifest->len > 1) {
+		qsort(manifest->entries, manifest->len, sizeof(manifest_entry_t),
+			  manifest_entry_cmp);
+	}
+
+	return manifest;
+}
+
+/**
+ * Finds the entry of a note in a manifest.
+ *
+ * @param manifest Manifest object.
+ * @param path     Path to the note relative to the workspace.
+ *
+ * @return Entry of the note or NULL if it isn't in the manifest.
+ */
+static const manifest_entry_t* manifest_find(const manifest_t *manifest,
+											 const char *path) {
+	manifest_entry_t key;
+
+	if (manifest->len == 0)
+		return NULL;
+
+	key.path = (char *)path;
+	return (const manifest_entry_t *)bsearch(&key, manifest->entries,
+		manifest->len, sizeof(manifest_entry_t), manifest_entry_cmp);
+}
+
+/**
+ * Compares a single note against a manifest, hashing its contents only if its
+ * size or modification time don't match. Used by manifest_scan.
+ *
+ * @param note  Note object.
+ * @param index Index of the note in the collection.
+ * @param ctx   Shared scan state.
+ */
+static void manifest_scan_func(note_t *note, size_t index, void *ctx) {
+	manifest_scan_t *scan;
+	const manifest_entry_t *entry;
+	struct stat st;
+
+	scan = (manifest_scan_t *)ctx;
+
+	/* Make sure we know the current state of the note's file. Notes that only
+	 * exist in memory, like the ones from a pack, are taken as they are. */
+	if (note_get_path(note) == NULL) {
+		scan->status[index] = MANIFEST_SUSPECT;
+		return;
+	}
+	if (note_stat(note, &st)) {
+		note_set_stat(note, &st);
+	} else if (!note_is_loaded(note)) {
+		scan->status[index] = MANIFEST_SUSPECT;
+		return;
+	}
+
+	/* Notes that look the same are trusted to be the same. */
+	entry = manifest_find(scan->since,
+						  fs_relpath(note_get_path(note), scan->basepath));
+	if (entry != NULL) {
+		scan->seen[entry - scan->since->entries] = 1;
+		if ((entry->size == note_get_size(note)) &&
+				(entry->mtime == note_get_mtime(note))) {
+			if (note_get_hash(note) == 0)
+				note_set_hash(note, entry->hash);
+			scan->status[index] = MANIFEST_SAME;
+			return;
+		}
+	}
+
+	/* Anything else needs to be hashed. */
+	scan->status[index] = (entry == NULL) ? MANIFEST_NEW : MANIFEST_SUSPECT;
+	if (note_get_hash(note) == 0)
+		note_hash(note);
+}
+
+/**
+ * Compares every note in a collection against a manifest using a pool of
+ * worker threads.
+ *
+ * @param scan     Scan state to be populated. (Arrays allocated by this
+ *                 function)
+ * @param since    Manifest to compare against.
+ * @param basepath Path to the workspace or pack the notes were loaded from.
+ * @param list     Note collection.
+ * @param opts     Loading options or NULL to use the defaults.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+static bool manifest_scan(manifest_scan_t *scan, const manifest_t *since,
+						  const char *basepath, notelist_t *list,
+						  const loader_opts_t *opts) {
+	scan->since = since;
+	scan->basepath = basepath;
+	scan->status = (uint8_t *)calloc(notelist_len(list) + 1, sizeof(uint8_t));
+	scan->seen = (uint8_t *)calloc(since->len + 1, sizeof(uint8_t));
+	if ((scan->status == NULL) || (scan->seen == NULL)) {
+		if (scan->status)
+			free(scan->status);
+		if (scan->seen)
+			free(scan->seen);
+		errno = ENOMEM;
+		return false;
+	}
+
+	loader_foreach(list, opts, manifest_scan_func, scan);
+	return true;
+}
+
+/**
+ * Finds every note that was added, changed or removed since a manifest was
+ * taken. Notes whose size and modification time match the manifest are taken
+ * as unchanged without being read, the others are hashed and only reported if
+ * their contents are actually different. The hash of every note is known
+ * afterwards.
+ *
+ * @param since    Manifest to compare against.
+ * @param basepath Path to the workspace or pack the notes were loaded from.
+ * @param list     Every note in the workspace.
+ * @param opts     Loading options or NULL to use the defaults.
+ * @param func     Function called for every change, in the order of the notes,
+ *                 followed by the removed ones, with paths that start with
+ *                 the base path.
+ * @param ctx      Context passed to the function.
+ *
+ * @return Number of changes found.
+ */
+size_t manifest_changed_since(const manifest_t *since, const char *basepath,
+							  notelist_t *list, const loader_opts_t *opts,
+							  manifest_func_t func, void *ctx) {
+	manifest_scan_t scan;
+	const manifest_entry_t *entry;
+	note_t *note;
+	const char *name;
+	char *path;
+	size_t count;
+	size_t i;
+
+	if (!manifest_scan(&scan, since, basepath, list, opts))
+		return 0;
+
+	/* Report the notes that were added or changed. */
+	count = 0;
+	for (i = 0; i < notelist_len(list); i++) {
+		note = notelist_get(list, i);
+		switch (scan.status[i]) {
+			case MANIFEST_NEW:
+				func(MANIFEST_ADDED, note, note_get_path(note), ctx);
+				count++;
+				break;
+			case MANIFEST_SUSPECT:
+				name = fs_relpath(note_get_path(note), basepath);
+				entry = manifest_find(since, name);
+				if ((entry != NULL) && (note_get_hash(note) == entry->hash))
+					break;
+
+				func(MANIFEST_CHANGED, note, note_get_path(note), ctx);
+				count++;
+				break;
+			default:
+				break;
+		}
+	}
+
+	/* Report the ones that are gone, where they would be now. */
+	path = NULL;
+	for (i = 0; i < since->len; i++) {
+		if (!scan.seen[i]) {
+			string_copy(&path, basepath);
+			fs_pathcat(&path, since->entries[i].path);
+			func(MANIFEST_REMOVED, NULL, path, ctx);
+			count++;
+		}
+	}
+	if (path)
+		free(path);
+
+	free(scan.status);
+	free(scan.seen);
+
+	return count;
+}
+
+/**
+ * Brings a manifest up to date with the notes as they are now. Only the notes
+ * that don't match their entries are hashed, so this is cheap right after
+ * manifest_changed_since.
+ *
+ * @param manifest Manifest object.
+ * @param basepath Path to the workspace or pack the notes were loaded from.
+ * @param list     Every note in the workspace.
+ * @param opts     Loading options or NULL to use the defaults.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+bool manifest_update(manifest_t *manifest, const char *basepath,
+					 notelist_t *list, const loader_opts_t *opts) {
+	manifest_scan_t scan;
+	const char *path;
+	note_t *note;
+	size_t i;
+
+	/* Make sure every note has been hashed. */
+	if (!manifest_scan(&scan, manifest, basepath, list, opts))
+		return false;
+	free(scan.status);
+	free(scan.seen);
+
+	/* Replace the entries. */
+	manifest_clear(manifest);
+	for (i = 0; i < notelist_len(list); i++) {
+		note = notelist_get(list, i);
+		if ((note_get_path(note) == NULL) || (note_get_hash(note) == 0))
+			continue;
+		path = fs_relpath(note_get_path(note), basepath);
+		if (strlen(path) > UINT16_MAX)
+			continue;
+
+		if (!manifest_push(manifest, path, strlen(path), note_get_size(note),
+						   note_get_mtime(note), note_get_hash(note))) {
+			errno = ENOMEM;
+			return false;
+		}
+	}
+	if (manifest->len > 1) {
+		qsort(manifest->entries, manifest->len, sizeof(manifest_entry_t),
+			  manifest_entry_cmp);
+	}
+
+	return true;
+}
+
+/**
+ * Writes a manifest to a file, atomically replacing it.
+ *
+ * @param manifest Manifest object.
+ * @param fname    Path to the manifest file.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ */
+bool manifest_save(const manifest_t *manifest, const char *fname) {
+	const manifest_entry_t *entry;
+	char rec[MANIFEST_RECORD_SIZE];
+	char *tmppath;
+	uint32_t u32;
+	uint16_t path_len;
+	FILE *fh;
+	size_t i;
+	bool ret;
+	int err;
+
+	/* Write everything to a temporary file. */
+	tmppath = NULL;
+	string_copy(&tmppath, fname);
+	string_concat(&tmppath, ".tmp");
+	fh = fopen(tmppath, "wb");
+	if (fh == NULL) {
+		free(tmppath);
+		return false;
+	}
+
+	/* Header. */
+	memset(rec, 0, MANIFEST_HEADER_SIZE);
+	u32 = MANIFEST_MAGIC;
+	memcpy(rec, &u32, sizeof(uint32_t));
+	u32 = MANIFEST_VERSION;
+	memcpy(rec + 4, &u32, sizeof(uint32_t));
+	u32 = (uint32_t)manifest->len;
+	memcpy(rec + 8, &u32, sizeof(uint32_t));
+	u32 = (uint32_t)manifest->depth;
+	memcpy(rec + 12, &u32, sizeof(uint32_t));
+	ret = fwrite(rec, sizeof(char), MANIFEST_HEADER_SIZE, fh) ==
+		MANIFEST_HEADER_SIZE;
+
+	/* Records. */
+	for (i = 0; ret && (i < manifest->len); i++) {
+		entry = &manifest->entries[i];
+		path_len = (uint16_t)strlen(entry->path);
+		memcpy(rec, &entry->size, sizeof(uint64_t));
+		memcpy(rec + 8, &entry->mtime, sizeof(int64_t));
+		memcpy(rec + 16, &entry->hash, sizeof(uint64_t));
+		memcpy(rec + 24, &path_len, sizeof(uint16_t));
+
+		ret = (fwrite(rec, sizeof(char), MANIFEST_RECORD_SIZE, fh) ==
+			   MANIFEST_RECORD_SIZE) &&
+			(fwrite(entry->path, sizeof(char), path_len + 1, fh) ==
+			 (size_t)(path_len + 1));
+	}
+
+	/* Atomically replace the old manifest. */
+	err = errno;
+	if ((fclose(fh) != 0) && ret) {
+		err = errno;
+		ret = false;
+	}
+	if (ret && (rename(tmppath, fname) != 0)) {
+		err = errno;
+		ret = false;
+	}
+	if (!ret) {
+		unlink(tmppath);
+		errno = err;
+	}
+	free(tmppath);
+
+	return ret;
+}
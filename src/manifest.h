@@ -0,0 +1,93 @@
+/**
+ * manifest.h
+ * Record of the state of every note used to find out what changed since.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _MANIFEST_H
+#define _MANIFEST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "loader.h"
+#include "notelist.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Name of the default manifest file inside the workspace. */
+#define MANIFEST_FNAME ".notein.sum"
+
+/* Name of the default manifest file for loads that go into subdirectories,
+ * which get one for each depth. */
+#define MANIFEST_DEPTH_FNAME ".notein.d%lu.sum"
+
+/* Manifest file format identification. */
+#define MANIFEST_MAGIC   0x4D55534EUL /* "NSUM" */
+#define MANIFEST_VERSION 3
+
+/**
+ * Kinds of changes reported by manifest_changed_since.
+ */
+typedef enum {
+	MANIFEST_ADDED = 0,
+	MANIFEST_CHANGED,
+	MANIFEST_REMOVED
+} manifest_change_t;
+
+/**
+ * State of a single note when the manifest was taken. Its path is relative to
+ * the workspace or pack, so it doesn't depend on how that was reached.
+ */
+typedef struct {
+	char *path;
+	uint64_t size;
+	int64_t mtime;
+	uint64_t hash;
+} manifest_entry_t;
+
+/**
+ * Manifest of every note in a workspace, down to the depth it was taken at.
+ */
+typedef struct {
+	manifest_entry_t *entries;
+	size_t len;
+	size_t cap;
+	size_t depth;
+} manifest_t;
+
+/**
+ * Function called for every change found by manifest_changed_since.
+ *
+ * @param change Kind of change.
+ * @param note   Note that was added or changed. NULL if it was removed.
+ * @param path   Path to the note.
+ * @param ctx    Context passed to manifest_changed_since.
+ */
+typedef void (*manifest_func_t)(manifest_change_t change, note_t *note,
+								const char *path, void *ctx);
+
+/* Construction and destruction. */
+manifest_t* manifest_new(size_t depth);
+manifest_t* manifest_open(const char *fname, size_t depth);
+void manifest_free(manifest_t *manifest);
+
+/* Change detection. */
+size_t manifest_changed_since(const manifest_t *since, const char *basepath,
+							  notelist_t *list, const loader_opts_t *opts,
+							  manifest_func_t func, void *ctx);
+bool manifest_update(manifest_t *manifest, const char *basepath,
+					 notelist_t *list, const loader_opts_t *opts);
+
+/* Persistence. */
+bool manifest_save(const manifest_t *manifest, const char *fname);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MANIFEST_H */
@@ -0,0 +1,402 @@
+/**
+ * markdown.c
+ * Streaming extractor for the structure of Markdown and plain text notes.
+ *
+ * Notes are fed to the parser in chunks of any size and it goes through them a
+ * line at a time, reporting ATX headings, #tags and open TODO items (either
+ * unchecked task list items or lines starting with TODO) as soon as it finds
+ * them. Lines are parsed in place whenever they're whole inside a chunk, so
+ * the only copying ever done is of the bits of a line that get split between
+ * chunks, into a fixed buffer inside the parser. Nothing is allocated.
+ *
+ * Fenced code blocks are skipped entirely, as are inline code spans when
+ * looking for tags, since they're usually full of things that look like
+ * structure but aren't.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "markdown.h"
+
+#include <string.h>
+#include <strings.h>
+
+/* Characters that separate things on a line. */
+#define MD_IS_SPACE(c) (((c) == ' ') || ((c) == '\t'))
+
+/* Characters that are part of a line number in an ordered list. */
+#define MD_IS_DIGIT(c) (((c) >= '0') && ((c) <= '9'))
+
+/* Longest ordered list number allowed by CommonMark. */
+#define MD_LIST_NUM_MAX 9
+
+/**
+ * Checks if a character can be part of a tag.
+ *
+ * @param c Character to be checked.
+ *
+ * @return TRUE if it can be part of a tag.
+ */
+static bool md_tag_char(unsigned char c) {
+	return ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) ||
+		MD_IS_DIGIT(c) || (c == '_') || (c == '-') || (c == '/') || (c >= 0x80);
+}
+
+/**
+ * Reports a piece of structure to the user.
+ *
+ * @param md    Parser object.
+ * @param kind  Kind of structure.
+ * @param level Level of the heading. (Ignored for everything else)
+ * @param text  Text of the structure.
+ * @param end   End of the text.
+ *
+ * @return TRUE if the parser should keep going.
+ *         FALSE if the user asked it to stop.
+ */
+static bool md_emit(md_parser_t *md, md_kind_t kind, unsigned int level,
+					const char *text, const char *end) {
+	md_item_t item;
+
+	/* Get rid of any surrounding whitespace. */
+	while ((text < end) && MD_IS_SPACE(*text))
+		text++;
+	while ((end > text) && MD_IS_SPACE(end[-1]))
+		end--;
+
+	item.kind = kind;
+	item.level = level;
+	item.line = md->line;
+	item.text = text;
+	item.len = (size_t)(end - text);
+	if (!md->func(&item, md->ctx))
+		md->stopped = true;
+
+	return !md->stopped;
+}
+
+/**
+ * Looks for tags in a line. A tag is a # right at the start of the line or
+ * after some whitespace, followed by tag characters that aren't all digits, so
+ * that issue numbers don't get mistaken for tags.
+ *
+ * @param md  Parser object.
+ * @param p   Start of the line.
+ * @param end End of the line.
+ *
+ * @return TRUE if the parser should keep going.
+ *         FALSE if the user asked it to stop.
+ */
+static bool md_tags(md_parser_t *md, const char *p, const char *end) {
+	const char *start;
+	const char *q;
+	bool code;
+	char prev;
+
+	code = false;
+	prev = ' ';
+	while (p < end) {
+		/* Skip over inline code spans. */
+		if (*p == '`') {
+			code = !code;
+			prev = *p++;
+			continue;
+		}
+
+		/* Is this the start of a tag? */
+		if (code || (*p != '#') || !MD_IS_SPACE(prev) || ((p + 1) == end) ||
+				!md_tag_char((unsigned char)p[1])) {
+			prev = *p++;
+			continue;
+		}
+
+		/* Find where it ends, leaving any trailing punctuation out of it. */
+		start = ++p;
+		while ((p < end) && md_tag_char((unsigned char)*p))
+			p++;
+		while ((p > start) && ((p[-1] == '-') || (p[-1] == '/')))
+			p--;
+
+		/* Tags must have more than just numbers. */
+		for (q = start; q < p; q++) {
+			if (!MD_IS_DIGIT(*q) && (*q != '-') && (*q != '/'))
+				break;
+		}
+		if ((q < p) && !md_emit(md, MD_TAG, 0, start, p))
+			return false;
+		prev = p[-1];
+	}
+
+	return true;
+}
+
+/**
+ * Looks for an open TODO item in a line. These are either unchecked task list
+ * items or lines that start with TODO, optionally inside a list item.
+ *
+ * @param md  Parser object.
+ * @param p   Start of the line, after its indentation.
+ * @param end End of the line.
+ *
+ * @return TRUE if the parser should keep going.
+ *         FALSE if the user asked it to stop.
+ */
+static bool md_todo(md_parser_t *md, const char *p, const char *end) {
+	const char *text;
+	const char *q;
+
+	/* Skip over list markers. */
+	text = p;
+	if ((p < end) && ((*p == '-') || (*p == '*') || (*p == '+')) &&
+			(((p + 1) == end) || MD_IS_SPACE(p[1]))) {
+		text = p + 1;
+	} else {
+		for (q = p; (q < end) && MD_IS_DIGIT(*q) &&
+				((q - p) < MD_LIST_NUM_MAX); q++);
+		if ((q > p) && (q < end) && ((*q == '.') || (*q == ')')) &&
+				(((q + 1) == end) || MD_IS_SPACE(q[1]))) {
+			text = q + 1;
+		}
+	}
+	while ((text < end) && MD_IS_SPACE(*text))
+		text++;
+
+	/* Task list items, which only count when they're unchecked. */
+	if ((text != p) && ((end - text) >= 3) && (text[0] == '[') &&
+			(text[2] == ']') && (((text + 3) == end) || MD_IS_SPACE(text[3]))) {
+		if (text[1] != ' ')
+			return true;
+
+		return md_emit(md, MD_TODO, 0, text + 3, end);
+	}
+
+	/* Plain old TODO markers. */
+	if (((end - text) >= 4) && (memcmp(text, "TODO", 4) == 0) &&
+			(((text + 4) == end) || (text[4] == ':') || MD_IS_SPACE(text[4]))) {
+		text += 4;
+		if ((text < end) && (*text == ':'))
+			text++;
+
+		return md_emit(md, MD_TODO, 0, text, end);
+	}
+
+	return true;
+}
+
+/**
+ * Parses a whole line.
+ *
+ * @param md  Parser object.
+ * @param p   Start of the line.
+ * @param end End of the line, without the line feed.
+ *
+ * @return TRUE if the parser should keep going.
+ *         FALSE if the user asked it to stop.
+ */
+static bool md_line(md_parser_t *md, const char *p, const char *end) {
+	const char *text;
+	const char *tend;
+	const char *q;
+	unsigned int level;
+	size_t indent;
+	size_t run;
+
+	md->line++;
+	if ((end > p) && (end[-1] == '\r'))
+		end--;
+
+	/* Measure the indentation. */
+	indent = 0;
+	while ((p < end) && MD_IS_SPACE(*p)) {
+		indent += (*p == '\t') ? (4 - (indent % 4)) : 1;
+		p++;
+	}
+
+	/* Open and close fenced code blocks. */
+	if ((indent < 4) && (p < end) && ((*p == '`') || (*p == '~'))) {
+		for (run = 0; ((p + run) < end) && (p[run] == *p); run++);
+		if (run >= 3) {
+			if (md->fence == '\0') {
+				md->fence = *p;
+				md->fence_len = run;
+				return true;
+			}
+
+			for (q = p + run; (q < end) && MD_IS_SPACE(*q); q++);
+			if ((*p == md->fence) && (run >= md->fence_len) && (q == end))
+				md->fence = '\0';
+			return true;
+		}
+	}
+	if (md->fence != '\0')
+		return true;
+
+	/* ATX headings. */
+	if ((md->flags & MD_HEADINGS) && (indent < 4) && (p < end) &&
+			(*p == '#')) {
+		for (level = 0; ((p + level) < end) && (p[level] == '#'); level++);
+		if ((level <= 6) && (((p + level) == end) || MD_IS_SPACE(p[level]))) {
+			/* Leave the optional closing sequence out of the text. */
+			text = p + level;
+			for (tend = end; (tend > text) && MD_IS_SPACE(tend[-1]); tend--);
+			for (q = tend; (q > text) && (q[-1] == '#'); q--);
+			if ((q == text) || MD_IS_SPACE(q[-1]))
+				tend = q;
+
+			if (!md_emit(md, MD_HEADING, level, text, tend))
+				return false;
+			return md_tags(md, text, tend);
+		}
+	}
+
+	/* Open TODO items and tags. */
+	if (!md_todo(md, p, end))
+		return false;
+	return md_tags(md, p, end);
+}
+
+/**
+ * Initializes a parser.
+ *
+ * @param md    Parser object.
+ * @param flags What should be looked for on top of tags and TODO items.
+ *              (MD_HEADINGS)
+ * @param func  Function called for every piece of structure found.
+ * @param ctx   Context passed to the function.
+ *
+ * @see md_flags_for
+ */
+void md_init(md_parser_t *md, int flags, md_func_t func, void *ctx) {
+	md->flags = flags;
+	md->func = func;
+	md->ctx = ctx;
+	md->line = 0;
+	md->fence = '\0';
+	md->fence_len = 0;
+	md->stopped = false;
+	md->buf_len = 0;
+}
+
+/**
+ * Feeds a chunk of a note to the parser. Chunks can be split anywhere, and
+ * lines that cross them are put back together, keeping at most MD_LINE_MAX
+ * characters of them.
+ *
+ * @param md   Parser object.
+ * @param data Chunk of the note.
+ * @param len  Length of the chunk.
+ *
+ * @return TRUE if the parser should keep going.
+ *         FALSE if the user asked it to stop.
+ *
+ * @see md_finish
+ */
+bool md_feed(md_parser_t *md, const char *data, size_t len) {
+	const char *end;
+	const char *nl;
+	size_t n;
+	bool ret;
+
+	if (md->stopped)
+		return false;
+
+	end = data + len;
+	while (data < end) {
+		/* Hold on to partial lines until the rest of them shows up. */
+		nl = (const char *)memchr(data, '\n', (size_t)(end - data));
+		n = (size_t)(((nl != NULL) ? nl : end) - data);
+		if ((nl == NULL) || (md->buf_len > 0)) {
+			if (n > (MD_LINE_MAX - md->buf_len))
+				n = MD_LINE_MAX - md->buf_len;
+			memcpy(md->buf + md->buf_len, data, n);
+			md->buf_len += n;
+			if (nl == NULL)
+				return true;
+
+			ret = md_line(md, md->buf, md->buf + md->buf_len);
+			md->buf_len = 0;
+		} else {
+			ret = md_line(md, data, nl);
+		}
+
+		if (!ret)
+			return false;
+		data = nl + 1;
+	}
+
+	return true;
+}
+
+/**
+ * Lets the parser know the note has ended, so that its last line gets parsed
+ * even if it didn't end with a line feed.
+ *
+ * @param md Parser object.
+ *
+ * @return TRUE if the parser should keep going.
+ *         FALSE if the user asked it to stop.
+ */
+bool md_finish(md_parser_t *md) {
+	bool ret;
+
+	if (md->stopped)
+		return false;
+	if (md->buf_len == 0)
+		return true;
+
+	ret = md_line(md, md->buf, md->buf + md->buf_len);
+	md->buf_len = 0;
+
+	return ret;
+}
+
+/**
+ * Parses a whole note that's already in memory. Unlike feeding it in chunks,
+ * no line is ever copied or cut short.
+ *
+ * @param data  Contents of the note.
+ * @param len   Length of the contents.
+ * @param flags What should be looked for on top of tags and TODO items.
+ *              (MD_HEADINGS)
+ * @param func  Function called for every piece of structure found.
+ * @param ctx   Context passed to the function.
+ *
+ * @return TRUE if the whole note was parsed.
+ *         FALSE if the user asked the parser to stop.
+ */
+bool md_parse(const char *data, size_t len, int flags, md_func_t func,
+			  void *ctx) {
+	md_parser_t md;
+	const char *tail;
+
+	md_init(&md, flags, func, ctx);
+
+	/* Every line that ends with a line feed. */
+	for (tail = data + len; (tail > data) && (tail[-1] != '\n'); tail--);
+	if (!md_feed(&md, data, (size_t)(tail - data)))
+		return false;
+
+	/* The last one, which might not. */
+	if (tail < (data + len))
+		return md_line(&md, tail, data + len);
+
+	return true;
+}
+
+/**
+ * Gets the parser flags appropriate for a note format. Headings are only
+ * looked for in Markdown notes, since a # at the start of a line in a plain
+ * text note usually means something else entirely.
+ *
+ * @param format Format (extension) of the note.
+ *
+ * @return Parser flags.
+ */
+int md_flags_for(const char *format) {
+	if ((format != NULL) && ((strcasecmp(format, "md") == 0) ||
+							 (strcasecmp(format, "markdown") == 0))) {
+		return MD_HEADINGS;
+	}
+
+	return 0;
+}
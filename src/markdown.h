@@ -0,0 +1,91 @@
+/**
+ * markdown.h
+ * Streaming extractor for the structure of Markdown and plain text notes.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _MARKDOWN_H
+#define _MARKDOWN_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Longest part of a line that will be kept when it's split between chunks. */
+#ifndef MD_LINE_MAX
+	#define MD_LINE_MAX 1024
+#endif /* MD_LINE_MAX */
+
+/* Parser flags. */
+#define MD_HEADINGS 0x01
+
+/**
+ * Kinds of structure found in a note.
+ */
+typedef enum {
+	MD_HEADING = 0,
+	MD_TAG,
+	MD_TODO
+} md_kind_t;
+
+/**
+ * Piece of structure found in a note.
+ *
+ * @warning The text points inside the data being parsed, or the parser's own
+ *          line buffer, and is only valid during the callback.
+ */
+typedef struct {
+	md_kind_t kind;
+	unsigned int level;
+	size_t line;
+
+	const char *text;
+	size_t len;
+} md_item_t;
+
+/**
+ * Function called for every piece of structure found by the parser.
+ *
+ * @param item Piece of structure that was found.
+ * @param ctx  Context passed to md_init.
+ *
+ * @return TRUE to keep parsing or FALSE to stop right away.
+ */
+typedef bool (*md_func_t)(const md_item_t *item, void *ctx);
+
+/**
+ * Streaming parser state.
+ */
+typedef struct {
+	int flags;
+	md_func_t func;
+	void *ctx;
+
+	size_t line;
+	char fence;
+	size_t fence_len;
+	bool stopped;
+
+	char buf[MD_LINE_MAX];
+	size_t buf_len;
+} md_parser_t;
+
+/* Streaming. */
+void md_init(md_parser_t *md, int flags, md_func_t func, void *ctx);
+bool md_feed(md_parser_t *md, const char *data, size_t len);
+bool md_finish(md_parser_t *md);
+
+/* Helpers. */
+bool md_parse(const char *data, size_t len, int flags, md_func_t func,
+			  void *ctx);
+int md_flags_for(const char *format);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MARKDOWN_H */
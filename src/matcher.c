@@ -0,0 +1,326 @@
+/**
+ * matcher.c
+ * Fast literal substring matching with optional ASCII case insensitivity.
+ *
+ * The vectorized implementations compare a whole block of the buffer against
+ * the first and last bytes of the pattern at once and only verify the
+ * positions where both of them match, which makes false candidates rare. The
+ * best implementation supported by the CPU is picked when the pattern is
+ * compiled.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "matcher.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define MATCHER_X86
+	#include <immintrin.h>
+#endif /* __GNUC__ && x86 */
+
+/**
+ * Converts an ASCII character to lowercase.
+ *
+ * @param c Character to be converted.
+ *
+ * @return Lowercase version of the character.
+ */
+#define MATCHER_LOWER(c) \
+	((((c) >= 'A') && ((c) <= 'Z')) ? (char)((c) + ('a' - 'A')) : (char)(c))
+
+/**
+ * Converts an ASCII character to uppercase.
+ *
+ * @param c Character to be converted.
+ *
+ * @return Uppercase version of the character.
+ */
+#define MATCHER_UPPER(c) \
+	((((c) >= 'a') && ((c) <= 'z')) ? (char)((c) - ('a' - 'A')) : (char)(c))
+
+/**
+ * Checks if the pattern is at a certain position of a buffer.
+ *
+ * @param m   Compiled pattern.
+ * @param buf Position inside the buffer. Must have at least the length of the
+ *            pattern available.
+ *
+ * @return Is the pattern at this position?
+ */
+static bool matcher_verify(const matcher_t *m, const char *buf) {
+	size_t i;
+
+	if (!m->icase)
+		return memcmp(buf, m->pattern, m->len) == 0;
+
+	for (i = 0; i < m->len; i++) {
+		if (MATCHER_LOWER(buf[i]) != m->pattern[i])
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Portable implementation of the matcher.
+ *
+ * @param m   Compiled pattern.
+ * @param buf Buffer to be searched.
+ * @param len Length of the buffer.
+ *
+ * @return Pointer to the first occurrence or NULL if it wasn't found.
+ */
+static const char* matcher_find_scalar(const matcher_t *m, const char *buf,
+									   size_t len) {
+	const char *cur;
+	const char *last;
+	char lower;
+	char upper;
+
+	if (len < m->len)
+		return NULL;
+	last = buf + (len - m->len);
+
+	/* Case sensitive matching can rely on the (usually vectorized) libc. */
+	if (!m->icase) {
+		for (cur = buf; cur <= last; cur++) {
+			cur = (const char *)memchr(cur, m->pattern[0], (last - cur) + 1);
+			if (cur == NULL)
+				return NULL;
+			if (matcher_verify(m, cur))
+				return cur;
+		}
+
+		return NULL;
+	}
+
+	/* Look for the first character in both cases. */
+	lower = m->pattern[0];
+	upper = MATCHER_UPPER(lower);
+	for (cur = buf; cur <= last; cur++) {
+		if (((*cur == lower) || (*cur == upper)) && matcher_verify(m, cur))
+			return cur;
+	}
+
+	return NULL;
+}
+
+#ifdef MATCHER_X86
+/**
+ * SSE2 implementation of the matcher.
+ *
+ * @param m   Compiled pattern.
+ * @param buf Buffer to be searched.
+ * @param len Length of the buffer.
+ *
+ * @return Pointer to the first occurrence or NULL if it wasn't found.
+ */
+__attribute__((target("sse2")))
+static const char* matcher_find_sse2(const matcher_t *m, const char *buf,
+									 size_t len) {
+	__m128i first_lo;
+	__m128i first_up;
+	__m128i last_lo;
+	__m128i last_up;
+	__m128i block_first;
+	__m128i block_last;
+	__m128i eq;
+	const char *found;
+	size_t i;
+	unsigned int mask;
+	unsigned int bit;
+	char c;
+
+	if (len < m->len)
+		return NULL;
+
+	/* Broadcast the first and last characters of the pattern in both cases. */
+	c = m->pattern[0];
+	first_lo = _mm_set1_epi8(c);
+	first_up = _mm_set1_epi8(m->icase ? MATCHER_UPPER(c) : c);
+	c = m->pattern[m->len - 1];
+	last_lo = _mm_set1_epi8(c);
+	last_up = _mm_set1_epi8(m->icase ? MATCHER_UPPER(c) : c);
+
+	/* Go through the buffer a block at a time. */
+	for (i = 0; (i + m->len - 1 + 16) <= len; i += 16) {
+		block_first = _mm_loadu_si128((const __m128i *)(buf + i));
+		block_last = _mm_loadu_si128((const __m128i *)(buf + i + m->len - 1));
+
+		eq = _mm_and_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(block_first, first_lo),
+						 _mm_cmpeq_epi8(block_first, first_up)),
+			_mm_or_si128(_mm_cmpeq_epi8(block_last, last_lo),
+						 _mm_cmpeq_epi8(block_last, last_up)));
+		mask = (unsigned int)_mm_movemask_epi8(eq);
+
+		/* Verify each candidate. */
+		while (mask != 0) {
+			bit = (unsigned int)__builtin_ctz(mask);
+			if (matcher_verify(m, buf + i + bit))
+				return buf + i + bit;
+			mask &= mask - 1;
+		}
+	}
+
+	/* Deal with whatever is left. */
+	found = matcher_find_scalar(m, buf + i, len - i);
+	return found;
+}
+
+/**
+ * AVX2 implementation of the matcher.
+ *
+ * @param m   Compiled pattern.
+ * @param buf Buffer to be searched.
+ * @param len Length of the buffer.
+ *
+ * @return Pointer to the first occurrence or NULL if it wasn't found.
+ */
+__attribute__((target("avx2")))
+static const char* matcher_find_avx2(const matcher_t *m, const char *buf,
+									 size_t len) {
+	__m256i first_lo;
+	__m256i first_up;
+	__m256i last_lo;
+	__m256i last_up;
+	__m256i block_first;
+	__m256i block_last;
+	__m256i eq;
+	size_t i;
+	unsigned int mask;
+	unsigned int bit;
+	char c;
+
+	if (len < m->len)
+		return NULL;
+
+	/* Broadcast the first and last characters of the pattern in both cases. */
+	c = m->pattern[0];
+	first_lo = _mm256_set1_epi8(c);
+	first_up = _mm256_set1_epi8(m->icase ? MATCHER_UPPER(c) : c);
+	c = m->pattern[m->len - 1];
+	last_lo = _mm256_set1_epi8(c);
+	last_up = _mm256_set1_epi8(m->icase ? MATCHER_UPPER(c) : c);
+
+	/* Go through the buffer a block at a time. */
+	for (i = 0; (i + m->len - 1 + 32) <= len; i += 32) {
+		block_first = _mm256_loadu_si256((const __m256i *)(buf + i));
+		block_last = _mm256_loadu_si256(
+			(const __m256i *)(buf + i + m->len - 1));
+
+		eq = _mm256_and_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(block_first, first_lo),
+							_mm256_cmpeq_epi8(block_first, first_up)),
+			_mm256_or_si256(_mm256_cmpeq_epi8(block_last, last_lo),
+							_mm256_cmpeq_epi8(block_last, last_up)));
+		mask = (unsigned int)_mm256_movemask_epi8(eq);
+
+		/* Verify each candidate. */
+		while (mask != 0) {
+			bit = (unsigned int)__builtin_ctz(mask);
+			if (matcher_verify(m, buf + i + bit))
+				return buf + i + bit;
+			mask &= mask - 1;
+		}
+	}
+
+	/* Let the narrower implementation deal with whatever is left. */
+	return matcher_find_sse2(m, buf + i, len - i);
+}
+#endif /* MATCHER_X86 */
+
+/**
+ * Compiles a literal pattern, picking the best implementation for this CPU.
+ * @warning The object allocated by this function must be free'd after use.
+ *
+ * @param pattern Literal pattern to look for. Must not be empty.
+ * @param icase   Should ASCII letters be matched regardless of their case?
+ *
+ * @return Compiled pattern or NULL in case of an error.
+ *
+ * @see matcher_free
+ */
+matcher_t* matcher_new(const char *pattern, bool icase) {
+	matcher_t *m;
+	size_t i;
+
+	/* Check if we have a valid pattern. */
+	if ((pattern == NULL) || (*pattern == '\0'))
+		return NULL;
+
+	/* Allocate enough memory for our object. */
+	m = (matcher_t *)malloc(sizeof(matcher_t));
+	if (m == NULL)
+		return NULL;
+	m->len = strlen(pattern);
+	m->icase = icase;
+	m->pattern = (char *)malloc((m->len + 1) * sizeof(char));
+	if (m->pattern == NULL) {
+		free(m);
+		return NULL;
+	}
+
+	/* Case insensitive patterns are stored in lowercase. */
+	for (i = 0; i <= m->len; i++)
+		m->pattern[i] = icase ? MATCHER_LOWER(pattern[i]) : pattern[i];
+
+	/* Pick the best implementation. */
+	m->find = matcher_find_scalar;
+#ifdef MATCHER_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		m->find = matcher_find_avx2;
+	} else if (__builtin_cpu_supports("sse2")) {
+		m->find = matcher_find_sse2;
+	}
+#endif /* MATCHER_X86 */
+
+	return m;
+}
+
+/**
+ * Frees up any resources allocated by a compiled pattern.
+ *
+ * @param m Compiled pattern to be free'd.
+ */
+void matcher_free(matcher_t *m) {
+	if (m == NULL)
+		return;
+
+	free(m->pattern);
+	free(m);
+}
+
+/**
+ * Finds the first occurrence of the pattern in a buffer.
+ *
+ * @param m   Compiled pattern.
+ * @param buf Buffer to be searched. Doesn't need to be NULL terminated.
+ * @param len Length of the buffer.
+ *
+ * @return Pointer to the first occurrence or NULL if it wasn't found.
+ */
+const char* matcher_find(const matcher_t *m, const char *buf, size_t len) {
+	return m->find(m, buf, len);
+}
+
+/**
+ * Gets the name of the implementation picked for a compiled pattern.
+ *
+ * @param m Compiled pattern.
+ *
+ * @return Name of the implementation.
+ */
+const char* matcher_impl(const matcher_t *m) {
+#ifdef MATCHER_X86
+	if (m->find == matcher_find_avx2)
+		return "avx2";
+	if (m->find == matcher_find_sse2)
+		return "sse2";
+#endif /* MATCHER_X86 */
+
+	return "scalar";
+}
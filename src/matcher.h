@@ -0,0 +1,48 @@
+/**
+ * matcher.h
+ * Fast literal substring matching with optional ASCII case insensitivity.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _MATCHER_H
+#define _MATCHER_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Function that finds the first occurrence of a pattern in a buffer.
+ */
+struct matcher_s;
+typedef const char* (*matcher_func_t)(const struct matcher_s *m,
+									  const char *buf, size_t len);
+
+/**
+ * Compiled literal pattern.
+ */
+typedef struct matcher_s {
+	char *pattern;
+	size_t len;
+	bool icase;
+
+	matcher_func_t find;
+} matcher_t;
+
+/* Construction and destruction. */
+matcher_t* matcher_new(const char *pattern, bool icase);
+void matcher_free(matcher_t *m);
+
+/* Matching. */
+const char* matcher_find(const matcher_t *m, const char *buf, size_t len);
+const char* matcher_impl(const matcher_t *m);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MATCHER_H */
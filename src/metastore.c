@@ -0,0 +1,845 @@
+/**
+ * metastore.c
+ * Compact columnar store for the metadata of the notes in a workspace.
+ *
+ * Instead of a note object per file, with a couple of separately allocated
+ * strings each, the metadata is kept in one array per field: dates as day
+ * numbers, formats and directories as small interned IDs and file names as
+ * offsets into a single blob of strings, with the title being a slice of the
+ * name. Sorting and filtering a huge workspace only ever goes through these
+ * contiguous arrays, and note objects are only created for the ones a caller
+ * actually needs.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "metastore.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "dateutils.h"
+#include "fsutils.h"
+#include "strutils.h"
+
+/* Offset of the title inside a note's file name. */
+#define METASTORE_TITLE_OFF (DATE_STR_LEN + 1)
+
+/* Runs of notes from the same day shorter than this are insertion sorted. */
+#define METASTORE_INSERTION_MAX 16
+
+/**
+ * Appends a string to the blob.
+ *
+ * @param ms  Metadata store object.
+ * @param str String to be appended.
+ * @param off Will hold the offset of the string inside the blob.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+static bool metastore_blob(metastore_t *ms, const char *str, uint32_t *off) {
+	char *blob;
+	size_t len;
+	size_t cap;
+
+	/* Make sure it fits. */
+	len = strlen(str) + 1;
+	if ((ms->blob_len + len) > UINT32_MAX) {
+		errno = ENOMEM;
+		return false;
+	}
+	if ((ms->blob_len + len) > ms->blob_cap) {
+		cap = (ms->blob_cap == 0) ? 4096 : ms->blob_cap;
+		while (cap < (ms->blob_len + len))
+			cap *= 2;
+		blob = (char *)realloc(ms->blob, cap);
+		if (blob == NULL) {
+			errno = ENOMEM;
+			return false;
+		}
+		ms->blob = blob;
+		ms->blob_cap = cap;
+	}
+
+	/* Put it in its place. */
+	memcpy(ms->blob + ms->blob_len, str, len);
+	*off = (uint32_t)ms->blob_len;
+	ms->blob_len += len;
+
+	return true;
+}
+
+/**
+ * Finds the ID of a string in a table of interned strings, adding it if it
+ * isn't there yet.
+ *
+ * @param ms    Metadata store object.
+ * @param table Table of blob offsets. (Will be reallocated)
+ * @param len   Number of strings in the table.
+ * @param max   Maximum number of strings allowed in the table.
+ * @param str   String to be interned.
+ * @param id    Will hold the ID of the string.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory or the table is full.
+ */
+static bool metastore_intern(metastore_t *ms, uint32_t **table, size_t *len,
+							 size_t max, const char *str, uint16_t *id) {
+	uint32_t *grown;
+	uint32_t off;
+	size_t i;
+
+	/* There are usually only a handful of them. */
+	for (i = 0; i < *len; i++) {
+		if (strcmp(ms->blob + (*table)[i], str) == 0) {
+			*id = (uint16_t)i;
+			return true;
+		}
+	}
+	if (*len >= max) {
+		errno = ENOMEM;
+		return false;
+	}
+
+	/* Add it to the table. */
+	grown = (uint32_t *)realloc(*table, (*len + 1) * sizeof(uint32_t));
+	if (grown == NULL) {
+		errno = ENOMEM;
+		return false;
+	}
+	*table = grown;
+	if (!metastore_blob(ms, str, &off))
+		return false;
+	(*table)[*len] = off;
+	*id = (uint16_t)(*len)++;
+
+	return true;
+}
+
+/**
+ * Grows a column to a new capacity.
+ *
+ * @param col  Column to be grown. (Will be reallocated)
+ * @param size Size of each element.
+ * @param cap  New number of elements.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+static bool metastore_grow_col(void *col, size_t size, size_t cap) {
+	void *grown;
+
+	grown = realloc(*(void **)col, size * cap);
+	if (grown == NULL)
+		return false;
+	*(void **)col = grown;
+
+	return true;
+}
+
+/**
+ * Makes room for one more note in every column.
+ *
+ * @param ms Metadata store object.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+static bool metastore_grow(metastore_t *ms) {
+	size_t cap;
+
+	if (ms->len < ms->cap)
+		return true;
+
+	cap = (ms->cap == 0) ? 1024 : ms->cap * 2;
+	if (!metastore_grow_col(&ms->days, sizeof(int32_t), cap) ||
+			!metastore_grow_col(&ms->names, sizeof(uint32_t), cap) ||
+			!metastore_grow_col(&ms->title_lens, sizeof(uint16_t), cap) ||
+			!metastore_grow_col(&ms->formats, sizeof(uint16_t), cap) ||
+			!metastore_grow_col(&ms->dirs, sizeof(uint16_t), cap) ||
+			!metastore_grow_col(&ms->sizes, sizeof(uint64_t), cap) ||
+			!metastore_grow_col(&ms->mtimes, sizeof(int64_t), cap) ||
+			!metastore_grow_col(&ms->inodes, sizeof(uint64_t), cap)) {
+		errno = ENOMEM;
+		return false;
+	}
+	if (ms->views != NULL) {
+		if (!metastore_grow_col(&ms->views, sizeof(note_t *), cap)) {
+			errno = ENOMEM;
+			return false;
+		}
+		memset(ms->views + ms->cap, 0, (cap - ms->cap) * sizeof(note_t *));
+	}
+	ms->cap = cap;
+
+	return true;
+}
+
+/**
+ * Compares two notes from the same day by title, format and location.
+ *
+ * @param ms Metadata store object.
+ * @param a  Index of a note.
+ * @param b  Index of another note.
+ *
+ * @return Same as note_cmp.
+ */
+static int metastore_cmp(const metastore_t *ms, uint32_t a, uint32_t b) {
+	const char *ta;
+	const char *tb;
+	size_t la;
+	size_t lb;
+	int ret;
+
+	/* Compare titles. */
+	ta = ms->blob + ms->names[a] + METASTORE_TITLE_OFF;
+	tb = ms->blob + ms->names[b] + METASTORE_TITLE_OFF;
+	la = ms->title_lens[a];
+	lb = ms->title_lens[b];
+	ret = memcmp(ta, tb, (la < lb) ? la : lb);
+	if (ret != 0)
+		return ret;
+	if (la != lb)
+		return (la < lb) ? -1 : 1;
+
+	/* Compare formats. */
+	if (ms->formats[a] != ms->formats[b]) {
+		ret = strcmp(ms->blob + ms->fmt_names[ms->formats[a]],
+					 ms->blob + ms->fmt_names[ms->formats[b]]);
+		if (ret != 0)
+			return ret;
+	}
+
+	/* Notes with the same name may live in different folders. */
+	if (ms->dirs[a] != ms->dirs[b]) {
+		ret = strcmp(ms->blob + ms->dir_names[ms->dirs[a]],
+					 ms->blob + ms->dir_names[ms->dirs[b]]);
+		if (ret != 0)
+			return ret;
+	}
+	return strcmp(ms->blob + ms->names[a], ms->blob + ms->names[b]);
+}
+
+/**
+ * Allocates a brand new empty metadata store.
+ * @warning The object allocated by this function must be free'd after use.
+ *
+ * @return Brand new metadata store or NULL if we couldn't allocate enough
+ *         memory.
+ *
+ * @see metastore_free
+ */
+metastore_t* metastore_new(void) {
+	metastore_t *ms;
+
+	/* Allocate enough memory for our object. */
+	ms = (metastore_t *)calloc(1, sizeof(metastore_t));
+	if (ms == NULL)
+		return NULL;
+	ms->sorted = true;
+
+	return ms;
+}
+
+/**
+ * Frees up a metadata store along with every note view created from it.
+ *
+ * @param ms Metadata store to be free'd.
+ */
+void metastore_free(metastore_t *ms) {
+	size_t i;
+
+	/* Do we even have anything to do? */
+	if (ms == NULL)
+		return;
+
+	/* Free the views. */
+	if (ms->views) {
+		for (i = 0; i < ms->len; i++)
+			note_free(ms->views[i]);
+		free(ms->views);
+	}
+
+	/* Free the columns and everything else. */
+	if (ms->days)
+		free(ms->days);
+	if (ms->names)
+		free(ms->names);
+	if (ms->title_lens)
+		free(ms->title_lens);
+	if (ms->formats)
+		free(ms->formats);
+	if (ms->dirs)
+		free(ms->dirs);
+	if (ms->sizes)
+		free(ms->sizes);
+	if (ms->mtimes)
+		free(ms->mtimes);
+	if (ms->inodes)
+		free(ms->inodes);
+	if (ms->blob)
+		free(ms->blob);
+	if (ms->fmt_names)
+		free(ms->fmt_names);
+	if (ms->dir_names)
+		free(ms->dir_names);
+	if (ms->scratch)
+		free(ms->scratch);
+	free(ms);
+}
+
+/**
+ * Registers a directory that notes can be pushed into.
+ *
+ * @param ms   Metadata store object.
+ * @param path Path to the directory.
+ * @param dir  Will hold the ID of the directory.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+bool metastore_add_dir(metastore_t *ms, const char *path, uint16_t *dir) {
+	return metastore_intern(ms, &ms->dir_names, &ms->ndirs,
+							METASTORE_MAX_DIRS, path, dir);
+}
+
+/**
+ * Appends the metadata of a note to the store.
+ *
+ * @param ms    Metadata store object.
+ * @param dir   ID of the directory the note is in.
+ * @param name  File name of the note. (Not a path)
+ * @param size  Size of the note's file or 0 if unknown.
+ * @param mtime Modification time of the note's file or 0 if unknown.
+ * @param inode Inode of the note's file or 0 if unknown.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if the name isn't of a note (errno is set to EINVAL) or we
+ *         couldn't allocate enough memory.
+ *
+ * @see metastore_add_dir
+ */
+bool metastore_push(metastore_t *ms, uint16_t dir, const char *name,
+					uint64_t size, int64_t mtime, uint64_t inode) {
+	note_fname_t parsed;
+	uint16_t fmt;
+	uint32_t off;
+
+	/* Parse the name. */
+	if ((dir >= ms->ndirs) || !note_parse_fname(name, &parsed) ||
+			(parsed.title_len > UINT16_MAX)) {
+		errno = EINVAL;
+		return false;
+	}
+
+	/* Make room for it. */
+	if (!metastore_intern(ms, &ms->fmt_names, &ms->nformats,
+						  METASTORE_MAX_FORMATS, parsed.format, &fmt) ||
+			!metastore_grow(ms) || !metastore_blob(ms, name, &off)) {
+		return false;
+	}
+
+	/* Fill in the columns. */
+	ms->days[ms->len] = parsed.days;
+	ms->names[ms->len] = off;
+	ms->title_lens[ms->len] = (uint16_t)parsed.title_len;
+	ms->formats[ms->len] = fmt;
+	ms->dirs[ms->len] = dir;
+	ms->sizes[ms->len] = size;
+	ms->mtimes[ms->len] = mtime;
+	ms->inodes[ms->len] = inode;
+	if (ms->views)
+		ms->views[ms->len] = NULL;
+
+	/* Notes are often pushed in order already. */
+	if (ms->sorted && (ms->len > 0) &&
+			((ms->days[ms->len - 1] > parsed.days) ||
+			 ((ms->days[ms->len - 1] == parsed.days) &&
+			  (metastore_cmp(ms, (uint32_t)ms->len - 1,
+							 (uint32_t)ms->len) > 0)))) {
+		ms->sorted = false;
+	}
+	ms->len++;
+
+	return true;
+}
+
+/**
+ * Appends the metadata of every note in a workspace directory to the store,
+ * straight from the directory entries. Entries that aren't notes are skipped.
+ *
+ * @param ms     Metadata store object.
+ * @param path   Path to the workspace.
+ * @param filter Only add the notes that pass this filter or NULL for all.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ */
+bool metastore_scan(metastore_t *ms, const char *path,
+					const filter_t *filter) {
+	fs_dirscan_t scan;
+	const fs_dirent_t *entries;
+	uint16_t dir;
+	size_t count;
+	size_t i;
+	bool ret;
+	int err;
+
+	/* Open the workspace. */
+	if (!metastore_add_dir(ms, path, &dir))
+		return false;
+	if (!fs_dirscan_open(&scan, path, FS_SCAN_FILES))
+		return false;
+
+	/* Go through the entries. */
+	ret = true;
+	while (ret && ((count = fs_dirscan_next(&scan, &entries)) > 0)) {
+		for (i = 0; i < count; i++) {
+			if ((filter != NULL) &&
+					!filter_match_at(filter, fs_dirscan_fd(&scan),
+									 entries[i].name)) {
+				continue;
+			}
+
+			if (!metastore_push(ms, dir, entries[i].name, 0, 0, 0) &&
+					(errno != EINVAL)) {
+				ret = false;
+				break;
+			}
+		}
+	}
+	err = fs_dirscan_error(&scan);
+	fs_dirscan_close(&scan);
+	if (ret && (err != 0)) {
+		errno = err;
+		return false;
+	}
+
+	return ret;
+}
+
+/**
+ * Sorts a run of notes from the same day with a stable merge sort.
+ *
+ * @param ms   Metadata store object.
+ * @param rows Indexes of the notes to be sorted.
+ * @param tmp  Scratch space for at least as many indexes.
+ * @param len  Number of notes.
+ */
+static void metastore_sort_run(const metastore_t *ms, uint32_t *rows,
+							   uint32_t *tmp, size_t len) {
+	uint32_t row;
+	size_t half;
+	size_t i;
+	size_t j;
+	size_t k;
+
+	/* Small runs are the most common by far. */
+	if (len <= METASTORE_INSERTION_MAX) {
+		for (i = 1; i < len; i++) {
+			row = rows[i];
+			for (j = i; (j > 0) && (metastore_cmp(ms, rows[j - 1], row) > 0);
+				 j--) {
+				rows[j] = rows[j - 1];
+			}
+			rows[j] = row;
+		}
+
+		return;
+	}
+
+	/* Sort each half and merge them. */
+	half = len / 2;
+	metastore_sort_run(ms, rows, tmp, half);
+	metastore_sort_run(ms, rows + half, tmp, len - half);
+	memcpy(tmp, rows, len * sizeof(uint32_t));
+	for (i = 0, j = half, k = 0; k < len; k++) {
+		if ((i < half) && ((j == len) || (metastore_cmp(ms, tmp[i],
+														tmp[j]) <= 0))) {
+			rows[k] = tmp[i++];
+		} else {
+			rows[k] = tmp[j++];
+		}
+	}
+}
+
+/**
+ * Rearranges the elements of a column.
+ *
+ * @param col     Column to be rearranged.
+ * @param size    Size of each element.
+ * @param order   Index of the element that goes into each position.
+ * @param len     Number of elements.
+ * @param scratch Scratch space for the whole column.
+ */
+static void metastore_permute(void *col, size_t size, const uint32_t *order,
+							  size_t len, void *scratch) {
+	size_t i;
+
+	switch (size) {
+		case sizeof(uint16_t):
+			for (i = 0; i < len; i++)
+				((uint16_t *)scratch)[i] = ((const uint16_t *)col)[order[i]];
+			break;
+		case sizeof(uint32_t):
+			for (i = 0; i < len; i++)
+				((uint32_t *)scratch)[i] = ((const uint32_t *)col)[order[i]];
+			break;
+		case sizeof(uint64_t):
+			for (i = 0; i < len; i++)
+				((uint64_t *)scratch)[i] = ((const uint64_t *)col)[order[i]];
+			break;
+		default:
+			for (i = 0; i < len; i++) {
+				memcpy((char *)scratch + (i * size),
+					   (const char *)col + (order[i] * size), size);
+			}
+			break;
+	}
+	memcpy(col, scratch, len * size);
+}
+
+/**
+ * Sorts the notes by date, title and format, the same way notelist_sort does.
+ * Dates are radix sorted as plain integers and only the notes that share a day
+ * are ever compared by title.
+ *
+ * @param ms Metadata store object.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ *
+ * @see note_cmp
+ */
+bool metastore_sort(metastore_t *ms) {
+	uint64_t *keys;
+	uint64_t *spare;
+	uint64_t *swap;
+	uint32_t *order;
+	size_t counts[256];
+	size_t total;
+	size_t shift;
+	size_t start;
+	size_t i;
+
+	/* Do we even have anything to do? */
+	if (ms->sorted || (ms->len < 2)) {
+		ms->sorted = true;
+		return true;
+	}
+	keys = (uint64_t *)malloc(ms->len * sizeof(uint64_t));
+	spare = (uint64_t *)malloc(ms->len * sizeof(uint64_t));
+	if ((keys == NULL) || (spare == NULL)) {
+		if (keys)
+			free(keys);
+		if (spare)
+			free(spare);
+		errno = ENOMEM;
+		return false;
+	}
+
+	/* Pair up the dates, flipped so that they're ordered as unsigned, with
+	 * their indexes and radix sort them a byte at a time. */
+	for (i = 0; i < ms->len; i++) {
+		keys[i] = ((uint64_t)((uint32_t)ms->days[i] ^ 0x80000000UL) << 32) |
+			(uint64_t)i;
+	}
+	for (shift = 32; shift < 64; shift += 8) {
+		memset(counts, 0, sizeof(counts));
+		for (i = 0; i < ms->len; i++)
+			counts[(keys[i] >> shift) & 0xFF]++;
+		if (counts[(keys[0] >> shift) & 0xFF] == ms->len)
+			continue;
+
+		for (i = 0, total = 0; i < 256; i++) {
+			start = counts[i];
+			counts[i] = total;
+			total += start;
+		}
+		for (i = 0; i < ms->len; i++)
+			spare[counts[(keys[i] >> shift) & 0xFF]++] = keys[i];
+		swap = keys;
+		keys = spare;
+		spare = swap;
+	}
+
+	/* Sort the notes that share a day. */
+	order = (uint32_t *)spare;
+	for (i = 0; i < ms->len; i++)
+		order[i] = (uint32_t)keys[i];
+	for (start = 0, i = 1; i <= ms->len; i++) {
+		if ((i == ms->len) || ((keys[i] >> 32) != (keys[start] >> 32))) {
+			if ((i - start) > 1) {
+				metastore_sort_run(ms, order + start, order + ms->len,
+								   i - start);
+			}
+			start = i;
+		}
+	}
+
+	/* Put every column in order. */
+	metastore_permute(ms->days, sizeof(int32_t), order, ms->len, keys);
+	metastore_permute(ms->names, sizeof(uint32_t), order, ms->len, keys);
+	metastore_permute(ms->title_lens, sizeof(uint16_t), order, ms->len, keys);
+	metastore_permute(ms->formats, sizeof(uint16_t), order, ms->len, keys);
+	metastore_permute(ms->dirs, sizeof(uint16_t), order, ms->len, keys);
+	metastore_permute(ms->sizes, sizeof(uint64_t), order, ms->len, keys);
+	metastore_permute(ms->mtimes, sizeof(int64_t), order, ms->len, keys);
+	metastore_permute(ms->inodes, sizeof(uint64_t), order, ms->len, keys);
+	if (ms->views) {
+		metastore_permute(ms->views, sizeof(note_t *), order, ms->len,
+						  keys);
+	}
+	ms->sorted = true;
+
+	free(keys);
+	free(spare);
+
+	return true;
+}
+
+/**
+ * Gets rid of the notes that don't pass a filter. Sizes are only checked for
+ * notes whose size is known.
+ *
+ * @param ms     Metadata store object.
+ * @param filter Filter that the notes must pass.
+ */
+void metastore_filter(metastore_t *ms, const filter_t *filter) {
+	bool sizes;
+	size_t i;
+	size_t j;
+
+	sizes = filter_needs_stat(filter);
+	for (i = 0, j = 0; i < ms->len; i++) {
+		/* Check the note. */
+		if (!filter_match_fields(filter, ms->days[i],
+								 ms->blob + ms->names[i] + METASTORE_TITLE_OFF,
+								 ms->title_lens[i],
+								 ms->blob + ms->fmt_names[ms->formats[i]]) ||
+				(sizes && (ms->sizes[i] > 0) &&
+				 !filter_match_size(filter, ms->sizes[i]))) {
+			if (ms->views)
+				note_free(ms->views[i]);
+			continue;
+		}
+
+		/* Keep it. */
+		if (i != j) {
+			ms->days[j] = ms->days[i];
+			ms->names[j] = ms->names[i];
+			ms->title_lens[j] = ms->title_lens[i];
+			ms->formats[j] = ms->formats[i];
+			ms->dirs[j] = ms->dirs[i];
+			ms->sizes[j] = ms->sizes[i];
+			ms->mtimes[j] = ms->mtimes[i];
+			ms->inodes[j] = ms->inodes[i];
+			if (ms->views)
+				ms->views[j] = ms->views[i];
+		}
+		j++;
+	}
+	ms->len = j;
+}
+
+/**
+ * Finds the notes of a sorted store that were written between two dates.
+ *
+ * @param ms    Metadata store sorted by metastore_sort.
+ * @param from  Earliest date as a number of days since 1970-01-01. (Inclusive)
+ * @param to    Latest date as a number of days since 1970-01-01. (Inclusive)
+ * @param first Will hold the index of the first note in range.
+ *
+ * @return Number of notes in range.
+ */
+size_t metastore_range(const metastore_t *ms, int32_t from, int32_t to,
+					   size_t *first) {
+	size_t lo;
+	size_t hi;
+	size_t mid;
+	size_t start;
+
+	/* First note on or after the starting date. */
+	lo = 0;
+	hi = ms->len;
+	while (lo < hi) {
+		mid = lo + ((hi - lo) / 2);
+		if (ms->days[mid] < from) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	start = lo;
+
+	/* First note after the ending date. */
+	hi = ms->len;
+	while (lo < hi) {
+		mid = lo + ((hi - lo) / 2);
+		if (ms->days[mid] <= to) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	*first = start;
+	return lo - start;
+}
+
+/**
+ * Gets the number of notes in the store.
+ *
+ * @param ms Metadata store object.
+ *
+ * @return Number of notes.
+ */
+size_t metastore_len(const metastore_t *ms) {
+	return ms->len;
+}
+
+/**
+ * Gets the date of a note.
+ *
+ * @param ms    Metadata store object.
+ * @param index Index of the note.
+ *
+ * @return Number of days since 1970-01-01.
+ */
+int32_t metastore_days(const metastore_t *ms, size_t index) {
+	return ms->days[index];
+}
+
+/**
+ * Gets the title of a note.
+ * @warning The title isn't NULL terminated and is only valid until the store
+ *          is changed.
+ *
+ * @param ms    Metadata store object.
+ * @param index Index of the note.
+ * @param len   Will hold the length of the title.
+ *
+ * @return Title of the note.
+ */
+const char* metastore_title(const metastore_t *ms, size_t index, size_t *len) {
+	*len = ms->title_lens[index];
+	return ms->blob + ms->names[index] + METASTORE_TITLE_OFF;
+}
+
+/**
+ * Gets the format of a note.
+ * @warning Only valid until the store is changed.
+ *
+ * @param ms    Metadata store object.
+ * @param index Index of the note.
+ *
+ * @return Format of the note.
+ */
+const char* metastore_format(const metastore_t *ms, size_t index) {
+	return ms->blob + ms->fmt_names[ms->formats[index]];
+}
+
+/**
+ * Gets the file name of a note.
+ * @warning Only valid until the store is changed.
+ *
+ * @param ms    Metadata store object.
+ * @param index Index of the note.
+ *
+ * @return File name of the note.
+ */
+const char* metastore_name(const metastore_t *ms, size_t index) {
+	return ms->blob + ms->names[index];
+}
+
+/**
+ * Builds a note object out of the metadata of a note.
+ *
+ * @param ms    Metadata store object.
+ * @param index Index of the note.
+ * @param arena Arena to allocate the note from or NULL to use the heap.
+ *
+ * @return Brand new note object or NULL if we couldn't allocate enough memory.
+ */
+static note_t* metastore_build(metastore_t *ms, size_t index,
+							   arena_t *arena) {
+	note_t *note;
+	const char *title;
+	size_t len;
+
+	note = note_new_arena(arena);
+	if (note == NULL)
+		return NULL;
+
+	/* Populate the note with the metadata we have. */
+	title = metastore_title(ms, index, &len);
+	note_set_date(note, date_from_days(ms->days[index]));
+	note_set_title_untilp(note, title, title + len);
+	note_set_format(note, metastore_format(ms, index));
+	note->size = ms->sizes[index];
+	note->mtime = ms->mtimes[index];
+	note->inode = ms->inodes[index];
+
+	/* Build the path to the note. */
+	string_copy(&ms->scratch, ms->blob + ms->dir_names[ms->dirs[index]]);
+	fs_pathcat(&ms->scratch, metastore_name(ms, index));
+	note_set_path(note, ms->scratch);
+
+	return note;
+}
+
+/**
+ * Gets a note object for a note in the store, which is only created the first
+ * time it's asked for and belongs to the store.
+ *
+ * @param ms    Metadata store object.
+ * @param index Index of the note.
+ *
+ * @return Note object or NULL if the index is out of bounds or we couldn't
+ *         allocate enough memory.
+ */
+note_t* metastore_note(metastore_t *ms, size_t index) {
+	if (index >= ms->len)
+		return NULL;
+
+	/* Views are only kept track of once someone asks for one. */
+	if (ms->views == NULL) {
+		ms->views = (note_t **)calloc(ms->cap, sizeof(note_t *));
+		if (ms->views == NULL)
+			return NULL;
+	}
+	if (ms->views[index] == NULL)
+		ms->views[index] = metastore_build(ms, index, NULL);
+
+	return ms->views[index];
+}
+
+/**
+ * Creates note objects for a range of notes and appends them to a collection,
+ * which takes ownership of them.
+ *
+ * @param ms    Metadata store object.
+ * @param first Index of the first note.
+ * @param count Number of notes.
+ * @param list  Note collection to append the notes to.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+bool metastore_export(metastore_t *ms, size_t first, size_t count,
+					  notelist_t *list) {
+	note_t *note;
+	size_t i;
+
+	for (i = first; (i < (first + count)) && (i < ms->len); i++) {
+		note = metastore_build(ms, i, notelist_arena(list));
+		if ((note == NULL) || !notelist_push(list, note)) {
+			note_free(note);
+			errno = ENOMEM;
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,90 @@
+/**
+ * metastore.h
+ * Compact columnar store for the metadata of the notes in a workspace.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _METASTORE_H
+#define _METASTORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "filter.h"
+#include "note.h"
+#include "notelist.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Maximum number of distinct formats and directories in a store. */
+#define METASTORE_MAX_FORMATS 0xFFFF
+#define METASTORE_MAX_DIRS    0xFFFF
+
+/**
+ * Metadata store object. Every column has one element per note, and strings
+ * are kept as offsets into a single blob.
+ */
+typedef struct {
+	int32_t *days;
+	uint32_t *names;
+	uint16_t *title_lens;
+	uint16_t *formats;
+	uint16_t *dirs;
+	uint64_t *sizes;
+	int64_t *mtimes;
+	uint64_t *inodes;
+	note_t **views;
+	size_t len;
+	size_t cap;
+	bool sorted;
+
+	char *blob;
+	size_t blob_len;
+	size_t blob_cap;
+
+	uint32_t *fmt_names;
+	size_t nformats;
+	uint32_t *dir_names;
+	size_t ndirs;
+
+	char *scratch;
+} metastore_t;
+
+/* Construction and destruction. */
+metastore_t* metastore_new(void);
+void metastore_free(metastore_t *ms);
+
+/* Populating. */
+bool metastore_add_dir(metastore_t *ms, const char *path, uint16_t *dir);
+bool metastore_push(metastore_t *ms, uint16_t dir, const char *name,
+					uint64_t size, int64_t mtime, uint64_t inode);
+bool metastore_scan(metastore_t *ms, const char *path,
+					const filter_t *filter);
+
+/* Querying. */
+bool metastore_sort(metastore_t *ms);
+void metastore_filter(metastore_t *ms, const filter_t *filter);
+size_t metastore_range(const metastore_t *ms, int32_t from, int32_t to,
+					   size_t *first);
+
+/* Accessors. */
+size_t metastore_len(const metastore_t *ms);
+int32_t metastore_days(const metastore_t *ms, size_t index);
+const char* metastore_title(const metastore_t *ms, size_t index, size_t *len);
+const char* metastore_format(const metastore_t *ms, size_t index);
+const char* metastore_name(const metastore_t *ms, size_t index);
+
+/* Views. */
+note_t* metastore_note(metastore_t *ms, size_t index);
+bool metastore_export(metastore_t *ms, size_t first, size_t count,
+					  notelist_t *list);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _METASTORE_H */
@@ -7,10 +7,16 @@
 
 #include "note.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
+#include "dateutils.h"
 #include "fsutils.h"
+#include "hash.h"
+#include "stats.h"
 #include "strutils.h"
 
 /**
@@ -22,16 +28,52 @@
  * @see note_free
  */
 note_t* note_new(void) {
+	return note_new_arena(NULL);
+}
+
+/**
+ * Allocates a brand new note object from an arena. Every string set on the
+ * note will also be allocated from it.
+ * @warning The object must still be passed to note_free in order to close its
+ *          file handle and release its contents, but its memory will only be
+ *          released when the arena is free'd.
+ *
+ * @param arena Arena to allocate from or NULL to use the heap.
+ *
+ * @return Brand new note object or NULL in case of an error.
+ *
+ * @see note_free
+ */
+note_t* note_new_arena(arena_t *arena) {
 	note_t* note;
 
 	/* Allocate enough memory for our object. */
-	note = (note_t *)malloc(sizeof(note_t));
+	if (arena != NULL) {
+		note = (note_t *)arena_alloc(arena, sizeof(note_t));
+		STATS_INC(STATS_ARENA_ALLOCS);
+	} else {
+		note = (note_t *)malloc(sizeof(note_t));
+		STATS_INC(STATS_ALLOCS);
+	}
+	if (note == NULL)
+		return NULL;
 
 	/* Populate the note with some defaults. */
+	note->arena = arena;
 	note->fh = NULL;
 	note->date = time(NULL);
 	note->title = NULL;
 	note->format = NULL;
+	note->path = NULL;
+	note->content.data = NULL;
+	note->content.len = 0;
+	note->content.mapped = false;
+	note->content.borrowed = false;
+	note->size = 0;
+	note->mtime = 0;
+	note->inode = 0;
+	note->hash = 0;
+	note->ws = NULL;
 
 	return note;
 }
@@ -46,20 +88,59 @@ void note_free(note_t *note) {
 	if (note == NULL)
 		return;
 
-	/* Close any open file handles. */
+	/* Close any open file handles and release cached contents. */
 	note_fh_close(note);
+	note_unload(note);
+
+	/* Memory allocated from an arena is released along with it. */
+	if (note->arena != NULL)
+		return;
 
 	/* Free the fields. */
 	if (note->title)
 		free(note->title);
 	if (note->format)
 		free(note->format);
+	if (note->path)
+		free(note->path);
 
 	/* Free the object itself. */
 	free(note);
 	note = NULL;
 }
 
+/**
+ * Compares two notes by date, title, format and path, in that order.
+ *
+ * @param a Note object.
+ * @param b Another note object.
+ *
+ * @return Negative if a comes before b, positive if it comes after, 0 if they
+ *         are equal.
+ */
+int note_cmp(const note_t *a, const note_t *b) {
+	int ret;
+
+	/* Compare dates. */
+	if (a->date != b->date)
+		return (a->date < b->date) ? -1 : 1;
+
+	/* Compare titles. */
+	ret = strcmp(a->title, b->title);
+	if (ret != 0)
+		return ret;
+
+	/* Compare formats. */
+	ret = strcmp(a->format, b->format);
+	if (ret != 0)
+		return ret;
+
+	/* Notes with the same name may live in different folders. */
+	if ((a->path == NULL) || (b->path == NULL))
+		return (a->path == NULL) - (b->path == NULL);
+	return strcmp(a->path, b->path);
+}
+
 /**
  * Allocates a brand new note object from a note's file name.
  * @warning The object allocated by this function must be free'd after use.
@@ -72,46 +153,87 @@ void note_free(note_t *note) {
  * @see note_free
  */
 note_t* note_from_fname(const char *path) {
-	const char *fname;
-	note_t *note;
-	struct tm _tm;
-	time_t _time;
-	const char *buf;
-	const char *ext;
-	int n;
+	return note_from_fname_arena(path, NULL);
+}
 
-	/* Set things up. */
-	fname = fs_basename(path);
-	note = note_new();
-	_time = time(NULL);
-	memcpy(&_tm, localtime(&_time), sizeof(struct tm));
+/**
+ * Allocates a brand new note object from a note's file name using an arena.
+ * @warning The object allocated by this function must be free'd after use.
+ *
+ * @param path  Path to a note.
+ * @param arena Arena to allocate from or NULL to use the heap.
+ *
+ * @return Brand new note object or NULL if we couldn't parse the necessary
+ *         information from the file name.
+ *
+ * @see note_new_arena
+ * @see note_free
+ */
+note_t* note_from_fname_arena(const char *path, arena_t *arena) {
+	note_fname_t parsed;
+	note_t *note;
 
 	/* Try to parse the data out of the filename. */
-	n = sscanf(fname, "%u-%u-%u_", &_tm.tm_year, &_tm.tm_mon, &_tm.tm_mday);
-	if (n != 3) {
-		fprintf(stderr, "Couldn't properly parse date from filename. Parsed %d "
-				"items.\n", n);
-
-		free(note);
+	STATS_BEGIN(STATS_PHASE_PARSE);
+	if (!note_parse_fname(fs_basename(path), &parsed)) {
+		STATS_END(STATS_PHASE_PARSE);
+		STATS_INC(STATS_NOTES_REJECTED);
+		fprintf(stderr, "Couldn't properly parse date from filename.\n");
 		return NULL;
 	}
+	STATS_END(STATS_PHASE_PARSE);
+	STATS_INC(STATS_NOTES_PARSED);
 
-	/* Fix the year and month fields and assign the date. */
-	_tm.tm_year -= 1900;
-	_tm.tm_mon--;
-	note_set_date(note, mktime(&_tm));
+	/* Set things up. */
+	note = note_new_arena(arena);
+	if (note == NULL)
+		return NULL;
 
-	/* Get the note format. */
-	ext = fs_extname(fname);
-	note_set_format(note, ext);
+	/* Populate the note. */
+	note_set_date(note, date_from_days(parsed.days));
+	note_set_format(note, parsed.format);
+	note_set_title_untilp(note, parsed.title,
+						  parsed.title + parsed.title_len);
 
-	/* Get note title. */
-	buf = strrchr(fname, '_');
-	string_copy_untilp(&note->title, buf + 1, ext - 1);
+	/* Remember where the note came from. */
+	note_set_path(note, path);
 
 	return note;
 }
 
+/**
+ * Parses a YYYY-MM-DD_title.ext note file name without allocating anything.
+ * The date is validated strictly and the extension is optional.
+ *
+ * @param fname  File name of a note. (Not a path)
+ * @param parsed Will hold the parsed information, pointing into fname.
+ *
+ * @return TRUE if the file name is a valid note name.
+ *         FALSE if it isn't.
+ */
+bool note_parse_fname(const char *fname, note_fname_t *parsed) {
+	const char *dot;
+	const char *end;
+
+	/* Date and separator. */
+	if (!date_parse(fname, &parsed->days) || (fname[DATE_STR_LEN] != '_'))
+		return false;
+
+	/* Extension. */
+	parsed->title = fname + DATE_STR_LEN + 1;
+	end = parsed->title + strlen(parsed->title);
+	dot = strrchr(parsed->title, '.');
+	if (dot != NULL) {
+		parsed->format = dot + 1;
+		parsed->title_len = (size_t)(dot - parsed->title);
+	} else {
+		parsed->format = end;
+		parsed->title_len = (size_t)(end - parsed->title);
+	}
+
+	return parsed->title_len > 0;
+}
+
 /**
  * Gets the file handle associated with the note object.
  *
@@ -134,6 +256,17 @@ time_t note_get_date(const note_t *note) {
 	return note->date;
 }
 
+/**
+ * Gets the date of the note object as a YYYY-MM-DD string.
+ *
+ * @param note  Note object.
+ * @param dates Buffer of at least NOTE_DATESTR_LEN bytes that will hold the
+ *              date string.
+ */
+void note_get_datestr(const note_t *note, char *dates) {
+	date_format(date_to_days(note->date), dates);
+}
+
 /**
  * Sets the date of the note object.
  *
@@ -162,9 +295,35 @@ const char* note_get_title(const note_t *note) {
  * @param title New title of the note.
  */
 void note_set_title(note_t *note, const char *title) {
+	if (note->arena != NULL) {
+		note->title = string_arena_copy(note->arena, title);
+		STATS_INC(STATS_ARENA_ALLOCS);
+		return;
+	}
+	STATS_INC(STATS_ALLOCS);
+
 	string_copy(&note->title, title);
 }
 
+/**
+ * Sets the title of the note object from a part of a string.
+ *
+ * @param note  Note object.
+ * @param title Start of the new title of the note.
+ * @param p     Point inside of the string where the title ends. (Won't be
+ *              included)
+ */
+void note_set_title_untilp(note_t *note, const char *title, const char *p) {
+	if (note->arena != NULL) {
+		note->title = string_arena_copy_untilp(note->arena, title, p);
+		STATS_INC(STATS_ARENA_ALLOCS);
+		return;
+	}
+	STATS_INC(STATS_ALLOCS);
+
+	string_copy_untilp(&note->title, title, p);
+}
+
 /**
  * Gets the format of the note object.
  *
@@ -183,9 +342,138 @@ const char* note_get_format(const note_t *note) {
  * @param format New format of the note.
  */
 void note_set_format(note_t *note, const char *format) {
+	if (note->arena != NULL) {
+		note->format = string_arena_copy(note->arena, format);
+		STATS_INC(STATS_ARENA_ALLOCS);
+		return;
+	}
+	STATS_INC(STATS_ALLOCS);
+
 	string_copy(&note->format, format);
 }
 
+/**
+ * Gets the path the note object was loaded from.
+ *
+ * @param note Note object.
+ *
+ * @return Path to the note file or NULL if it wasn't loaded from one.
+ */
+const char* note_get_path(const note_t *note) {
+	return note->path;
+}
+
+/**
+ * Sets the path of the file backing the note object.
+ *
+ * @param note Note object.
+ * @param path New path to the note file.
+ */
+void note_set_path(note_t *note, const char *path) {
+	if (note->arena != NULL) {
+		note->path = string_arena_copy(note->arena, path);
+		STATS_INC(STATS_ARENA_ALLOCS);
+		return;
+	}
+	STATS_INC(STATS_ALLOCS);
+
+	string_copy(&note->path, path);
+}
+
+/**
+ * Gets the size in bytes of the note file as of the last time it was checked.
+ *
+ * @param note Note object.
+ *
+ * @return Size of the note file or 0 if unknown.
+ */
+uint64_t note_get_size(const note_t *note) {
+	return note->size;
+}
+
+/**
+ * Gets the modification time of the note file as of the last time it was
+ * checked.
+ *
+ * @param note Note object.
+ *
+ * @return Modification time in nanoseconds since the epoch or 0 if unknown.
+ */
+int64_t note_get_mtime(const note_t *note) {
+	return note->mtime;
+}
+
+/**
+ * Gets the inode number of the note file.
+ *
+ * @param note Note object.
+ *
+ * @return Inode number of the note file or 0 if unknown.
+ */
+uint64_t note_get_inode(const note_t *note) {
+	return note->inode;
+}
+
+/**
+ * Updates the file information of the note object.
+ *
+ * @param note Note object.
+ * @param st   File information as returned by stat.
+ */
+void note_set_stat(note_t *note, const struct stat *st) {
+	note->size = (uint64_t)st->st_size;
+	note->mtime = fs_stat_mtime(st);
+	note->inode = (uint64_t)st->st_ino;
+}
+
+/**
+ * Gets the hash of the contents of the note.
+ *
+ * @param note Note object.
+ *
+ * @return Hash of the contents or 0 if it hasn't been computed.
+ *
+ * @see note_hash
+ */
+uint64_t note_get_hash(const note_t *note) {
+	return note->hash;
+}
+
+/**
+ * Sets the hash of the contents of the note. Used when it's already known, for
+ * example from a previous run, and the file hasn't changed since.
+ *
+ * @param note Note object.
+ * @param hash Hash of the contents.
+ */
+void note_set_hash(note_t *note, uint64_t hash) {
+	note->hash = hash;
+}
+
+/**
+ * Gets the workspace the note lives in.
+ *
+ * @param note Note object.
+ *
+ * @return Workspace of the note or NULL if it doesn't belong to one.
+ */
+workspace_t* note_get_workspace(const note_t *note) {
+	return note->ws;
+}
+
+/**
+ * Sets the workspace the note lives in, so that its file is reached relative
+ * to it instead of through its full path.
+ *
+ * @warning The workspace must outlive the note.
+ *
+ * @param note Note object.
+ * @param ws   Workspace of the note or NULL if it doesn't belong to one.
+ */
+void note_set_workspace(note_t *note, workspace_t *ws) {
+	note->ws = ws;
+}
+
 /**
  * Gets the canonical filename for a note.
  *
@@ -198,23 +486,131 @@ void note_set_format(note_t *note, const char *format) {
  */
 char* note_get_fname(note_t *note) {
 	char *fname;
-	const struct tm *time;
-	char dates[11];
-
-	/* Get date-related stuff. */
-	time = localtime(&note->date);
-	strftime(dates, sizeof(dates), "%Y-%m-%d", time);
+	size_t len;
 
 	/* Allocate enough space for our filename. */
-	fname = (char *)malloc(
-		(strlen(note->title) + strlen(note->format) + 13) * sizeof(char));
+	len = strlen(note->title) + ((note->format) ? strlen(note->format) : 0) +
+		NOTE_DATESTR_LEN + 2;
+	fname = (char *)malloc(len * sizeof(char));
+	if (fname == NULL)
+		return NULL;
 
 	/* Copy the string over. */
-	sprintf(fname, "%s_%s.%s", dates, note->title, note->format);
+	note_fname_fmt(note, fname, len);
 
 	return fname;
 }
 
+/**
+ * Builds the canonical filename for a note into a buffer.
+ *
+ * @param note Note object.
+ * @param buf  Buffer that will hold the filename.
+ * @param len  Size of the buffer.
+ *
+ * @return Length of the filename or 0 if the note has no title or its name
+ *         doesn't fit in the buffer. Check errno.
+ */
+size_t note_fname_fmt(const note_t *note, char *buf, size_t len) {
+	size_t title_len;
+	size_t format_len;
+	size_t total;
+	char *p;
+
+	/* Make sure it fits. */
+	if (note->title == NULL) {
+		errno = EINVAL;
+		return 0;
+	}
+	title_len = strlen(note->title);
+	format_len = (note->format) ? strlen(note->format) : 0;
+	total = NOTE_DATESTR_LEN + title_len + ((format_len > 0) ?
+											(format_len + 1) : 0);
+	if (total >= len) {
+		errno = ENAMETOOLONG;
+		return 0;
+	}
+
+	/* Put it together as YYYY-MM-DD_Title.format. */
+	note_get_datestr(note, buf);
+	buf[NOTE_DATESTR_LEN - 1] = '_';
+	p = buf + NOTE_DATESTR_LEN;
+	memcpy(p, note->title, title_len);
+	p += title_len;
+	if (format_len > 0) {
+		*p++ = '.';
+		memcpy(p, note->format, format_len);
+		p += format_len;
+	}
+	*p = '\0';
+
+	return total;
+}
+
+/**
+ * Gets the name of the note's file relative to its workspace. Notes that were
+ * loaded from it use the name they were found with, while the ones that only
+ * exist in memory get their canonical name built into the workspace's scratch
+ * buffer.
+ *
+ * @warning Notes without a path share the workspace's scratch buffer, so they
+ *          must not be opened from more than one thread at a time.
+ *
+ * @param note Note object.
+ *
+ * @return Name of the file relative to the workspace or NULL if the note isn't
+ *         inside of one.
+ */
+static const char* note_ws_name(note_t *note) {
+	char *scratch;
+
+	/* Do we even belong to a workspace? */
+	if (note->ws == NULL)
+		return NULL;
+
+	/* Notes we already know where they are. */
+	if (note->path)
+		return workspace_relname(note->ws, note->path);
+
+	/* Build the canonical name without touching the heap. */
+	scratch = workspace_scratch(note->ws);
+	if (note_fname_fmt(note, scratch, WORKSPACE_FNAME_MAX) == 0)
+		return NULL;
+
+	return scratch;
+}
+
+/**
+ * Translates a file open mode string into open flags.
+ *
+ * @param mode File open mode string.
+ *
+ * @return Flags to be passed to open.
+ */
+static int note_open_flags(const char *mode) {
+	int flags;
+
+	/* Figure out the access mode. */
+	switch (mode[0]) {
+		case 'w':
+			flags = O_CREAT | O_TRUNC;
+			break;
+		case 'a':
+			flags = O_CREAT | O_APPEND;
+			break;
+		default:
+			flags = 0;
+			break;
+	}
+	if (strchr(mode, '+') != NULL) {
+		flags |= O_RDWR;
+	} else {
+		flags |= (mode[0] == 'r') ? O_RDONLY : O_WRONLY;
+	}
+
+	return flags;
+}
+
 /**
  * Opens the note file handle for reading the note's contents. This will do
  * nothing if called on a note that already has it's file handle opened.
@@ -225,28 +621,111 @@ char* note_get_fname(note_t *note) {
  * @return Note opened file handle or NULL in case of an error.
  */
 FILE *note_fh_open(note_t *note, const char *mode) {
-	char *fname;
-	char *path;
+	const char *name;
+	int fd;
 
 	/* Do we even have to do anything? */
 	if (note->fh)
 		return note->fh;
 
-	/* Get note path. */
-	/* TODO: Implement proper workspaces and fix this. */
-	path = NULL;
-	string_copy(&path, "example/");
-	fname = note_get_fname(note);
-	string_concat(&path, fname);
-	free(fname);
+	/* Open notes relative to their workspace if possible. */
+	name = note_ws_name(note);
+	if (name != NULL) {
+		fd = workspace_openat(note->ws, name, note_open_flags(mode));
+		if (fd < 0)
+			return NULL;
+
+		note->fh = fdopen(fd, mode);
+		if (note->fh == NULL)
+			close(fd);
+
+		return note->fh;
+	}
+
+	/* Fall back to where they were loaded from. */
+	if (note->path == NULL) {
+		errno = ENOENT;
+		return NULL;
+	}
+	STATS_INC(STATS_SYS_OPEN);
+	note->fh = fopen(note->path, mode);
+
+	return note->fh;
+}
+
+/**
+ * Creates the note's file in its workspace and opens it for writing. Notes
+ * that only exist in memory get their canonical name and have their path set
+ * accordingly. Fails if the file already exists.
+ *
+ * @param note Note object.
+ *
+ * @return Note opened file handle or NULL in case of an error. Check errno.
+ */
+FILE* note_fh_create(note_t *note) {
+	const char *name;
+	char *path;
+	int fd;
+
+	/* Do we have somewhere to create it? */
+	if (note->fh) {
+		errno = EBUSY;
+		return NULL;
+	}
+	name = note_ws_name(note);
+	if (name == NULL) {
+		if (errno != ENAMETOOLONG)
+			errno = EINVAL;
+		return NULL;
+	}
 
-	/* Open the note's file handle and free the filename. */
-	note->fh = fopen(path, mode);
-	free(path);
+	/* Create the file. */
+	fd = workspace_openat(note->ws, name, O_WRONLY | O_CREAT | O_EXCL);
+	if (fd < 0)
+		return NULL;
+	note->fh = fdopen(fd, "w");
+	if (note->fh == NULL) {
+		close(fd);
+		return NULL;
+	}
+
+	/* Remember where it was created. */
+	if (note->path == NULL) {
+		path = NULL;
+		string_copy(&path, workspace_get_path(note->ws));
+		fs_pathcat(&path, name);
+		note_set_path(note, path);
+		free(path);
+	}
 
 	return note->fh;
 }
 
+/**
+ * Gets information about the note's file, relative to its workspace if
+ * possible.
+ *
+ * @param note Note object.
+ * @param st   Will hold the information about the file.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ */
+bool note_stat(note_t *note, struct stat *st) {
+	const char *name;
+
+	name = note_ws_name(note);
+	if (name != NULL)
+		return workspace_stat(note->ws, name, st);
+	if (note->path == NULL) {
+		errno = ENOENT;
+		return false;
+	}
+
+	STATS_INC(STATS_SYS_STAT);
+	return stat(note->path, st) == 0;
+}
+
 /**
  * Closes the note's file handle. Does nothing if one isn't opened.
  *
@@ -263,6 +742,7 @@ bool note_fh_close(note_t *note) {
 		return true;
 
 	/* Close the file handle. */
+	STATS_INC(STATS_SYS_CLOSE);
 	ret = fclose(note->fh);
 	note->fh = NULL;
 
@@ -270,6 +750,58 @@ bool note_fh_close(note_t *note) {
 	return ret == 0;
 }
 
+/**
+ * Gets a borrowed read-only view over the entire content of a note without
+ * copying it.
+ *
+ * @warning The view must be released with note_fh_view_release after use. Its
+ *          data isn't guaranteed to be NULL terminated.
+ *
+ * @param note Note object.
+ * @param view View object to be populated.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ *
+ * @see note_fh_view_release
+ */
+bool note_fh_view(note_t *note, fs_view_t *view) {
+	const char *name;
+	bool ret;
+	int fd;
+
+	/* Go straight through a file descriptor if we don't need a handle. */
+	name = (note->fh == NULL) ? note_ws_name(note) : NULL;
+	if (name != NULL) {
+		fd = workspace_openat(note->ws, name, O_RDONLY);
+		if (fd < 0)
+			return false;
+
+		ret = fs_fdview(fd, view);
+		STATS_INC(STATS_SYS_CLOSE);
+		close(fd);
+
+		return ret;
+	}
+
+	/* Ensure we have opened the note file. */
+	if (note_fh_open(note, "r") == NULL)
+		return false;
+
+	return fs_fview(note->fh, view);
+}
+
+/**
+ * Releases a view obtained from a note.
+ *
+ * @param view View to be released.
+ *
+ * @see note_fh_view
+ */
+void note_fh_view_release(fs_view_t *view) {
+	fs_fview_release(view);
+}
+
 /**
  * Slurps the entire content of a note and return it as a string.
  *
@@ -278,15 +810,420 @@ bool note_fh_close(note_t *note) {
  *
  * @param note Note object.
  *
- * @return Entire contents of a note document. (Allocated by this function)
+ * @return Entire contents of a note document or NULL in case of an error or if
+ *         the note is empty. (Allocated by this function)
  */
 char* note_fh_slurp(note_t *note) {
-	/* Ensure we have opened the note file. */
-	if (note_fh_open(note, "r") == NULL)
+	fs_view_t view;
+	char *contents;
+
+	/* Get a view over the contents. */
+	if (!note_fh_view(note, &view) || (view.len == 0))
 		return NULL;
 
-	/* Slurp it up! */
-	return fs_fslurp(note->fh);
+	/* Small files are read into our own buffer, so just take ownership. */
+	if (!view.mapped)
+		return (char *)view.data;
+
+	/* Copy mapped contents over to a proper string. */
+	contents = (char *)malloc((view.len + 1) * sizeof(char));
+	if (contents != NULL) {
+		memcpy(contents, view.data, view.len);
+		contents[view.len] = '\0';
+	}
+	note_fh_view_release(&view);
+
+	return contents;
+}
+
+/**
+ * Sets up a streaming reader, allocating the buffer it'll reuse for every note
+ * it goes through.
+ * @warning The reader must be released with note_reader_release after use.
+ *
+ * @param rd      Reader object.
+ * @param bufsize Size of the buffer in bytes. (0 for NOTE_READER_BUFSIZE)
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate the buffer.
+ *
+ * @see note_reader_open
+ * @see note_reader_release
+ */
+bool note_reader_init(note_reader_t *rd, size_t bufsize) {
+	memset(rd, 0, sizeof(note_reader_t));
+	rd->fd = -1;
+	rd->cap = (bufsize == 0) ? NOTE_READER_BUFSIZE : bufsize;
+	rd->buf = (char *)malloc(rd->cap * sizeof(char));
+	if (rd->buf == NULL)
+		return false;
+	STATS_INC(STATS_ALLOCS);
+
+	return true;
+}
+
+/**
+ * Closes the note the reader is on and frees its buffer.
+ *
+ * @param rd Reader object.
+ */
+void note_reader_release(note_reader_t *rd) {
+	note_reader_close(rd);
+	if (rd->buf)
+		free(rd->buf);
+	rd->buf = NULL;
+	rd->cap = 0;
+}
+
+/**
+ * Starts reading a note. Notes that have their contents loaded are read
+ * straight from memory, the others are opened without a file handle.
+ *
+ * @param rd   Reader object. Any note it was on is closed.
+ * @param note Note object.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ *
+ * @see note_reader_close
+ */
+bool note_reader_open(note_reader_t *rd, note_t *note) {
+	const char *name;
+	int fd;
+
+	/* Start from scratch. */
+	note_reader_close(rd);
+
+	/* Contents that are already in memory are used as they are. */
+	if (note_is_loaded(note)) {
+		rd->data = note_get_content(note, &rd->data_len);
+		return true;
+	}
+
+	/* Open the note relative to its workspace if possible. */
+	name = note_ws_name(note);
+	if (name != NULL) {
+		fd = workspace_openat(note->ws, name, O_RDONLY);
+	} else if (note->path != NULL) {
+		STATS_INC(STATS_SYS_OPEN);
+		fd = open(note->path, O_RDONLY | O_CLOEXEC);
+	} else {
+		errno = ENOENT;
+		return false;
+	}
+	if (fd < 0)
+		return false;
+	rd->fd = fd;
+
+	return true;
+}
+
+/**
+ * Stops reading the current note. The buffer is kept around to be reused by
+ * the next one.
+ *
+ * @param rd Reader object.
+ */
+void note_reader_close(note_reader_t *rd) {
+	if (rd->fd >= 0) {
+		STATS_INC(STATS_SYS_CLOSE);
+		close(rd->fd);
+	}
+
+	rd->fd = -1;
+	rd->err = 0;
+	rd->eof = false;
+	rd->advised = false;
+	rd->data = NULL;
+	rd->data_len = 0;
+	rd->start = 0;
+	rd->end = 0;
+	rd->cur = NULL;
+	rd->cur_end = NULL;
+}
+
+/**
+ * Reads some more of the note into the free space at the end of the buffer,
+ * moving whatever is still pending to its start first. Notes that don't fit in
+ * the buffer get a hint to read ahead of us, since they're read sequentially.
+ *
+ * @param rd Reader object.
+ *
+ * @return Number of bytes read or 0 if the buffer is full, we've reached the
+ *         end of the note or an error occurred. (Check the reader's err field)
+ */
+static size_t note_reader_fill(note_reader_t *rd) {
+	ssize_t n;
+
+	/* Make room for more. */
+	if (rd->start > 0) {
+		memmove(rd->buf, rd->buf + rd->start, rd->end - rd->start);
+		rd->end -= rd->start;
+		rd->start = 0;
+	}
+	if (rd->eof || (rd->fd < 0) || (rd->end == rd->cap))
+		return 0;
+
+	/* Read what we can. */
+	STATS_BEGIN(STATS_PHASE_READ);
+	do {
+		STATS_INC(STATS_SYS_READ);
+		n = read(rd->fd, rd->buf + rd->end, rd->cap - rd->end);
+	} while ((n < 0) && (errno == EINTR));
+	STATS_END(STATS_PHASE_READ);
+	if (n <= 0) {
+		rd->err = (n < 0) ? errno : 0;
+		rd->eof = true;
+		return 0;
+	}
+	STATS_ADD(STATS_BYTES_READ, n);
+
+	/* Big notes are worth telling the kernel about. */
+	if (!rd->advised && ((size_t)n == rd->cap)) {
+		posix_fadvise(rd->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+		rd->advised = true;
+	}
+
+	rd->end += (size_t)n;
+	return (size_t)n;
+}
+
+/**
+ * Gets the next chunk of the note, exactly as it was read.
+ *
+ * @warning The chunk is only valid until the reader is used again.
+ *
+ * @param rd    Reader object.
+ * @param chunk Pointer that will hold the chunk.
+ *
+ * @return Length of the chunk or 0 if we've reached the end of the note or an
+ *         error occurred. (Check the reader's err field)
+ */
+size_t note_reader_chunk(note_reader_t *rd, const char **chunk) {
+	size_t len;
+
+	/* Contents in memory are a single chunk. */
+	if (rd->data != NULL) {
+		len = rd->data_len;
+		*chunk = rd->data;
+		rd->data += len;
+		rd->data_len = 0;
+
+		return len;
+	}
+
+	/* Get more if we don't have anything pending. */
+	if ((rd->start == rd->end) && (note_reader_fill(rd) == 0))
+		return 0;
+
+	*chunk = rd->buf + rd->start;
+	len = rd->end - rd->start;
+	rd->start = rd->end;
+
+	return len;
+}
+
+/**
+ * Gets the next block of whole lines in the note, line feeds included. The
+ * last line might not have one, and lines that don't fit in the buffer are
+ * split into buffer sized pieces.
+ *
+ * @warning The block is only valid until the reader is used again.
+ *
+ * @param rd    Reader object.
+ * @param lines Pointer that will hold the block.
+ *
+ * @return Length of the block or 0 if we've reached the end of the note or an
+ *         error occurred. (Check the reader's err field)
+ */
+size_t note_reader_lines(note_reader_t *rd, const char **lines) {
+	const char *p;
+	size_t scanned;
+	size_t len;
+
+	/* Contents in memory are a single block. */
+	if (rd->data != NULL)
+		return note_reader_chunk(rd, lines);
+
+	/* Whatever is pending never has a line feed, so only look at new data. */
+	scanned = rd->end - rd->start;
+	for (;;) {
+		if (note_reader_fill(rd) == 0) {
+			/* Split lines that are too long and hand over the last one. */
+			if (rd->start == rd->end)
+				return 0;
+
+			return note_reader_chunk(rd, lines);
+		}
+
+		/* Find the last line feed in what we've just read. */
+		for (p = rd->buf + rd->end; p > (rd->buf + scanned); p--) {
+			if (p[-1] == '\n')
+				break;
+		}
+		if (p > (rd->buf + scanned))
+			break;
+		scanned = rd->end;
+	}
+
+	*lines = rd->buf + rd->start;
+	len = (size_t)(p - *lines);
+	rd->start += len;
+
+	return len;
+}
+
+/**
+ * Gets the next line in the note, without its line feed. Lines that don't fit
+ * in the buffer are split into buffer sized pieces.
+ *
+ * @warning The line is only valid until the reader is used again.
+ *
+ * @param rd   Reader object.
+ * @param line Pointer that will hold the line.
+ * @param len  Will hold the length of the line.
+ *
+ * @return TRUE if a line was read.
+ *         FALSE if we've reached the end of the note or an error occurred.
+ *         (Check the reader's err field)
+ */
+bool note_reader_line(note_reader_t *rd, const char **line, size_t *len) {
+	const char *nl;
+	size_t n;
+
+	/* Get another block of lines once we've gone through this one. */
+	if (rd->cur == rd->cur_end) {
+		n = note_reader_lines(rd, &rd->cur);
+		if (n == 0) {
+			rd->cur = NULL;
+			rd->cur_end = NULL;
+			return false;
+		}
+		rd->cur_end = rd->cur + n;
+	}
+
+	/* Take the next one out of it. */
+	*line = rd->cur;
+	nl = (const char *)memchr(rd->cur, '\n', (size_t)(rd->cur_end - rd->cur));
+	if (nl == NULL) {
+		*len = (size_t)(rd->cur_end - rd->cur);
+		rd->cur = rd->cur_end;
+	} else {
+		*len = (size_t)(nl - rd->cur);
+		rd->cur = nl + 1;
+	}
+
+	return true;
+}
+
+/**
+ * Loads the contents of the note into memory so that they can be accessed later
+ * without touching the filesystem. The file handle is closed afterwards, since
+ * the contents no longer depend on it. Does nothing if they were already
+ * loaded.
+ *
+ * @param note Note object.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ *
+ * @see note_unload
+ */
+bool note_load(note_t *note) {
+	bool ret;
+
+	/* Do we even have to do anything? */
+	if (note_is_loaded(note))
+		return true;
+
+	/* Grab a view over the contents and let go of the file handle. */
+	ret = note_fh_view(note, &note->content);
+	note_fh_close(note);
+	if (!ret) {
+		note->content.data = NULL;
+		return false;
+	}
+
+	/* Hashing is cheap while the contents are still hot in the cache. */
+	return note_hash(note);
+}
+
+/**
+ * Releases the cached contents of the note. Does nothing if they weren't
+ * loaded.
+ *
+ * @param note Note object.
+ */
+void note_unload(note_t *note) {
+	if (!note_is_loaded(note))
+		return;
+
+	note_fh_view_release(&note->content);
+	note->content.data = NULL;
+}
+
+/**
+ * Checks if the contents of the note are cached in memory.
+ *
+ * @param note Note object.
+ *
+ * @return Are the contents of the note loaded?
+ */
+bool note_is_loaded(const note_t *note) {
+	return note->content.data != NULL;
+}
+
+/**
+ * Gets the cached contents of the note.
+ *
+ * @warning The contents aren't guaranteed to be NULL terminated, always use the
+ *          length.
+ *
+ * @param note Note object.
+ * @param len  Optional pointer that will hold the length of the contents.
+ *
+ * @return Contents of the note or NULL if they weren't loaded.
+ *
+ * @see note_load
+ */
+const char* note_get_content(const note_t *note, size_t *len) {
+	if (len)
+		*len = note->content.len;
+
+	return note->content.data;
+}
+
+/**
+ * Computes the hash of the contents of the note. If they aren't loaded they're
+ * read temporarily.
+ *
+ * @param note Note object.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if the contents couldn't be read. Check errno.
+ *
+ * @see note_get_hash
+ */
+bool note_hash(note_t *note) {
+	fs_view_t view;
+
+	/* Use the cached contents if we have them. */
+	if (note_is_loaded(note)) {
+		note->hash = hash_xxh64(note->content.data, note->content.len,
+								HASH_SEED);
+	} else {
+		if (!note_fh_view(note, &view))
+			return false;
+		note_fh_close(note);
+		note->hash = hash_xxh64(view.data, view.len, HASH_SEED);
+		note_fh_view_release(&view);
+	}
+
+	/* Zero is reserved for hashes that weren't computed. */
+	if (note->hash == 0)
+		note->hash = 1;
+
+	return true;
 }
 
 /**
@@ -295,13 +1232,10 @@ char* note_fh_slurp(note_t *note) {
  * @param note Note object.
  */
 void note_debug_print(const note_t *note) {
-	const struct tm *time;
-	char dates[11];
+	char dates[NOTE_DATESTR_LEN];
 
 	/* Get date-related stuff. */
-	time = localtime(&note->date);
-	strftime(dates, sizeof(dates), "%Y-%m-%d", time);
-
+	note_get_datestr(note, dates);
 
 	printf("\"note\": {\n");
 	printf("    \"date\": \"%s\"\n", dates);
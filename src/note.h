@@ -9,14 +9,27 @@
 #define _NOTE_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
 
+#include "arena.h"
+#include "fsutils.h"
+#include "workspace.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Size of a YYYY-MM-DD date string including the NULL terminator. */
+#define NOTE_DATESTR_LEN 11
+
+/* Default size of the buffer used to stream through the contents of a note. */
+#ifndef NOTE_READER_BUFSIZE
+	#define NOTE_READER_BUFSIZE (64 * 1024)
+#endif /* NOTE_READER_BUFSIZE */
+
 /**
  * Note abstraction object.
  */
@@ -25,28 +38,107 @@ typedef struct {
 	char *title;
 	char *format;
 
+	char *path;
 	FILE *fh;
+	fs_view_t content;
+
+	uint64_t size;
+	int64_t mtime;
+	uint64_t inode;
+	uint64_t hash;
+
+	arena_t *arena;
+	workspace_t *ws;
 } note_t;
 
+/**
+ * Information parsed out of a note file name. Strings point into the name.
+ */
+typedef struct {
+	int32_t days;
+	const char *title;
+	size_t title_len;
+	const char *format;
+} note_fname_t;
+
+/**
+ * Streaming reader that goes through the contents of a note in constant memory
+ * using a single reusable buffer.
+ */
+typedef struct {
+	int fd;
+	int err;
+	bool eof;
+	bool advised;
+
+	const char *data;
+	size_t data_len;
+
+	char *buf;
+	size_t cap;
+	size_t start;
+	size_t end;
+
+	const char *cur;
+	const char *cur_end;
+} note_reader_t;
+
 /* Construction and destruction. */
 note_t* note_new(void);
+note_t* note_new_arena(arena_t *arena);
 note_t* note_from_fname(const char *path);
+note_t* note_from_fname_arena(const char *path, arena_t *arena);
 void note_free(note_t *note);
+bool note_parse_fname(const char *fname, note_fname_t *parsed);
+int note_cmp(const note_t *a, const note_t *b);
 
 /* Getters and setters. */
 FILE* note_get_fh(note_t *note);
 time_t note_get_date(const note_t *note);
+void note_get_datestr(const note_t *note, char *dates);
 void note_set_date(note_t *note, time_t date);
 const char* note_get_title(const note_t *note);
 void note_set_title(note_t *note, const char *title);
+void note_set_title_untilp(note_t *note, const char *title, const char *p);
 const char* note_get_format(const note_t *note);
 void note_set_format(note_t *note, const char *format);
+const char* note_get_path(const note_t *note);
+void note_set_path(note_t *note, const char *path);
+uint64_t note_get_size(const note_t *note);
+int64_t note_get_mtime(const note_t *note);
+uint64_t note_get_inode(const note_t *note);
+void note_set_stat(note_t *note, const struct stat *st);
+uint64_t note_get_hash(const note_t *note);
+void note_set_hash(note_t *note, uint64_t hash);
+workspace_t* note_get_workspace(const note_t *note);
+void note_set_workspace(note_t *note, workspace_t *ws);
 
 /* File operations. */
 FILE* note_fh_open(note_t *note, const char *mode);
+FILE* note_fh_create(note_t *note);
 bool note_fh_close(note_t *note);
 char* note_fh_slurp(note_t *note);
+bool note_fh_view(note_t *note, fs_view_t *view);
+void note_fh_view_release(fs_view_t *view);
 char* note_get_fname(note_t *note);
+size_t note_fname_fmt(const note_t *note, char *buf, size_t len);
+bool note_stat(note_t *note, struct stat *st);
+
+/* Streaming. */
+bool note_reader_init(note_reader_t *rd, size_t bufsize);
+void note_reader_release(note_reader_t *rd);
+bool note_reader_open(note_reader_t *rd, note_t *note);
+void note_reader_close(note_reader_t *rd);
+size_t note_reader_chunk(note_reader_t *rd, const char **chunk);
+size_t note_reader_lines(note_reader_t *rd, const char **lines);
+bool note_reader_line(note_reader_t *rd, const char **line, size_t *len);
+
+/* Cached contents. */
+bool note_load(note_t *note);
+void note_unload(note_t *note);
+bool note_is_loaded(const note_t *note);
+const char* note_get_content(const note_t *note, size_t *len);
+bool note_hash(note_t *note);
 
 /* Debugging */
 void note_debug_print(const note_t *note);
@@ -0,0 +1,310 @@
+/**
+ * notelist.c
+ * A growable collection of note objects.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "notelist.h"
+
+#include <string.h>
+
+/* Initial capacity of a note collection. */
+#define NOTELIST_INITIAL_CAP 64
+
+/**
+ * Allocates a brand new empty note collection.
+ * @warning The object allocated by this function must be free'd after use.
+ *
+ * @return Brand new note collection or NULL in case of an error.
+ *
+ * @see notelist_free
+ */
+notelist_t* notelist_new(void) {
+	notelist_t *list;
+
+	/* Allocate enough memory for our object. */
+	list = (notelist_t *)malloc(sizeof(notelist_t));
+	if (list == NULL)
+		return NULL;
+
+	/* Populate the collection with some defaults. */
+	list->notes = NULL;
+	list->len = 0;
+	list->cap = 0;
+	list->arena = NULL;
+	list->ws = NULL;
+
+	return list;
+}
+
+/**
+ * Frees up a note collection and every note inside of it.
+ *
+ * @param list Note collection to be free'd.
+ */
+void notelist_free(notelist_t *list) {
+	/* Do we even have anything to do? */
+	if (list == NULL)
+		return;
+
+	/* Free the notes, their arena and the object itself. */
+	notelist_clear(list);
+	if (list->notes)
+		free(list->notes);
+	arena_free(list->arena);
+	free(list);
+}
+
+/**
+ * Frees every note inside of a collection and leaves it empty.
+ *
+ * @param list Note collection.
+ */
+void notelist_clear(notelist_t *list) {
+	size_t i;
+
+	for (i = 0; i < list->len; i++)
+		note_free(list->notes[i]);
+	list->len = 0;
+}
+
+/**
+ * Makes the collection own an arena that notes can be allocated from, so that
+ * all of them are released in one go along with the collection. Does nothing
+ * if the collection already has one.
+ *
+ * @param list Note collection.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ *
+ * @see notelist_arena
+ */
+bool notelist_use_arena(notelist_t *list) {
+	if (list->arena == NULL)
+		list->arena = arena_new(0);
+
+	return list->arena != NULL;
+}
+
+/**
+ * Gets the arena owned by the collection.
+ *
+ * @param list Note collection.
+ *
+ * @return Arena used for the notes of this collection or NULL if they should
+ *         be allocated from the heap.
+ */
+arena_t* notelist_arena(const notelist_t *list) {
+	return list->arena;
+}
+
+/**
+ * Makes every note that gets added to the collection belong to a workspace, so
+ * that their files are reached relative to it. Notes that already belong to a
+ * workspace are left alone.
+ *
+ * @warning The workspace isn't owned by the collection and must outlive it.
+ *
+ * @param list Note collection.
+ * @param ws   Workspace of the notes or NULL to stop assigning one.
+ *
+ * @see notelist_workspace
+ */
+void notelist_use_workspace(notelist_t *list, workspace_t *ws) {
+	list->ws = ws;
+}
+
+/**
+ * Gets the workspace assigned to the notes of the collection.
+ *
+ * @param list Note collection.
+ *
+ * @return Workspace of the notes or NULL if they aren't assigned one.
+ */
+workspace_t* notelist_workspace(const notelist_t *list) {
+	return list->ws;
+}
+
+/**
+ * Ensures a collection has room for a certain number of notes.
+ *
+ * @param list Note collection.
+ * @param cap  Minimum capacity of the collection.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+static bool notelist_reserve(notelist_t *list, size_t cap) {
+	note_t **notes;
+	size_t ncap;
+
+	/* Do we even have to do anything? */
+	if (cap <= list->cap)
+		return true;
+
+	/* Grow geometrically. */
+	ncap = (list->cap == 0) ? NOTELIST_INITIAL_CAP : list->cap;
+	while (ncap < cap)
+		ncap *= 2;
+
+	/* Resize the array. */
+	notes = (note_t **)realloc(list->notes, ncap * sizeof(note_t *));
+	if (notes == NULL)
+		return false;
+	list->notes = notes;
+	list->cap = ncap;
+
+	return true;
+}
+
+/**
+ * Appends a note to the collection. The collection takes ownership of it.
+ *
+ * @param list Note collection.
+ * @param note Note to be appended.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+bool notelist_push(notelist_t *list, note_t *note) {
+	if (!notelist_reserve(list, list->len + 1))
+		return false;
+
+	if ((list->ws != NULL) && (note_get_workspace(note) == NULL))
+		note_set_workspace(note, list->ws);
+	list->notes[list->len++] = note;
+	return true;
+}
+
+/**
+ * Moves all of the notes from one collection to the end of another, leaving the
+ * source collection empty.
+ *
+ * @param list  Note collection to be appended to.
+ * @param other Note collection to take the notes from.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+bool notelist_extend(notelist_t *list, notelist_t *other) {
+	size_t i;
+
+	if (other->len == 0)
+		return true;
+	if (!notelist_reserve(list, list->len + other->len))
+		return false;
+
+	memcpy(list->notes + list->len, other->notes,
+		   other->len * sizeof(note_t *));
+	if (list->ws != NULL) {
+		for (i = 0; i < other->len; i++) {
+			if (note_get_workspace(other->notes[i]) == NULL)
+				note_set_workspace(other->notes[i], list->ws);
+		}
+	}
+	list->len += other->len;
+	other->len = 0;
+
+	return true;
+}
+
+/**
+ * qsort comparison wrapper for note pointers.
+ *
+ * @param a Pointer to a note pointer.
+ * @param b Pointer to another note pointer.
+ *
+ * @return Same as note_cmp.
+ */
+static int notelist_cmp(const void *a, const void *b) {
+	return note_cmp(*(const note_t **)a, *(const note_t **)b);
+}
+
+/**
+ * Sorts the collection by date, title and format.
+ *
+ * @param list Note collection.
+ *
+ * @see note_cmp
+ */
+void notelist_sort(notelist_t *list) {
+	if (list->len > 1)
+		qsort(list->notes, list->len, sizeof(note_t *), notelist_cmp);
+}
+
+/**
+ * Finds the first note in a sorted collection dated on or after a given date.
+ *
+ * @param list Note collection sorted by notelist_sort.
+ * @param date Date to look for.
+ *
+ * @return Index of the first note dated on or after the date.
+ */
+static size_t notelist_lower_bound(const notelist_t *list, time_t date) {
+	size_t lo;
+	size_t hi;
+	size_t mid;
+
+	lo = 0;
+	hi = list->len;
+	while (lo < hi) {
+		mid = lo + ((hi - lo) / 2);
+		if (note_get_date(list->notes[mid]) < date) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+/**
+ * Finds the notes of a sorted collection that fall within a date range using a
+ * binary search. Since the collection is sorted by date they're contiguous.
+ *
+ * @param list  Note collection sorted by notelist_sort.
+ * @param from  Earliest date of the range. (Inclusive)
+ * @param to    Latest date of the range. (Inclusive)
+ * @param first Will hold the index of the first note in the range.
+ *
+ * @return Number of notes in the range.
+ *
+ * @see notelist_sort
+ */
+size_t notelist_range(const notelist_t *list, time_t from, time_t to,
+					  size_t *first) {
+	*first = notelist_lower_bound(list, from);
+	if (to < from)
+		return 0;
+
+	return notelist_lower_bound(list, to + 1) - *first;
+}
+
+/**
+ * Gets the number of notes in the collection.
+ *
+ * @param list Note collection.
+ *
+ * @return Number of notes in the collection.
+ */
+size_t notelist_len(const notelist_t *list) {
+	return list->len;
+}
+
+/**
+ * Gets a note from the collection.
+ *
+ * @param list  Note collection.
+ * @param index Index of the note.
+ *
+ * @return Note at the index or NULL if it's out of bounds.
+ */
+note_t* notelist_get(const notelist_t *list, size_t index) {
+	if (index >= list->len)
+		return NULL;
+
+	return list->notes[index];
+}
@@ -0,0 +1,58 @@
+/**
+ * notelist.h
+ * A growable collection of note objects.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _NOTELIST_H
+#define _NOTELIST_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "arena.h"
+#include "note.h"
+#include "workspace.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Note collection object.
+ */
+typedef struct {
+	note_t **notes;
+	size_t len;
+	size_t cap;
+
+	arena_t *arena;
+	workspace_t *ws;
+} notelist_t;
+
+/* Construction and destruction. */
+notelist_t* notelist_new(void);
+void notelist_free(notelist_t *list);
+void notelist_clear(notelist_t *list);
+bool notelist_use_arena(notelist_t *list);
+arena_t* notelist_arena(const notelist_t *list);
+void notelist_use_workspace(notelist_t *list, workspace_t *ws);
+workspace_t* notelist_workspace(const notelist_t *list);
+
+/* Manipulation. */
+bool notelist_push(notelist_t *list, note_t *note);
+bool notelist_extend(notelist_t *list, notelist_t *other);
+void notelist_sort(notelist_t *list);
+
+/* Accessors. */
+size_t notelist_len(const notelist_t *list);
+note_t* notelist_get(const notelist_t *list, size_t index);
+size_t notelist_range(const notelist_t *list, time_t from, time_t to,
+					  size_t *first);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _NOTELIST_H */
@@ -0,0 +1,513 @@
+/**
+ * output.c
+ * Buffered and structured output of notes.
+ *
+ * Output is gathered into a single reusable buffer, with big blocks such as the
+ * contents of notes only being referenced instead of copied, and handed to the
+ * kernel with writev when the buffer fills up. JSON strings are escaped a run
+ * at a time using a lookup table, so plain text gets copied in bulk.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "output.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Hexadecimal digits. */
+static const char hexdigits[] = "0123456789abcdef";
+
+/**
+ * Characters that need escaping in JSON strings. 0 means it doesn't, 'u' means
+ * it's escaped as \u00XX and anything else is the character after a backslash.
+ */
+static const char json_escapes[256] = {
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u',
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+	'u', 'u', 0, 0, '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\'
+};
+
+/**
+ * Allocates a new buffered output stream.
+ * @warning The object must be free'd with output_free, which also flushes it.
+ *
+ * @param fd      File descriptor to write to.
+ * @param fmt     Format to print notes in.
+ * @param content Should the contents of the notes be printed if loaded?
+ *
+ * @return Output stream or NULL if we couldn't allocate memory.
+ *
+ * @see output_free
+ */
+output_t* output_new(int fd, output_fmt_t fmt, bool content) {
+	output_t *out;
+
+	out = (output_t *)malloc(sizeof(output_t));
+	if (out == NULL)
+		return NULL;
+
+	out->buf = (char *)malloc(OUTPUT_BUFSIZE * sizeof(char));
+	if (out->buf == NULL) {
+		free(out);
+		return NULL;
+	}
+
+	out->fd = fd;
+	out->fmt = fmt;
+	out->content = content;
+	out->len = 0;
+	out->mark = 0;
+	out->niov = 0;
+	out->failed = false;
+
+	return out;
+}
+
+/**
+ * Flushes and frees up an output stream.
+ *
+ * @param out Output stream.
+ *
+ * @return TRUE if everything was written out successfully.
+ *         FALSE if an error occurred at any point. Check errno.
+ */
+bool output_free(output_t *out) {
+	bool ret;
+
+	ret = output_flush(out);
+	free(out->buf);
+	free(out);
+
+	return ret;
+}
+
+/**
+ * Gets an output format from its name.
+ *
+ * @param name Name of the format. (text, json or tsv)
+ * @param fmt  Will hold the format.
+ *
+ * @return TRUE if the format exists.
+ */
+bool output_parse_fmt(const char *name, output_fmt_t *fmt) {
+	if (strcmp(name, "text") == 0) {
+		*fmt = OUTPUT_TEXT;
+	} else if ((strcmp(name, "json") == 0) || (strcmp(name, "jsonl") == 0)) {
+		*fmt = OUTPUT_JSONL;
+	} else if (strcmp(name, "tsv") == 0) {
+		*fmt = OUTPUT_TSV;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Adds whatever was copied into the buffer since the last piece as a piece of
+ * its own.
+ *
+ * @param out Output stream.
+ */
+static void output_seal(output_t *out) {
+	if (out->len == out->mark)
+		return;
+
+	out->iov[out->niov].iov_base = out->buf + out->mark;
+	out->iov[out->niov].iov_len = out->len - out->mark;
+	out->niov++;
+	out->mark = out->len;
+}
+
+/**
+ * Writes out everything that was buffered so far.
+ *
+ * @param out Output stream.
+ *
+ * @return TRUE if everything was written out successfully.
+ *         FALSE if an error occurred at any point. Check errno.
+ */
+bool output_flush(output_t *out) {
+	struct iovec *iov;
+	ssize_t n;
+	int niov;
+
+	output_seal(out);
+	iov = out->iov;
+	niov = out->niov;
+
+	/* Keep going until the kernel takes everything. */
+	while ((niov > 0) && !out->failed) {
+		n = writev(out->fd, iov, niov);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+
+			out->failed = true;
+			break;
+		}
+
+		/* Skip over whatever was written. */
+		while ((niov > 0) && ((size_t)n >= iov->iov_len)) {
+			n -= iov->iov_len;
+			iov++;
+			niov--;
+		}
+		if (niov > 0) {
+			iov->iov_base = (char *)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+
+	out->len = 0;
+	out->mark = 0;
+	out->niov = 0;
+
+	return !out->failed;
+}
+
+/**
+ * Makes sure there's enough space in the buffer for some data.
+ *
+ * @param out Output stream.
+ * @param len Number of bytes that are about to be copied. Must not exceed the
+ *            size of the buffer.
+ */
+static void output_reserve(output_t *out, size_t len) {
+	if (((out->len + len) > OUTPUT_BUFSIZE) ||
+			(out->niov >= (OUTPUT_IOV_MAX - 1))) {
+		output_flush(out);
+	}
+}
+
+/**
+ * Writes some data to the output stream.
+ * @warning Big blocks are referenced instead of copied, so the data must stay
+ *          valid until the stream is flushed.
+ *
+ * @param out  Output stream.
+ * @param data Data to be written.
+ * @param len  Length of the data.
+ */
+void output_write(output_t *out, const char *data, size_t len) {
+	size_t chunk;
+
+	/* Reference big blocks instead of copying them around. */
+	if (len >= OUTPUT_REF_THRESHOLD) {
+		output_reserve(out, 0);
+		output_seal(out);
+		out->iov[out->niov].iov_base = (void *)data;
+		out->iov[out->niov].iov_len = len;
+		out->niov++;
+
+		return;
+	}
+
+	/* Copy small pieces into the buffer. */
+	while (len > 0) {
+		output_reserve(out, 1);
+		chunk = OUTPUT_BUFSIZE - out->len;
+		if (chunk > len)
+			chunk = len;
+
+		memcpy(out->buf + out->len, data, chunk);
+		out->len += chunk;
+		data += chunk;
+		len -= chunk;
+	}
+}
+
+/**
+ * Writes a string to the output stream.
+ *
+ * @param out Output stream.
+ * @param str NULL terminated string to be written.
+ */
+void output_puts(output_t *out, const char *str) {
+	output_write(out, str, strlen(str));
+}
+
+/**
+ * Writes a single character to the output stream.
+ *
+ * @param out Output stream.
+ * @param c   Character to be written.
+ */
+void output_putc(output_t *out, char c) {
+	output_reserve(out, 1);
+	out->buf[out->len++] = c;
+}
+
+/**
+ * Writes an unsigned number in decimal to the output stream.
+ *
+ * @param out Output stream.
+ * @param num Number to be written.
+ */
+void output_uint(output_t *out, uint64_t num) {
+	char digits[20];
+	size_t i;
+
+	/* Build the number backwards. */
+	i = sizeof(digits);
+	do {
+		digits[--i] = (char)('0' + (num % 10));
+		num /= 10;
+	} while (num > 0);
+
+	output_write(out, digits + i, sizeof(digits) - i);
+}
+
+/**
+ * Writes a quoted and escaped JSON string to the output stream. Bytes outside
+ * of the ASCII range are passed through as they are.
+ *
+ * @param out Output stream.
+ * @param str String to be written.
+ * @param len Length of the string.
+ */
+void output_json_str(output_t *out, const char *str, size_t len) {
+	const unsigned char *cur;
+	const unsigned char *end;
+	const unsigned char *run;
+	char esc[6];
+	char c;
+
+	output_putc(out, '"');
+
+	cur = (const unsigned char *)str;
+	end = cur + len;
+	while (cur < end) {
+		/* Copy everything that doesn't need escaping in one go. */
+		run = cur;
+		while ((cur < end) && (json_escapes[*cur] == 0))
+			cur++;
+		if (cur > run) {
+			/* The run is copied, since it's usually part of a bigger string. */
+			while (run < cur) {
+				size_t chunk;
+
+				output_reserve(out, 1);
+				chunk = OUTPUT_BUFSIZE - out->len;
+				if (chunk > (size_t)(cur - run))
+					chunk = (size_t)(cur - run);
+				memcpy(out->buf + out->len, run, chunk);
+				out->len += chunk;
+				run += chunk;
+			}
+		}
+		if (cur == end)
+			break;
+
+		/* Escape the character. */
+		c = json_escapes[*cur];
+		esc[0] = '\\';
+		if (c == 'u') {
+			esc[1] = 'u';
+			esc[2] = '0';
+			esc[3] = '0';
+			esc[4] = hexdigits[*cur >> 4];
+			esc[5] = hexdigits[*cur & 0xF];
+			output_write(out, esc, 6);
+		} else {
+			esc[1] = c;
+			output_write(out, esc, 2);
+		}
+		cur++;
+	}
+
+	output_putc(out, '"');
+}
+
+/**
+ * Writes an escaped TSV field to the output stream. Tabs, line breaks and
+ * backslashes are escaped with a backslash so that every record stays in a
+ * single line.
+ *
+ * @param out Output stream.
+ * @param str String to be written.
+ * @param len Length of the string.
+ */
+void output_tsv_str(output_t *out, const char *str, size_t len) {
+	const char *end;
+	const char *run;
+
+	end = str + len;
+	while (str < end) {
+		/* Copy everything that doesn't need escaping in one go. */
+		run = str;
+		while ((str < end) && (*str != '\t') && (*str != '\n') &&
+			   (*str != '\r') && (*str != '\\')) {
+			str++;
+		}
+		if (str > run) {
+			while (run < str) {
+				size_t chunk;
+
+				output_reserve(out, 1);
+				chunk = OUTPUT_BUFSIZE - out->len;
+				if (chunk > (size_t)(str - run))
+					chunk = (size_t)(str - run);
+				memcpy(out->buf + out->len, run, chunk);
+				out->len += chunk;
+				run += chunk;
+			}
+		}
+		if (str == end)
+			break;
+
+		/* Escape the character. */
+		output_putc(out, '\\');
+		switch (*str) {
+			case '\t':
+				output_putc(out, 't');
+				break;
+			case '\n':
+				output_putc(out, 'n');
+				break;
+			case '\r':
+				output_putc(out, 'r');
+				break;
+			default:
+				output_putc(out, '\\');
+				break;
+		}
+		str++;
+	}
+}
+
+/**
+ * Writes a note as human readable text.
+ *
+ * @param out     Output stream.
+ * @param note    Note object.
+ * @param content Contents of the note or NULL if they shouldn't be printed.
+ * @param len     Length of the contents.
+ */
+static void output_note_text(output_t *out, const note_t *note,
+							 const char *content, size_t len) {
+	char dates[NOTE_DATESTR_LEN];
+
+	note_get_datestr(note, dates);
+
+	output_puts(out, note_get_path(note));
+	output_puts(out, "\n\"note\": {\n    \"date\": \"");
+	output_puts(out, dates);
+	output_puts(out, "\"\n    \"title\": \"");
+	output_puts(out, note_get_title(note));
+	output_puts(out, "\"\n    \"format\": \"");
+	output_puts(out, note_get_format(note));
+	output_puts(out, "\"\n}\n");
+
+	if (content != NULL) {
+		output_puts(out, "---\n");
+		output_write(out, content, len);
+		output_puts(out, "\n---\n");
+	}
+	output_putc(out, '\n');
+}
+
+/**
+ * Writes a note as a JSON object in a line of its own.
+ *
+ * @param out     Output stream.
+ * @param note    Note object.
+ * @param content Contents of the note or NULL if they shouldn't be printed.
+ * @param len     Length of the contents.
+ */
+static void output_note_json(output_t *out, const note_t *note,
+							 const char *content, size_t len) {
+	char dates[NOTE_DATESTR_LEN];
+	const char *str;
+
+	note_get_datestr(note, dates);
+
+	output_puts(out, "{\"date\":\"");
+	output_puts(out, dates);
+	output_puts(out, "\",\"title\":");
+	str = note_get_title(note);
+	output_json_str(out, str, strlen(str));
+	output_puts(out, ",\"format\":");
+	str = note_get_format(note);
+	output_json_str(out, str, strlen(str));
+	str = note_get_path(note);
+	if (str != NULL) {
+		output_puts(out, ",\"path\":");
+		output_json_str(out, str, strlen(str));
+	}
+	if (content != NULL) {
+		output_puts(out, ",\"size\":");
+		output_uint(out, len);
+		output_puts(out, ",\"content\":");
+		output_json_str(out, content, len);
+	}
+	output_puts(out, "}\n");
+}
+
+/**
+ * Writes a note as a line of tab separated values.
+ *
+ * @param out     Output stream.
+ * @param note    Note object.
+ * @param content Contents of the note or NULL if they shouldn't be printed.
+ * @param len     Length of the contents.
+ */
+static void output_note_tsv(output_t *out, const note_t *note,
+							const char *content, size_t len) {
+	char dates[NOTE_DATESTR_LEN];
+	const char *str;
+
+	note_get_datestr(note, dates);
+
+	output_puts(out, dates);
+	output_putc(out, '\t');
+	str = note_get_title(note);
+	output_tsv_str(out, str, strlen(str));
+	output_putc(out, '\t');
+	str = note_get_format(note);
+	output_tsv_str(out, str, strlen(str));
+	output_putc(out, '\t');
+	str = note_get_path(note);
+	if (str != NULL)
+		output_tsv_str(out, str, strlen(str));
+	if (content != NULL) {
+		output_putc(out, '\t');
+		output_tsv_str(out, content, len);
+	}
+	output_putc(out, '\n');
+}
+
+/**
+ * Writes a note to the output stream in its format. The contents are only
+ * written if they were loaded and the stream was asked to include them.
+ * @warning The contents of the note are referenced instead of copied, so they
+ *          must stay loaded until the stream is flushed.
+ *
+ * @param out  Output stream.
+ * @param note Note object.
+ */
+void output_note(output_t *out, const note_t *note) {
+	const char *content;
+	size_t len;
+
+	content = NULL;
+	len = 0;
+	if (out->content)
+		content = note_get_content(note, &len);
+
+	switch (out->fmt) {
+		case OUTPUT_JSONL:
+			output_note_json(out, note, content, len);
+			break;
+		case OUTPUT_TSV:
+			output_note_tsv(out, note, content, len);
+			break;
+		default:
+			output_note_text(out, note, content, len);
+			break;
+	}
+}
@@ -0,0 +1,85 @@
+/**
+ * output.h
+ * Buffered and structured output of notes.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _OUTPUT_H
+#define _OUTPUT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+
+#include "note.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Size of the output buffer. */
+#ifndef OUTPUT_BUFSIZE
+	#define OUTPUT_BUFSIZE (256 * 1024)
+#endif /* OUTPUT_BUFSIZE */
+
+/* Maximum number of pieces written in a single call. */
+#define OUTPUT_IOV_MAX 64
+
+/* Blocks at least this big are written straight from where they are. */
+#define OUTPUT_REF_THRESHOLD 4096
+
+/**
+ * Output formats.
+ */
+typedef enum {
+	OUTPUT_TEXT = 0,
+	OUTPUT_JSONL,
+	OUTPUT_TSV
+} output_fmt_t;
+
+/**
+ * Buffered output stream. Small pieces are copied into a buffer while big
+ * blocks are only referenced, and everything is written out in a single
+ * writev call when the buffer fills up.
+ */
+typedef struct {
+	int fd;
+	output_fmt_t fmt;
+	bool content;
+
+	char *buf;
+	size_t len;
+	size_t mark;
+
+	struct iovec iov[OUTPUT_IOV_MAX];
+	int niov;
+
+	bool failed;
+} output_t;
+
+/* Construction and destruction. */
+output_t* output_new(int fd, output_fmt_t fmt, bool content);
+bool output_free(output_t *out);
+bool output_parse_fmt(const char *name, output_fmt_t *fmt);
+
+/* Raw output. */
+bool output_flush(output_t *out);
+void output_write(output_t *out, const char *data, size_t len);
+void output_puts(output_t *out, const char *str);
+void output_putc(output_t *out, char c);
+void output_uint(output_t *out, uint64_t num);
+
+/* Escaped output. */
+void output_json_str(output_t *out, const char *str, size_t len);
+void output_tsv_str(output_t *out, const char *str, size_t len);
+
+/* Notes. */
+void output_note(output_t *out, const note_t *note);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _OUTPUT_H */
@@ -0,0 +1,783 @@
+/**
+ * pack.c
+ * Single file archive of a whole workspace that can be read in place.
+ *
+ * A pack is a small header followed by the contents of every note, one after
+ * the other, and an index footer with a record per note. Each record holds the
+ * metadata parsed from the note's file name, its size and modification time,
+ * where its contents are in the pack, how long they are and a CRC-32 of them.
+ * Notes that shrink when deflated are stored compressed. The pack ends with a
+ * trailer that points to the index, so it can be written in a single pass.
+ *
+ * Packs are mapped into memory when opened. Listing their notes only needs the
+ * index, and the contents of notes that aren't compressed are handed out as
+ * views straight into the mapping, so no per-file system calls are ever made.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "pack.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "dateutils.h"
+#include "fsutils.h"
+#include "note.h"
+#include "stats.h"
+#include "strutils.h"
+
+/* Sizes of the fixed parts of the pack file. */
+#define PACK_HEADER_SIZE  16
+#define PACK_RECORD_SIZE  52
+#define PACK_TRAILER_SIZE 24
+
+/* Size of the buffer used to write packs and extracted notes. */
+#define PACK_BUFSIZE (256 * 1024)
+
+/**
+ * In-memory representation of a pack record.
+ */
+typedef struct {
+	int32_t date;
+	uint16_t flags;
+	uint16_t name_len;
+	uint64_t offset;
+	uint64_t stored;
+	uint64_t size;
+	int64_t mtime;
+	uint32_t crc;
+	uint16_t title_off;
+	uint16_t title_len;
+	uint16_t fmt_off;
+
+	const char *name;
+} pack_rec_t;
+
+/**
+ * Reads a record from the index.
+ *
+ * @param rec Record to be populated. Its name will point inside the index.
+ * @param buf Position of the record in the index.
+ */
+static void pack_rec_read(pack_rec_t *rec, const char *buf) {
+	memcpy(&rec->date, buf, sizeof(int32_t));
+	memcpy(&rec->flags, buf + 4, sizeof(uint16_t));
+	memcpy(&rec->name_len, buf + 6, sizeof(uint16_t));
+	memcpy(&rec->offset, buf + 8, sizeof(uint64_t));
+	memcpy(&rec->stored, buf + 16, sizeof(uint64_t));
+	memcpy(&rec->size, buf + 24, sizeof(uint64_t));
+	memcpy(&rec->mtime, buf + 32, sizeof(int64_t));
+	memcpy(&rec->crc, buf + 40, sizeof(uint32_t));
+	memcpy(&rec->title_off, buf + 44, sizeof(uint16_t));
+	memcpy(&rec->title_len, buf + 46, sizeof(uint16_t));
+	memcpy(&rec->fmt_off, buf + 48, sizeof(uint16_t));
+	rec->name = buf + PACK_RECORD_SIZE;
+}
+
+/**
+ * Writes a record to the index.
+ *
+ * @param rec Record to be written.
+ * @param buf Buffer with at least PACK_RECORD_SIZE bytes available.
+ */
+static void pack_rec_write(const pack_rec_t *rec, char *buf) {
+	memset(buf, 0, PACK_RECORD_SIZE);
+	memcpy(buf, &rec->date, sizeof(int32_t));
+	memcpy(buf + 4, &rec->flags, sizeof(uint16_t));
+	memcpy(buf + 6, &rec->name_len, sizeof(uint16_t));
+	memcpy(buf + 8, &rec->offset, sizeof(uint64_t));
+	memcpy(buf + 16, &rec->stored, sizeof(uint64_t));
+	memcpy(buf + 24, &rec->size, sizeof(uint64_t));
+	memcpy(buf + 32, &rec->mtime, sizeof(int64_t));
+	memcpy(buf + 40, &rec->crc, sizeof(uint32_t));
+	memcpy(buf + 44, &rec->title_off, sizeof(uint16_t));
+	memcpy(buf + 46, &rec->title_len, sizeof(uint16_t));
+	memcpy(buf + 48, &rec->fmt_off, sizeof(uint16_t));
+}
+
+/**
+ * Checks that a name stored in a pack can't escape the directory it's going to
+ * be extracted to.
+ *
+ * @param name Relative path of the note.
+ *
+ * @return TRUE if the name is safe to use.
+ */
+static bool pack_name_safe(const char *name) {
+	const char *cur;
+
+	if ((name[0] == '\0') || (name[0] == PATH_SEP))
+		return false;
+
+	/* Look for parent directory components. */
+	for (cur = name; cur != NULL; cur = strchr(cur, PATH_SEP)) {
+		if (*cur == PATH_SEP)
+			cur++;
+		if ((cur[0] == '.') && (cur[1] == '.') &&
+				((cur[2] == PATH_SEP) || (cur[2] == '\0'))) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Checks that the index of a pack is consistent with the rest of it.
+ *
+ * @param pack Pack object with its index located.
+ *
+ * @return TRUE if every record is valid.
+ */
+static bool pack_validate(const pack_t *pack) {
+	pack_rec_t rec;
+	size_t data_end;
+	size_t pos;
+	uint32_t i;
+
+	data_end = pack->index - pack->data;
+	pos = 0;
+	for (i = 0; i < pack->count; i++) {
+		if ((pack->index_len - pos) < PACK_RECORD_SIZE)
+			return false;
+		pack_rec_read(&rec, pack->index + pos);
+		pos += PACK_RECORD_SIZE;
+
+		/* Names are stored NULL terminated. */
+		if (((pack->index_len - pos) < ((size_t)rec.name_len + 1)) ||
+				(rec.name[rec.name_len] != '\0') ||
+				(strlen(rec.name) != rec.name_len) ||
+				!pack_name_safe(rec.name) ||
+				(((size_t)rec.title_off + rec.title_len) > rec.name_len) ||
+				(rec.fmt_off > rec.name_len)) {
+			return false;
+		}
+		pos += rec.name_len + 1;
+
+		/* Contents must be inside the data section. */
+		if ((rec.offset < PACK_HEADER_SIZE) || (rec.offset > data_end) ||
+				(rec.stored > (data_end - rec.offset))) {
+			return false;
+		}
+		if (!(rec.flags & PACK_DEFLATE) && (rec.stored != rec.size))
+			return false;
+	}
+
+	return pos == pack->index_len;
+}
+
+/**
+ * Opens a pack file and maps it into memory.
+ *
+ * @param path Path to the pack file.
+ *
+ * @return Pack object or NULL in case of an error. Check errno, which will be
+ *         EINVAL if the file isn't a valid pack.
+ *
+ * @see pack_close
+ */
+pack_t* pack_open(const char *path) {
+	pack_t *pack;
+	struct stat st;
+	uint64_t index_off;
+	uint32_t index_crc;
+	uint32_t version;
+	uint32_t magic;
+	const char *trailer;
+	void *map;
+	int fd;
+
+	/* Map the whole file. */
+	STATS_INC(STATS_SYS_OPEN);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+	STATS_INC(STATS_SYS_STAT);
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return NULL;
+	}
+	if ((st.st_size < (PACK_HEADER_SIZE + PACK_TRAILER_SIZE)) ||
+			((uint64_t)st.st_size > (uint64_t)SIZE_MAX)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	STATS_INC(STATS_SYS_MMAP);
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	STATS_INC(STATS_SYS_CLOSE);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+	STATS_ADD(STATS_BYTES_MAPPED, st.st_size);
+
+	/* Allocate our object. */
+	pack = (pack_t *)malloc(sizeof(pack_t));
+	if (pack == NULL) {
+		munmap(map, (size_t)st.st_size);
+		errno = ENOMEM;
+		return NULL;
+	}
+	pack->path = NULL;
+	string_copy(&pack->path, path);
+	pack->data = (const char *)map;
+	pack->len = (size_t)st.st_size;
+
+	/* Check the header and the trailer. */
+	memcpy(&magic, pack->data, sizeof(uint32_t));
+	memcpy(&version, pack->data + 4, sizeof(uint32_t));
+	if ((magic != PACK_MAGIC) || (version != PACK_VERSION))
+		goto invalid;
+	trailer = pack->data + pack->len - PACK_TRAILER_SIZE;
+	memcpy(&index_off, trailer, sizeof(uint64_t));
+	memcpy(&pack->count, trailer + 8, sizeof(uint32_t));
+	memcpy(&index_crc, trailer + 12, sizeof(uint32_t));
+	memcpy(&version, trailer + 16, sizeof(uint32_t));
+	memcpy(&magic, trailer + 20, sizeof(uint32_t));
+	if ((magic != PACK_MAGIC) || (version != PACK_VERSION) ||
+			(index_off < PACK_HEADER_SIZE) ||
+			(index_off > (uint64_t)(pack->len - PACK_TRAILER_SIZE))) {
+		goto invalid;
+	}
+
+	/* Locate the index and make sure it can be trusted. */
+	pack->index = pack->data + index_off;
+	pack->index_len = (trailer - pack->index);
+	if ((crc32(0L, (const Bytef *)pack->index, (uInt)pack->index_len) !=
+			index_crc) || !pack_validate(pack)) {
+		goto invalid;
+	}
+
+	return pack;
+
+invalid:
+	pack_close(pack);
+	errno = EINVAL;
+	return NULL;
+}
+
+/**
+ * Unmaps a pack and frees up its object.
+ *
+ * @warning Notes loaded from the pack may point into it, so they must be gone
+ *          before it's closed.
+ *
+ * @param pack Pack object to be free'd.
+ */
+void pack_close(pack_t *pack) {
+	/* Do we even have anything to do? */
+	if (pack == NULL)
+		return;
+
+	munmap((void *)pack->data, pack->len);
+	if (pack->path)
+		free(pack->path);
+	free(pack);
+}
+
+/**
+ * Attaches the contents of a pack record to a note. Stored contents are
+ * borrowed straight from the mapping, compressed ones are inflated into a
+ * buffer owned by the note.
+ *
+ * @param pack Pack object.
+ * @param rec  Record of the note.
+ * @param note Note object.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if the contents are corrupt or we ran out of memory.
+ */
+static bool pack_rec_content(const pack_t *pack, const pack_rec_t *rec,
+							 note_t *note) {
+	const char *stored;
+	uLongf len;
+	char *buf;
+
+	stored = pack->data + rec->offset;
+	note->content.mapped = false;
+	note->content.borrowed = false;
+	if (rec->size == 0) {
+		note->content.data = "";
+		note->content.len = 0;
+
+		return true;
+	}
+
+	/* Stored contents are handed out as they are. */
+	if (!(rec->flags & PACK_DEFLATE)) {
+		if (crc32(0L, (const Bytef *)stored, (uInt)rec->size) != rec->crc) {
+			errno = EINVAL;
+			return false;
+		}
+
+		note->content.data = stored;
+		note->content.len = (size_t)rec->size;
+		note->content.borrowed = true;
+
+		return true;
+	}
+
+	/* Inflate compressed contents. */
+	buf = (char *)malloc(((size_t)rec->size + 1) * sizeof(char));
+	if (buf == NULL)
+		return false;
+	STATS_INC(STATS_ALLOCS);
+	len = (uLongf)rec->size;
+	if ((uncompress((Bytef *)buf, &len, (const Bytef *)stored,
+					(uLong)rec->stored) != Z_OK) || (len != rec->size) ||
+			(crc32(0L, (const Bytef *)buf, (uInt)len) != rec->crc)) {
+		free(buf);
+		errno = EINVAL;
+		return false;
+	}
+	buf[len] = '\0';
+
+	note->content.data = buf;
+	note->content.len = (size_t)len;
+
+	return true;
+}
+
+/**
+ * Loads every note in a pack.
+ *
+ * @param pack    Pack object. Must outlive the notes.
+ * @param content Should the contents of the notes be attached to them? Stored
+ *                contents cost nothing, compressed ones are inflated.
+ * @param filter  Only load the notes that pass this filter. (NULL for all of
+ *                them)
+ * @param list    Note collection to append the notes to. They will be sorted
+ *                by date, title and format. If it uses an arena the notes will
+ *                be allocated from it.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno, which will be EINVAL if the
+ *         contents of a note are corrupt.
+ */
+bool pack_load(const pack_t *pack, bool content, const filter_t *filter,
+			   notelist_t *list) {
+	pack_rec_t rec;
+	note_t *note;
+	char *scratch;
+	size_t pos;
+	uint32_t i;
+
+	scratch = NULL;
+	pos = 0;
+	for (i = 0; i < pack->count; i++) {
+		pack_rec_read(&rec, pack->index + pos);
+		pos += PACK_RECORD_SIZE + rec.name_len + 1;
+
+		/* Skip the notes we don't want before doing anything with them. */
+		if ((filter != NULL) &&
+				(!filter_match_name(filter, fs_basename(rec.name)) ||
+				 !filter_match_size(filter, rec.size))) {
+			continue;
+		}
+
+		note = note_new_arena(notelist_arena(list));
+		if (note == NULL)
+			goto nomem;
+
+		/* Populate the note with the metadata we had stored. */
+		note_set_date(note, date_from_days(rec.date));
+		note_set_title_untilp(note, rec.name + rec.title_off,
+							  rec.name + rec.title_off + rec.title_len);
+		note_set_format(note, rec.name + rec.fmt_off);
+		note->size = rec.size;
+		note->mtime = rec.mtime;
+		note->inode = 0;
+
+		/* Notes live in the pack as if it was a directory. */
+		string_copy(&scratch, pack->path);
+		fs_pathcat(&scratch, rec.name);
+		note_set_path(note, scratch);
+
+		/* Attach the contents. */
+		if (content) {
+			if (!pack_rec_content(pack, &rec, note)) {
+				note_free(note);
+				if (scratch)
+					free(scratch);
+				return false;
+			}
+			note_hash(note);
+		}
+
+		if (!notelist_push(list, note)) {
+			note_free(note);
+			goto nomem;
+		}
+	}
+	if (scratch)
+		free(scratch);
+
+	/* Ensure the output is deterministic. */
+	notelist_sort(list);
+
+	return true;
+
+nomem:
+	if (scratch)
+		free(scratch);
+	errno = ENOMEM;
+	return false;
+}
+
+/**
+ * Gets a view over the contents of a note, using the cached ones if they were
+ * loaded.
+ *
+ * @param note Note object.
+ * @param view View to be populated. Release it with pack_view_release.
+ *
+ * @return TRUE if the operation was successful.
+ */
+static bool pack_view(note_t *note, fs_view_t *view) {
+	bool ret;
+
+	if (note_is_loaded(note)) {
+		view->data = note_get_content(note, &view->len);
+		view->mapped = false;
+		view->borrowed = true;
+
+		return true;
+	}
+
+	ret = note_fh_view(note, view);
+	note_fh_close(note);
+
+	return ret;
+}
+
+/**
+ * Writes a buffer to a file handle in its entirety.
+ *
+ * @param fh  File handle.
+ * @param buf Buffer to be written.
+ * @param len Length of the buffer.
+ *
+ * @return TRUE if the operation was successful.
+ */
+static bool pack_fwrite(FILE *fh, const void *buf, size_t len) {
+	if (len == 0)
+		return true;
+
+	return fwrite(buf, sizeof(char), len, fh) == len;
+}
+
+/**
+ * Writes every note in a collection to a pack file. The pack is written to a
+ * temporary file first and atomically moved into place.
+ *
+ * @param list     Note collection.
+ * @param basepath Path to the workspace the notes were loaded from. Used to
+ *                 figure out their relative paths.
+ * @param fname    Path to the pack file to be written.
+ * @param compress Should notes be deflated when that makes them smaller?
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ */
+bool pack_write(const notelist_t *list, const char *basepath, const char *fname,
+				bool compress) {
+	pack_rec_t rec;
+	note_fname_t parsed;
+	fs_view_t view;
+	const char *name;
+	char *tmppath;
+	char *index;
+	char *zbuf;
+	char *cur;
+	char hdr[PACK_TRAILER_SIZE];
+	size_t index_len;
+	size_t index_cap;
+	size_t zcap;
+	uLongf zlen;
+	uint64_t offset;
+	uint32_t count;
+	uint32_t u32;
+	note_t *note;
+	FILE *fh;
+	size_t i;
+	int err;
+
+	/* Open a temporary file next to the pack. */
+	tmppath = NULL;
+	string_copy(&tmppath, fname);
+	string_concat(&tmppath, ".tmp");
+	fh = fopen(tmppath, "wb");
+	if (fh == NULL) {
+		free(tmppath);
+		return false;
+	}
+	setvbuf(fh, NULL, _IOFBF, PACK_BUFSIZE);
+
+	/* Write the header. */
+	memset(hdr, 0, PACK_HEADER_SIZE);
+	u32 = PACK_MAGIC;
+	memcpy(hdr, &u32, sizeof(uint32_t));
+	u32 = PACK_VERSION;
+	memcpy(hdr + 4, &u32, sizeof(uint32_t));
+	err = 0;
+	if (!pack_fwrite(fh, hdr, PACK_HEADER_SIZE))
+		goto fail;
+
+	/* Write the contents of every note while building the index. */
+	index = NULL;
+	index_len = 0;
+	index_cap = 0;
+	zbuf = NULL;
+	zcap = 0;
+	count = 0;
+	offset = PACK_HEADER_SIZE;
+	for (i = 0; i < notelist_len(list); i++) {
+		note = notelist_get(list, i);
+		name = fs_relpath(note_get_path(note), basepath);
+		if (!note_parse_fname(fs_basename(name), &parsed) ||
+				(strlen(name) > UINT16_MAX) || !pack_name_safe(name)) {
+			continue;
+		}
+
+		/* Build the record. */
+		memset(&rec, 0, sizeof(pack_rec_t));
+		rec.date = parsed.days;
+		rec.name_len = (uint16_t)strlen(name);
+		rec.title_off = (uint16_t)(parsed.title - name);
+		rec.title_len = (uint16_t)parsed.title_len;
+		rec.fmt_off = (uint16_t)(parsed.format - name);
+		rec.mtime = note_get_mtime(note);
+		rec.offset = offset;
+
+		/* Get the contents of the note. */
+		if (!pack_view(note, &view)) {
+			err = errno;
+			goto fail_index;
+		}
+		rec.size = view.len;
+		rec.stored = view.len;
+		rec.crc = (uint32_t)crc32(0L, (const Bytef *)view.data,
+								  (uInt)view.len);
+
+		/* Deflate them if that's worth it. */
+		cur = (char *)view.data;
+		if (compress && (view.len > 0)) {
+			zlen = compressBound((uLong)view.len);
+			if (zlen > zcap) {
+				cur = (char *)realloc(zbuf, zlen * sizeof(char));
+				if (cur == NULL) {
+					fs_fview_release(&view);
+					err = ENOMEM;
+					goto fail_index;
+				}
+				zbuf = cur;
+				zcap = zlen;
+			}
+
+			cur = (char *)view.data;
+			if ((compress2((Bytef *)zbuf, &zlen, (const Bytef *)view.data,
+						   (uLong)view.len, Z_BEST_SPEED) == Z_OK) &&
+					(zlen < view.len)) {
+				rec.flags |= PACK_DEFLATE;
+				rec.stored = zlen;
+				cur = zbuf;
+			}
+		}
+
+		/* Write them. */
+		if (!pack_fwrite(fh, cur, (size_t)rec.stored)) {
+			err = errno;
+			fs_fview_release(&view);
+			goto fail_index;
+		}
+		fs_fview_release(&view);
+		offset += rec.stored;
+
+		/* Append the record to the index. */
+		if ((index_len + PACK_RECORD_SIZE + rec.name_len + 1) > index_cap) {
+			index_cap = (index_cap == 0) ? 16384 : index_cap * 2;
+			while (index_cap < (index_len + PACK_RECORD_SIZE + rec.name_len + 1))
+				index_cap *= 2;
+			cur = (char *)realloc(index, index_cap * sizeof(char));
+			if (cur == NULL) {
+				err = ENOMEM;
+				goto fail_index;
+			}
+			index = cur;
+		}
+		pack_rec_write(&rec, index + index_len);
+		index_len += PACK_RECORD_SIZE;
+		memcpy(index + index_len, name, rec.name_len + 1);
+		index_len += rec.name_len + 1;
+		count++;
+	}
+
+	/* Write the index and the trailer pointing to it. */
+	if (!pack_fwrite(fh, index, index_len)) {
+		err = errno;
+		goto fail_index;
+	}
+	memcpy(hdr, &offset, sizeof(uint64_t));
+	memcpy(hdr + 8, &count, sizeof(uint32_t));
+	u32 = (uint32_t)crc32(0L, (const Bytef *)index, (uInt)index_len);
+	memcpy(hdr + 12, &u32, sizeof(uint32_t));
+	u32 = PACK_VERSION;
+	memcpy(hdr + 16, &u32, sizeof(uint32_t));
+	u32 = PACK_MAGIC;
+	memcpy(hdr + 20, &u32, sizeof(uint32_t));
+	if (!pack_fwrite(fh, hdr, PACK_TRAILER_SIZE)) {
+		err = errno;
+		goto fail_index;
+	}
+	if (index)
+		free(index);
+	if (zbuf)
+		free(zbuf);
+
+	/* Atomically move the pack into place. */
+	if (fclose(fh) != 0) {
+		err = errno;
+		unlink(tmppath);
+		free(tmppath);
+		errno = err;
+		return false;
+	}
+	if (rename(tmppath, fname) != 0) {
+		err = errno;
+		unlink(tmppath);
+		free(tmppath);
+		errno = err;
+		return false;
+	}
+	free(tmppath);
+
+	return true;
+
+fail_index:
+	if (index)
+		free(index);
+	if (zbuf)
+		free(zbuf);
+fail:
+	if (err == 0)
+		err = errno;
+	fclose(fh);
+	unlink(tmppath);
+	free(tmppath);
+	errno = err;
+
+	return false;
+}
+
+/**
+ * Creates every missing parent directory of a path.
+ *
+ * @param path Path to a file. Temporarily modified while walking it.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ */
+static bool pack_mkparents(char *path) {
+	char *cur;
+
+	for (cur = strchr(path + 1, PATH_SEP); cur != NULL;
+			cur = strchr(cur + 1, PATH_SEP)) {
+		*cur = '\0';
+		if ((mkdir(path, 0755) != 0) && (errno != EEXIST)) {
+			*cur = PATH_SEP;
+			return false;
+		}
+		*cur = PATH_SEP;
+	}
+
+	return true;
+}
+
+/**
+ * Writes every note in a collection out to a directory as regular files,
+ * restoring their relative paths and modification times. Used to turn a pack
+ * back into a workspace.
+ *
+ * @param list     Note collection.
+ * @param basepath Path to the workspace or pack the notes were loaded from.
+ *                 Used to figure out their relative paths.
+ * @param dest     Path to the directory the notes will be written to. It's
+ *                 created if needed.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ */
+bool pack_extract(const notelist_t *list, const char *basepath,
+				  const char *dest) {
+	struct timespec times[2];
+	fs_view_t view;
+	const char *name;
+	char *path;
+	note_t *note;
+	FILE *fh;
+	size_t i;
+	bool ret;
+	int err;
+
+	/* Make sure we have somewhere to extract to. */
+	if ((mkdir(dest, 0755) != 0) && (errno != EEXIST))
+		return false;
+
+	path = NULL;
+	ret = true;
+	for (i = 0; ret && (i < notelist_len(list)); i++) {
+		note = notelist_get(list, i);
+		name = fs_relpath(note_get_path(note), basepath);
+		if (!pack_name_safe(name))
+			continue;
+
+		/* Build the path to the note. */
+		string_copy(&path, dest);
+		fs_pathcat(&path, name);
+		if (!pack_mkparents(path)) {
+			ret = false;
+			break;
+		}
+
+		/* Write its contents. */
+		if (!pack_view(note, &view)) {
+			ret = false;
+			break;
+		}
+		fh = fopen(path, "wb");
+		if (fh == NULL) {
+			fs_fview_release(&view);
+			ret = false;
+			break;
+		}
+		ret = pack_fwrite(fh, view.data, view.len);
+		err = errno;
+		fs_fview_release(&view);
+
+		/* Restore its modification time if we know it. */
+		if (ret && (note_get_mtime(note) != 0)) {
+			fflush(fh);
+			times[0].tv_sec = 0;
+			times[0].tv_nsec = UTIME_OMIT;
+			times[1].tv_sec = (time_t)(note_get_mtime(note) / 1000000000);
+			times[1].tv_nsec = (long)(note_get_mtime(note) % 1000000000);
+			futimens(fileno(fh), times);
+		}
+		if ((fclose(fh) != 0) && ret) {
+			err = errno;
+			ret = false;
+		}
+		if (!ret)
+			errno = err;
+	}
+
+	if (path)
+		free(path);
+	return ret;
+}
@@ -0,0 +1,61 @@
+/**
+ * pack.h
+ * Single file archive of a whole workspace that can be read in place.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _PACK_H
+#define _PACK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "filter.h"
+#include "notelist.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Pack file format identification. */
+#define PACK_MAGIC   0x4B41504EUL /* "NPAK" */
+#define PACK_VERSION 1
+
+/* Pack record flags. */
+#define PACK_DEFLATE 0x0001
+
+/**
+ * Pack file mapped into memory.
+ */
+typedef struct {
+	char *path;
+
+	const char *data;
+	size_t len;
+
+	const char *index;
+	size_t index_len;
+	uint32_t count;
+} pack_t;
+
+/* Opening and closing. */
+pack_t* pack_open(const char *path);
+void pack_close(pack_t *pack);
+
+/* Reading. */
+bool pack_load(const pack_t *pack, bool content, const filter_t *filter,
+			   notelist_t *list);
+bool pack_extract(const notelist_t *list, const char *basepath,
+				  const char *dest);
+
+/* Writing. */
+bool pack_write(const notelist_t *list, const char *basepath, const char *fname,
+				bool compress);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PACK_H */
@@ -0,0 +1,334 @@
+/**
+ * query.c
+ * Date-range and recency queries over the notes of a workspace.
+ *
+ * The dates of the notes are parsed straight out of the directory entries, so
+ * that only the notes that actually match a query ever get allocated. Recency
+ * queries keep the K most recent entries seen so far in a bounded min-heap
+ * while the directory is being scanned.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "query.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "dateutils.h"
+#include "fsutils.h"
+#include "note.h"
+#include "strutils.h"
+
+/**
+ * Entry of the recency heap.
+ */
+typedef struct {
+	int32_t days;
+	char *name;
+	size_t title_len;
+	size_t fmt_off;
+} query_entry_t;
+
+/**
+ * Bounded min-heap holding the most recent entries, with the oldest one at the
+ * top so that it can be quickly replaced.
+ */
+typedef struct {
+	query_entry_t *entries;
+	size_t len;
+	size_t cap;
+} query_heap_t;
+
+/**
+ * Compares two heap entries in the same order notes are sorted: by date, title
+ * and format.
+ *
+ * @param a Heap entry.
+ * @param b Another heap entry.
+ *
+ * @return Negative if a is older than b, positive if it's newer, 0 if equal.
+ *
+ * @see note_cmp
+ */
+static int query_entry_cmp(const query_entry_t *a, const query_entry_t *b) {
+	int ret;
+
+	/* Compare dates. */
+	if (a->days != b->days)
+		return (a->days < b->days) ? -1 : 1;
+
+	/* Compare titles, which are slices of the names. */
+	ret = memcmp(a->name + DATE_STR_LEN + 1, b->name + DATE_STR_LEN + 1,
+				 (a->title_len < b->title_len) ? a->title_len : b->title_len);
+	if (ret != 0)
+		return ret;
+	if (a->title_len != b->title_len)
+		return (a->title_len < b->title_len) ? -1 : 1;
+
+	/* Compare formats. */
+	return strcmp(a->name + a->fmt_off, b->name + b->fmt_off);
+}
+
+/**
+ * Restores the heap property by moving an entry down from the top.
+ *
+ * @param heap Heap object.
+ * @param i    Index of the entry to be moved down.
+ */
+static void query_heap_down(query_heap_t *heap, size_t i) {
+	query_entry_t tmp;
+	size_t child;
+
+	for (;;) {
+		child = (i * 2) + 1;
+		if (child >= heap->len)
+			break;
+		if (((child + 1) < heap->len) &&
+				(query_entry_cmp(&heap->entries[child + 1],
+								 &heap->entries[child]) < 0)) {
+			child++;
+		}
+		if (query_entry_cmp(&heap->entries[i], &heap->entries[child]) <= 0)
+			break;
+
+		tmp = heap->entries[i];
+		heap->entries[i] = heap->entries[child];
+		heap->entries[child] = tmp;
+		i = child;
+	}
+}
+
+/**
+ * Restores the heap property by moving an entry up from the bottom.
+ *
+ * @param heap Heap object.
+ * @param i    Index of the entry to be moved up.
+ */
+static void query_heap_up(query_heap_t *heap, size_t i) {
+	query_entry_t tmp;
+	size_t parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (query_entry_cmp(&heap->entries[parent], &heap->entries[i]) <= 0)
+			break;
+
+		tmp = heap->entries[i];
+		heap->entries[i] = heap->entries[parent];
+		heap->entries[parent] = tmp;
+		i = parent;
+	}
+}
+
+/**
+ * Offers an entry to the heap. It's only kept if the heap isn't full yet or if
+ * it's more recent than the oldest entry in it.
+ *
+ * @param heap   Heap object.
+ * @param name   File name of the note. (Copied if the entry is kept)
+ * @param parsed Information parsed out of the file name.
+ *
+ * @return FALSE if we couldn't allocate memory. Check errno.
+ */
+static bool query_heap_offer(query_heap_t *heap, const char *name,
+							 const note_fname_t *parsed) {
+	query_entry_t entry;
+	size_t len;
+
+	/* Check if the entry is worth keeping before copying anything. */
+	entry.days = parsed->days;
+	entry.name = (char *)name;
+	entry.title_len = parsed->title_len;
+	entry.fmt_off = (size_t)(parsed->format - name);
+	if ((heap->len == heap->cap) &&
+			(query_entry_cmp(&entry, &heap->entries[0]) <= 0)) {
+		return true;
+	}
+
+	/* Copy the name over. */
+	len = strlen(name);
+	entry.name = (char *)malloc((len + 1) * sizeof(char));
+	if (entry.name == NULL)
+		return false;
+	memcpy(entry.name, name, len + 1);
+
+	/* Replace the oldest entry or append a new one. */
+	if (heap->len == heap->cap) {
+		free(heap->entries[0].name);
+		heap->entries[0] = entry;
+		query_heap_down(heap, 0);
+	} else {
+		heap->entries[heap->len] = entry;
+		query_heap_up(heap, heap->len++);
+	}
+
+	return true;
+}
+
+/**
+ * Creates a note from an entry of the workspace and appends it to a collection.
+ *
+ * @param list    Note collection.
+ * @param scratch Scratch buffer for building paths. (Will be reallocated)
+ * @param path    Path to the workspace.
+ * @param name    File name of the note inside the workspace.
+ *
+ * @return FALSE if we couldn't allocate memory. Check errno.
+ */
+static bool query_push(notelist_t *list, char **scratch, const char *path,
+					   const char *name) {
+	note_t *note;
+
+	/* Build the path to the note. */
+	string_copy(scratch, path);
+	fs_pathcat(scratch, name);
+
+	/* Create the note. */
+	note = note_from_fname_arena(*scratch, notelist_arena(list));
+	if (note == NULL)
+		return false;
+	if (!notelist_push(list, note)) {
+		note_free(note);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Populates a collection with the notes of a workspace that fall within a date
+ * range. Entries outside the range are never allocated.
+ *
+ * @param path Path to the workspace.
+ * @param from Earliest date of the range. (Inclusive)
+ * @param to   Latest date of the range. (Inclusive)
+ * @param list Note collection that will be populated and sorted.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ */
+bool query_range(const char *path, time_t from, time_t to, notelist_t *list) {
+	fs_dirscan_t scan;
+	const fs_dirent_t *entries;
+	note_fname_t parsed;
+	int32_t first;
+	int32_t last;
+	char *scratch;
+	size_t count;
+	size_t i;
+	bool ret;
+	int err;
+
+	/* Open the workspace. */
+	if (!fs_dirscan_open(&scan, path, FS_SCAN_FILES))
+		return false;
+	first = date_to_days(from);
+	last = date_to_days(to);
+	if (date_from_days(first) < from)
+		first++;
+
+	/* Only create the notes that are in range. */
+	ret = true;
+	scratch = NULL;
+	while (ret && ((count = fs_dirscan_next(&scan, &entries)) > 0)) {
+		for (i = 0; i < count; i++) {
+			if (!note_parse_fname(entries[i].name, &parsed))
+				continue;
+			if ((parsed.days < first) || (parsed.days > last))
+				continue;
+
+			if (!query_push(list, &scratch, path, entries[i].name)) {
+				ret = false;
+				break;
+			}
+		}
+	}
+
+	err = (ret) ? fs_dirscan_error(&scan) : 0;
+	if (scratch)
+		free(scratch);
+	fs_dirscan_close(&scan);
+	notelist_sort(list);
+	if (err != 0) {
+		errno = err;
+		return false;
+	}
+
+	return ret;
+}
+
+/**
+ * Populates a collection with the K most recent notes of a workspace. Only
+ * those notes are ever allocated.
+ *
+ * @param path Path to the workspace.
+ * @param k    Maximum number of notes to get.
+ * @param list Note collection that will be populated and sorted.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ */
+bool query_recent(const char *path, size_t k, notelist_t *list) {
+	fs_dirscan_t scan;
+	const fs_dirent_t *entries;
+	query_heap_t heap;
+	note_fname_t parsed;
+	char *scratch;
+	size_t count;
+	size_t i;
+	bool ret;
+	int err;
+
+	/* Nothing to look for. */
+	if (k == 0)
+		return true;
+
+	/* Set up the heap. */
+	heap.len = 0;
+	heap.cap = k;
+	heap.entries = (query_entry_t *)malloc(k * sizeof(query_entry_t));
+	if (heap.entries == NULL)
+		return false;
+
+	/* Open the workspace. */
+	if (!fs_dirscan_open(&scan, path, FS_SCAN_FILES)) {
+		free(heap.entries);
+		return false;
+	}
+
+	/* Keep the most recent entries as we go. */
+	ret = true;
+	while (ret && ((count = fs_dirscan_next(&scan, &entries)) > 0)) {
+		for (i = 0; i < count; i++) {
+			if (!note_parse_fname(entries[i].name, &parsed))
+				continue;
+
+			if (!query_heap_offer(&heap, entries[i].name, &parsed)) {
+				ret = false;
+				break;
+			}
+		}
+	}
+	err = (ret) ? fs_dirscan_error(&scan) : 0;
+	fs_dirscan_close(&scan);
+	if (err != 0)
+		ret = false;
+
+	/* Create the notes that made the cut. */
+	scratch = NULL;
+	for (i = 0; i < heap.len; i++) {
+		if (ret && !query_push(list, &scratch, path, heap.entries[i].name))
+			ret = false;
+		free(heap.entries[i].name);
+	}
+	notelist_sort(list);
+
+	if (scratch)
+		free(scratch);
+	free(heap.entries);
+
+	if (err != 0)
+		errno = err;
+	return ret;
+}
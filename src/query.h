@@ -0,0 +1,29 @@
+/**
+ * query.h
+ * Date-range and recency queries over the notes of a workspace.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _QUERY_H
+#define _QUERY_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "notelist.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Querying. */
+bool query_range(const char *path, time_t from, time_t to, notelist_t *list);
+bool query_recent(const char *path, size_t k, notelist_t *list);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _QUERY_H */
@@ -0,0 +1,1047 @@
+/**
+ * server.c
+ * Serves queries from a warm in-memory workspace over a Unix domain socket.
+ *
+ * The workspace is loaded once and kept up to date by watching its directory,
+ * along with its full-text index and a title trie that's only rebuilt when
+ * the notes change. Clients are served by a single thread going around an
+ * epoll event loop, so nothing is ever locked and answering a request only
+ * costs the lookup itself.
+ *
+ * Requests are single lines made of a verb, optionally followed by a tab (or a
+ * space) and its argument:
+ *
+ *   ping               Does nothing, just to check the server is alive.
+ *   list               Every note.
+ *   lookup <title>     Notes with exactly this title.
+ *   search <words>     Full-text search, best matches first.
+ *   read <file name>   Contents of a note.
+ *
+ * Every response starts with a line holding "OK" or "ERR" and the length of
+ * the payload that follows it, so clients always know how much to read.
+ * Notes are sent as tab separated values, just like the tsv output format, and
+ * errors as a message. Requests can be pipelined, and responses come back in
+ * the same order. Currently only supported on Linux.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "server.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#ifdef __linux__
+	#include <sys/epoll.h>
+#endif /* __linux__ */
+
+#include "fsutils.h"
+#include "strutils.h"
+
+/* Longest response header. ("ERR" and a 64-bit length) */
+#define SERVER_HEADER_MAX 32
+
+/* Size of the buffer used by clients to read responses. */
+#define SERVER_ASK_BUFSIZE (64 * 1024)
+
+/* Set when we've been asked to stop. */
+static volatile sig_atomic_t server_stopping = 0;
+
+/**
+ * Appends data to a buffer, making room for it if needed.
+ *
+ * @param buf  Buffer object.
+ * @param data Data to be appended.
+ * @param len  Length of the data.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+static bool server_buf_put(server_buf_t *buf, const char *data, size_t len) {
+	char *grown;
+	size_t cap;
+
+	if ((buf->len + len) > buf->cap) {
+		cap = (buf->cap == 0) ? 4096 : buf->cap * 2;
+		while (cap < (buf->len + len))
+			cap *= 2;
+
+		grown = (char *)realloc(buf->data, cap * sizeof(char));
+		if (grown == NULL)
+			return false;
+		buf->data = grown;
+		buf->cap = cap;
+	}
+
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+
+	return true;
+}
+
+/**
+ * Appends a TSV field to a buffer, escaping tabs, line breaks and backslashes
+ * the same way the tsv output format does.
+ *
+ * @param buf Buffer object.
+ * @param str String to be appended.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+static bool server_buf_tsv(server_buf_t *buf, const char *str) {
+	const char *run;
+	char esc[2];
+
+	while (*str != '\0') {
+		/* Copy everything that doesn't need escaping in one go. */
+		run = str;
+		while ((*str != '\0') && (*str != '\t') && (*str != '\n') &&
+			   (*str != '\r') && (*str != '\\')) {
+			str++;
+		}
+		if ((str > run) && !server_buf_put(buf, run, (size_t)(str - run)))
+			return false;
+		if (*str == '\0')
+			break;
+
+		/* Escape the character. */
+		esc[0] = '\\';
+		switch (*str) {
+			case '\t':
+				esc[1] = 't';
+				break;
+			case '\n':
+				esc[1] = 'n';
+				break;
+			case '\r':
+				esc[1] = 'r';
+				break;
+			default:
+				esc[1] = '\\';
+				break;
+		}
+		if (!server_buf_put(buf, esc, 2))
+			return false;
+		str++;
+	}
+
+	return true;
+}
+
+/**
+ * Appends a note to a buffer as a line of tab separated values.
+ *
+ * @param buf   Buffer object.
+ * @param score Prefix the line with this search score if it's positive.
+ * @param note  Note object.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+static bool server_buf_note(server_buf_t *buf, double score,
+							const note_t *note) {
+	char dates[NOTE_DATESTR_LEN];
+	char num[32];
+	const char *path;
+
+	if (score > 0) {
+		sprintf(num, "%.4f\t", score);
+		if (!server_buf_put(buf, num, strlen(num)))
+			return false;
+	}
+
+	note_get_datestr(note, dates);
+	path = note_get_path(note);
+
+	return server_buf_put(buf, dates, NOTE_DATESTR_LEN - 1) &&
+		server_buf_put(buf, "\t", 1) &&
+		server_buf_tsv(buf, note_get_title(note)) &&
+		server_buf_put(buf, "\t", 1) &&
+		server_buf_tsv(buf, note_get_format(note)) &&
+		server_buf_put(buf, "\t", 1) &&
+		server_buf_tsv(buf, (path != NULL) ? path : "") &&
+		server_buf_put(buf, "\n", 1);
+}
+
+/**
+ * Frees the memory held by a buffer.
+ *
+ * @param buf Buffer object.
+ */
+static void server_buf_free(server_buf_t *buf) {
+	if (buf->data)
+		free(buf->data);
+	buf->data = NULL;
+	buf->len = 0;
+	buf->cap = 0;
+}
+
+/**
+ * Builds the path to the socket of a workspace.
+ *
+ * @param path Path to the workspace directory.
+ * @param addr Socket address to be populated.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if the path is too long for a socket. (errno is ENAMETOOLONG)
+ */
+static bool server_addr(const char *path, struct sockaddr_un *addr) {
+	char *sockpath;
+	size_t len;
+
+	sockpath = NULL;
+	string_copy(&sockpath, path);
+	fs_pathcat(&sockpath, SERVER_SOCK_FNAME);
+	len = (sockpath != NULL) ? strlen(sockpath) : 0;
+
+	memset(addr, 0, sizeof(struct sockaddr_un));
+	addr->sun_family = AF_UNIX;
+	if ((len == 0) || (len >= sizeof(addr->sun_path))) {
+		if (sockpath)
+			free(sockpath);
+		errno = ENAMETOOLONG;
+		return false;
+	}
+	memcpy(addr->sun_path, sockpath, len + 1);
+	free(sockpath);
+
+	return true;
+}
+
+/**
+ * Connects to the server of a workspace.
+ *
+ * @param path Path to the workspace directory.
+ *
+ * @return Connected socket or -1 in case of an error. Check errno.
+ */
+static int server_connect(const char *path) {
+	struct sockaddr_un addr;
+	int fd;
+
+	if (!server_addr(path, &addr))
+		return -1;
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	if (connect(fd, (struct sockaddr *)&addr,
+				sizeof(struct sockaddr_un)) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+#ifdef __linux__
+/**
+ * Lets the event loop know it should stop.
+ *
+ * @param sig Signal that was caught.
+ */
+static void server_signal(int sig) {
+	server_stopping = 1;
+}
+
+/**
+ * Adds a note from the watched workspace to the sorted collection.
+ *
+ * @param note  Note object.
+ * @param index Index of the note in the watched workspace.
+ * @param ctx   Server object.
+ */
+static void server_collect(note_t *note, size_t index, void *ctx) {
+	server_t *srv;
+
+	srv = (server_t *)ctx;
+	if (!notelist_push(srv->notes, note))
+		srv->dirty = true;
+}
+
+/**
+ * Brings everything derived from the notes up to date after they've changed.
+ * The sorted collection only borrows the notes, which belong to the watcher.
+ *
+ * @param srv Server object.
+ */
+static void server_refresh(server_t *srv) {
+	/* Do we even have anything to do? */
+	if (!srv->dirty)
+		return;
+
+	/* Sort the notes again. */
+	srv->dirty = false;
+	srv->notes->len = 0;
+	watch_foreach(srv->watch, server_collect, srv);
+	notelist_sort(srv->notes);
+
+	/* The trie is built again the next time it's needed. */
+	trie_free(srv->trie);
+	srv->trie = NULL;
+
+	/* Every note is new after a rescan. */
+	if (srv->reindex) {
+		ftindex_update(srv->idx, srv->notes);
+		srv->reindex = false;
+	}
+}
+
+/**
+ * Keeps track of the changes to the workspace.
+ *
+ * @param event Type of change.
+ * @param note  Affected note or NULL for rescans.
+ * @param ctx   Server object.
+ */
+static void server_changed(watch_event_t event, const note_t *note,
+						   void *ctx) {
+	server_t *srv;
+
+	srv = (server_t *)ctx;
+	srv->dirty = true;
+	switch (event) {
+		case WATCH_ADDED:
+		case WATCH_MODIFIED:
+			ftindex_update_note(srv->idx, (note_t *)note);
+			break;
+		case WATCH_REMOVED:
+			ftindex_remove_note(srv->idx, note);
+			break;
+		default:
+			srv->reindex = true;
+			break;
+	}
+}
+
+/**
+ * Changes the events we're waiting for on a client.
+ *
+ * @param srv    Server object.
+ * @param client Client object.
+ * @param events Events to wait for.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred.
+ */
+static bool server_client_want(server_t *srv, server_client_t *client,
+							   unsigned int events) {
+	struct epoll_event ev;
+
+	if (client->events == events)
+		return true;
+
+	ev.events = events;
+	ev.data.ptr = client;
+	if (epoll_ctl(srv->epfd, EPOLL_CTL_MOD, client->fd, &ev) != 0)
+		return false;
+	client->events = events;
+
+	return true;
+}
+
+/**
+ * Disconnects a client and frees it.
+ *
+ * @param srv    Server object.
+ * @param client Client object.
+ */
+static void server_client_close(server_t *srv, server_client_t *client) {
+	/* Take it out of the list. */
+	srv->clients[client->slot] = srv->clients[--srv->nclients];
+	srv->clients[client->slot]->slot = client->slot;
+
+	/* Closing the socket also takes it out of the event loop. */
+	close(client->fd);
+	server_buf_free(&client->out);
+	free(client);
+}
+
+/**
+ * Accepts every client waiting to be connected.
+ *
+ * @param srv Server object.
+ */
+static void server_accept(server_t *srv) {
+	server_client_t **clients;
+	server_client_t *client;
+	struct epoll_event ev;
+	size_t cap;
+	int fd;
+
+	for (;;) {
+		fd = accept(srv->lfd, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+		/* Make room for it. */
+		if (srv->nclients == srv->clients_cap) {
+			cap = (srv->clients_cap == 0) ? 64 : srv->clients_cap * 2;
+			clients = (server_client_t **)realloc(srv->clients,
+				cap * sizeof(server_client_t *));
+			if (clients == NULL) {
+				close(fd);
+				continue;
+			}
+			srv->clients = clients;
+			srv->clients_cap = cap;
+		}
+		client = (server_client_t *)calloc(1, sizeof(server_client_t));
+		if (client == NULL) {
+			close(fd);
+			continue;
+		}
+		client->fd = fd;
+		client->events = EPOLLIN;
+
+		/* Start listening to it. */
+		ev.events = client->events;
+		ev.data.ptr = client;
+		if (epoll_ctl(srv->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+			close(fd);
+			free(client);
+			continue;
+		}
+		client->slot = srv->nclients;
+		srv->clients[srv->nclients++] = client;
+	}
+}
+
+/**
+ * Queues up a response to a client.
+ *
+ * @param client Client object.
+ * @param ok     Was the request successful?
+ * @param data   Payload of the response.
+ * @param len    Length of the payload.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+static bool server_reply(server_client_t *client, bool ok, const char *data,
+						 size_t len) {
+	char header[SERVER_HEADER_MAX];
+
+	sprintf(header, "%s %lu\n", (ok) ? "OK" : "ERR", (unsigned long)len);
+
+	return server_buf_put(&client->out, header, strlen(header)) &&
+		server_buf_put(&client->out, data, len);
+}
+
+/**
+ * Queues up an error response to a client.
+ *
+ * @param client Client object.
+ * @param msg    Error message.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+static bool server_reply_error(server_client_t *client, const char *msg) {
+	return server_reply(client, false, msg, strlen(msg));
+}
+
+/**
+ * Answers a single request.
+ *
+ * @param srv     Server object.
+ * @param client  Client object.
+ * @param request Request line without its line feed. (Modified in place)
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+static bool server_answer(server_t *srv, server_client_t *client,
+						  char *request) {
+	server_buf_t *resp;
+	ftindex_hit_t *hits;
+	uint32_t *ids;
+	note_t *note;
+	const char *chunk;
+	char *arg;
+	size_t count;
+	size_t len;
+	size_t i;
+	bool ok;
+	int err;
+
+	/* Split the verb from its argument. */
+	arg = request + strcspn(request, "\t ");
+	if (*arg != '\0')
+		*arg++ = '\0';
+	len = strlen(request);
+	if ((len > 0) && (request[len - 1] == '\r'))
+		request[len - 1] = '\0';
+	len = strlen(arg);
+	if ((len > 0) && (arg[len - 1] == '\r'))
+		arg[len - 1] = '\0';
+
+	/* Make sure we're looking at the latest state of the workspace. */
+	server_refresh(srv);
+	resp = &srv->resp;
+	resp->len = 0;
+	ok = true;
+
+	if (strcmp(request, "ping") == 0) {
+		/* Nothing to do. */
+	} else if (strcmp(request, "list") == 0) {
+		for (i = 0; ok && (i < notelist_len(srv->notes)); i++)
+			ok = server_buf_note(resp, 0, notelist_get(srv->notes, i));
+	} else if (strcmp(request, "lookup") == 0) {
+		if (srv->trie == NULL)
+			srv->trie = trie_new(srv->notes, srv->icase);
+		if (srv->trie == NULL)
+			return false;
+
+		count = trie_exact(srv->trie, arg, &ids);
+		for (i = 0; ok && (i < count); i++) {
+			ok = server_buf_note(resp, 0, notelist_get(srv->notes,
+													   (size_t)ids[i]));
+		}
+		if (ids)
+			free(ids);
+	} else if (strcmp(request, "search") == 0) {
+		count = ftindex_search(srv->idx, arg, &hits);
+		for (i = 0; ok && (i < count); i++)
+			ok = server_buf_note(resp, hits[i].score, hits[i].note);
+		if (hits)
+			free(hits);
+	} else if (strcmp(request, "read") == 0) {
+		note = (*arg != '\0') ? watch_find(srv->watch, arg) : NULL;
+		if (note == NULL)
+			return server_reply_error(client, "No such note.");
+		if (!note_reader_open(&srv->reader, note))
+			return server_reply_error(client, strerror(errno));
+
+		while (ok && ((len = note_reader_chunk(&srv->reader, &chunk)) > 0))
+			ok = server_buf_put(resp, chunk, len);
+		err = srv->reader.err;
+		note_reader_close(&srv->reader);
+		if (err != 0)
+			return server_reply_error(client, strerror(err));
+	} else {
+		return server_reply_error(client, "Unknown request.");
+	}
+
+	return ok && server_reply(client, true, resp->data, resp->len);
+}
+
+/**
+ * Sends as much of the pending responses to a client as it'll take.
+ *
+ * @param client Client object.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if the client went away.
+ */
+static bool server_client_flush(server_client_t *client) {
+	ssize_t n;
+
+	while (client->out_pos < client->out.len) {
+		n = send(client->fd, client->out.data + client->out_pos,
+				 client->out.len - client->out_pos, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return (errno == EAGAIN) || (errno == EWOULDBLOCK);
+		}
+		client->out_pos += (size_t)n;
+	}
+
+	/* Start from scratch, but hold on to the memory. */
+	client->out.len = 0;
+	client->out_pos = 0;
+
+	return true;
+}
+
+/**
+ * Reads whatever a client has sent us, up to the size of its buffer.
+ *
+ * @param client Client object.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred.
+ */
+static bool server_client_read(server_client_t *client) {
+	ssize_t n;
+
+	while (!client->eof && (client->in_len < SERVER_REQUEST_MAX)) {
+		n = recv(client->fd, client->in + client->in_len,
+				 SERVER_REQUEST_MAX - client->in_len, 0);
+		if (n > 0) {
+			client->in_len += (size_t)n;
+		} else if (n == 0) {
+			client->eof = true;
+		} else if (errno != EINTR) {
+			return (errno == EAGAIN) || (errno == EWOULDBLOCK);
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Answers the requests a client has sent us, one at a time, only taking the
+ * next one once the previous response has been sent, so that clients that
+ * don't read can't make us buffer forever.
+ *
+ * @param srv    Server object.
+ * @param client Client object.
+ *
+ * @return TRUE if the client should be kept around.
+ *         FALSE if it should be disconnected.
+ */
+static bool server_client_work(server_t *srv, server_client_t *client) {
+	char *nl;
+	size_t n;
+
+	for (;;) {
+		/* Wait until the client takes what we've got for it. */
+		if (!server_client_flush(client))
+			return false;
+		if (client->out.len > 0)
+			return server_client_want(srv, client, EPOLLOUT);
+
+		/* Answer the next request if it's all here. */
+		nl = (char *)memchr(client->in, '\n', client->in_len);
+		if (nl == NULL) {
+			if (client->in_len < SERVER_REQUEST_MAX)
+				break;
+
+			/* Nobody sends requests this long. */
+			client->in_len = 0;
+			client->eof = true;
+			if (!server_reply_error(client, "Request too long."))
+				return false;
+			continue;
+		}
+
+		*nl = '\0';
+		if (!server_answer(srv, client, client->in))
+			return false;
+		n = (size_t)(nl + 1 - client->in);
+		memmove(client->in, nl + 1, client->in_len - n);
+		client->in_len -= n;
+	}
+
+	/* Wait for more requests unless the client has hung up. */
+	if (client->eof)
+		return false;
+
+	return server_client_want(srv, client, EPOLLIN);
+}
+#endif /* __linux__ */
+
+/**
+ * Loads a workspace, starts watching it for changes and listens for clients
+ * on a socket inside of it. Fails if another server is already listening
+ * there, while stale sockets left behind are replaced.
+ * @warning The object allocated by this function must be free'd after use.
+ *
+ * @param path  Path to the workspace directory.
+ * @param opts  Loading options or NULL to use the defaults.
+ * @param icase Should title lookups ignore ASCII case?
+ *
+ * @return Server object or NULL in case of an error. Check errno.
+ *
+ * @see server_run
+ * @see server_free
+ */
+server_t* server_new(const char *path, const loader_opts_t *opts, bool icase) {
+#ifdef __linux__
+	struct sockaddr_un addr;
+	struct epoll_event ev;
+	server_t *srv;
+	int err;
+	int fd;
+
+	/* Allocate our object. */
+	srv = (server_t *)calloc(1, sizeof(server_t));
+	if (srv == NULL)
+		return NULL;
+	srv->lfd = -1;
+	srv->epfd = -1;
+	srv->icase = icase;
+	string_copy(&srv->path, path);
+	if (!note_reader_init(&srv->reader, 0))
+		goto fail;
+
+	/* Don't step on the toes of another server. */
+	if (!server_addr(path, &addr))
+		goto fail;
+	fd = server_connect(path);
+	if (fd >= 0) {
+		close(fd);
+		errno = EADDRINUSE;
+		goto fail;
+	}
+
+	/* Load the workspace and everything derived from it. */
+	srv->watch = watch_new(path, opts);
+	if (srv->watch == NULL)
+		goto fail;
+	srv->notes = notelist_new();
+	srv->idx = ftindex_open(path);
+	if ((srv->notes == NULL) || (srv->idx == NULL)) {
+		errno = ENOMEM;
+		goto fail;
+	}
+	srv->dirty = true;
+	srv->reindex = true;
+	server_refresh(srv);
+	ftindex_save(srv->idx, path);
+
+	/* Listen for clients, replacing any stale socket. */
+	unlink(addr.sun_path);
+	srv->lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (srv->lfd < 0)
+		goto fail;
+	if (bind(srv->lfd, (struct sockaddr *)&addr,
+			 sizeof(struct sockaddr_un)) != 0) {
+		goto fail;
+	}
+	string_copy(&srv->sockpath, addr.sun_path);
+	if (listen(srv->lfd, SOMAXCONN) != 0)
+		goto fail;
+
+	/* Set up the event loop. */
+	srv->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (srv->epfd < 0)
+		goto fail;
+	ev.events = EPOLLIN;
+	ev.data.ptr = &srv->lfd;
+	if (epoll_ctl(srv->epfd, EPOLL_CTL_ADD, srv->lfd, &ev) != 0)
+		goto fail;
+	ev.events = EPOLLIN;
+	ev.data.ptr = srv->watch;
+	if (epoll_ctl(srv->epfd, EPOLL_CTL_ADD, watch_fd(srv->watch), &ev) != 0)
+		goto fail;
+
+	return srv;
+
+fail:
+	err = errno;
+	server_free(srv);
+	errno = err;
+	return NULL;
+#else
+	errno = ENOSYS;
+	return NULL;
+#endif /* __linux__ */
+}
+
+/**
+ * Disconnects every client, removes the socket, saves the full-text index and
+ * frees up the server.
+ *
+ * @param srv Server object to be free'd.
+ */
+void server_free(server_t *srv) {
+	/* Do we even have anything to do? */
+	if (srv == NULL)
+		return;
+
+#ifdef __linux__
+	/* Disconnect everyone. */
+	while (srv->nclients > 0)
+		server_client_close(srv, srv->clients[0]);
+#endif /* __linux__ */
+	if (srv->clients)
+		free(srv->clients);
+
+	/* Stop listening. */
+	if (srv->epfd >= 0)
+		close(srv->epfd);
+	if (srv->lfd >= 0)
+		close(srv->lfd);
+	if (srv->sockpath) {
+		unlink(srv->sockpath);
+		free(srv->sockpath);
+	}
+
+	/* Free the workspace. The sorted collection only borrows its notes. */
+	if (srv->idx) {
+		ftindex_save(srv->idx, srv->path);
+		ftindex_free(srv->idx);
+	}
+	trie_free(srv->trie);
+	if (srv->notes) {
+		srv->notes->len = 0;
+		notelist_free(srv->notes);
+	}
+	watch_free(srv->watch);
+
+	note_reader_release(&srv->reader);
+	server_buf_free(&srv->resp);
+	if (srv->path)
+		free(srv->path);
+	free(srv);
+}
+
+/**
+ * Serves clients and keeps the workspace up to date until we're interrupted
+ * or the workspace goes away.
+ *
+ * @param srv Server object.
+ *
+ * @return TRUE if we stopped because we were asked to.
+ *         FALSE if an error occurred. Check errno.
+ */
+bool server_run(server_t *srv) {
+#ifdef __linux__
+	struct epoll_event events[SERVER_MAX_EVENTS];
+	struct sigaction sa;
+	struct sigaction old_int;
+	struct sigaction old_term;
+	server_client_t *client;
+	bool ret;
+	int err;
+	int n;
+	int i;
+
+	/* Stop gracefully when interrupted. */
+	memset(&sa, 0, sizeof(struct sigaction));
+	sa.sa_handler = server_signal;
+	sigemptyset(&sa.sa_mask);
+	server_stopping = 0;
+	sigaction(SIGINT, &sa, &old_int);
+	sigaction(SIGTERM, &sa, &old_term);
+
+	ret = true;
+	err = 0;
+	while (!server_stopping) {
+		n = epoll_wait(srv->epfd, events, SERVER_MAX_EVENTS, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = false;
+			err = errno;
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			/* New clients. */
+			if (events[i].data.ptr == &srv->lfd) {
+				server_accept(srv);
+				continue;
+			}
+
+			/* Changes to the workspace. */
+			if (events[i].data.ptr == srv->watch) {
+				if (watch_poll(srv->watch, 0, server_changed, srv) < 0) {
+					ret = false;
+					err = errno;
+					server_stopping = 1;
+					break;
+				}
+				continue;
+			}
+
+			/* Requests and clients ready for more of their responses. */
+			client = (server_client_t *)events[i].data.ptr;
+			if ((events[i].events & EPOLLERR) ||
+					((events[i].events & (EPOLLIN | EPOLLHUP)) &&
+					 !server_client_read(client)) ||
+					!server_client_work(srv, client)) {
+				server_client_close(srv, client);
+			}
+		}
+	}
+
+	/* Put things back the way they were. */
+	sigaction(SIGINT, &old_int, NULL);
+	sigaction(SIGTERM, &old_term, NULL);
+
+	if (!ret)
+		errno = err;
+	return ret;
+#else
+	errno = ENOSYS;
+	return false;
+#endif /* __linux__ */
+}
+
+/**
+ * Gets the number of notes being served.
+ *
+ * @param srv Server object.
+ *
+ * @return Number of notes in the workspace.
+ */
+size_t server_count(const server_t *srv) {
+	return watch_count(srv->watch);
+}
+
+/**
+ * Gets the path to the socket the server is listening on.
+ *
+ * @param srv Server object.
+ *
+ * @return Path to the socket.
+ */
+const char* server_sockpath(const server_t *srv) {
+	return srv->sockpath;
+}
+
+/**
+ * Writes everything in a buffer to a file descriptor.
+ *
+ * @param fd   File descriptor.
+ * @param data Data to be written.
+ * @param len  Length of the data.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ */
+static bool server_write_all(int fd, const char *data, size_t len) {
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, data, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		data += n;
+		len -= (size_t)n;
+	}
+
+	return true;
+}
+
+/**
+ * Sends a single request to the server of a workspace and copies the payload
+ * of its response over as it arrives.
+ *
+ * @param path  Path to the workspace directory.
+ * @param verb  Request verb. (ping, list, lookup, search or read)
+ * @param arg   Argument of the request or NULL if it doesn't take one.
+ * @param outfd Where the payload of successful responses should go.
+ * @param errfd Where error messages should go.
+ *
+ * @return 0 if the request was successful, 1 if the server answered with an
+ *         error or -1 if we couldn't talk to it. Check errno.
+ */
+int server_ask(const char *path, const char *verb, const char *arg, int outfd,
+			   int errfd) {
+	char buf[SERVER_ASK_BUFSIZE];
+	struct iovec iov[4];
+	struct msghdr msg;
+	unsigned long len;
+	size_t have;
+	size_t left;
+	char *nl;
+	ssize_t n;
+	bool ok;
+	int fd;
+
+	/* Requests must fit in a single line. */
+	if ((strchr(verb, '\n') != NULL) ||
+			((arg != NULL) && (strchr(arg, '\n') != NULL)) ||
+			((strlen(verb) + ((arg != NULL) ? strlen(arg) : 0) + 2) >
+			 SERVER_REQUEST_MAX)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	fd = server_connect(path);
+	if (fd < 0)
+		return -1;
+
+	/* Send the request. */
+	memset(&msg, 0, sizeof(struct msghdr));
+	iov[0].iov_base = (void *)verb;
+	iov[0].iov_len = strlen(verb);
+	iov[1].iov_base = (void *)"\t";
+	iov[1].iov_len = (arg != NULL) ? 1 : 0;
+	iov[2].iov_base = (void *)((arg != NULL) ? arg : "");
+	iov[2].iov_len = (arg != NULL) ? strlen(arg) : 0;
+	iov[3].iov_base = (void *)"\n";
+	iov[3].iov_len = 1;
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 4;
+	if (sendmsg(fd, &msg, MSG_NOSIGNAL) < 0)
+		goto fail;
+
+	/* Read the header. */
+	have = 0;
+	nl = NULL;
+	while (nl == NULL) {
+		n = recv(fd, buf + have, sizeof(buf) - have, 0);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			goto fail;
+		}
+		if (n == 0) {
+			errno = ECONNRESET;
+			goto fail;
+		}
+		have += (size_t)n;
+		nl = (char *)memchr(buf, '\n', have);
+		if ((nl == NULL) && (have >= SERVER_HEADER_MAX)) {
+			errno = EPROTO;
+			goto fail;
+		}
+	}
+	*nl = '\0';
+	if (strncmp(buf, "OK ", 3) == 0) {
+		ok = true;
+		len = strtoul(buf + 3, NULL, 10);
+	} else if (strncmp(buf, "ERR ", 4) == 0) {
+		ok = false;
+		len = strtoul(buf + 4, NULL, 10);
+	} else {
+		errno = EPROTO;
+		goto fail;
+	}
+
+	/* Copy the payload over as it comes. */
+	have -= (size_t)(nl + 1 - buf);
+	memmove(buf, nl + 1, have);
+	left = (size_t)len;
+	for (;;) {
+		if (have > left)
+			have = left;
+		if ((have > 0) && !server_write_all((ok) ? outfd : errfd, buf, have))
+			goto fail;
+		left -= have;
+		if (left == 0)
+			break;
+
+		do {
+			n = recv(fd, buf, sizeof(buf), 0);
+		} while ((n < 0) && (errno == EINTR));
+		if (n <= 0) {
+			if (n == 0)
+				errno = ECONNRESET;
+			goto fail;
+		}
+		have = (size_t)n;
+	}
+	if (!ok)
+		server_write_all(errfd, "\n", 1);
+
+	close(fd);
+	return (ok) ? 0 : 1;
+
+fail:
+	n = errno;
+	close(fd);
+	errno = (int)n;
+	return -1;
+}
@@ -0,0 +1,105 @@
+/**
+ * server.h
+ * Serves queries from a warm in-memory workspace over a Unix domain socket.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _SERVER_H
+#define _SERVER_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "ftindex.h"
+#include "loader.h"
+#include "note.h"
+#include "notelist.h"
+#include "trie.h"
+#include "watch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Name of the socket inside the workspace directory. */
+#define SERVER_SOCK_FNAME ".notein.sock"
+
+/* Longest request line a client can send. */
+#ifndef SERVER_REQUEST_MAX
+	#define SERVER_REQUEST_MAX 4096
+#endif /* SERVER_REQUEST_MAX */
+
+/* Maximum number of events handled per trip around the event loop. */
+#ifndef SERVER_MAX_EVENTS
+	#define SERVER_MAX_EVENTS 64
+#endif /* SERVER_MAX_EVENTS */
+
+/**
+ * Growable byte buffer used to build responses.
+ */
+typedef struct {
+	char *data;
+	size_t len;
+	size_t cap;
+} server_buf_t;
+
+/**
+ * Connected client.
+ */
+typedef struct {
+	int fd;
+	unsigned int events;
+	size_t slot;
+	bool eof;
+
+	char in[SERVER_REQUEST_MAX];
+	size_t in_len;
+
+	server_buf_t out;
+	size_t out_pos;
+} server_client_t;
+
+/**
+ * Server object.
+ */
+typedef struct {
+	char *path;
+	char *sockpath;
+	int lfd;
+	int epfd;
+	bool icase;
+
+	watch_t *watch;
+	notelist_t *notes;
+	trie_t *trie;
+	ftindex_t *idx;
+	bool dirty;
+	bool reindex;
+
+	server_client_t **clients;
+	size_t nclients;
+	size_t clients_cap;
+
+	server_buf_t resp;
+	note_reader_t reader;
+} server_t;
+
+/* Construction and destruction. */
+server_t* server_new(const char *path, const loader_opts_t *opts, bool icase);
+void server_free(server_t *srv);
+
+/* Serving. */
+bool server_run(server_t *srv);
+size_t server_count(const server_t *srv);
+const char* server_sockpath(const server_t *srv);
+
+/* Client. */
+int server_ask(const char *path, const char *verb, const char *arg, int outfd,
+			   int errfd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SERVER_H */
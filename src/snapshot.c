@@ -0,0 +1,518 @@
+/**
+ * snapshot.c
+ * Immutable versions of a note collection that can be read without locking.
+ *
+ * Updaters build a whole new version of the collection off to the side and
+ * swap it in with a single pointer store, so readers never wait on a lock or
+ * see a note while it's being changed. Notes that are no longer in the
+ * collection are retired instead of free'd, and only go away along with the
+ * last snapshot that could still be referencing them.
+ *
+ * Every reader thread registers a slot of its own, on a cache line of its own,
+ * and announces the snapshot it's about to use there before checking that it's
+ * still the latest one. Getting hold of a snapshot only ever writes to the
+ * reader's own slot, so readers never fight over shared counters. Replaced
+ * snapshots are queued up from oldest to newest, and after every update the
+ * ones at the front that no reader has announced are free'd.
+ *
+ * @warning Notes in a snapshot must be treated as read-only. Loading their
+ *          contents or opening their files changes them.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "snapshot.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * qsort comparison wrapper for note pointers.
+ *
+ * @param a Pointer to a note pointer.
+ * @param b Pointer to another note pointer.
+ *
+ * @return Same as note_cmp.
+ */
+static int snapshot_cmp(const void *a, const void *b) {
+	return note_cmp(*(const note_t **)a, *(const note_t **)b);
+}
+
+/**
+ * qsort and bsearch comparison function for note addresses.
+ *
+ * @param a Pointer to a note pointer.
+ * @param b Pointer to another note pointer.
+ *
+ * @return Negative, zero or positive as the first address is lower, equal or
+ *         higher than the second.
+ */
+static int snapshot_addrcmp(const void *a, const void *b) {
+	uintptr_t pa;
+	uintptr_t pb;
+
+	pa = (uintptr_t)*(note_t * const *)a;
+	pb = (uintptr_t)*(note_t * const *)b;
+	return (pa > pb) - (pa < pb);
+}
+
+/**
+ * Checks if a note is among the ones sorted by snapshot_addrcmp.
+ *
+ * @param notes Notes sorted by their addresses.
+ * @param len   Number of notes.
+ * @param note  Note to look for.
+ *
+ * @return TRUE if the note is in there.
+ */
+static bool snapshot_has(note_t **notes, size_t len, const note_t *note) {
+	if (len == 0)
+		return false;
+
+	return bsearch(&note, notes, len, sizeof(note_t *),
+				   snapshot_addrcmp) != NULL;
+}
+
+/**
+ * Allocates a snapshot with a copy of a note collection, sorted.
+ *
+ * @param notes Notes in the collection.
+ * @param len   Number of notes.
+ *
+ * @return Snapshot object or NULL if we couldn't allocate enough memory.
+ */
+static snapshot_t* snapshot_new(note_t **notes, size_t len) {
+	snapshot_t *snap;
+
+	/* Allocate enough memory for our object. */
+	snap = (snapshot_t *)calloc(1, sizeof(snapshot_t));
+	if (snap == NULL)
+		return NULL;
+
+	/* Copy the notes over and put them in order. */
+	if (len > 0) {
+		snap->notes = (note_t **)malloc(len * sizeof(note_t *));
+		if (snap->notes == NULL) {
+			free(snap);
+			return NULL;
+		}
+		memcpy(snap->notes, notes, len * sizeof(note_t *));
+		if (len > 1)
+			qsort(snap->notes, len, sizeof(note_t *), snapshot_cmp);
+	}
+	snap->len = len;
+
+	return snap;
+}
+
+/**
+ * Frees up a snapshot along with the notes retired when it was replaced.
+ *
+ * @param snap Snapshot to be free'd.
+ */
+static void snapshot_destroy(snapshot_t *snap) {
+	size_t i;
+
+	for (i = 0; i < snap->nretired; i++)
+		note_free(snap->retired[i]);
+	if (snap->retired)
+		free(snap->retired);
+	if (snap->notes)
+		free(snap->notes);
+	free(snap);
+}
+
+/**
+ * Frees the replaced snapshots, oldest first, until one that a reader may
+ * still be using. Notes retired along with a snapshot can still be in any
+ * older one, so they must never go away before those.
+ * @warning The store's lock must be held.
+ *
+ * @param store Store to be cleaned up.
+ */
+static void snapshot_collect(snapshot_store_t *store) {
+	snapshot_t *snap;
+	size_t i;
+
+	while ((snap = store->oldest) != NULL) {
+		for (i = 0; i < store->nreaders; i++) {
+			if (__atomic_load_n(&store->readers[i].hazard,
+								__ATOMIC_SEQ_CST) == snap) {
+				return;
+			}
+		}
+
+		store->oldest = snap->next;
+		if (store->oldest == NULL)
+			store->newest = NULL;
+		snapshot_destroy(snap);
+	}
+}
+
+/**
+ * Allocates a brand new store with an empty snapshot published in it.
+ * @warning The object allocated by this function must be free'd after use.
+ *
+ * @return Brand new store or NULL in case of an error. Check errno.
+ *
+ * @see snapshot_store_free
+ */
+snapshot_store_t* snapshot_store_new(void) {
+	snapshot_store_t *store;
+
+	/* Allocate enough memory for our object. */
+	store = (snapshot_store_t *)calloc(1, sizeof(snapshot_store_t));
+	if (store == NULL)
+		return NULL;
+
+	/* Readers always get something, even before anything is published. */
+	store->current = snapshot_new(NULL, 0);
+	if (store->current == NULL) {
+		free(store);
+		errno = ENOMEM;
+		return NULL;
+	}
+	if ((errno = pthread_mutex_init(&store->lock, NULL)) != 0) {
+		snapshot_destroy(store->current);
+		free(store);
+		return NULL;
+	}
+
+	return store;
+}
+
+/**
+ * Frees up a store along with the notes retired to it.
+ * @warning Every reader registered with the store must have been free'd.
+ *
+ * @param store Store to be free'd.
+ */
+void snapshot_store_free(snapshot_store_t *store) {
+	snapshot_t *snap;
+	size_t i;
+
+	/* Do we even have anything to do? */
+	if (store == NULL)
+		return;
+
+	/* Get rid of the snapshots and the notes retired since the last one. */
+	while ((snap = store->oldest) != NULL) {
+		store->oldest = snap->next;
+		snapshot_destroy(snap);
+	}
+	snapshot_destroy(store->current);
+	for (i = 0; i < store->nretired; i++)
+		note_free(store->retired[i]);
+	if (store->retired)
+		free(store->retired);
+
+	pthread_mutex_destroy(&store->lock);
+	free(store);
+}
+
+/**
+ * Swaps a new snapshot in and frees the old ones nobody is using anymore.
+ * @warning The store's lock must be held.
+ *
+ * @param store Store to publish the snapshot to.
+ * @param snap  Snapshot to be published.
+ */
+static void snapshot_swap(snapshot_store_t *store, snapshot_t *snap) {
+	snapshot_t *old;
+
+	old = store->current;
+	snap->version = ++store->version;
+
+	/* Notes retired since the last version may still be referenced by it or
+	 * any older one, so they go away along with it. */
+	old->retired = store->retired;
+	old->nretired = store->nretired;
+	store->retired = NULL;
+	store->nretired = 0;
+	store->retired_cap = 0;
+
+	/* Swap it in and queue the old one up behind the ones still in use. */
+	__atomic_store_n(&store->current, snap, __ATOMIC_SEQ_CST);
+	if (store->newest != NULL) {
+		store->newest->next = old;
+	} else {
+		store->oldest = old;
+	}
+	store->newest = old;
+
+	snapshot_collect(store);
+}
+
+/**
+ * Publishes a whole new version of the collection. The notes are only borrowed
+ * and must stay put until they're retired.
+ *
+ * @param store Store to publish the snapshot to.
+ * @param notes Notes in the new version of the collection, in any order.
+ * @param len   Number of notes.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ *
+ * @see snapshot_update
+ * @see snapshot_retire
+ */
+bool snapshot_publish(snapshot_store_t *store, note_t **notes, size_t len) {
+	snapshot_t *snap;
+
+	/* Build the new version off to the side. */
+	snap = snapshot_new(notes, len);
+	if (snap == NULL) {
+		errno = ENOMEM;
+		return false;
+	}
+
+	pthread_mutex_lock(&store->lock);
+	snapshot_swap(store, snap);
+	pthread_mutex_unlock(&store->lock);
+
+	return true;
+}
+
+/**
+ * Publishes a new version of the collection made up of the latest one without
+ * the notes retired since then, plus the ones that have been added. Only the
+ * changes get sorted, which is a lot cheaper than publishing everything again
+ * when a few notes change in a big collection.
+ *
+ * @param store  Store to publish the snapshot to.
+ * @param added  Notes that weren't in the latest version, in any order. The
+ *               ones that have already been retired are left out.
+ * @param nadded Number of added notes.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ *
+ * @see snapshot_publish
+ * @see snapshot_retire
+ */
+bool snapshot_update(snapshot_store_t *store, note_t **added, size_t nadded) {
+	const snapshot_t *cur;
+	snapshot_t *snap;
+	size_t i;
+	size_t j;
+
+	pthread_mutex_lock(&store->lock);
+	cur = store->current;
+	qsort(store->retired, store->nretired, sizeof(note_t *),
+		  snapshot_addrcmp);
+
+	/* Sort the notes that are actually new. */
+	snap = snapshot_new(added, nadded);
+	if ((snap == NULL) || ((snap->len + cur->len) == 0))
+		goto done;
+	for (i = 0, j = 0; i < snap->len; i++) {
+		if (!snapshot_has(store->retired, store->nretired, snap->notes[i]))
+			snap->notes[j++] = snap->notes[i];
+	}
+	snap->len = j;
+	added = snap->notes;
+	nadded = snap->len;
+	snap->notes = (note_t **)malloc((cur->len + nadded) * sizeof(note_t *));
+	if (snap->notes == NULL) {
+		snap->notes = added;
+		snapshot_destroy(snap);
+		snap = NULL;
+		goto done;
+	}
+
+	/* Merge them with the ones that are still around. */
+	snap->len = 0;
+	for (i = 0, j = 0; (i < cur->len) || (j < nadded); ) {
+		if ((i < cur->len) &&
+				snapshot_has(store->retired, store->nretired, cur->notes[i])) {
+			i++;
+		} else if ((j == nadded) || ((i < cur->len) &&
+				(note_cmp(cur->notes[i], added[j]) <= 0))) {
+			snap->notes[snap->len++] = cur->notes[i++];
+		} else {
+			snap->notes[snap->len++] = added[j++];
+		}
+	}
+	if (added)
+		free(added);
+
+done:
+	if (snap == NULL) {
+		pthread_mutex_unlock(&store->lock);
+		errno = ENOMEM;
+		return false;
+	}
+	snapshot_swap(store, snap);
+	pthread_mutex_unlock(&store->lock);
+
+	return true;
+}
+
+/**
+ * Hands over a note that's no longer in the collection to the store, which
+ * frees it once no snapshot can reference it anymore.
+ *
+ * @param store Store that takes ownership of the note.
+ * @param note  Note that won't be part of the next version.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+bool snapshot_retire(snapshot_store_t *store, note_t *note) {
+	note_t **retired;
+	size_t cap;
+	bool ret;
+
+	pthread_mutex_lock(&store->lock);
+	ret = true;
+	if (store->nretired == store->retired_cap) {
+		cap = (store->retired_cap == 0) ? 16 : store->retired_cap * 2;
+		retired = (note_t **)realloc(store->retired, cap * sizeof(note_t *));
+		if (retired == NULL) {
+			errno = ENOMEM;
+			ret = false;
+		} else {
+			store->retired = retired;
+			store->retired_cap = cap;
+		}
+	}
+	if (ret)
+		store->retired[store->nretired++] = note;
+	pthread_mutex_unlock(&store->lock);
+
+	return ret;
+}
+
+/**
+ * Registers a reader with a store. Each reader thread needs one of its own.
+ * @warning The reader must be free'd after use.
+ *
+ * @param store Store to read snapshots from.
+ *
+ * @return Reader object or NULL if there are already SNAPSHOT_MAX_READERS
+ *         registered. (errno is EAGAIN)
+ *
+ * @see snapshot_reader_free
+ */
+snapshot_reader_t* snapshot_reader_new(snapshot_store_t *store) {
+	snapshot_reader_t *rd;
+	size_t i;
+
+	/* Take the first free slot. */
+	rd = NULL;
+	pthread_mutex_lock(&store->lock);
+	for (i = 0; i < SNAPSHOT_MAX_READERS; i++) {
+		if (!store->readers[i].used) {
+			rd = &store->readers[i];
+			rd->used = true;
+			rd->store = store;
+			rd->hazard = NULL;
+			if (i >= store->nreaders)
+				store->nreaders = i + 1;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&store->lock);
+
+	if (rd == NULL)
+		errno = EAGAIN;
+	return rd;
+}
+
+/**
+ * Unregisters a reader, releasing the snapshot it may be holding on to.
+ *
+ * @param rd Reader to be free'd.
+ */
+void snapshot_reader_free(snapshot_reader_t *rd) {
+	snapshot_store_t *store;
+
+	/* Do we even have anything to do? */
+	if (rd == NULL)
+		return;
+
+	store = rd->store;
+	pthread_mutex_lock(&store->lock);
+	__atomic_store_n(&rd->hazard, NULL, __ATOMIC_RELEASE);
+	rd->used = false;
+	while ((store->nreaders > 0) && !store->readers[store->nreaders - 1].used)
+		store->nreaders--;
+	pthread_mutex_unlock(&store->lock);
+}
+
+/**
+ * Gets hold of the latest version of the collection without ever blocking.
+ * A reader holds on to a single snapshot at a time, so acquiring another one
+ * releases the previous one.
+ * @warning The snapshot must be released after use.
+ *
+ * @param rd Reader getting hold of the snapshot.
+ *
+ * @return Latest snapshot published.
+ *
+ * @see snapshot_release
+ */
+snapshot_t* snapshot_acquire(snapshot_reader_t *rd) {
+	snapshot_t *snap;
+	snapshot_t *cur;
+
+	/* Announce the snapshot and make sure it wasn't replaced in the meantime,
+	 * otherwise an updater may have missed it and free'd it already. */
+	cur = __atomic_load_n(&rd->store->current, __ATOMIC_ACQUIRE);
+	do {
+		snap = cur;
+		__atomic_store_n(&rd->hazard, snap, __ATOMIC_SEQ_CST);
+		cur = __atomic_load_n(&rd->store->current, __ATOMIC_SEQ_CST);
+	} while (cur != snap);
+
+	return snap;
+}
+
+/**
+ * Lets go of the snapshot a reader is holding on to. Replaced snapshots are
+ * free'd by the next update that finds nobody using them.
+ *
+ * @param rd Reader that's done with its snapshot.
+ */
+void snapshot_release(snapshot_reader_t *rd) {
+	__atomic_store_n(&rd->hazard, NULL, __ATOMIC_RELEASE);
+}
+
+/**
+ * Gets the number of notes in a snapshot.
+ *
+ * @param snap Snapshot object.
+ *
+ * @return Number of notes.
+ */
+size_t snapshot_len(const snapshot_t *snap) {
+	return snap->len;
+}
+
+/**
+ * Gets a note from a snapshot.
+ *
+ * @param snap  Snapshot object.
+ * @param index Index of the note, in date, title and format order.
+ *
+ * @return Note object or NULL if the index is out of bounds.
+ */
+note_t* snapshot_get(const snapshot_t *snap, size_t index) {
+	if (index >= snap->len)
+		return NULL;
+
+	return snap->notes[index];
+}
+
+/**
+ * Gets the version of a snapshot, which goes up every time one is published.
+ *
+ * @param snap Snapshot object.
+ *
+ * @return Version of the snapshot.
+ */
+uint64_t snapshot_version(const snapshot_t *snap) {
+	return snap->version;
+}
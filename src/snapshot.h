@@ -0,0 +1,103 @@
+/**
+ * snapshot.h
+ * Immutable versions of a note collection that can be read without locking.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "note.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Maximum number of readers registered with a store at the same time. */
+#ifndef SNAPSHOT_MAX_READERS
+	#define SNAPSHOT_MAX_READERS 64
+#endif /* SNAPSHOT_MAX_READERS */
+
+/* Room taken by each reader, so that no two of them share a cache line. */
+#ifndef SNAPSHOT_READER_SIZE
+	#define SNAPSHOT_READER_SIZE 128
+#endif /* SNAPSHOT_READER_SIZE */
+
+struct snapshot_store_s;
+
+/**
+ * Immutable version of a note collection, sorted by date, title and format.
+ */
+typedef struct snapshot_s {
+	note_t **notes;
+	size_t len;
+	uint64_t version;
+
+	struct snapshot_s *next;
+
+	note_t **retired;
+	size_t nretired;
+} snapshot_t;
+
+/**
+ * Slot owned by a single reader thread, announcing the snapshot it's using.
+ */
+typedef struct {
+	snapshot_t *hazard;
+	struct snapshot_store_s *store;
+	bool used;
+
+	char pad[SNAPSHOT_READER_SIZE - sizeof(snapshot_t *) -
+			 sizeof(struct snapshot_store_s *) - sizeof(bool)];
+} snapshot_reader_t;
+
+/**
+ * Place where snapshots get published to readers.
+ */
+typedef struct snapshot_store_s {
+	snapshot_reader_t readers[SNAPSHOT_MAX_READERS];
+	size_t nreaders;
+
+	snapshot_t *current;
+	snapshot_t *oldest;
+	snapshot_t *newest;
+
+	pthread_mutex_t lock;
+	uint64_t version;
+
+	note_t **retired;
+	size_t nretired;
+	size_t retired_cap;
+} snapshot_store_t;
+
+/* Construction and destruction. */
+snapshot_store_t* snapshot_store_new(void);
+void snapshot_store_free(snapshot_store_t *store);
+
+/* Readers. */
+snapshot_reader_t* snapshot_reader_new(snapshot_store_t *store);
+void snapshot_reader_free(snapshot_reader_t *rd);
+
+/* Updating. */
+bool snapshot_publish(snapshot_store_t *store, note_t **notes, size_t len);
+bool snapshot_update(snapshot_store_t *store, note_t **added, size_t nadded);
+bool snapshot_retire(snapshot_store_t *store, note_t *note);
+
+/* Reading. */
+snapshot_t* snapshot_acquire(snapshot_reader_t *rd);
+void snapshot_release(snapshot_reader_t *rd);
+size_t snapshot_len(const snapshot_t *snap);
+note_t* snapshot_get(const snapshot_t *snap, size_t index);
+uint64_t snapshot_version(const snapshot_t *snap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SNAPSHOT_H */
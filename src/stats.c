@@ -0,0 +1,204 @@
+/**
+ * stats.c
+ * Lightweight instrumentation of the hot paths of the application.
+ *
+ * Counters are shared between every thread and updated atomically. Phase
+ * timers use a monotonic clock, with the start of each phase kept per thread
+ * so that workers can time themselves independently. The time of a phase is
+ * the sum across every thread, so it may exceed the wall clock time.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "stats.h"
+
+#include <time.h>
+
+/* Names of the counters as they're reported. */
+static const char *counter_names[STATS_NCOUNTERS] = {
+	"open", "close", "stat", "getdents", "read", "mmap", "bytes_read",
+	"bytes_mapped", "dirents", "allocs", "arena_allocs", "notes_parsed",
+	"notes_rejected", "uring_enters", "uring_sqes", "uring_max_depth"
+};
+
+/* Names of the phases as they're reported. */
+static const char *phase_names[STATS_NPHASES] = {
+	"scan", "stat", "parse", "read"
+};
+
+#ifndef STATS_DISABLED
+/* Totals. */
+static uint64_t counters[STATS_NCOUNTERS];
+static uint64_t phase_ns[STATS_NPHASES];
+static uint64_t phase_calls[STATS_NPHASES];
+
+/* Start of the phases currently running in this thread. */
+static __thread uint64_t phase_start[STATS_NPHASES];
+
+/**
+ * Gets the current time of a monotonic clock.
+ *
+ * @return Time in nanoseconds.
+ */
+static uint64_t stats_clock(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+#endif /* !STATS_DISABLED */
+
+/**
+ * Adds to a counter. Use the STATS_ADD and STATS_INC macros instead so that
+ * the call compiles out in release builds.
+ *
+ * @param counter Counter to add to.
+ * @param n       Amount to add.
+ */
+void stats_add(stats_counter_t counter, uint64_t n) {
+#ifndef STATS_DISABLED
+	__sync_fetch_and_add(&counters[counter], n);
+#endif /* !STATS_DISABLED */
+}
+
+/**
+ * Raises a counter that works as a high-water mark. Use the STATS_MAX macro
+ * instead so that the call compiles out in release builds.
+ *
+ * @param counter Counter to raise.
+ * @param n       Value that the counter should be at least at.
+ */
+void stats_max(stats_counter_t counter, uint64_t n) {
+#ifndef STATS_DISABLED
+	uint64_t cur;
+
+	cur = __sync_fetch_and_add(&counters[counter], 0);
+	while (cur < n) {
+		if (__sync_bool_compare_and_swap(&counters[counter], cur, n))
+			break;
+		cur = __sync_fetch_and_add(&counters[counter], 0);
+	}
+#endif /* !STATS_DISABLED */
+}
+
+/**
+ * Marks the start of a phase in the current thread. Use the STATS_BEGIN macro
+ * instead so that the call compiles out in release builds.
+ *
+ * @param phase Phase that's starting.
+ *
+ * @see stats_end
+ */
+void stats_begin(stats_phase_t phase) {
+#ifndef STATS_DISABLED
+	phase_start[phase] = stats_clock();
+#endif /* !STATS_DISABLED */
+}
+
+/**
+ * Marks the end of a phase in the current thread, adding the time spent in it
+ * to the totals. Use the STATS_END macro instead so that the call compiles out
+ * in release builds.
+ *
+ * @param phase Phase that's ending.
+ *
+ * @see stats_begin
+ */
+void stats_end(stats_phase_t phase) {
+#ifndef STATS_DISABLED
+	__sync_fetch_and_add(&phase_ns[phase], stats_clock() - phase_start[phase]);
+	__sync_fetch_and_add(&phase_calls[phase], 1);
+#endif /* !STATS_DISABLED */
+}
+
+/**
+ * Checks if the instrumentation was compiled in.
+ *
+ * @return TRUE if statistics are being gathered.
+ */
+bool stats_enabled(void) {
+#ifndef STATS_DISABLED
+	return true;
+#else
+	return false;
+#endif /* !STATS_DISABLED */
+}
+
+/**
+ * Gets the total of a counter.
+ *
+ * @param counter Counter to get.
+ *
+ * @return Total of the counter. Always 0 in release builds.
+ */
+uint64_t stats_get(stats_counter_t counter) {
+#ifndef STATS_DISABLED
+	return __sync_fetch_and_add(&counters[counter], 0);
+#else
+	return 0;
+#endif /* !STATS_DISABLED */
+}
+
+/**
+ * Gets the total time spent in a phase across every thread.
+ *
+ * @param phase Phase to get.
+ *
+ * @return Time spent in nanoseconds. Always 0 in release builds.
+ */
+uint64_t stats_phase_ns(stats_phase_t phase) {
+#ifndef STATS_DISABLED
+	return __sync_fetch_and_add(&phase_ns[phase], 0);
+#else
+	return 0;
+#endif /* !STATS_DISABLED */
+}
+
+/**
+ * Gets the number of times a phase ran across every thread.
+ *
+ * @param phase Phase to get.
+ *
+ * @return Number of times the phase ran. Always 0 in release builds.
+ */
+uint64_t stats_phase_calls(stats_phase_t phase) {
+#ifndef STATS_DISABLED
+	return __sync_fetch_and_add(&phase_calls[phase], 0);
+#else
+	return 0;
+#endif /* !STATS_DISABLED */
+}
+
+/**
+ * Prints out the totals gathered so far.
+ *
+ * @param out Stream to print to.
+ */
+void stats_print(FILE *out) {
+	size_t i;
+
+	if (!stats_enabled()) {
+		fprintf(out, "Statistics weren't compiled into this build.\n");
+		return;
+	}
+
+	fprintf(out, "Phases:\n");
+	for (i = 0; i < STATS_NPHASES; i++) {
+		fprintf(out, "    %-16s %12.3f ms %10lu calls\n", phase_names[i],
+				(double)stats_phase_ns((stats_phase_t)i) / 1e6,
+				(unsigned long)stats_phase_calls((stats_phase_t)i));
+	}
+
+	fprintf(out, "Counters:\n");
+	for (i = 0; i < STATS_NCOUNTERS; i++) {
+		fprintf(out, "    %-16s %12lu\n", counter_names[i],
+				(unsigned long)stats_get((stats_counter_t)i));
+	}
+
+	/* Achieved io_uring queue depth. */
+	if (stats_get(STATS_URING_ENTERS) > 0) {
+		fprintf(out, "    %-16s %12.1f\n", "uring_avg_depth",
+				(double)stats_get(STATS_URING_SQES) /
+				(double)stats_get(STATS_URING_ENTERS));
+	}
+}
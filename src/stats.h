@@ -0,0 +1,87 @@
+/**
+ * stats.h
+ * Lightweight instrumentation of the hot paths of the application.
+ *
+ * Everything compiles out when STATS_DISABLED is defined, which is what the
+ * release build does.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Event counters.
+ */
+typedef enum {
+	STATS_SYS_OPEN = 0,
+	STATS_SYS_CLOSE,
+	STATS_SYS_STAT,
+	STATS_SYS_GETDENTS,
+	STATS_SYS_READ,
+	STATS_SYS_MMAP,
+	STATS_BYTES_READ,
+	STATS_BYTES_MAPPED,
+	STATS_DIRENTS,
+	STATS_ALLOCS,
+	STATS_ARENA_ALLOCS,
+	STATS_NOTES_PARSED,
+	STATS_NOTES_REJECTED,
+	STATS_URING_ENTERS,
+	STATS_URING_SQES,
+	STATS_URING_MAX_DEPTH,
+	STATS_NCOUNTERS
+} stats_counter_t;
+
+/**
+ * Timed phases.
+ */
+typedef enum {
+	STATS_PHASE_SCAN = 0,
+	STATS_PHASE_STAT,
+	STATS_PHASE_PARSE,
+	STATS_PHASE_READ,
+	STATS_NPHASES
+} stats_phase_t;
+
+#ifndef STATS_DISABLED
+	#define STATS_ADD(counter, n) stats_add((counter), (uint64_t)(n))
+	#define STATS_INC(counter)    stats_add((counter), 1)
+	#define STATS_MAX(counter, n) stats_max((counter), (uint64_t)(n))
+	#define STATS_BEGIN(phase)    stats_begin(phase)
+	#define STATS_END(phase)      stats_end(phase)
+#else
+	#define STATS_ADD(counter, n) ((void)0)
+	#define STATS_INC(counter)    ((void)0)
+	#define STATS_MAX(counter, n) ((void)0)
+	#define STATS_BEGIN(phase)    ((void)0)
+	#define STATS_END(phase)      ((void)0)
+#endif /* !STATS_DISABLED */
+
+/* Instrumentation. */
+void stats_add(stats_counter_t counter, uint64_t n);
+void stats_max(stats_counter_t counter, uint64_t n);
+void stats_begin(stats_phase_t phase);
+void stats_end(stats_phase_t phase);
+
+/* Reporting. */
+bool stats_enabled(void);
+uint64_t stats_get(stats_counter_t counter);
+uint64_t stats_phase_ns(stats_phase_t phase);
+uint64_t stats_phase_calls(stats_phase_t phase);
+void stats_print(FILE *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _STATS_H */
@@ -117,6 +117,47 @@ size_t string_copy_untilp(char **dest, const char *src, const char *p) {
 	return len;
 }
 
+/**
+ * Similar to strdup except the copy is allocated from an arena.
+ *
+ * @param arena Arena to allocate the copy from.
+ * @param src   Source string to be copied.
+ *
+ * @return Copy of the string or NULL in case of an error. (Lives as long as the
+ *         arena)
+ */
+char* string_arena_copy(arena_t *arena, const char *src) {
+	return string_arena_copy_untilp(arena, src, src + strlen(src));
+}
+
+/**
+ * Copies a string until a point inside of it (non-inclusive) into memory
+ * allocated from an arena. Always NULL terminated.
+ *
+ * @param arena Arena to allocate the copy from.
+ * @param src   Source string to be copied.
+ * @param p     Point inside of source to stop copying at. (Won't be included)
+ *
+ * @return Copy of the string or NULL in case of an error. (Lives as long as the
+ *         arena)
+ */
+char* string_arena_copy_untilp(arena_t *arena, const char *src, const char *p) {
+	char *dest;
+	size_t len;
+
+	/* Allocate space for the new string. */
+	len = p - src;
+	dest = (char *)arena_alloc(arena, (len + 1) * sizeof(char));
+	if (dest == NULL)
+		return NULL;
+
+	/* Copy the string over and ensure its NULL termination. */
+	memcpy(dest, src, len);
+	dest[len] = '\0';
+
+	return dest;
+}
+
 /**
  * Concatenates a string to another and automatically resizes the destination
  * string to fit.
@@ -152,3 +193,25 @@ size_t string_concat(char **orig, const char *append) {
 
 	return nlen;
 }
+
+/**
+ * Hashes a string using FNV-1a. Meant for hash tables, not for anything where
+ * security matters.
+ *
+ * @param str String to be hashed. Doesn't need to be NULL terminated.
+ * @param len Length of the string.
+ *
+ * @return Hash of the string.
+ */
+uint32_t string_hash(const char *str, size_t len) {
+	uint32_t hash;
+	size_t i;
+
+	hash = 2166136261UL;
+	for (i = 0; i < len; i++) {
+		hash ^= (uint8_t)str[i];
+		hash *= 16777619UL;
+	}
+
+	return hash;
+}
@@ -8,8 +8,11 @@
 #ifndef _STRUTILS_H
 #define _STRUTILS_H
 
+#include <stdint.h>
 #include <stdlib.h>
 
+#include "arena.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -19,9 +22,16 @@ size_t string_copy(char **dest, const char *src);
 size_t string_copy_until(char **dest, const char *src, char c);
 size_t string_copy_untilp(char **dest, const char *src, const char *p);
 
+/* Arena string copying. */
+char* string_arena_copy(arena_t *arena, const char *src);
+char* string_arena_copy_untilp(arena_t *arena, const char *src, const char *p);
+
 /* String concatenation. */
 size_t string_concat(char **orig, const char *append);
 
+/* Hashing. */
+uint32_t string_hash(const char *str, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
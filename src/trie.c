@@ -0,0 +1,525 @@
+/**
+ * trie.c
+ * Compressed trie over the titles of every note for quick lookups by title.
+ *
+ * The titles are sorted once and the trie is built straight out of the sorted
+ * array, so every node covers a contiguous range of it: titles that end at the
+ * node come first and the ones that go on into its children follow. Edges are
+ * labelled with whole runs of characters pointing inside the titles
+ * themselves, so the trie only costs a handful of integers per node. Prefix
+ * lookups are a walk down the trie followed by a copy of the node's range, and
+ * fuzzy lookups walk it with a row of the Levenshtein matrix per character,
+ * giving up on whole subtrees as soon as they can't get close enough.
+ *
+ * Results are indices into the note collection, which is sorted by date, so
+ * they come out sorted by date as well.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "trie.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+
+#include "note.h"
+
+/* Node index returned when we ran out of memory while building the trie. */
+#define TRIE_FAILED 0xFFFFFFFFUL
+
+/* Folds a character for comparison according to the trie's case sensitivity. */
+#define TRIE_FOLD(trie, c) \
+	((trie)->icase ? tolower((unsigned char)(c)) : (unsigned char)(c))
+
+/**
+ * Growable array of note indices.
+ */
+typedef struct {
+	uint32_t *notes;
+	size_t len;
+	size_t cap;
+	bool failed;
+} trie_results_t;
+
+/**
+ * State of a fuzzy lookup.
+ */
+typedef struct {
+	const trie_t *trie;
+	const char *query;
+	size_t len;
+	unsigned int dist;
+
+	unsigned int *rows;
+	trie_results_t *res;
+} trie_fuzzy_t;
+
+/**
+ * qsort comparison function for trie entries by title and note.
+ *
+ * @param a Trie entry.
+ * @param b Another trie entry.
+ *
+ * @return Same as strcmp on their titles, falling back to their notes.
+ */
+static int trie_entry_cmp(const void *a, const void *b) {
+	const trie_entry_t *ea = (const trie_entry_t *)a;
+	const trie_entry_t *eb = (const trie_entry_t *)b;
+	int ret;
+
+	ret = strcmp(ea->title, eb->title);
+	if (ret != 0)
+		return ret;
+
+	return (ea->note < eb->note) ? -1 : (ea->note > eb->note);
+}
+
+/**
+ * qsort comparison function for trie entries by title ignoring ASCII case and
+ * note.
+ *
+ * @param a Trie entry.
+ * @param b Another trie entry.
+ *
+ * @return Same as strcasecmp on their titles, falling back to their notes.
+ */
+static int trie_entry_casecmp(const void *a, const void *b) {
+	const trie_entry_t *ea = (const trie_entry_t *)a;
+	const trie_entry_t *eb = (const trie_entry_t *)b;
+	int ret;
+
+	ret = strcasecmp(ea->title, eb->title);
+	if (ret != 0)
+		return ret;
+
+	return (ea->note < eb->note) ? -1 : (ea->note > eb->note);
+}
+
+/**
+ * qsort comparison function for note indices.
+ *
+ * @param a Note index.
+ * @param b Another note index.
+ *
+ * @return Negative, zero or positive like strcmp.
+ */
+static int trie_note_cmp(const void *a, const void *b) {
+	uint32_t na = *(const uint32_t *)a;
+	uint32_t nb = *(const uint32_t *)b;
+
+	return (na < nb) ? -1 : (na > nb);
+}
+
+/**
+ * Builds the node covering a range of sorted entries that share their first
+ * characters, along with every node below it.
+ *
+ * @param trie  Trie object.
+ * @param lo    First entry of the range.
+ * @param hi    Entry right after the last one of the range.
+ * @param depth Number of characters shared by every entry of the range that
+ *              are already covered by the node's ancestors.
+ *
+ * @return Index of the node or TRIE_FAILED if we couldn't allocate enough
+ *         memory.
+ */
+static uint32_t trie_build(trie_t *trie, uint32_t lo, uint32_t hi,
+						   size_t depth) {
+	const trie_entry_t *first;
+	const trie_entry_t *last;
+	trie_node_t *nodes;
+	uint32_t prev;
+	uint32_t child;
+	uint32_t idx;
+	uint32_t i;
+	uint32_t j;
+	size_t cap;
+	size_t l;
+	int c;
+
+	/* Allocate the node. */
+	if (trie->len == trie->cap) {
+		cap = (trie->cap == 0) ? 256 : trie->cap * 2;
+		nodes = (trie_node_t *)realloc(trie->nodes, cap * sizeof(trie_node_t));
+		if (nodes == NULL)
+			return TRIE_FAILED;
+		trie->nodes = nodes;
+		trie->cap = cap;
+	}
+	idx = (uint32_t)trie->len++;
+
+	/* The range is sorted, so its first and last entries share the least. */
+	first = &trie->entries[lo];
+	last = &trie->entries[hi - 1];
+	for (l = depth; (l < first->len) && (l < last->len) &&
+			(TRIE_FOLD(trie, first->title[l]) ==
+			 TRIE_FOLD(trie, last->title[l])); l++);
+	trie->nodes[idx].label = first->title + depth;
+	trie->nodes[idx].label_len = (uint32_t)(l - depth);
+	trie->nodes[idx].child = 0;
+	trie->nodes[idx].sibling = 0;
+	trie->nodes[idx].lo = lo;
+	trie->nodes[idx].hi = hi;
+
+	/* Titles that end right here always come first. */
+	for (i = lo; (i < hi) && (trie->entries[i].len == l); i++);
+	trie->nodes[idx].nexact = i - lo;
+
+	/* Every run of titles that goes on with the same character is a child. */
+	prev = 0;
+	while (i < hi) {
+		c = TRIE_FOLD(trie, trie->entries[i].title[l]);
+		for (j = i + 1; (j < hi) &&
+				(TRIE_FOLD(trie, trie->entries[j].title[l]) == c); j++);
+
+		child = trie_build(trie, i, j, l + 1);
+		if (child == TRIE_FAILED)
+			return TRIE_FAILED;
+
+		/* Children also get the character that told them apart. */
+		trie->nodes[child].label--;
+		trie->nodes[child].label_len++;
+		if (prev == 0) {
+			trie->nodes[idx].child = child;
+		} else {
+			trie->nodes[prev].sibling = child;
+		}
+		prev = child;
+		i = j;
+	}
+
+	return idx;
+}
+
+/**
+ * Builds a trie over the titles of every note in a collection.
+ *
+ * @warning The trie points to the titles of the notes, so the collection must
+ *          outlive it and can't be changed while it's in use.
+ *
+ * @param list  Note collection sorted by date.
+ * @param icase Should lookups ignore ASCII case?
+ *
+ * @return Trie object or NULL if we couldn't allocate enough memory.
+ *
+ * @see trie_free
+ */
+trie_t* trie_new(const notelist_t *list, bool icase) {
+	const char *title;
+	trie_t *trie;
+	size_t i;
+
+	/* Allocate our object. */
+	trie = (trie_t *)calloc(1, sizeof(trie_t));
+	if (trie == NULL)
+		return NULL;
+	trie->icase = icase;
+
+	/* Gather the titles. */
+	trie->entries = (trie_entry_t *)malloc((notelist_len(list) + 1) *
+										   sizeof(trie_entry_t));
+	if (trie->entries == NULL)
+		goto fail;
+	for (i = 0; i < notelist_len(list); i++) {
+		title = note_get_title(notelist_get(list, i));
+		if (title == NULL)
+			continue;
+
+		trie->entries[trie->nentries].title = title;
+		trie->entries[trie->nentries].len = (uint32_t)strlen(title);
+		trie->entries[trie->nentries].note = (uint32_t)i;
+		if (trie->entries[trie->nentries].len > trie->maxlen)
+			trie->maxlen = trie->entries[trie->nentries].len;
+		trie->nentries++;
+	}
+	if (trie->nentries > 1) {
+		qsort(trie->entries, trie->nentries, sizeof(trie_entry_t),
+			  (icase) ? trie_entry_casecmp : trie_entry_cmp);
+	}
+
+	/* Build the nodes. */
+	if (trie->nentries > 0) {
+		if (trie_build(trie, 0, (uint32_t)trie->nentries, 0) == TRIE_FAILED)
+			goto fail;
+	}
+
+	return trie;
+
+fail:
+	trie_free(trie);
+	errno = ENOMEM;
+	return NULL;
+}
+
+/**
+ * Frees up a trie.
+ *
+ * @param trie Trie object to be free'd.
+ */
+void trie_free(trie_t *trie) {
+	/* Do we even have anything to do? */
+	if (trie == NULL)
+		return;
+
+	if (trie->nodes)
+		free(trie->nodes);
+	if (trie->entries)
+		free(trie->entries);
+	free(trie);
+}
+
+/**
+ * Appends the notes of a range of entries to the results.
+ *
+ * @param trie Trie object.
+ * @param res  Results object.
+ * @param lo   First entry of the range.
+ * @param hi   Entry right after the last one of the range.
+ */
+static void trie_results_add(const trie_t *trie, trie_results_t *res,
+							 uint32_t lo, uint32_t hi) {
+	uint32_t *notes;
+	size_t cap;
+	uint32_t i;
+
+	if ((lo >= hi) || res->failed)
+		return;
+
+	/* Grow the array if needed. */
+	if ((res->len + (hi - lo)) > res->cap) {
+		cap = (res->cap == 0) ? 64 : res->cap * 2;
+		while (cap < (res->len + (hi - lo)))
+			cap *= 2;
+		notes = (uint32_t *)realloc(res->notes, cap * sizeof(uint32_t));
+		if (notes == NULL) {
+			res->failed = true;
+			return;
+		}
+		res->notes = notes;
+		res->cap = cap;
+	}
+
+	for (i = lo; i < hi; i++)
+		res->notes[res->len++] = trie->entries[i].note;
+}
+
+/**
+ * Hands the results over to the caller sorted by date.
+ *
+ * @param res   Results object.
+ * @param notes Pointer that will hold the note indices.
+ *
+ * @return Number of notes found.
+ */
+static size_t trie_results_finish(trie_results_t *res, uint32_t **notes) {
+	if (res->failed || (res->len == 0)) {
+		if (res->notes)
+			free(res->notes);
+		if (res->failed)
+			errno = ENOMEM;
+
+		*notes = NULL;
+		return 0;
+	}
+
+	if (res->len > 1)
+		qsort(res->notes, res->len, sizeof(uint32_t), trie_note_cmp);
+	*notes = res->notes;
+
+	return res->len;
+}
+
+/**
+ * Walks down the trie following a string.
+ *
+ * @param trie Trie object.
+ * @param str  String to follow.
+ * @param end  Will be TRUE if the string ended exactly at the end of the
+ *             returned node's label.
+ *
+ * @return Node where the string ended or NULL if no title starts with it.
+ */
+static const trie_node_t* trie_walk(const trie_t *trie, const char *str,
+									bool *end) {
+	const trie_node_t *node;
+	uint32_t i;
+	uint32_t n;
+	int c;
+
+	if (trie->len == 0)
+		return NULL;
+
+	node = &trie->nodes[0];
+	for (;;) {
+		/* Follow the label. */
+		for (i = 0; i < node->label_len; i++, str++) {
+			if (*str == '\0') {
+				*end = false;
+				return node;
+			}
+			if (TRIE_FOLD(trie, *str) != TRIE_FOLD(trie, node->label[i]))
+				return NULL;
+		}
+		if (*str == '\0') {
+			*end = true;
+			return node;
+		}
+
+		/* Find the child that goes on with the next character. */
+		c = TRIE_FOLD(trie, *str);
+		for (n = node->child; n != 0; n = trie->nodes[n].sibling) {
+			if (TRIE_FOLD(trie, trie->nodes[n].label[0]) == c)
+				break;
+		}
+		if (n == 0)
+			return NULL;
+		node = &trie->nodes[n];
+	}
+}
+
+/**
+ * Looks up the notes with a title.
+ *
+ * @param trie  Trie object.
+ * @param title Title to look for.
+ * @param notes Will hold the indices of the notes found, sorted by date.
+ *              (Allocated by this function, NULL if nothing was found)
+ *
+ * @return Number of notes found.
+ */
+size_t trie_exact(const trie_t *trie, const char *title, uint32_t **notes) {
+	const trie_node_t *node;
+	trie_results_t res;
+	bool end;
+
+	memset(&res, 0, sizeof(trie_results_t));
+	node = trie_walk(trie, title, &end);
+	if ((node != NULL) && end)
+		trie_results_add(trie, &res, node->lo, node->lo + node->nexact);
+
+	return trie_results_finish(&res, notes);
+}
+
+/**
+ * Looks up the notes with a title that starts with a prefix.
+ *
+ * @param trie   Trie object.
+ * @param prefix Prefix to look for.
+ * @param notes  Will hold the indices of the notes found, sorted by date.
+ *               (Allocated by this function, NULL if nothing was found)
+ *
+ * @return Number of notes found.
+ */
+size_t trie_prefix(const trie_t *trie, const char *prefix, uint32_t **notes) {
+	const trie_node_t *node;
+	trie_results_t res;
+	bool end;
+
+	memset(&res, 0, sizeof(trie_results_t));
+	node = trie_walk(trie, prefix, &end);
+	if (node != NULL)
+		trie_results_add(trie, &res, node->lo, node->hi);
+
+	return trie_results_finish(&res, notes);
+}
+
+/**
+ * Visits a node during a fuzzy lookup, computing a row of the Levenshtein
+ * matrix for every character of its label.
+ *
+ * @param fz    Fuzzy lookup state.
+ * @param n     Index of the node.
+ * @param depth Number of characters before the node's label.
+ */
+static void trie_fuzzy_visit(trie_fuzzy_t *fz, uint32_t n, size_t depth) {
+	const trie_node_t *node;
+	unsigned int *prev;
+	unsigned int *cur;
+	unsigned int best;
+	unsigned int v;
+	size_t cols;
+	uint32_t i;
+	size_t j;
+	int c;
+
+	node = &fz->trie->nodes[n];
+	cols = fz->len + 1;
+
+	/* Compute a row for every character of the label. */
+	for (i = 0; i < node->label_len; i++) {
+		c = TRIE_FOLD(fz->trie, node->label[i]);
+		prev = fz->rows + ((depth + i) * cols);
+		cur = prev + cols;
+
+		cur[0] = prev[0] + 1;
+		best = cur[0];
+		for (j = 1; j < cols; j++) {
+			v = prev[j - 1] + ((TRIE_FOLD(fz->trie, fz->query[j - 1]) == c) ?
+							   0 : 1);
+			if ((prev[j] + 1) < v)
+				v = prev[j] + 1;
+			if ((cur[j - 1] + 1) < v)
+				v = cur[j - 1] + 1;
+			cur[j] = v;
+			if (v < best)
+				best = v;
+		}
+
+		/* Nothing below this point can get close enough. */
+		if (best > fz->dist)
+			return;
+	}
+	depth += node->label_len;
+
+	/* Titles that end here are close enough. */
+	if (fz->rows[(depth * cols) + fz->len] <= fz->dist)
+		trie_results_add(fz->trie, fz->res, node->lo, node->lo + node->nexact);
+
+	/* Go on to the children. */
+	for (n = node->child; n != 0; n = fz->trie->nodes[n].sibling)
+		trie_fuzzy_visit(fz, n, depth);
+}
+
+/**
+ * Looks up the notes with a title that's within an edit distance of another.
+ *
+ * @param trie  Trie object.
+ * @param title Title to look for.
+ * @param dist  Maximum number of characters inserted, removed or replaced.
+ * @param notes Will hold the indices of the notes found, sorted by date.
+ *              (Allocated by this function, NULL if nothing was found)
+ *
+ * @return Number of notes found.
+ */
+size_t trie_fuzzy(const trie_t *trie, const char *title, unsigned int dist,
+				  uint32_t **notes) {
+	trie_fuzzy_t fz;
+	trie_results_t res;
+	size_t j;
+
+	memset(&res, 0, sizeof(trie_results_t));
+	if (trie->len == 0)
+		return trie_results_finish(&res, notes);
+
+	/* Set up a row for every character of the longest title. */
+	fz.trie = trie;
+	fz.query = title;
+	fz.len = strlen(title);
+	fz.dist = dist;
+	fz.res = &res;
+	fz.rows = (unsigned int *)malloc((trie->maxlen + 1) * (fz.len + 1) *
+									 sizeof(unsigned int));
+	if (fz.rows == NULL) {
+		res.failed = true;
+		return trie_results_finish(&res, notes);
+	}
+	for (j = 0; j <= fz.len; j++)
+		fz.rows[j] = (unsigned int)j;
+
+	trie_fuzzy_visit(&fz, 0, 0);
+	free(fz.rows);
+
+	return trie_results_finish(&res, notes);
+}
@@ -0,0 +1,74 @@
+/**
+ * trie.h
+ * Compressed trie over the titles of every note for quick lookups by title.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _TRIE_H
+#define _TRIE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "notelist.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Node of the trie. Its edge label points inside one of the titles.
+ */
+typedef struct {
+	const char *label;
+	uint32_t label_len;
+
+	uint32_t child;
+	uint32_t sibling;
+
+	uint32_t lo;
+	uint32_t hi;
+	uint32_t nexact;
+} trie_node_t;
+
+/**
+ * Title of a note as stored in the trie.
+ */
+typedef struct {
+	const char *title;
+	uint32_t len;
+	uint32_t note;
+} trie_entry_t;
+
+/**
+ * Compressed trie object.
+ */
+typedef struct {
+	trie_node_t *nodes;
+	size_t len;
+	size_t cap;
+
+	trie_entry_t *entries;
+	size_t nentries;
+	size_t maxlen;
+
+	bool icase;
+} trie_t;
+
+/* Construction and destruction. */
+trie_t* trie_new(const notelist_t *list, bool icase);
+void trie_free(trie_t *trie);
+
+/* Lookups. */
+size_t trie_exact(const trie_t *trie, const char *title, uint32_t **notes);
+size_t trie_prefix(const trie_t *trie, const char *prefix, uint32_t **notes);
+size_t trie_fuzzy(const trie_t *trie, const char *title, unsigned int dist,
+				  uint32_t **notes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TRIE_H */
@@ -0,0 +1,684 @@
+/**
+ * walk.c
+ * Loads the notes of a workspace and all of its subdirectories in parallel.
+ *
+ * Every directory is a task. Workers keep their own deque of tasks, taking the
+ * most recently found directories from its back and stealing the oldest ones
+ * from the front of other workers' deques when they run out of work, so that
+ * both deep and wide trees keep every core busy. Subdirectories are opened
+ * relative to their parent's descriptor, which is only kept open while there
+ * are still children waiting to be opened. Directories are identified by their
+ * device and inode to avoid walking into the same one twice, which also stops
+ * symbolic link loops.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "walk.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fsutils.h"
+#include "note.h"
+#include "strutils.h"
+
+/* Initial number of slots of the deques and of the visited set. */
+#define WALK_INIT_CAP 64
+
+/**
+ * Directory that has already been opened. Kept alive while its subdirectories
+ * are waiting to be opened relative to it.
+ */
+typedef struct {
+	int fd;
+	char *path;
+	size_t refs;
+} walk_dir_t;
+
+/**
+ * Directory waiting to be walked.
+ */
+typedef struct {
+	walk_dir_t *parent;
+	char *name;
+	size_t depth;
+} walk_task_t;
+
+/**
+ * Double-ended queue of tasks owned by a worker.
+ */
+typedef struct {
+	pthread_mutex_t lock;
+	walk_task_t *tasks;
+	size_t head;
+	size_t tail;
+	size_t cap;
+} walk_deque_t;
+
+/**
+ * Device and inode pair identifying a directory.
+ */
+typedef struct {
+	uint64_t dev;
+	uint64_t ino;
+} walk_id_t;
+
+struct walk_state_s;
+
+/**
+ * Worker thread state.
+ */
+typedef struct {
+	struct walk_state_s *state;
+	walk_deque_t deque;
+	notelist_t *list;
+	pthread_t thread;
+	char *scratch;
+	size_t scratch_len;
+} walk_worker_t;
+
+/**
+ * Shared state of the walk.
+ */
+typedef struct walk_state_s {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	size_t pending;
+	size_t pushes;
+	int err;
+
+	walk_id_t *visited;
+	size_t nvisited;
+	size_t visited_cap;
+
+	walk_worker_t *workers;
+	size_t nworkers;
+
+	size_t max_depth;
+	bool content;
+	const filter_t *filter;
+} walk_state_t;
+
+/**
+ * Drops a reference to an opened directory, closing it when nobody else needs
+ * it anymore.
+ *
+ * @param state Shared state.
+ * @param dir   Opened directory.
+ */
+static void walk_dir_release(walk_state_t *state, walk_dir_t *dir) {
+	bool last;
+
+	pthread_mutex_lock(&state->lock);
+	last = --dir->refs == 0;
+	pthread_mutex_unlock(&state->lock);
+	if (!last)
+		return;
+
+	if (dir->fd >= 0)
+		close(dir->fd);
+	free(dir->path);
+	free(dir);
+}
+
+/**
+ * Frees up the resources held by a task that won't be walked.
+ *
+ * @param state Shared state.
+ * @param task  Task object.
+ */
+static void walk_task_discard(walk_state_t *state, walk_task_t *task) {
+	if (task->parent != NULL)
+		walk_dir_release(state, task->parent);
+	free(task->name);
+}
+
+/**
+ * Marks a directory as visited.
+ * @warning The shared state must be locked.
+ *
+ * @param state Shared state.
+ * @param id    Identification of the directory.
+ *
+ * @return TRUE if the directory hasn't been visited before.
+ *         FALSE if it has or if we couldn't allocate memory.
+ */
+static bool walk_visit(walk_state_t *state, walk_id_t id) {
+	walk_id_t *slots;
+	size_t mask;
+	size_t i;
+
+	/* Grow the set when it gets half full. */
+	if (((state->nvisited + 1) * 2) > state->visited_cap) {
+		size_t cap;
+		size_t j;
+
+		cap = (state->visited_cap == 0) ? WALK_INIT_CAP :
+			(state->visited_cap * 2);
+		slots = (walk_id_t *)calloc(cap, sizeof(walk_id_t));
+		if (slots == NULL)
+			return false;
+		for (j = 0; j < state->visited_cap; j++) {
+			if (state->visited[j].ino == 0)
+				continue;
+			i = (size_t)((state->visited[j].ino * 0x9E3779B1UL) ^
+						 state->visited[j].dev) & (cap - 1);
+			while (slots[i].ino != 0)
+				i = (i + 1) & (cap - 1);
+			slots[i] = state->visited[j];
+		}
+
+		if (state->visited)
+			free(state->visited);
+		state->visited = slots;
+		state->visited_cap = cap;
+	}
+
+	/* Look for the directory with linear probing. Inode 0 marks empty slots. */
+	mask = state->visited_cap - 1;
+	i = (size_t)((id.ino * 0x9E3779B1UL) ^ id.dev) & mask;
+	while (state->visited[i].ino != 0) {
+		if ((state->visited[i].ino == id.ino) &&
+				(state->visited[i].dev == id.dev)) {
+			return false;
+		}
+		i = (i + 1) & mask;
+	}
+	state->visited[i] = id;
+	state->nvisited++;
+
+	return true;
+}
+
+/**
+ * Pushes a task to the back of a worker's deque and lets idle workers know
+ * that there's something to steal.
+ *
+ * @param worker Worker that owns the deque.
+ * @param task   Task to be pushed.
+ *
+ * @return FALSE if we couldn't allocate memory.
+ */
+static bool walk_push(walk_worker_t *worker, const walk_task_t *task) {
+	walk_deque_t *dq;
+	walk_state_t *state;
+	walk_task_t *tasks;
+	size_t cap;
+
+	dq = &worker->deque;
+	state = worker->state;
+
+	/* Count the task before anyone can steal it and be done with it. */
+	pthread_mutex_lock(&state->lock);
+	state->pending++;
+	pthread_mutex_unlock(&state->lock);
+
+	/* Make room by compacting or growing the deque. */
+	pthread_mutex_lock(&dq->lock);
+	if (dq->tail == dq->cap) {
+		if (dq->head > (dq->cap / 2)) {
+			memmove(dq->tasks, dq->tasks + dq->head,
+					(dq->tail - dq->head) * sizeof(walk_task_t));
+		} else {
+			cap = (dq->cap == 0) ? WALK_INIT_CAP : (dq->cap * 2);
+			tasks = (walk_task_t *)realloc(dq->tasks,
+										   cap * sizeof(walk_task_t));
+			if (tasks == NULL) {
+				pthread_mutex_unlock(&dq->lock);
+				pthread_mutex_lock(&state->lock);
+				state->pending--;
+				pthread_mutex_unlock(&state->lock);
+				return false;
+			}
+			dq->tasks = tasks;
+			dq->cap = cap;
+			memmove(dq->tasks, dq->tasks + dq->head,
+					(dq->tail - dq->head) * sizeof(walk_task_t));
+		}
+		dq->tail -= dq->head;
+		dq->head = 0;
+	}
+	dq->tasks[dq->tail++] = *task;
+	pthread_mutex_unlock(&dq->lock);
+
+	/* Wake up anyone that's waiting for work. */
+	pthread_mutex_lock(&state->lock);
+	state->pushes++;
+	pthread_cond_broadcast(&state->cond);
+	pthread_mutex_unlock(&state->lock);
+
+	return true;
+}
+
+/**
+ * Takes a task from a deque.
+ *
+ * @param dq    Deque to take the task from.
+ * @param task  Will hold the task that was taken.
+ * @param front Take the oldest task instead of the newest one?
+ *
+ * @return TRUE if a task was taken.
+ */
+static bool walk_take(walk_deque_t *dq, walk_task_t *task, bool front) {
+	bool ret;
+
+	pthread_mutex_lock(&dq->lock);
+	ret = dq->head < dq->tail;
+	if (ret) {
+		if (front) {
+			*task = dq->tasks[dq->head++];
+		} else {
+			*task = dq->tasks[--dq->tail];
+		}
+		if (dq->head == dq->tail) {
+			dq->head = 0;
+			dq->tail = 0;
+		}
+	}
+	pthread_mutex_unlock(&dq->lock);
+
+	return ret;
+}
+
+/**
+ * Gets the next task for a worker, stealing one from another worker if its own
+ * deque is empty.
+ *
+ * @param worker Worker looking for work.
+ * @param task   Will hold the task that was found.
+ *
+ * @return TRUE if a task was found.
+ */
+static bool walk_next(walk_worker_t *worker, walk_task_t *task) {
+	walk_state_t *state;
+	size_t self;
+	size_t i;
+
+	/* Our own work first, depth first to keep the deque short. */
+	if (walk_take(&worker->deque, task, false))
+		return true;
+
+	/* Steal the oldest task of someone else, which is usually the biggest. */
+	state = worker->state;
+	self = (size_t)(worker - state->workers);
+	for (i = 1; i < state->nworkers; i++) {
+		if (walk_take(&state->workers[(self + i) % state->nworkers].deque,
+					  task, true)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Creates a note from a file and appends it to the worker's collection.
+ *
+ * @param worker Worker state.
+ * @param dir    Directory the file is in.
+ * @param name   Name of the file.
+ *
+ * @return FALSE if we couldn't allocate memory.
+ */
+static bool walk_file(walk_worker_t *worker, const walk_dir_t *dir,
+					  const char *name) {
+	note_fname_t parsed;
+	note_t *note;
+	size_t dlen;
+	size_t nlen;
+	char *buf;
+
+	/* Quietly skip anything that isn't a note. */
+	if (!note_parse_fname(name, &parsed))
+		return true;
+
+	/* Ensure our scratch buffer has enough space for the path. */
+	dlen = strlen(dir->path);
+	nlen = strlen(name);
+	if ((dlen + nlen + 2) > worker->scratch_len) {
+		buf = (char *)realloc(worker->scratch, (dlen + nlen + 2) * sizeof(char));
+		if (buf == NULL)
+			return false;
+		worker->scratch = buf;
+		worker->scratch_len = dlen + nlen + 2;
+	}
+
+	/* Build the path to the note. */
+	buf = worker->scratch;
+	memcpy(buf, dir->path, dlen);
+	if ((dlen > 0) && (buf[dlen - 1] != PATH_SEP))
+		buf[dlen++] = PATH_SEP;
+	memcpy(buf + dlen, name, nlen + 1);
+
+	/* Parse the note and load its contents if needed. */
+	note = note_from_fname_arena(buf, notelist_arena(worker->list));
+	if (note == NULL)
+		return true;
+	if (worker->state->content)
+		loader_note_load(note);
+	if (!notelist_push(worker->list, note)) {
+		note_free(note);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Walks a single directory, loading its notes and queueing its subdirectories.
+ *
+ * @param worker Worker state.
+ * @param task   Directory to be walked. Its resources are released.
+ *
+ * @return 0 if the operation was successful, otherwise an errno value.
+ */
+static int walk_dir(walk_worker_t *worker, walk_task_t *task) {
+	walk_state_t *state;
+	fs_dirscan_t scan;
+	const fs_dirent_t *entries;
+	walk_task_t child;
+	walk_dir_t *dir;
+	walk_id_t id;
+	struct stat st;
+	size_t count;
+	size_t i;
+	bool fresh;
+	int flags;
+	int err;
+
+	state = worker->state;
+	flags = FS_SCAN_FILES;
+	if (task->depth < state->max_depth)
+		flags |= FS_SCAN_DIRS;
+
+	/* Open the directory relative to its parent. */
+	if (!fs_dirscan_openat(&scan, (task->parent) ? task->parent->fd : AT_FDCWD,
+						   task->name, flags)) {
+		err = errno;
+		walk_task_discard(state, task);
+		return err;
+	}
+
+	/* Make sure we haven't been here before. */
+	if (fstat(fs_dirscan_fd(&scan), &st) != 0) {
+		err = errno;
+		fs_dirscan_close(&scan);
+		walk_task_discard(state, task);
+		return err;
+	}
+	id.dev = (uint64_t)st.st_dev;
+	id.ino = (uint64_t)st.st_ino;
+	pthread_mutex_lock(&state->lock);
+	fresh = walk_visit(state, id);
+	pthread_mutex_unlock(&state->lock);
+	if (!fresh) {
+		fs_dirscan_close(&scan);
+		walk_task_discard(state, task);
+		return 0;
+	}
+
+	/* Keep track of the directory for its children. */
+	dir = (walk_dir_t *)malloc(sizeof(walk_dir_t));
+	if (dir == NULL) {
+		fs_dirscan_close(&scan);
+		walk_task_discard(state, task);
+		return ENOMEM;
+	}
+	dir->fd = -1;
+	dir->refs = 1;
+	dir->path = NULL;
+	if (task->parent == NULL) {
+		string_copy(&dir->path, task->name);
+	} else {
+		string_copy(&dir->path, task->parent->path);
+		fs_pathcat(&dir->path, task->name);
+	}
+	walk_task_discard(state, task);
+
+	/* Go through the entries. */
+	err = 0;
+	while ((err == 0) && ((count = fs_dirscan_next(&scan, &entries)) > 0)) {
+		for (i = 0; i < count; i++) {
+			if (!entries[i].is_dir) {
+				if ((state->filter != NULL) &&
+						!filter_match_at(state->filter, fs_dirscan_fd(&scan),
+										 entries[i].name)) {
+					continue;
+				}
+				if (!walk_file(worker, dir, entries[i].name)) {
+					err = ENOMEM;
+					break;
+				}
+
+				continue;
+			}
+
+			/* Our descriptor is only kept around if we have children. */
+			if (dir->fd < 0) {
+				dir->fd = fcntl(fs_dirscan_fd(&scan), F_DUPFD_CLOEXEC, 0);
+				if (dir->fd < 0) {
+					err = errno;
+					break;
+				}
+			}
+
+			/* Queue up the subdirectory. */
+			child.parent = dir;
+			child.name = NULL;
+			child.depth = task->depth + 1;
+			string_copy(&child.name, entries[i].name);
+			pthread_mutex_lock(&state->lock);
+			dir->refs++;
+			pthread_mutex_unlock(&state->lock);
+			if ((child.name == NULL) || !walk_push(worker, &child)) {
+				walk_task_discard(state, &child);
+				err = ENOMEM;
+				break;
+			}
+		}
+	}
+
+	/* A listing that was cut short loses notes, no matter where it is. */
+	if ((err == 0) && (fs_dirscan_error(&scan) != 0)) {
+		err = fs_dirscan_error(&scan);
+		pthread_mutex_lock(&state->lock);
+		if (state->err == 0)
+			state->err = err;
+		pthread_mutex_unlock(&state->lock);
+	}
+
+	fs_dirscan_close(&scan);
+	walk_dir_release(state, dir);
+
+	return err;
+}
+
+/**
+ * Worker thread that keeps walking directories until there are none left
+ * anywhere.
+ *
+ * @param arg Worker state object.
+ *
+ * @return Always NULL.
+ */
+static void* walk_worker(void *arg) {
+	walk_worker_t *worker;
+	walk_state_t *state;
+	walk_task_t task;
+	size_t pushes;
+	bool root;
+	int err;
+
+	worker = (walk_worker_t *)arg;
+	state = worker->state;
+
+	for (;;) {
+		/* Remember how much work there was before looking for some. */
+		pthread_mutex_lock(&state->lock);
+		pushes = state->pushes;
+		pthread_mutex_unlock(&state->lock);
+
+		if (!walk_next(worker, &task)) {
+			/* Wait for more work or for everything to be done. */
+			pthread_mutex_lock(&state->lock);
+			while ((state->pending > 0) && (state->pushes == pushes))
+				pthread_cond_wait(&state->cond, &state->lock);
+			if (state->pending == 0) {
+				pthread_mutex_unlock(&state->lock);
+				break;
+			}
+			pthread_mutex_unlock(&state->lock);
+
+			continue;
+		}
+
+		/* Walk the directory. Only errors on the workspace itself matter. */
+		root = task.parent == NULL;
+		err = walk_dir(worker, &task);
+
+		pthread_mutex_lock(&state->lock);
+		if ((err != 0) && (root || (err == ENOMEM)) && (state->err == 0))
+			state->err = err;
+		if (--state->pending == 0)
+			pthread_cond_broadcast(&state->cond);
+		pthread_mutex_unlock(&state->lock);
+	}
+
+	return NULL;
+}
+
+/**
+ * Loads every note in a workspace directory and its subdirectories using a pool
+ * of work-stealing worker threads.
+ *
+ * @param path Path to the workspace directory.
+ * @param opts Loading options or NULL to use the defaults. The depth option
+ *             limits how deep into subdirectories we'll go.
+ * @param list Note collection to append the notes to. They will be sorted by
+ *             date, title, format and path. If it uses an arena the notes will
+ *             be allocated from it.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ *
+ * @see loader_opts_init
+ */
+bool walk_load(const char *path, const loader_opts_t *opts, notelist_t *list) {
+	loader_opts_t defopts;
+	walk_state_t state;
+	walk_task_t root;
+	size_t nthreads;
+	size_t started;
+	size_t i;
+
+	/* Use the default options if none were provided. */
+	if (opts == NULL) {
+		loader_opts_init(&defopts);
+		opts = &defopts;
+	}
+
+	/* Figure out how many workers we should use. */
+	nthreads = (opts->threads == 0) ? loader_ncpus() : opts->threads;
+	if (nthreads > LOADER_MAX_THREADS)
+		nthreads = LOADER_MAX_THREADS;
+
+	/* Set up the shared state. */
+	memset(&state, 0, sizeof(walk_state_t));
+	pthread_mutex_init(&state.lock, NULL);
+	pthread_cond_init(&state.cond, NULL);
+	state.max_depth = (opts->depth > WALK_MAX_DEPTH) ? WALK_MAX_DEPTH :
+		opts->depth;
+	state.content = opts->content;
+	state.filter = opts->filter;
+	state.workers = (walk_worker_t *)calloc(nthreads, sizeof(walk_worker_t));
+	if (state.workers == NULL) {
+		pthread_cond_destroy(&state.cond);
+		pthread_mutex_destroy(&state.lock);
+		return false;
+	}
+
+	/* Set up the workers. The first one is the calling thread. */
+	for (i = 0; i < nthreads; i++) {
+		state.workers[i].state = &state;
+		pthread_mutex_init(&state.workers[i].deque.lock, NULL);
+		state.workers[i].list = (i == 0) ? list : notelist_new();
+		if ((state.workers[i].list == NULL) ||
+				((i > 0) && (notelist_arena(list) != NULL) &&
+				 !notelist_use_arena(state.workers[i].list))) {
+			if (state.workers[i].list != NULL)
+				notelist_free(state.workers[i].list);
+			pthread_mutex_destroy(&state.workers[i].deque.lock);
+			state.err = ENOMEM;
+			break;
+		}
+		state.nworkers++;
+	}
+
+	/* Seed the walk with the workspace itself. */
+	root.parent = NULL;
+	root.name = NULL;
+	root.depth = 0;
+	string_copy(&root.name, path);
+	if ((state.err == 0) &&
+			((root.name == NULL) || !walk_push(&state.workers[0], &root))) {
+		state.err = ENOMEM;
+		if (root.name)
+			free(root.name);
+	}
+
+	/* Walk the tree. */
+	started = 1;
+	if (state.err == 0) {
+		for (; started < state.nworkers; started++) {
+			if (pthread_create(&state.workers[started].thread, NULL,
+							   walk_worker, &state.workers[started]) != 0) {
+				break;
+			}
+		}
+		walk_worker(&state.workers[0]);
+	}
+
+	/* Wait for the workers and gather their results. */
+	for (i = 0; i < state.nworkers; i++) {
+		if ((i > 0) && (i < started))
+			pthread_join(state.workers[i].thread, NULL);
+
+		if (i > 0) {
+			if (!notelist_extend(list, state.workers[i].list))
+				state.err = ENOMEM;
+			if (notelist_arena(list) != NULL) {
+				arena_merge(notelist_arena(list),
+							notelist_arena(state.workers[i].list));
+			}
+			notelist_free(state.workers[i].list);
+		}
+
+		if (state.workers[i].scratch)
+			free(state.workers[i].scratch);
+		if (state.workers[i].deque.tasks)
+			free(state.workers[i].deque.tasks);
+		pthread_mutex_destroy(&state.workers[i].deque.lock);
+	}
+
+	/* Ensure the output is deterministic. */
+	notelist_sort(list);
+
+	/* Clean up. */
+	if (state.visited)
+		free(state.visited);
+	free(state.workers);
+	pthread_cond_destroy(&state.cond);
+	pthread_mutex_destroy(&state.lock);
+
+	if (state.err != 0) {
+		errno = state.err;
+		return false;
+	}
+
+	return true;
+}
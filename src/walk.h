@@ -0,0 +1,33 @@
+/**
+ * walk.h
+ * Loads the notes of a workspace and all of its subdirectories in parallel.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _WALK_H
+#define _WALK_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "loader.h"
+#include "notelist.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Maximum depth of subdirectories that will be walked into. */
+#ifndef WALK_MAX_DEPTH
+	#define WALK_MAX_DEPTH 64
+#endif /* WALK_MAX_DEPTH */
+
+/* Loading. */
+bool walk_load(const char *path, const loader_opts_t *opts, notelist_t *list);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WALK_H */
@@ -0,0 +1,523 @@
+/**
+ * watch.c
+ * Keeps an in-memory workspace up to date by watching its directory.
+ *
+ * Notes are kept in a hash table keyed by their file name, so applying a change
+ * only costs the parsing of the affected file name, no matter how big the
+ * workspace is. Currently only supported on Linux through inotify.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "watch.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+	#include <sys/inotify.h>
+#endif /* __linux__ */
+
+#include "fsutils.h"
+#include "strutils.h"
+
+/* Size of the buffer used to read events. */
+#define WATCH_BUFSIZE (64 * 1024)
+
+/* Events that we are interested in. */
+#define WATCH_MASK (IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM | \
+					IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE_SELF | \
+					IN_MOVE_SELF | IN_ONLYDIR)
+
+/* Marker for slots whose note has been removed. */
+static note_t watch_tombstone;
+#define WATCH_TOMB (&watch_tombstone)
+
+/**
+ * Finds the slot where a note with a name is (or should be) in the table.
+ *
+ * @param w    Watched workspace.
+ * @param name File name of the note.
+ * @param len  Length of the name.
+ * @param free Will hold the first free slot found along the way if the note
+ *             isn't in the table.
+ *
+ * @return Slot of the note or the size of the table if it isn't there.
+ */
+static size_t watch_slot(const watch_t *w, const char *name, size_t len,
+						 size_t *free) {
+	const note_t *note;
+	const char *fname;
+	size_t mask;
+	size_t i;
+
+	/* Workspaces that started out empty don't have a table yet. */
+	*free = w->nslots;
+	if (w->nslots == 0)
+		return 0;
+
+	mask = w->nslots - 1;
+	for (i = string_hash(name, len) & mask; (note = w->slots[i]) != NULL;
+		 i = (i + 1) & mask) {
+		if (note == WATCH_TOMB) {
+			if (*free == w->nslots)
+				*free = i;
+			continue;
+		}
+
+		fname = fs_basename(note_get_path(note));
+		if ((strncmp(fname, name, len) == 0) && (fname[len] == '\0'))
+			return i;
+	}
+	if (*free == w->nslots)
+		*free = i;
+
+	return w->nslots;
+}
+
+/**
+ * Rebuilds the table with a new size, getting rid of tombstones.
+ *
+ * @param w    Watched workspace.
+ * @param size New number of slots. (Must be a power of two)
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+static bool watch_rehash(watch_t *w, size_t size) {
+	note_t **old;
+	size_t nold;
+	size_t slot;
+	size_t i;
+	const char *name;
+
+	old = w->slots;
+	nold = w->nslots;
+	w->slots = (note_t **)calloc(size, sizeof(note_t *));
+	if (w->slots == NULL) {
+		w->slots = old;
+		return false;
+	}
+	w->nslots = size;
+	w->used = w->count;
+
+	/* Re-insert every note. */
+	for (i = 0; i < nold; i++) {
+		if ((old[i] == NULL) || (old[i] == WATCH_TOMB))
+			continue;
+
+		name = fs_basename(note_get_path(old[i]));
+		watch_slot(w, name, strlen(name), &slot);
+		w->slots[slot] = old[i];
+	}
+	if (old)
+		free(old);
+
+	return true;
+}
+
+/**
+ * Inserts a note into the table. The table takes ownership of it.
+ *
+ * @param w    Watched workspace.
+ * @param note Note to be inserted. Must not be in the table already.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+static bool watch_insert(watch_t *w, note_t *note) {
+	const char *name;
+	size_t slot;
+	size_t size;
+
+	/* Keep the table at most half full (counting tombstones). */
+	if (((w->used + 1) * 2) > w->nslots) {
+		size = (w->nslots == 0) ? 1024 : w->nslots;
+		while (((w->count + 1) * 4) > size)
+			size *= 2;
+		if (!watch_rehash(w, size))
+			return false;
+	}
+
+	/* Put the note in its place. */
+	name = fs_basename(note_get_path(note));
+	watch_slot(w, name, strlen(name), &slot);
+	if (w->slots[slot] == NULL)
+		w->used++;
+	w->slots[slot] = note;
+	w->count++;
+
+	return true;
+}
+
+/**
+ * Frees every note in the table and leaves it empty.
+ *
+ * @param w Watched workspace.
+ */
+static void watch_clear(watch_t *w) {
+	size_t i;
+
+	for (i = 0; i < w->nslots; i++) {
+		if ((w->slots[i] != NULL) && (w->slots[i] != WATCH_TOMB))
+			note_free(w->slots[i]);
+		w->slots[i] = NULL;
+	}
+	w->count = 0;
+	w->used = 0;
+}
+
+/**
+ * Loads the whole workspace from scratch into the table.
+ *
+ * @param w Watched workspace.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ */
+static bool watch_rescan(watch_t *w) {
+	notelist_t *list;
+	size_t i;
+	bool ret;
+
+	list = notelist_new();
+	if (list == NULL)
+		return false;
+
+	/* Load the workspace. */
+	watch_clear(w);
+	ret = loader_load(w->path, &w->opts, list);
+
+	/* Move the notes over to the table. */
+	for (i = 0; ret && (i < notelist_len(list)); i++) {
+		if (!watch_insert(w, list->notes[i])) {
+			errno = ENOMEM;
+			ret = false;
+			break;
+		}
+	}
+	if (ret) {
+		list->len = 0;
+	} else {
+		/* Only free the notes that didn't make it into the table. */
+		memmove(list->notes, list->notes + i,
+				(list->len - i) * sizeof(note_t *));
+		list->len -= i;
+	}
+	notelist_free(list);
+
+	return ret;
+}
+
+/**
+ * Starts watching a workspace and loads all of its notes. The watch is set up
+ * before the notes are loaded so that no changes are lost in between.
+ * @warning The object allocated by this function must be free'd after use.
+ *
+ * @param path Path to the workspace directory.
+ * @param opts Loading options or NULL to use the defaults. Only the notes at
+ *             the top of the workspace can be watched, so the depth must be 0.
+ *
+ * @return Watched workspace object or NULL in case of an error. Check errno.
+ *
+ * @see watch_free
+ */
+watch_t* watch_new(const char *path, const loader_opts_t *opts) {
+#ifdef __linux__
+	watch_t *w;
+
+	/* Notes are kept by their file names and only the top directory is
+	 * watched, so subdirectories can't be kept up to date. */
+	if ((opts != NULL) && (opts->depth > 0)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* Allocate enough memory for our object. */
+	w = (watch_t *)calloc(1, sizeof(watch_t));
+	if (w == NULL)
+		return NULL;
+	w->wd = -1;
+	string_copy(&w->path, path);
+	if (opts != NULL) {
+		w->opts = *opts;
+	} else {
+		loader_opts_init(&w->opts);
+	}
+
+	/* Start watching the directory. */
+	w->buf = (char *)malloc(WATCH_BUFSIZE);
+	w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if ((w->buf == NULL) || (w->fd < 0))
+		goto fail;
+	w->wd = inotify_add_watch(w->fd, path, WATCH_MASK);
+	if (w->wd < 0)
+		goto fail;
+
+	/* Load the notes. */
+	if (!watch_rescan(w))
+		goto fail;
+
+	return w;
+
+fail:
+	watch_free(w);
+	return NULL;
+#else
+	errno = ENOSYS;
+	return NULL;
+#endif /* __linux__ */
+}
+
+/**
+ * Stops watching a workspace and frees up every note in it.
+ *
+ * @param w Watched workspace to be free'd.
+ */
+void watch_free(watch_t *w) {
+	/* Do we even have anything to do? */
+	if (w == NULL)
+		return;
+
+	/* Stop watching. */
+	if (w->fd >= 0)
+		close(w->fd);
+
+	/* Free the notes and everything else. */
+	watch_clear(w);
+	if (w->slots)
+		free(w->slots);
+	if (w->path)
+		free(w->path);
+	if (w->buf)
+		free(w->buf);
+	if (w->scratch)
+		free(w->scratch);
+	free(w);
+}
+
+/**
+ * Gets the file descriptor that becomes readable whenever there are changes to
+ * be applied, so that the watcher can be integrated into event loops.
+ *
+ * @param w Watched workspace.
+ *
+ * @return File descriptor to be polled for reading.
+ */
+int watch_fd(const watch_t *w) {
+	return w->fd;
+}
+
+#ifdef __linux__
+/**
+ * Applies a single change to the workspace.
+ *
+ * @param w    Watched workspace.
+ * @param mask Mask of the inotify event.
+ * @param name Name of the file that has changed.
+ * @param last Last note modified in this batch. Used to coalesce events.
+ * @param func Function called for every change applied.
+ * @param ctx  Context to be passed to the function.
+ *
+ * @return TRUE if a change was applied.
+ *         FALSE if the event was ignored.
+ */
+static bool watch_apply(watch_t *w, uint32_t mask, const char *name,
+						const note_t **last, watch_func_t func, void *ctx) {
+	note_fname_t parsed;
+	note_t *note;
+	struct stat st;
+	size_t slot;
+	size_t free;
+	size_t len;
+
+	/* Ignore directories and dotfiles (including our own indexes). */
+	if ((mask & IN_ISDIR) || (name[0] == '\0') || (name[0] == '.'))
+		return false;
+
+	/* Build the path to the file. */
+	string_copy(&w->scratch, w->path);
+	fs_pathcat(&w->scratch, name);
+
+	/* Look for the note. */
+	len = strlen(name);
+	slot = watch_slot(w, name, len, &free);
+	note = (slot < w->nslots) ? w->slots[slot] : NULL;
+
+	/* Note went away. */
+	if (mask & (IN_DELETE | IN_MOVED_FROM)) {
+		if (note == NULL)
+			return false;
+
+		w->slots[slot] = WATCH_TOMB;
+		w->count--;
+		if (*last == note)
+			*last = NULL;
+		if (func)
+			func(WATCH_REMOVED, note, ctx);
+		note_free(note);
+
+		return true;
+	}
+
+	/* Note that we don't know about yet. */
+	if (note == NULL) {
+		if ((mask & (IN_CREATE | IN_MOVED_TO)) == 0)
+			return false;
+
+		/* Editors come and go with swap and temporary files all the time. */
+		if (!note_parse_fname(name, &parsed))
+			return false;
+
+		note = note_from_fname(w->scratch);
+		if (note == NULL)
+			return false;
+		if (stat(w->scratch, &st) == 0)
+			note_set_stat(note, &st);
+		if (!watch_insert(w, note)) {
+			note_free(note);
+			return false;
+		}
+
+		*last = note;
+		if (func)
+			func(WATCH_ADDED, note, ctx);
+
+		return true;
+	}
+
+	/* Coalesce the bursts of events generated while a note is written, since
+	 * everything in a batch has already happened by the time we look at it. */
+	if (*last == note)
+		return false;
+
+	/* Invalidate the cached contents of a modified note. */
+	note_unload(note);
+	note_fh_close(note);
+	if (stat(w->scratch, &st) == 0)
+		note_set_stat(note, &st);
+	*last = note;
+	if (func)
+		func(WATCH_MODIFIED, note, ctx);
+
+	return true;
+}
+#endif /* __linux__ */
+
+/**
+ * Waits for changes in the workspace and applies them.
+ *
+ * @param w       Watched workspace.
+ * @param timeout Maximum time to wait for changes in milliseconds. 0 doesn't
+ *                wait at all and -1 waits forever.
+ * @param func    Function called for every change applied or NULL.
+ * @param ctx     Context to be passed to the function.
+ *
+ * @return Number of changes applied or -1 in case of an error or if the
+ *         workspace directory went away. Check errno.
+ */
+int watch_poll(watch_t *w, int timeout, watch_func_t func, void *ctx) {
+#ifdef __linux__
+	const struct inotify_event *ev;
+	const note_t *last;
+	struct pollfd pfd;
+	ssize_t len;
+	ssize_t pos;
+	int count;
+
+	/* Wait for something to happen. */
+	pfd.fd = w->fd;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, timeout) < 0)
+		return (errno == EINTR) ? 0 : -1;
+
+	/* Go through all of the pending events. */
+	count = 0;
+	last = NULL;
+	while ((len = read(w->fd, w->buf, WATCH_BUFSIZE)) > 0) {
+		for (pos = 0; pos < len;
+			 pos += sizeof(struct inotify_event) + ev->len) {
+			ev = (const struct inotify_event *)(w->buf + pos);
+
+			/* The workspace itself went away. */
+			if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+				errno = ENOENT;
+				return -1;
+			}
+
+			/* We've lost track of things, so start over. */
+			if (ev->mask & IN_Q_OVERFLOW) {
+				if (!watch_rescan(w))
+					return -1;
+				last = NULL;
+				if (func)
+					func(WATCH_RESCANNED, NULL, ctx);
+				count++;
+				continue;
+			}
+
+			if ((ev->len > 0) && watch_apply(w, ev->mask, ev->name, &last,
+											 func, ctx)) {
+				count++;
+			}
+		}
+	}
+	if ((len < 0) && (errno != EAGAIN) && (errno != EINTR))
+		return -1;
+
+	return count;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif /* __linux__ */
+}
+
+/**
+ * Gets the number of notes in the workspace.
+ *
+ * @param w Watched workspace.
+ *
+ * @return Number of notes.
+ */
+size_t watch_count(const watch_t *w) {
+	return w->count;
+}
+
+/**
+ * Finds a note by its file name.
+ *
+ * @param w    Watched workspace.
+ * @param name File name of the note.
+ *
+ * @return Note object or NULL if it isn't in the workspace.
+ */
+note_t* watch_find(const watch_t *w, const char *name) {
+	size_t slot;
+	size_t free;
+
+	if (w->nslots == 0)
+		return NULL;
+
+	slot = watch_slot(w, name, strlen(name), &free);
+	return (slot < w->nslots) ? w->slots[slot] : NULL;
+}
+
+/**
+ * Calls a function on every note in the workspace, in no particular order.
+ *
+ * @param w    Watched workspace.
+ * @param func Function to be called for every note.
+ * @param ctx  Context to be passed to the function.
+ */
+void watch_foreach(const watch_t *w, loader_func_t func, void *ctx) {
+	size_t index;
+	size_t i;
+
+	index = 0;
+	for (i = 0; i < w->nslots; i++) {
+		if ((w->slots[i] != NULL) && (w->slots[i] != WATCH_TOMB))
+			func(w->slots[i], index++, ctx);
+	}
+}
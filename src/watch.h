@@ -0,0 +1,78 @@
+/**
+ * watch.h
+ * Keeps an in-memory workspace up to date by watching its directory.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _WATCH_H
+#define _WATCH_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "loader.h"
+#include "note.h"
+#include "notelist.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Types of changes reported by the watcher.
+ */
+typedef enum {
+	WATCH_ADDED,
+	WATCH_REMOVED,
+	WATCH_MODIFIED,
+	WATCH_RESCANNED
+} watch_event_t;
+
+/**
+ * Function called for every change applied to the workspace.
+ *
+ * @param event Type of change.
+ * @param note  Affected note or NULL for rescans. Removed notes are free'd
+ *              right after the callback returns.
+ * @param ctx   Context passed to watch_poll.
+ */
+typedef void (*watch_func_t)(watch_event_t event, const note_t *note,
+							 void *ctx);
+
+/**
+ * Watched workspace object.
+ */
+typedef struct {
+	int fd;
+	int wd;
+	char *path;
+	loader_opts_t opts;
+
+	note_t **slots;
+	size_t nslots;
+	size_t count;
+	size_t used;
+
+	char *buf;
+	char *scratch;
+} watch_t;
+
+/* Construction and destruction. */
+watch_t* watch_new(const char *path, const loader_opts_t *opts);
+void watch_free(watch_t *w);
+
+/* Watching. */
+int watch_fd(const watch_t *w);
+int watch_poll(watch_t *w, int timeout, watch_func_t func, void *ctx);
+
+/* Accessors. */
+size_t watch_count(const watch_t *w);
+note_t* watch_find(const watch_t *w, const char *name);
+void watch_foreach(const watch_t *w, loader_func_t func, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WATCH_H */
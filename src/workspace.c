@@ -0,0 +1,171 @@
+/**
+ * workspace.c
+ * Directory that holds notes, kept open so they can be reached relative to it.
+ *
+ * Keeping the directory open means notes are opened, stat'ed and created with
+ * the *at family of system calls using just their names, so the kernel never
+ * has to resolve the workspace's path again, and it keeps working even if the
+ * workspace gets moved around while we're running. Names that have to be built
+ * on the fly go into a scratch buffer owned by the workspace, so none of this
+ * ever touches the heap.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "workspace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fsutils.h"
+#include "stats.h"
+#include "strutils.h"
+
+/**
+ * Opens a workspace directory.
+ * @warning The object allocated by this function must be free'd after use.
+ *
+ * @param path Path to the workspace directory.
+ *
+ * @return Workspace object or NULL in case of an error. Check errno.
+ *
+ * @see workspace_free
+ */
+workspace_t* workspace_open(const char *path) {
+	workspace_t *ws;
+	int fd;
+
+	/* Open the directory itself. */
+	STATS_INC(STATS_SYS_OPEN);
+	fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	/* Allocate our object. */
+	ws = (workspace_t *)malloc(sizeof(workspace_t));
+	if (ws == NULL) {
+		close(fd);
+		errno = ENOMEM;
+		return NULL;
+	}
+	ws->path = NULL;
+	string_copy(&ws->path, path);
+	ws->path_len = (ws->path != NULL) ? strlen(ws->path) : 0;
+	ws->fd = fd;
+	ws->fname[0] = '\0';
+
+	return ws;
+}
+
+/**
+ * Closes a workspace and frees it up.
+ *
+ * @param ws Workspace object to be free'd.
+ */
+void workspace_free(workspace_t *ws) {
+	/* Do we even have anything to do? */
+	if (ws == NULL)
+		return;
+
+	STATS_INC(STATS_SYS_CLOSE);
+	close(ws->fd);
+	if (ws->path)
+		free(ws->path);
+	free(ws);
+}
+
+/**
+ * Gets the path the workspace was opened from.
+ *
+ * @param ws Workspace object.
+ *
+ * @return Path to the workspace directory.
+ */
+const char* workspace_get_path(const workspace_t *ws) {
+	return ws->path;
+}
+
+/**
+ * Gets the file descriptor of the workspace directory.
+ *
+ * @param ws Workspace object.
+ *
+ * @return Directory file descriptor.
+ */
+int workspace_get_fd(const workspace_t *ws) {
+	return ws->fd;
+}
+
+/**
+ * Gets the scratch buffer used to build file names in the workspace. It's
+ * always WORKSPACE_FNAME_MAX characters long.
+ *
+ * @warning The buffer is shared by everyone using the workspace, so it must
+ *          only be used from one thread at a time and its contents are only
+ *          valid until the next time it's requested.
+ *
+ * @param ws Workspace object.
+ *
+ * @return Scratch buffer.
+ */
+char* workspace_scratch(workspace_t *ws) {
+	return ws->fname;
+}
+
+/**
+ * Gets the name of a file relative to the workspace from its full path.
+ *
+ * @param ws   Workspace object.
+ * @param path Path to a file inside the workspace.
+ *
+ * @return Pointer inside the path where the name relative to the workspace
+ *         starts or NULL if the file isn't inside the workspace.
+ */
+const char* workspace_relname(const workspace_t *ws, const char *path) {
+	const char *name;
+
+	/* Make sure the path actually starts with the workspace's. */
+	if ((ws->path_len == 0) || (strncmp(path, ws->path, ws->path_len) != 0))
+		return NULL;
+	name = path + ws->path_len;
+	if ((*name != PATH_SEP) && (ws->path[ws->path_len - 1] != PATH_SEP))
+		return NULL;
+
+	/* Skip over the separators. */
+	while (*name == PATH_SEP)
+		name++;
+
+	return (*name == '\0') ? NULL : name;
+}
+
+/**
+ * Opens a file relative to the workspace. Files that get created are readable
+ * by everyone and writable only by their owner.
+ *
+ * @param ws    Workspace object.
+ * @param name  Name of the file relative to the workspace.
+ * @param flags Same flags as open.
+ *
+ * @return Opened file descriptor or -1 in case of an error. Check errno.
+ */
+int workspace_openat(const workspace_t *ws, const char *name, int flags) {
+	STATS_INC(STATS_SYS_OPEN);
+	return openat(ws->fd, name, flags | O_CLOEXEC, 0644);
+}
+
+/**
+ * Gets information about a file relative to the workspace.
+ *
+ * @param ws   Workspace object.
+ * @param name Name of the file relative to the workspace.
+ * @param st   Will hold the information about the file.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ */
+bool workspace_stat(const workspace_t *ws, const char *name, struct stat *st) {
+	STATS_INC(STATS_SYS_STAT);
+	return fstatat(ws->fd, name, st, 0) == 0;
+}
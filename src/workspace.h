@@ -0,0 +1,56 @@
+/**
+ * workspace.h
+ * Directory that holds notes, kept open so they can be reached relative to it.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _WORKSPACE_H
+#define _WORKSPACE_H
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Size of the scratch buffer used to build file names in a workspace. */
+#ifdef NAME_MAX
+	#define WORKSPACE_FNAME_MAX (NAME_MAX + 1)
+#else
+	#define WORKSPACE_FNAME_MAX 256
+#endif /* NAME_MAX */
+
+/**
+ * Workspace abstraction object.
+ */
+typedef struct {
+	char *path;
+	size_t path_len;
+	int fd;
+
+	char fname[WORKSPACE_FNAME_MAX];
+} workspace_t;
+
+/* Opening and closing. */
+workspace_t* workspace_open(const char *path);
+void workspace_free(workspace_t *ws);
+
+/* Getters. */
+const char* workspace_get_path(const workspace_t *ws);
+int workspace_get_fd(const workspace_t *ws);
+char* workspace_scratch(workspace_t *ws);
+const char* workspace_relname(const workspace_t *ws, const char *path);
+
+/* File operations. */
+int workspace_openat(const workspace_t *ws, const char *name, int flags);
+bool workspace_stat(const workspace_t *ws, const char *name, struct stat *st);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WORKSPACE_H */
@@ -0,0 +1,717 @@
+/**
+ * wsindex.c
+ * Persistent on-disk index of the metadata of every note in a workspace.
+ *
+ * The index is a header followed by one record per directory entry. Each
+ * record holds the parsed date of the note as a day number, so that the index
+ * stays valid across timezones, the file's size, modification time and inode,
+ * and the file name itself, with the title and format stored as offsets into
+ * it. Entries that couldn't be parsed as notes are also recorded so that we
+ * don't have to look at them again.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "wsindex.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dateutils.h"
+#include "fsutils.h"
+#include "strutils.h"
+
+/* Sizes of the fixed parts of the index file. */
+#define WSINDEX_HEADER_SIZE 32
+#define WSINDEX_RECORD_SIZE 44
+
+/* Offset of the directory modification time inside the header. */
+#define WSINDEX_DIR_MTIME_OFFSET 16
+
+/**
+ * In-memory representation of an index record.
+ */
+typedef struct {
+	int64_t date;
+	uint64_t size;
+	int64_t mtime;
+	uint64_t inode;
+
+	uint16_t name_len;
+	uint16_t title_off;
+	uint16_t title_len;
+	uint16_t fmt_off;
+	uint16_t flags;
+
+	const char *name;
+	size_t name_off;
+} wsindex_rec_t;
+
+/**
+ * In-memory representation of the whole index.
+ */
+typedef struct {
+	int64_t dir_mtime;
+	uint64_t dir_inode;
+
+	wsindex_rec_t *recs;
+	size_t len;
+	size_t cap;
+} wsindex_t;
+
+/**
+ * Appends a record to the in-memory index.
+ *
+ * @param idx Index object.
+ * @param rec Record to be appended.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if we couldn't allocate enough memory.
+ */
+static bool wsindex_push(wsindex_t *idx, const wsindex_rec_t *rec) {
+	wsindex_rec_t *recs;
+	size_t cap;
+
+	/* Grow the array if needed. */
+	if (idx->len == idx->cap) {
+		cap = (idx->cap == 0) ? 256 : idx->cap * 2;
+		recs = (wsindex_rec_t *)realloc(idx->recs, cap * sizeof(wsindex_rec_t));
+		if (recs == NULL)
+			return false;
+		idx->recs = recs;
+		idx->cap = cap;
+	}
+
+	idx->recs[idx->len++] = *rec;
+	return true;
+}
+
+/**
+ * Parses an index file that has been read into memory.
+ *
+ * @param idx  Index object to be populated. Record names will point inside the
+ *             buffer.
+ * @param buf  Contents of the index file.
+ * @param len  Length of the contents.
+ *
+ * @return TRUE if the index was valid.
+ *         FALSE if it's corrupt or from another version.
+ */
+static bool wsindex_parse(wsindex_t *idx, const char *buf, size_t len) {
+	wsindex_rec_t rec;
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	size_t pos;
+	uint32_t i;
+
+	/* Check the header. */
+	if (len < WSINDEX_HEADER_SIZE)
+		return false;
+	memcpy(&magic, buf, sizeof(uint32_t));
+	memcpy(&version, buf + 4, sizeof(uint32_t));
+	memcpy(&count, buf + 8, sizeof(uint32_t));
+	if ((magic != WSINDEX_MAGIC) || (version != WSINDEX_VERSION))
+		return false;
+	memcpy(&idx->dir_mtime, buf + WSINDEX_DIR_MTIME_OFFSET, sizeof(int64_t));
+	memcpy(&idx->dir_inode, buf + 24, sizeof(uint64_t));
+
+	/* Go through the records. */
+	pos = WSINDEX_HEADER_SIZE;
+	for (i = 0; i < count; i++) {
+		if ((len - pos) < WSINDEX_RECORD_SIZE)
+			return false;
+
+		memcpy(&rec.date, buf + pos, sizeof(int64_t));
+		memcpy(&rec.size, buf + pos + 8, sizeof(uint64_t));
+		memcpy(&rec.mtime, buf + pos + 16, sizeof(int64_t));
+		memcpy(&rec.inode, buf + pos + 24, sizeof(uint64_t));
+		memcpy(&rec.name_len, buf + pos + 32, sizeof(uint16_t));
+		memcpy(&rec.title_off, buf + pos + 34, sizeof(uint16_t));
+		memcpy(&rec.title_len, buf + pos + 36, sizeof(uint16_t));
+		memcpy(&rec.fmt_off, buf + pos + 38, sizeof(uint16_t));
+		memcpy(&rec.flags, buf + pos + 40, sizeof(uint16_t));
+		pos += WSINDEX_RECORD_SIZE;
+
+		/* Names are stored NULL terminated. */
+		if (((len - pos) < ((size_t)rec.name_len + 1)) ||
+				(buf[pos + rec.name_len] != '\0') ||
+				(((size_t)rec.title_off + rec.title_len) > rec.name_len) ||
+				(rec.fmt_off > rec.name_len)) {
+			return false;
+		}
+		rec.name = buf + pos;
+		pos += rec.name_len + 1;
+
+		if (!wsindex_push(idx, &rec))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * qsort and bsearch comparison function for string pointers.
+ *
+ * @param a Pointer to a string.
+ * @param b Pointer to another string.
+ *
+ * @return Same as strcmp.
+ */
+static int wsindex_name_cmp(const void *a, const void *b) {
+	return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+/**
+ * Checks if a name belongs to the index file itself or its temporary file.
+ *
+ * @param name Name of a directory entry.
+ *
+ * @return TRUE if it's one of ours.
+ */
+static bool wsindex_is_own(const char *name) {
+	return strncmp(name, WSINDEX_FNAME, sizeof(WSINDEX_FNAME) - 1) == 0;
+}
+
+/**
+ * Checks if the entries of a directory are still the ones in an index, leaving
+ * out the index file itself.
+ *
+ * @param idx  Index object.
+ * @param path Path to the workspace directory.
+ *
+ * @return TRUE if the directory has exactly the entries in the index.
+ *         FALSE if they differ or an error occurred.
+ */
+static bool wsindex_unchanged(const wsindex_t *idx, const char *path) {
+	fs_dirscan_t scan;
+	const fs_dirent_t *entries;
+	const char **names;
+	const char *name;
+	size_t len;
+	size_t seen;
+	size_t count;
+	size_t i;
+	bool ret;
+
+	/* Sort the names in the index so that we can look them up. */
+	names = (const char **)malloc((idx->len + 1) * sizeof(char *));
+	if (names == NULL)
+		return false;
+	len = 0;
+	for (i = 0; i < idx->len; i++) {
+		if (!wsindex_is_own(idx->recs[i].name))
+			names[len++] = idx->recs[i].name;
+	}
+	if (len > 1)
+		qsort(names, len, sizeof(char *), wsindex_name_cmp);
+
+	/* Every entry in the directory must be one of them. */
+	if (!fs_dirscan_open(&scan, path, FS_SCAN_FILES)) {
+		free(names);
+		return false;
+	}
+	ret = true;
+	seen = 0;
+	while (ret && ((count = fs_dirscan_next(&scan, &entries)) > 0)) {
+		for (i = 0; ret && (i < count); i++) {
+			name = entries[i].name;
+			if (wsindex_is_own(name))
+				continue;
+
+			ret = (len > 0) && (bsearch(&name, names, len, sizeof(char *),
+										wsindex_name_cmp) != NULL);
+			seen++;
+		}
+	}
+	if (fs_dirscan_error(&scan) != 0)
+		ret = false;
+	fs_dirscan_close(&scan);
+	free(names);
+
+	return ret && (seen == len);
+}
+
+/**
+ * Serializes the in-memory index and atomically replaces the index file in the
+ * workspace with it.
+ *
+ * @param idx  Index object.
+ * @param path Path to the workspace directory.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ */
+static bool wsindex_write(const wsindex_t *idx, const char *path) {
+	char *tmppath;
+	char *idxpath;
+	char *buf;
+	char *cur;
+	struct stat st;
+	uint32_t u32;
+	int64_t dir_mtime;
+	size_t len;
+	size_t i;
+	ssize_t n;
+	int fd;
+	bool ret;
+
+	/* Figure out how big the index is going to be. */
+	len = WSINDEX_HEADER_SIZE;
+	for (i = 0; i < idx->len; i++)
+		len += WSINDEX_RECORD_SIZE + idx->recs[i].name_len + 1;
+	buf = (char *)calloc(len, sizeof(char));
+	if (buf == NULL)
+		return false;
+
+	/* Build the header. */
+	u32 = WSINDEX_MAGIC;
+	memcpy(buf, &u32, sizeof(uint32_t));
+	u32 = WSINDEX_VERSION;
+	memcpy(buf + 4, &u32, sizeof(uint32_t));
+	u32 = (uint32_t)idx->len;
+	memcpy(buf + 8, &u32, sizeof(uint32_t));
+	memcpy(buf + WSINDEX_DIR_MTIME_OFFSET, &idx->dir_mtime, sizeof(int64_t));
+	memcpy(buf + 24, &idx->dir_inode, sizeof(uint64_t));
+
+	/* Build the records. */
+	cur = buf + WSINDEX_HEADER_SIZE;
+	for (i = 0; i < idx->len; i++) {
+		const wsindex_rec_t *rec = &idx->recs[i];
+
+		memcpy(cur, &rec->date, sizeof(int64_t));
+		memcpy(cur + 8, &rec->size, sizeof(uint64_t));
+		memcpy(cur + 16, &rec->mtime, sizeof(int64_t));
+		memcpy(cur + 24, &rec->inode, sizeof(uint64_t));
+		memcpy(cur + 32, &rec->name_len, sizeof(uint16_t));
+		memcpy(cur + 34, &rec->title_off, sizeof(uint16_t));
+		memcpy(cur + 36, &rec->title_len, sizeof(uint16_t));
+		memcpy(cur + 38, &rec->fmt_off, sizeof(uint16_t));
+		memcpy(cur + 40, &rec->flags, sizeof(uint16_t));
+		cur += WSINDEX_RECORD_SIZE;
+
+		memcpy(cur, rec->name, rec->name_len);
+		cur += rec->name_len + 1;
+	}
+
+	/* Build the paths to the index file. */
+	idxpath = NULL;
+	string_copy(&idxpath, path);
+	fs_pathcat(&idxpath, WSINDEX_FNAME);
+	tmppath = NULL;
+	string_copy(&tmppath, idxpath);
+	string_concat(&tmppath, ".tmp");
+
+	/* Write everything to a temporary file in one go. */
+	ret = false;
+	fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+		goto cleanup;
+	n = write(fd, buf, len);
+	if ((n < 0) || ((size_t)n != len)) {
+		close(fd);
+		unlink(tmppath);
+		goto cleanup;
+	}
+
+	/* Atomically replace the old index. */
+	if (rename(tmppath, idxpath) != 0) {
+		close(fd);
+		unlink(tmppath);
+		goto cleanup;
+	}
+
+	/* Replacing the index touched the directory, so record its new time, but
+	 * only if nothing else changed in it since it was scanned. Otherwise the
+	 * time taken before the scan stays and the index is rebuilt next time. */
+	ret = true;
+	if ((stat(path, &st) == 0) && wsindex_unchanged(idx, path)) {
+		dir_mtime = fs_stat_mtime(&st);
+		n = pwrite(fd, &dir_mtime, sizeof(int64_t), WSINDEX_DIR_MTIME_OFFSET);
+		ret = n == sizeof(int64_t);
+	}
+	close(fd);
+
+cleanup:
+	free(buf);
+	free(tmppath);
+	free(idxpath);
+
+	return ret;
+}
+
+/**
+ * qsort and bsearch comparison function for index records by name.
+ *
+ * @param a Index record.
+ * @param b Another index record.
+ *
+ * @return Same as strcmp on their names.
+ */
+static int wsindex_rec_cmp(const void *a, const void *b) {
+	return strcmp(((const wsindex_rec_t *)a)->name,
+				  ((const wsindex_rec_t *)b)->name);
+}
+
+/**
+ * Builds a note object out of an index record.
+ *
+ * @param rec      Index record.
+ * @param basepath Path to the workspace directory.
+ * @param scratch  Scratch buffer used to build the path. (Will be reallocated)
+ * @param arena    Arena to allocate the note from or NULL to use the heap.
+ *
+ * @return Brand new note object or NULL in case of an error.
+ */
+static note_t* wsindex_rec_note(const wsindex_rec_t *rec, const char *basepath,
+								char **scratch, arena_t *arena) {
+	note_t *note;
+
+	note = note_new_arena(arena);
+	if (note == NULL)
+		return NULL;
+
+	/* Populate the note with the metadata we had stored. */
+	note_set_date(note, date_from_days((int32_t)rec->date));
+	note_set_title_untilp(note, rec->name + rec->title_off,
+						  rec->name + rec->title_off + rec->title_len);
+	note_set_format(note, rec->name + rec->fmt_off);
+	note->size = rec->size;
+	note->mtime = rec->mtime;
+	note->inode = rec->inode;
+
+	/* Build the path to the note. */
+	string_copy(scratch, basepath);
+	fs_pathcat(scratch, rec->name);
+	note_set_path(note, *scratch);
+
+	return note;
+}
+
+/**
+ * Builds an index record by looking at a directory entry, reusing the metadata
+ * from an old record if it's still valid.
+ *
+ * @param rec  Index record to be populated.
+ * @param old  Old record for the same name or NULL if there isn't one.
+ * @param name Name of the directory entry.
+ * @param st   File information of the entry.
+ */
+static void wsindex_rec_build(wsindex_rec_t *rec, const wsindex_rec_t *old,
+							  const char *name, const struct stat *st) {
+	note_fname_t parsed;
+
+	/* Populate the file information. */
+	memset(rec, 0, sizeof(wsindex_rec_t));
+	rec->name = name;
+	rec->name_len = (uint16_t)strlen(name);
+	rec->size = (uint64_t)st->st_size;
+	rec->mtime = fs_stat_mtime(st);
+	rec->inode = (uint64_t)st->st_ino;
+
+	/* The metadata only depends on the name, so reuse it if we can. */
+	if (old != NULL) {
+		rec->date = old->date;
+		rec->title_off = old->title_off;
+		rec->title_len = old->title_len;
+		rec->fmt_off = old->fmt_off;
+		rec->flags = old->flags;
+
+		return;
+	}
+
+	/* Parse the metadata from the name. */
+	if (!note_parse_fname(name, &parsed)) {
+		rec->flags = WSINDEX_REJECTED;
+		rec->fmt_off = rec->name_len;
+		return;
+	}
+	rec->date = parsed.days;
+	rec->title_off = (uint16_t)(parsed.title - name);
+	rec->title_len = (uint16_t)parsed.title_len;
+	rec->fmt_off = (uint16_t)(parsed.format - name);
+}
+
+/**
+ * Rebuilds the index by walking the workspace directory, only parsing the
+ * entries that weren't already in the old index.
+ *
+ * @param idx  New index object to be populated. Record names will be allocated
+ *             in the names buffer.
+ * @param old  Old index object sorted by name.
+ * @param path Path to the workspace directory.
+ * @param names Buffer that will hold the names. (Allocated by this function)
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ */
+static bool wsindex_refresh(wsindex_t *idx, const wsindex_t *old,
+							const char *path, char **names) {
+	fs_dirscan_t scan;
+	const fs_dirent_t *entries;
+	wsindex_rec_t key;
+	wsindex_rec_t rec;
+	const wsindex_rec_t *found;
+	struct stat st;
+	size_t nlen;
+	size_t ncap;
+	size_t count;
+	size_t i;
+	char *buf;
+	int err;
+
+	/* Walk the directory. */
+	if (!fs_dirscan_open(&scan, path, FS_SCAN_FILES))
+		return false;
+
+	*names = NULL;
+	nlen = 0;
+	ncap = 0;
+	while ((count = fs_dirscan_next(&scan, &entries)) > 0) {
+		for (i = 0; i < count; i++) {
+			size_t len;
+
+			/* Get the file information relative to the directory. */
+			len = strlen(entries[i].name) + 1;
+			if ((len > UINT16_MAX) ||
+					(fstatat(scan.fd, entries[i].name, &st, 0) != 0)) {
+				continue;
+			}
+
+			/* Keep the name around. Records point to it by offset for now. */
+			if ((nlen + len) > ncap) {
+				ncap = (ncap == 0) ? 16384 : ncap * 2;
+				while (ncap < (nlen + len))
+					ncap *= 2;
+				buf = (char *)realloc(*names, ncap * sizeof(char));
+				if (buf == NULL)
+					goto fail;
+				*names = buf;
+			}
+			memcpy(*names + nlen, entries[i].name, len);
+
+			/* Look for the entry in the old index. */
+			key.name = entries[i].name;
+			found = NULL;
+			if (old->len > 0) {
+				found = (const wsindex_rec_t *)bsearch(&key, old->recs,
+					old->len, sizeof(wsindex_rec_t), wsindex_rec_cmp);
+			}
+
+			/* Build the new record. */
+			wsindex_rec_build(&rec, found, entries[i].name, &st);
+			rec.name_off = nlen;
+			if (!wsindex_push(idx, &rec))
+				goto fail;
+			nlen += len;
+		}
+	}
+	err = fs_dirscan_error(&scan);
+	fs_dirscan_close(&scan);
+	if (err != 0) {
+		errno = err;
+		return false;
+	}
+
+	/* Now that the names buffer won't move anymore, fix up the pointers. */
+	for (i = 0; i < idx->len; i++)
+		idx->recs[i].name = *names + idx->recs[i].name_off;
+
+	return true;
+
+fail:
+	fs_dirscan_close(&scan);
+	errno = ENOMEM;
+	return false;
+}
+
+/**
+ * Gets the up to date index of a workspace. If the directory hasn't changed
+ * since the index was written this is a single sequential read, otherwise the
+ * directory is walked, only new entries are parsed and the index is updated on
+ * disk.
+ * @warning Everything must be released with wsindex_close afterwards, even if
+ *          this function fails.
+ *
+ * @param path  Path to the workspace directory.
+ * @param old   Will hold the index that was stored in the workspace.
+ * @param idx   Will hold the rebuilt index if the old one was stale.
+ * @param use   Will point to whichever of the two is up to date.
+ * @param view  Will hold the view over the stored index file.
+ * @param names Will hold the names of the entries of a rebuilt index.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ *
+ * @see wsindex_close
+ */
+static bool wsindex_open(const char *path, wsindex_t *old, wsindex_t *idx,
+						 const wsindex_t **use, fs_view_t *view,
+						 char **names) {
+	struct stat st;
+	char *idxpath;
+	FILE *fh;
+	bool valid;
+	bool ret;
+
+	/* Get the current state of the directory. */
+	memset(old, 0, sizeof(wsindex_t));
+	memset(idx, 0, sizeof(wsindex_t));
+	view->data = "";
+	view->len = 0;
+	view->mapped = false;
+	view->borrowed = false;
+	*names = NULL;
+	*use = idx;
+	if (stat(path, &st) != 0)
+		return false;
+
+	/* Read the old index in one go. */
+	idxpath = NULL;
+	string_copy(&idxpath, path);
+	fs_pathcat(&idxpath, WSINDEX_FNAME);
+	fh = fopen(idxpath, "rb");
+	free(idxpath);
+	valid = false;
+	if (fh != NULL) {
+		valid = fs_fview(fh, view) && wsindex_parse(old, view->data, view->len);
+		if (!valid)
+			old->len = 0;
+		fclose(fh);
+	}
+
+	/* Check if the index is still valid for the directory. */
+	ret = true;
+	if (valid && (old->dir_mtime == fs_stat_mtime(&st)) &&
+			(old->dir_inode == (uint64_t)st.st_ino)) {
+		*use = old;
+	} else {
+		/* Rebuild the index reusing whatever we can from the old one. */
+		if (old->len > 1)
+			qsort(old->recs, old->len, sizeof(wsindex_rec_t), wsindex_rec_cmp);
+		idx->dir_mtime = fs_stat_mtime(&st);
+		idx->dir_inode = (uint64_t)st.st_ino;
+		ret = wsindex_refresh(idx, old, path, names);
+		if (ret)
+			wsindex_write(idx, path);
+	}
+
+	return ret;
+}
+
+/**
+ * Releases everything that was used to get the index of a workspace.
+ *
+ * @param old   Index that was stored in the workspace.
+ * @param idx   Rebuilt index.
+ * @param view  View over the stored index file.
+ * @param names Names of the entries of the rebuilt index.
+ *
+ * @see wsindex_open
+ */
+static void wsindex_close(wsindex_t *old, wsindex_t *idx, fs_view_t *view,
+						  char *names) {
+	if (old->recs)
+		free(old->recs);
+	if (idx->recs)
+		free(idx->recs);
+	if (names)
+		free(names);
+	fs_fview_release(view);
+}
+
+/**
+ * Loads the metadata of every note in a workspace using the index stored in it.
+ * If the directory hasn't changed since the index was written this is a single
+ * sequential read, otherwise the directory is walked, only new entries are
+ * parsed and the index is updated on disk.
+ *
+ * @param path Path to the workspace directory.
+ * @param list Note collection to append the notes to. They will be sorted by
+ *             date, title and format. If it uses an arena the notes will be
+ *             allocated from it.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ */
+bool wsindex_load(const char *path, notelist_t *list) {
+	wsindex_t old;
+	wsindex_t idx;
+	const wsindex_t *use;
+	fs_view_t view;
+	char *names;
+	char *scratch;
+	note_t *note;
+	size_t i;
+	bool ret;
+
+	/* Build the notes. */
+	ret = wsindex_open(path, &old, &idx, &use, &view, &names);
+	scratch = NULL;
+	for (i = 0; ret && (i < use->len); i++) {
+		if (use->recs[i].flags & WSINDEX_REJECTED)
+			continue;
+
+		note = wsindex_rec_note(&use->recs[i], path, &scratch,
+								notelist_arena(list));
+		if ((note == NULL) || !notelist_push(list, note)) {
+			note_free(note);
+			errno = ENOMEM;
+			ret = false;
+		}
+	}
+	notelist_sort(list);
+
+	/* Clean up. */
+	wsindex_close(&old, &idx, &view, names);
+	if (scratch)
+		free(scratch);
+
+	return ret;
+}
+
+/**
+ * Loads the metadata of every note in a workspace into a metadata store using
+ * the index stored in it, without creating a single note object.
+ *
+ * @param path Path to the workspace directory.
+ * @param ms   Metadata store to append the notes to.
+ *
+ * @return TRUE if the operation was successful.
+ *         FALSE if an error occurred. Check errno.
+ *
+ * @see wsindex_load
+ */
+bool wsindex_load_meta(const char *path, metastore_t *ms) {
+	wsindex_t old;
+	wsindex_t idx;
+	const wsindex_t *use;
+	const wsindex_rec_t *rec;
+	fs_view_t view;
+	char *names;
+	uint16_t dir;
+	size_t i;
+	bool ret;
+
+	/* Push the records straight into the columns. */
+	ret = wsindex_open(path, &old, &idx, &use, &view, &names) &&
+		metastore_add_dir(ms, path, &dir);
+	for (i = 0; ret && (i < use->len); i++) {
+		rec = &use->recs[i];
+		if (rec->flags & WSINDEX_REJECTED)
+			continue;
+
+		if (!metastore_push(ms, dir, rec->name, rec->size, rec->mtime,
+							rec->inode) && (errno != EINVAL)) {
+			ret = false;
+		}
+	}
+
+	/* Clean up. */
+	wsindex_close(&old, &idx, &view, names);
+
+	return ret;
+}
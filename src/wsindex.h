@@ -0,0 +1,40 @@
+/**
+ * wsindex.h
+ * Persistent on-disk index of the metadata of every note in a workspace.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _WSINDEX_H
+#define _WSINDEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "metastore.h"
+#include "notelist.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Name of the index file inside the workspace. */
+#define WSINDEX_FNAME ".notein.idx"
+
+/* Index file format identification. */
+#define WSINDEX_MAGIC   0x5844494EUL /* "NIDX" */
+#define WSINDEX_VERSION 2
+
+/* Index record flags. */
+#define WSINDEX_REJECTED 0x0001
+
+/* Loading. */
+bool wsindex_load(const char *path, notelist_t *list);
+bool wsindex_load_meta(const char *path, metastore_t *ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WSINDEX_H */
@@ -0,0 +1,217 @@
+#!/bin/sh
+### regress.sh
+### Regression tests that run the application against throwaway workspaces.
+###
+### Author: Nathan Campos <nathan@innoveworkshop.com>
+
+NOTEIN="${1:-build/notein}"
+TMPDIR="$(mktemp -d)" || exit 1
+FAILED=0
+trap 'rm -rf "$TMPDIR"' EXIT
+
+# Reports the result of a test.
+result() {
+	if [ "$2" -eq 0 ]; then
+		echo "PASS $1"
+	else
+		echo "FAIL $1"
+		FAILED=1
+	fi
+}
+
+# Creates an empty workspace with the given notes in it.
+workspace() {
+	ws="$TMPDIR/$1"
+	shift
+	mkdir -p "$ws"
+	for name in "$@"; do
+		echo "$name" > "$ws/$name"
+	done
+}
+
+# Notes from the same day must be picked in the order they are sorted, by title
+# and then format, with and without the index.
+test_recent_index() {
+	workspace recent "2024-01-01_a b.md" "2024-01-01_a.txt" "2024-01-01_a.md" \
+		"2024-01-01_ab" "2023-12-31_z.md"
+	ret=0
+	for k in 1 2 3 4 5 6; do
+		"$NOTEIN" -n -I recent "$ws" "$k" > "$TMPDIR/scan.out" 2>&1
+		"$NOTEIN" -n recent "$ws" "$k" > "$TMPDIR/index.out" 2>&1
+		cmp -s "$TMPDIR/scan.out" "$TMPDIR/index.out" || ret=1
+	done
+	result recent_index $ret
+}
+
+# Regular expressions in filters may hold spaces up to their closing slash,
+# like the example in the README.
+test_filter_regex() {
+	workspace regex "2024-01-01_Re: hello.md" "2024-01-02_fwd: notes.md" \
+		"2024-01-03_Report.md" "2024-01-04_re:nospace.md"
+	"$NOTEIN" -n -f tsv -i -w "title:/^(re|fwd): /" list "$ws" \
+		> "$TMPDIR/regex.out" 2>&1
+	printf '%s\n' "2024-01-01_Re: hello.md" "2024-01-02_fwd: notes.md" \
+		> "$TMPDIR/regex.exp"
+	cut -f 4 "$TMPDIR/regex.out" | sed 's|.*/||' | cmp -s - "$TMPDIR/regex.exp"
+	result filter_regex $?
+}
+
+# Looking for changes with and without subdirectories must not make the notes
+# in them look like they came and went.
+test_changed_depth() {
+	workspace changed "2024-01-01_top.md"
+	mkdir -p "$ws/sub"
+	echo sub > "$ws/sub/2024-01-02_sub.md"
+	"$NOTEIN" -r changed "$ws" > /dev/null 2>&1
+	"$NOTEIN" changed "$ws" > /dev/null 2>&1
+	"$NOTEIN" -r changed "$ws" > "$TMPDIR/changed.out" 2>&1
+	"$NOTEIN" changed "$ws" >> "$TMPDIR/changed.out" 2>&1
+	[ ! -s "$TMPDIR/changed.out" ]
+	result changed_depth $?
+}
+
+# Signs the index of a pack again after it has been tampered with. gzip's
+# trailer carries the same CRC-32 that zlib uses for the index.
+pack_resign() {
+	len=$(wc -c < "$1")
+	off=$(od -An -t u8 -j $((len - 24)) -N 8 "$1" | tr -d ' ')
+	dd if="$1" bs=1 skip="$off" count=$((len - 24 - off)) 2> /dev/null | \
+		gzip -c | tail -c 8 | head -c 4 | \
+		dd of="$1" bs=1 seek=$((len - 12)) conv=notrunc 2> /dev/null
+}
+
+# Packing a workspace and unpacking it somewhere else must give us back the
+# same notes, with and without compression.
+test_pack_roundtrip() {
+	workspace pack "2024-01-01_one.md" "2024-01-02_two.txt"
+	mkdir -p "$ws/sub"
+	printf 'sub\nwith more lines\n' > "$ws/sub/2024-01-03_sub.md"
+	ret=0
+	for z in "" "-z"; do
+		rm -rf "$TMPDIR/unpacked"
+		"$NOTEIN" -r $z pack "$ws" "$TMPDIR/pack.npk" > /dev/null 2>&1 || ret=1
+		"$NOTEIN" unpack "$TMPDIR/pack.npk" "$TMPDIR/unpacked" \
+			> /dev/null 2>&1 || ret=1
+		for note in "2024-01-01_one.md" "2024-01-02_two.txt" \
+				"sub/2024-01-03_sub.md"; do
+			cmp -s "$ws/$note" "$TMPDIR/unpacked/$note" || ret=1
+		done
+	done
+	result pack_roundtrip $ret
+}
+
+# Packs that were cut short or that hold names escaping the destination
+# directory must be rejected before anything gets extracted.
+test_pack_reject() {
+	workspace reject "2024-01-01_one.md"
+	mkdir -p "$ws/ab"
+	echo x > "$ws/ab/2024-01-02_x.md"
+	"$NOTEIN" -r pack "$ws" "$TMPDIR/good.npk" > /dev/null 2>&1
+	ret=0
+
+	# Truncated.
+	head -c $(($(wc -c < "$TMPDIR/good.npk") - 10)) "$TMPDIR/good.npk" \
+		> "$TMPDIR/short.npk"
+	"$NOTEIN" list "$TMPDIR/short.npk" > /dev/null 2>&1 && ret=1
+
+	# Turn "ab/2024-01-02_x.md" into "../2024-01-02_x.md".
+	cp "$TMPDIR/good.npk" "$TMPDIR/evil.npk"
+	pos=$(grep -a -b -o "ab/2024" "$TMPDIR/evil.npk" | head -n 1 | cut -d : -f 1)
+	[ -n "$pos" ] || ret=1
+	printf '../' | dd of="$TMPDIR/evil.npk" bs=1 seek="$pos" conv=notrunc \
+		2> /dev/null
+	pack_resign "$TMPDIR/evil.npk"
+	mkdir -p "$TMPDIR/evil/dest"
+	"$NOTEIN" unpack "$TMPDIR/evil.npk" "$TMPDIR/evil/dest" \
+		> /dev/null 2>&1 && ret=1
+	[ -e "$TMPDIR/evil/2024-01-02_x.md" ] && ret=1
+
+	result pack_reject $ret
+}
+
+# Checks that a title lookup finds exactly the titles given after the command,
+# separated by a comma, in any order.
+title_is() {
+	expected="$1"
+	shift
+	"$NOTEIN" -n -f tsv "$@" 2> /dev/null | cut -f 2 | sort > "$TMPDIR/title.out"
+	printf '%s\n' "$expected" | tr ',' '\n' | sed '/^$/d' | sort | \
+		cmp -s - "$TMPDIR/title.out"
+}
+
+# Title lookups must tell apart titles that share a prefix, respect the case
+# unless told otherwise, and stick to the edit distance they were given.
+test_title_lookup() {
+	workspace title "2024-01-01_Meeting.md" "2024-01-02_Meeting notes.md" \
+		"2024-01-03_Meetings.txt" "2024-01-04_meeting.md" "2024-01-05_Meat.md" \
+		"2024-01-06_Greeting.md"
+	ret=0
+	title_is "Meeting" title "$ws" exact "Meeting" || ret=1
+	title_is "" title "$ws" exact "Meet" || ret=1
+	title_is "Meeting,meeting" -i title "$ws" exact "MEETING" || ret=1
+	title_is "Meeting,Meeting notes,Meetings" title "$ws" prefix "Meet" || ret=1
+	title_is "Meeting,Meeting notes,Meetings,meeting" -i title "$ws" prefix \
+		"meeting" || ret=1
+	title_is "Meeting" title "$ws" fuzzy "Meeting" 0 || ret=1
+	title_is "Meeting,Meetings,meeting" title "$ws" fuzzy "Meeting" 1 || ret=1
+	title_is "Meeting,Meetings,meeting,Greeting" title "$ws" fuzzy "Meeting" 2 \
+		|| ret=1
+	title_is "Meeting,meeting" -i title "$ws" fuzzy "MEETING" 0 || ret=1
+	title_is "Meat" -i title "$ws" fuzzy "meat" 1 || ret=1
+	result title_lookup $ret
+}
+
+# Tags and TODO items must only come from the prose of a note, never from code,
+# language names or links, and headings must not leak from one note to the next.
+test_markdown_extract() {
+	workspace markdown
+	cat > "$ws/2024-01-01_first.md" <<-'EOF'
+	# Project #alpha
+
+	Some text with #beta and an issue #123.
+	Learning C# is fun, see http://example.com/page#fragment too.
+	Inline `#notatag` code and `TODO: not this` either.
+
+	```
+	#fenced
+	- [ ] fenced task
+	TODO: fenced todo
+	```
+
+	## Tasks
+	- [ ] dash task
+	* [ ] star task
+	- [x] done task
+	TODO: plain todo
+	EOF
+	cat > "$ws/2024-01-02_second.md" <<-'EOF'
+	TODO: before any heading #gamma
+	# Later
+	1. [ ] numbered task
+	EOF
+	ret=0
+
+	"$NOTEIN" tags "$ws" > "$TMPDIR/tags.out" 2>&1
+	printf '1\t#%s\n' alpha beta gamma | cmp -s - "$TMPDIR/tags.out" || ret=1
+
+	"$NOTEIN" todo "$ws" > "$TMPDIR/todo.out" 2>&1
+	printf '%s\t%s\t%s\t%s\t%s\n' \
+		2024-01-01 first 14 Tasks "dash task" \
+		2024-01-01 first 15 Tasks "star task" \
+		2024-01-01 first 17 Tasks "plain todo" \
+		2024-01-02 second 1 "" "before any heading #gamma" \
+		2024-01-02 second 3 Later "numbered task" | \
+		cmp -s - "$TMPDIR/todo.out" || ret=1
+
+	result markdown_extract $ret
+}
+
+test_recent_index
+test_filter_regex
+test_changed_depth
+test_pack_roundtrip
+test_pack_reject
+test_title_lookup
+test_markdown_extract
+
+exit $FAILED
@@ -11,6 +11,8 @@ PLATFORM := $(shell uname -s)
 
 # Directories and Paths
 SRCDIR     := src
+BENCHDIR   := bench
+TESTDIR    := test
 BUILDDIR   := build
 EXAMPLEDIR ?= example
 TARGET     := $(BUILDDIR)/$(PROJECT)
@@ -30,5 +32,13 @@ ifeq ($(PLATFORM), Darwin)
 endif
 
 # Flags
-CFLAGS  = -Wall -Wno-psabi --std=c89
-LDFLAGS =
+CFLAGS  = -Wall -Wno-psabi --std=c89 -D_DEFAULT_SOURCE -pthread
+LDFLAGS = -pthread -lm -lz
+
+# Benchmarks count allocations by wrapping the allocator when the linker allows.
+BENCH_CFLAGS  =
+BENCH_LDFLAGS =
+ifeq ($(PLATFORM), Linux)
+	BENCH_CFLAGS  = -DBENCH_WRAP_ALLOC
+	BENCH_LDFLAGS = -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free
+endif